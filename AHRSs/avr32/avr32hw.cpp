@@ -38,6 +38,42 @@ bool	Sensing::flipMagns()
 	return true;
 }
 
+using namespace openAHRS;
+
+void	Sensing::initTransforms()
+{
+	/* LIS3LV02: x,y swapped and negated */
+	accelRaw	= calib::SensorTransform::axes( 1,-1, 0,-1, 2,1 );
+	/* gyros: volts to rad/s, 2mV/deg/s for X and Y, 3.3mV/deg/s for Z */
+	gyroRaw		= calib::SensorTransform::scale( 3.14/180/2.0e-3, 3.14/180/2.0e-3, 3.14/180/3.3e-3 );
+	/* mags: Y negated */
+	magRaw		= calib::SensorTransform::scale( 1, -1, 1 );
+
+	magCal	= mount = calib::SensorTransform();
+
+	rebuildTransforms();
+}
+
+/* after a change of magCal or mount, only then */
+void	Sensing::rebuildTransforms()
+{
+	accelT	= accelRaw.then( mount );
+	gyroT	= gyroRaw.then( mount );
+	magCalT	= magRaw.then( magCal ).then( mount );
+}
+
+void	Sensing::setMagCalibration( const calib::SensorTransform &cal )
+{
+	magCal	= cal;
+	rebuildTransforms();
+}
+
+void	Sensing::setMounting( const Matrix<FT,3,3> &R )
+{
+	mount	= calib::SensorTransform::rotation( R );
+	rebuildTransforms();
+}
+
 bool	Sensing::init()
 {
 	d12	= new input::AD12( AVR32_SPIDEV_MCP3208, AVR32_MCP3208_VREF );
@@ -74,7 +110,7 @@ bool	Sensing::getAccels( Matrix<FT,3,1>	&a )
 	if ( !dAccel->getAccel(f) )	
 		return false;
 	
-	a << -f[1],-f[0],f[2];
+	accelT.apply( f[0], f[1], f[2], a );
 
 	return true;
 }
@@ -89,9 +125,18 @@ bool	Sensing::getGyros( Matrix<FT,3,1>	&omega )
 	if ( !d12->getSample( CH_GYROZ, &gz ) )
 		return false;
 
-	omega	<<	gx*3.14/180/2.0e-3,
-				gy*3.14/180/2.0e-3,
-				gz*3.14/180/3.3e-3;
+	gyroT.apply( gx, gy, gz, omega );
+
+	return true;
+}
+
+bool	Sensing::getTemperature( FT &t )
+{
+	float	v;
+	if ( !d12->getSample( CH_TEMP, &v ) )
+		return false;
+
+	t	= v*AVR32_TEMP_SCALE + AVR32_TEMP_OFFSET;
 
 	return true;
 }
@@ -106,7 +151,22 @@ bool	Sensing::getMagns( Matrix<FT,3,1>	&m )
 	if ( !dADS->convert( CH_MAGZ, &z ) )
 		return false;
 
-	m	<< x,-y,z;
+	magRaw.apply( x, y, z, m );
+
+	return true;
+}
+
+bool	Sensing::getMagnsCalibrated( Matrix<FT,3,1>	&m )
+{
+	float	x,y,z;
+	if ( !dADS->convert( CH_MAGX, &x ) )
+		return false;
+	if ( !dADS->convert( CH_MAGY, &y ) )
+		return false;
+	if ( !dADS->convert( CH_MAGZ, &z ) )
+		return false;
+
+	magCalT.apply( x, y, z, m );
 
 	return true;
 }
@@ -71,6 +71,11 @@
 #define	CH_TEMP		3
 #define	CH_VREF		4
 
+/** CH_TEMP volts to degrees C, 10mV/C sensor. The calibration cache
+ * only needs it monotonic and repeatable */
+#define	AVR32_TEMP_SCALE	100.0
+#define	AVR32_TEMP_OFFSET	0.0
+
 
 /** ADS1256, differential **/
 #define	CH_MAGX		1,0
@@ -84,6 +89,8 @@ USING_PART_OF_NAMESPACE_EIGEN
 #include "input/ad12.h"
 #include "input/ads1256.h"
 
+#include <openAHRS/calib/SensorTransform.h>
+
 class	Sensing
 {
 private:
@@ -91,11 +98,22 @@ private:
 	input::AD12		*d12;
 	input::ADS1256		*dADS;
 
+	/** A/D to sensor frame and units, fixed by the board **/
+	openAHRS::calib::SensorTransform	accelRaw, gyroRaw, magRaw;
+	/** magnetometer calibration and board mounting, set at run time **/
+	openAHRS::calib::SensorTransform	magCal, mount;
+	/** the above folded together, what the get*() functions apply **/
+	openAHRS::calib::SensorTransform	accelT, gyroT, magCalT;
+
+	void	initTransforms();
+	void	rebuildTransforms();
+
 public:
 	Sensing() { 
 		dAccel = 0;
 		d12 = 0;
-		dADS = 0; }
+		dADS = 0;
+		initTransforms(); }
 
 	~Sensing() { if ( dAccel ) 
 					delete dAccel; 
@@ -109,6 +127,21 @@ public:
 	bool	getAccels( Matrix<FT,3,1>	&a );
 	bool	getMagns( Matrix<FT,3,1>	&m );
 	bool	getGyros( Matrix<FT,3,1>	&g );
+	bool	getTemperature( FT &t );		//board temperature, degrees C
+
+	/** magnetometer with calibration and mounting applied, getMagns() is
+	 * the sensor frame, uncalibrated, for the calibration itself */
+	bool	getMagnsCalibrated( Matrix<FT,3,1>	&m );
+
+	/** calibration of the getMagns() output, from MagCalib::getTransform() */
+	void	setMagCalibration( const openAHRS::calib::SensorTransform &cal );
+	/** getMagns() output to getMagnsCalibrated() output for a calibration cal,
+	 * for applying a calibration to samples already read */
+	openAHRS::calib::SensorTransform	magTransform( const openAHRS::calib::SensorTransform &cal ) const {
+		return cal.then( mount ); }
+
+	/** rotation of the board, body = R*sensor, applied to all three sensors */
+	void	setMounting( const Matrix<FT,3,3> &R );
 
 	bool	flipMagns();	//flip/reset magnetometer coils
 };
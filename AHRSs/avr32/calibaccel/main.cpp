@@ -27,6 +27,7 @@
 #include <openAHRS/calib/Sphere.h>
 #include <openAHRS/calib/Ellipsoid.h>
 #include <openAHRS/calib/UKFEllipsoid.h>
+#include <openAHRS/calib/DirectionSelector.h>
 //#include <openAHRS/calib/UKFEllipsoid2.h>
 
 #include <openAHRS/util/util.h>
@@ -49,6 +50,9 @@
 	//static openAHRS::calib::Ellipsoid	SP;
 #endif
 
+/* only samples in directions not seen yet go to the calibrator, 1g radius */
+static openAHRS::calib::DirectionSelector	sel( 1.0 );
+
 using namespace openAHRS;
 using namespace input;
 using namespace std;
@@ -87,7 +91,8 @@ static void	getAccel( LIS3LV02 &ac, Matrix<FT,3,1> &out )
 		firstTime = false;
 	}
 
-	SP.estimateParams( meas );
+	if ( sel.accept( meas ) )
+		SP.estimateParams( meas );
 
 	SP.processInput( meas, out );
 }
@@ -137,6 +142,7 @@ int main()
 			printf("I:%d\n" , i );
 			printf("Min: %.10f\n", mmin );
 			printf("Max: %.10f\n", mmax );
+			printf("Coverage: %.0f%% (%d samples used)\n", (float)sel.getCoverage(), sel.getAccepted() );
 
 			cout << "---------- Raw:\n" << raw << endl;
 			cout << "---------- Res:\n" << res << endl;
@@ -26,15 +26,33 @@
 #ifndef	_magcalib_h_
 #define	_magcalib_h_
 
-#include <openAHRS/calib/UKFEllipsoid.h>
+/** set to 1 to calibrate with calib::StreamEllipsoid instead of the UKF,
+ * a few dozen multiply-adds per sample instead of a filter step */
+#ifndef	MAGCALIB_STREAMING
+	#define	MAGCALIB_STREAMING	0
+#endif
+
+#if	MAGCALIB_STREAMING
+	#include <openAHRS/calib/StreamEllipsoid.h>
+#else
+	#include <openAHRS/calib/UKFEllipsoid.h>
+#endif
+#include <openAHRS/calib/SensorTransform.h>
 #include <openAHRS/util/util.h>
-#include <openAHRS/util/matrixserializer.h>
+#include <openAHRS/util/calibstore.h>
+
+/** expected field magnitude, in sensor units */
+#define	MAGCALIB_EST_AMPLITUDE	0.11e-3
 
 /** Magnetometer calibration **/
 class	MagCalib
 {
 private:
+#if	MAGCALIB_STREAMING
+	openAHRS::calib::StreamEllipsoid	SP;
+#else
 	openAHRS::calib::UKFEllipsoid	SP;
+#endif
 	
 public:
 	static const int	numParams = 9;
@@ -42,7 +60,11 @@ public:
 	MagCalib() {
 		Matrix<FT,3,1>	estBias;
 		estBias << 0,0,0;
-		SP.init( 1e-4, estBias, /*est amplitude*/ 0.11e-3, 0, 0, 1e-12 );
+	#if	MAGCALIB_STREAMING
+		SP.init( estBias, MAGCALIB_EST_AMPLITUDE );
+	#else
+		SP.init( 1e-4, estBias, MAGCALIB_EST_AMPLITUDE, 0, 0, 1e-12 );
+	#endif
 	}
 
 	
@@ -51,6 +73,23 @@ public:
 		SP.getStateVector(p);
 	}
 
+	//start from the given parameters, from the calibration cache for instance
+	void	setParams( const Matrix<FT,numParams,1> &p ){
+	#if	MAGCALIB_STREAMING
+		SP.init(p);		/* sums start over from there */
+	#else
+		SP.setStateVector(p);
+	#endif
+	}
+
+	//current parameters as a transform, for Sensing::setMagCalibration()
+	void	getTransform( openAHRS::calib::SensorTransform &t )
+	{
+		Matrix<FT,numParams,1>	p;
+		SP.getStateVector(p);
+		t	= openAHRS::calib::SensorTransform::ellipsoid(p);
+	}
+
 	//processes input without modifying calibration parameters
 	void	processInput( Matrix<FT,3,1> &meas, Matrix<FT,3,1> &out )
 	{
@@ -65,30 +104,35 @@ public:
 
 
 
-	bool	saveParameters( const char *fileName )
+	/** state as record "mag.state", and for the UKF its covariance as "mag.cov" */
+	void	saveParameters( util::CalibStoreWriter &w )
 	{
-		Matrix<FT,numParams,numParams>	P;
 		Matrix<FT,numParams,1>	S;
-		Matrix<FT, numParams, numParams+1> sm;
-		
-		SP.getCovarianceMatrix(P);
 		SP.getStateVector(S);
+		w.add( "mag.state", S );
 
-		sm.block<numParams,numParams>(0,0)	= P;
-		sm.block<numParams,1>(0,numParams)	= S;
-
-		return util::MatrixSerializer::save(sm, fileName);
+	#if	!MAGCALIB_STREAMING
+		Matrix<FT,numParams,numParams>	P;
+		SP.getCovarianceMatrix(P);
+		w.add( "mag.cov", P );
+	#endif
 	}
 
-	bool	loadParameters( const char *fileName )
+	/** false if s has no "mag.state" of this size, the UKF keeps its covariance without "mag.cov" */
+	bool	loadParameters( const util::CalibStore &s )
 	{
-		Matrix<FT, numParams, numParams+1> sm;
-		
-		if ( !util::MatrixSerializer::load(sm, fileName) )
+		Matrix<FT,numParams,1>	S;
+		if ( !s.get( "mag.state", S ) )
 			return false;
 
-		SP.setCovarianceMatrix( sm.block<numParams,numParams>(0,0) );
-		SP.setStateVector( sm.block<numParams,1>(0,numParams) );
+	#if	MAGCALIB_STREAMING
+		SP.init( S );
+	#else
+		Matrix<FT,numParams,numParams>	P;
+		if ( s.get( "mag.cov", P ) )
+			SP.setCovarianceMatrix( P );
+		SP.setStateVector( S );
+	#endif
 
 		return true;
 	}
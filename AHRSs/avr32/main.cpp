@@ -27,61 +27,104 @@
 #include <iostream>
 
 #include <openAHRS/util/util.h>
+#include <openAHRS/util/quatkernel.h>
 #include <openAHRS/kalman/UKFst7.h>
 #include <openAHRS/util/net.h>
-#include <openAHRS/util/matrixserializer.h>
+#include <openAHRS/util/calibstore.h>
+#include <openAHRS/util/eventqueue.h>
+#include <openAHRS/util/seqlock.h>
 
 using namespace std;
 using namespace openAHRS;
 
 #include "avr32hw.h"
 #include "magcalib.h"
+#include <openAHRS/calib/DirectionSelector.h>
+#include <openAHRS/calib/TemperatureCache.h>
+#include <openAHRS/calib/Alignment.h>
 
 static MagCalib	calibM;
 static Sensing	s;
 static	util::UDPConnection	udp( "192.168.0.246", 4444 );
 
-#define	USE_UKF	0
-#if	USE_UKF
+#define	USE_UKF		0
+#define	USE_MEKF	0	/* multiplicative 6-state filter instead of kalman7 */
+#define	USE_FIXED	0	/* fixed point kalman7, no FPU needed */
+#define	USE_VECTOR_MEAS	0	/* gravity/magnetic vectors as measurements, no trig. kalman7 or UKF */
+#define	USE_STEADY_GAIN	0	/* kalman7 with angle updates: freeze the gain once converged, see kalman7::setSteadyStateGain() */
+#define	MAGCALIB_BACKGROUND	1	/* keep refining the mag calibration on its own thread while filtering */
+#define	USE_CALIB_CACHE	1	/* start from the gyro bias and mag calibration last seen at this temperature */
+#define	USE_ALIGNMENT	1	/* wait for the board to be still and start the filter from there, see alignAtStart() */
+#if	USE_UKF && USE_VECTOR_MEAS
+	#include <openAHRS/kalman/UKFst7v.h>
+#elif	USE_UKF
 	#include <openAHRS/kalman/UKFst7.h>
+#elif	USE_MEKF
+	#include <openAHRS/kalman/mekf6.h>
+#elif	USE_FIXED
+	#include <openAHRS/kalman/kalman7fx.h>
 #else
 	#include <openAHRS/kalman/kalman7.h>
 #endif
 
 
-#if	USE_UKF
+#if	USE_UKF && USE_VECTOR_MEAS
+	static	openAHRS::UKFst7v	K7;
+#elif	USE_UKF
 	static	openAHRS::UKFst7	K7;
+#elif	USE_MEKF
+	static	openAHRS::mekf6		K7;
+#elif	USE_FIXED
+	static	openAHRS::kalman7fx	K7;
 #else
 	static	openAHRS::kalman7	K7;
 #endif
 
-static struct timespec	t1,t2;
-
-#include <Eigen/Geometry>
-
-#define	MAGCALIB_FILENAME	"mag.cal"
-
 /**
- * Gets elapsed time between t2 and t1,
- * in seconds
+ * Everything kept between runs goes to one util::CalibStore: the mag
+ * calibration ("mag.state", "mag.cov"), the calibration cache ("cache")
+ * and the filter noise found by util/tune ("tune.kalman7", "tune.ukfst7",
+ * as [meas_var bias_var quat_var]). A damaged file is refused as a whole
+ * and the defaults are used.
  */
-static float	getElapsedTime( struct timespec *t1, struct timespec *t2 )
-{
-	return 1.0*(1.0*t2->tv_nsec - t1->tv_nsec*1.0)*1e-9 + 1.0*t2->tv_sec - 1.0*t1->tv_sec;
-}
+#define	STORE_FILENAME	"ahrs.cal"
+
+#if	USE_UKF
+	#define	TUNE_RECORD	"tune.ukfst7"
+	static	FT	tuneParams[3]	= { 1e-1, 1e-8, 1e-12 };
+#else
+	#define	TUNE_RECORD	"tune.kalman7"
+	static	FT	tuneParams[3]	= { 1e-2, 1e-4, 1e-7 };
+#endif
+
+static	bool	magValid	= false;	/* calibM calibrated or loaded, worth saving */
 
 //takes quaternion, returns quaternion
 static	Matrix<FT,4,1>	correct45Deg( Matrix<FT,4,1>	quat )
 {
-	static Eigen::Quaternion<FT>	qRot;	//quaternion used to rotate the measurements 45 degrees
-	static bool	firstTime = true;
-	if	(firstTime) {
-		qRot.coeffs()	= util::eulerToQuat(  Matrix<FT,3,1>(0,0,-45*M_PI/180) );
-		firstTime = false;
-	}
-
+	/* This used to be Eigen::Quaternion( eulerToQuat(0,0,-45deg) ) * Eigen::Quaternion( quat ),
+	 * but Eigen keeps the coefficients as [x y z w], so both our [e0 ex ey ez] quaternions
+	 * went in, and the result came out, shifted by one place. Same transform as before,
+	 * spelled out with the shift so the output doesn't change. */
+	static const FT	qRot[4]	= { -0.38268343236508977, 0.92387953251128674, 0, 0 };	/* -sin, cos 22.5deg */
+	FT	q[4]	= { quat(3), quat(0), quat(1), quat(2) };
+	FT	r[4];
+
+	quat::quatMultiply( qRot, q, r );
+
+	Matrix<FT,4,1>	ret;
+	ret	<< r[1], r[2], r[3], r[0];
+	return ret;
+}
 
-	return (qRot * Eigen::Quaternion<FT>( quat ) ).coeffs();
+/* the calibration goes into the magnetometer transform of Sensing, so that
+ * getMagnsCalibrated() does remap, calibration and mounting in one step.
+ * Call again whenever calibM changes */
+static void	applyMagCalibration()
+{
+	calib::SensorTransform	t;
+	calibM.getTransform(t);
+	s.setMagCalibration(t);
 }
 
 static double	processMagn( const Matrix<FT,3,1>	&m, const Matrix<FT,3,1> &angles )
@@ -95,15 +138,13 @@ static double	processMagn( const Matrix<FT,3,1>	&m, const Matrix<FT,3,1> &angles
 
 bool	testMagAccel()
 {
-	Matrix<FT,3,1>	a,mr,m,angles;
+	Matrix<FT,3,1>	a,m,angles;
 	
 	while(1)
 	{
-		if ( !s.getMagns(mr) )	{ printf("Error get magn\n") ; return false; }
+		if ( !s.getMagnsCalibrated(m) )	{ printf("Error get magn\n") ; return false; }
 		if ( !s.getAccels(a) )	{ printf("Error get accel\n"); return false; }
 
-		calibM.processInput(mr, m);
-
 		util::accelToPR( a, angles );
 		
 		angles(2)	= processMagn( m, angles );
@@ -125,107 +166,512 @@ bool	testMagAccel()
 	return true;
 }
 
+/**
+ * Multi-rate filtering.
+ *
+ * The gyros (MCP3208) are fast to read and drive KalmanPredict at
+ * FILTER_GYRO_RATE. The accels and specially the magnetometers (ADS1256,
+ * which waits for each conversion) are slow, so they are read by their own
+ * thread at FILTER_ACCEL_RATE and FILTER_MAG_RATE. Their samples go through a
+ * timestamped single-producer single-consumer ring, and the filter loop
+ * predicts up to each sample's timestamp before applying it as an update of
+ * the angles it measures. The filter loop never waits on a slow sensor, and
+ * takes no lock: util::SensorEventRing, and the SeqLock below, are lock-free.
+ *
+ * With MAGCALIB_BACKGROUND the magnetometer calibration goes on meanwhile:
+ * the sensor thread hands one raw mag sample in MAGCALIB_DECIMATION to a
+ * calibration thread through a second ring. That thread runs calibM on
+ * the ones in directions not seen yet (calib::DirectionSelector, as in
+ * doMagCalibration(), so a board sitting still doesn't pull the fit to
+ * one side) and publishes the result every MAGCALIB_PUBLISH of them
+ * through a SeqLock. The filter loop picks up a new calibration when it applies a
+ * mag sample, without a lock: if it races a publication it keeps the
+ * previous calibration for that sample.
+ */
+#define	FILTER_GYRO_RATE	200		/* Hz */
+#define	FILTER_ACCEL_RATE	50		/* Hz */
+#define	FILTER_MAG_RATE		10		/* Hz */
+
+#define	MAGCALIB_DECIMATION	2		/* one mag sample in this many is used for calibration */
+#define	MAGCALIB_PUBLISH	16		/* calibration samples between published calibrations */
+
+enum { EV_ACCEL, EV_MAG };
+
+static	util::SensorEventRing<32>	events;
+static	volatile bool	readerRunning;
+static	volatile bool	readerError;
+
+/** a calibration, as published by magCalibThread() **/
+struct	MagCalibUpdate
+{
+	Matrix<FT,MagCalib::numParams,1>	params;		/* calibM parameters */
+	calib::SensorTransform				transform;	/* raw mags to calibrated, body frame */
+	int									samples;	/* calibration samples so far */
+};
+
+/**
+ * Calibration cache: gyro bias and calibM parameters by board temperature,
+ * 5C bins from -20 to 55C. doFiltering() starts from the values for the
+ * current temperature instead of converging again from the first gyro
+ * sample and the stored calibration, and once the filter has settled it refines the bin
+ * of the current temperature once a second with what it has found.
+ */
+#define	CALCACHE_SETTLE		30		/* s of filtering before refining the cache */
+#define	CALCACHE_BIAS_VAR	1e-4	/* initial bias variance when taken from the cache, (rad/s)^2 */
+
+typedef	calib::TemperatureCache<3 + MagCalib::numParams, 16>	CalibCache;	/* [ gyro bias; calibM params ] */
+static	CalibCache	calCache( -20, 5 );
+
+/**
+ * Start-up alignment, see alignAtStart(). Still means a variance of each
+ * accel and gyro axis over ALIGN_WINDOW samples below these, the attitude
+ * and bias variances are floored for the errors the noise doesn't show
+ * (calibration, misalignment).
+ */
+#define	ALIGN_WINDOW		FILTER_GYRO_RATE	/* samples, 1 s */
+#define	ALIGN_TIMEOUT		10		/* s to wait for the board to be still */
+#define	ALIGN_ACCEL_VAR		1e-4	/* accel units^2 */
+#define	ALIGN_GYRO_VAR		1e-3	/* (rad/s)^2 */
+#define	ALIGN_ATT_VAR_MIN	1e-4	/* rad^2 */
+#define	ALIGN_BIAS_VAR_MIN	1e-6	/* (rad/s)^2 */
+
+typedef	calib::Alignment<ALIGN_WINDOW, ALIGN_WINDOW*FILTER_MAG_RATE/FILTER_GYRO_RATE>	StartAlignment;
+
+static	util::SensorEventRing<32>		calibSamples;	/* raw mags, for the calibration thread */
+static	util::SeqLock<MagCalibUpdate>	calibPublished;
+static	volatile bool	calibRunning;
+
+/**
+ * Rewrite the store with the mag calibration, if there is one, and the
+ * cache, keeping the records of the old file this build doesn't write
+ * (the tuning of the other filter for instance)
+ */
+static bool	saveStore()
+{
+	util::CalibStore		old;
+	util::CalibStoreWriter	w;
+
+	if ( magValid )
+		calibM.saveParameters( w );
+#if	USE_CALIB_CACHE
+	calCache.save( w, "cache" );
+#endif
+
+	if ( old.open( STORE_FILENAME ) )
+		w.keep( old );
+	old.close();
+
+	return w.save( STORE_FILENAME );
+}
+
+/** sleep until the given monotonicTime() */
+static void	sleepUntil( double t )
+{
+	double	d = t - util::monotonicTime();
+	if ( d > 0 )
+		usleep( d*1e6 );
+}
+
+/** 
+ * Thread for the slow sensors, each read at its own rate.
+ * The sample is timestamped in the middle of the read.
+ */
+static void	*slowSensorReader( void * )
+{
+	double	nextAccel	= util::monotonicTime();
+	double	nextMag		= nextAccel;
+	int		nMag		= 0;
+	util::SensorEvent	ev;
+
+	while ( readerRunning )
+	{
+	#ifdef	KAL_DONT_USE_MAG
+		nextMag	= nextAccel + 1;
+	#endif
+		bool	accel = ( nextAccel <= nextMag );
+		sleepUntil( accel ? nextAccel : nextMag );
+
+		double	t0 = util::monotonicTime();
+		if ( accel ) {
+			if ( !s.getAccels(ev.v) )	{ printf("Error get accel\n"); readerError = true; break; }
+			ev.type		= EV_ACCEL;
+			nextAccel	+= 1.0/FILTER_ACCEL_RATE;
+		} else {
+			/* raw, the filter loop applies the calibration */
+			if ( !s.getMagns(ev.v) )	{ printf("Error get magn\n"); readerError = true; break; }
+			ev.type		= EV_MAG;
+			nextMag		+= 1.0/FILTER_MAG_RATE;
+		}
+		ev.t	= ( t0 + util::monotonicTime() )/2;
+
+		if ( !events.push(ev) )
+			printf("Filter loop too slow, sensor event dropped\n");
+
+	#if	MAGCALIB_BACKGROUND
+		/* the calibration thread keeps up or loses the newest samples, never blocks us */
+		if ( !accel && ( ++nMag % MAGCALIB_DECIMATION == 0 ) )
+			calibSamples.push(ev);
+	#endif
+	}
+
+	return NULL;
+}
+
+/**
+ * Background magnetometer calibration, see doFiltering().
+ * Only this thread touches calibM while the filter runs.
+ */
+static void	*magCalibThread( void * )
+{
+	util::SensorEvent	ev;
+	MagCalibUpdate		u;
+	u.samples	= 0;
+
+	/* only samples in directions not seen yet go to the calibrator */
+	calib::DirectionSelector	sel( MAGCALIB_EST_AMPLITUDE );
+
+	while ( calibRunning )
+	{
+		if ( !calibSamples.popUntil( util::monotonicTime(), ev ) ) {
+			usleep( 1e6/FILTER_MAG_RATE );
+			continue;
+		}
+
+		if ( !sel.accept(ev.v) )
+			continue;
+
+		calibM.estimateParams(ev.v);
+
+		if ( ++u.samples % MAGCALIB_PUBLISH == 0 ) {
+			calib::SensorTransform	t;
+			calibM.getParams(u.params);
+			calibM.getTransform(t);
+			u.transform	= s.magTransform(t);
+			calibPublished.write(u);
+		}
+	}
+
+	return NULL;
+}
+
+#if	USE_ALIGNMENT
+/**
+ * Sample the gyros and accels at FILTER_GYRO_RATE, and the mags at
+ * FILTER_MAG_RATE, until the board has been still for ALIGN_WINDOW
+ * samples. Then the gyro bias is their mean over that window, the
+ * attitude comes from the mean accels and mags in closed form, and P
+ * from the noise seen, see calib::Alignment.
+ *
+ * @return	false if the board didn't keep still within ALIGN_TIMEOUT,
+ *			or a sensor failed: doFiltering() then starts from one sample
+ */
+static bool	alignAtStart( Matrix<FT,3,1> &angles, Matrix<FT,3,1> &bias, Matrix<FT,7,7> &P )
+{
+	static StartAlignment	al( ALIGN_ACCEL_VAR, ALIGN_GYRO_VAR );
+	Matrix<FT,3,1>	a, g, m;
+
+	printf("Aligning, keep the board still\n");
+	al.reset();
+
+	double	t	= util::monotonicTime();
+	for (int i=0; i < ALIGN_TIMEOUT*FILTER_GYRO_RATE; i++)
+	{
+		t	+= 1.0/FILTER_GYRO_RATE;
+		sleepUntil( t );
+
+		if ( !s.getGyros(g) || !s.getAccels(a) )
+			return false;
+		if ( i % ( FILTER_GYRO_RATE/FILTER_MAG_RATE ) == 0 ) {
+			if ( !s.getMagnsCalibrated(m) )
+				return false;
+			al.addMagn(m);
+		}
+
+		if ( al.addSample( a, g ) ) {
+			al.getBias( bias );
+			al.getAngles( angles );
+		#if	!USE_VECTOR_MEAS
+			/* the angle updates measure yaw with processMagn(), start from what they will see */
+			if ( al.hasHeading() ) {
+				al.getMeanMagn( m );
+				angles(2)	= processMagn( m, angles );
+			}
+		#endif
+			al.getCovariance( P, ALIGN_ATT_VAR_MIN, ALIGN_BIAS_VAR_MIN );
+			printf("Aligned after %.2f s\n", (float)( i + 1 )/FILTER_GYRO_RATE);
+			return true;
+		}
+	}
+
+	printf("Board not still, starting without alignment\n");
+	return false;
+}
+#endif
+
 bool	doFiltering()
 {
-	Matrix<FT,3,1>	a,g,mr,m, angles;
+	Matrix<FT,3,1>	a,g,gPrev,m, angles;
 	Matrix<FT,3,1>	startBias;
 	Matrix<FT,7,1>	X;
 
+#if	USE_CALIB_CACHE
+	FT					temp;
+	CalibCache::Vector	cv;
+	bool				cached	= false;
+
+	if ( s.getTemperature(temp) && calCache.lookup( temp, cv ) ) {
+		calibM.setParams( cv.block<MagCalib::numParams,1>(3,0) );
+		applyMagCalibration();
+		cached	= true;
+		printf("Starting from the calibration cache, %.1fC\n", (float)temp);
+	}
+#endif
+
+	/* raw mags to calibrated, updated from the calibration thread */
+	calib::SensorTransform	magT;
+	calibM.getTransform(magT);
+	magT	= s.magTransform(magT);
+
+	/* calibM parameters behind magT, for the cache */
+	Matrix<FT,MagCalib::numParams,1>	magParams;
+	calibM.getParams(magParams);
+
 	startBias << 0,0,0;
 
-	int i = 0;
+	int i = 0;		/* gyro steps */
+	int nUpd = 0;	/* accel updates, for output */
 
 	//init
 		if ( !s.getGyros(g) )	{ printf("Error get gyros\n"); return -3; }
 		if ( !s.getAccels(a) )	{ printf("Error get accel\n"); return -2; }
-		if ( !s.getMagns(mr) )	{ printf("Error get magn\n"); return -4; }
-
-		calibM.processInput(mr, m);
+		if ( !s.getMagnsCalibrated(m) )	{ printf("Error get magn\n"); return -4; }
 
 		util::accelToPR( a, angles );
 		angles(2)	= processMagn( m, angles );
 
+		startBias = g;
+
+	#if	USE_ALIGNMENT
+		Matrix<FT,7,7>	alignP;
+		bool	aligned	= alignAtStart( angles, startBias, alignP );
+	#else
+		bool	aligned	= false;
+	#endif
+
 	#ifdef	KAL_DONT_USE_MAG
 		g(2) = 0;
 		angles(2) = 0;
+		startBias(2) = 0;
 	#endif
 
-		startBias = g;
+	#if	USE_CALIB_CACHE
+		/* a bias measured now beats the one last seen at this temperature */
+		if ( cached && !aligned ) {
+			startBias	= cv.start<3>();
+		#ifdef	KAL_DONT_USE_MAG
+			startBias(2)	= 0;
+		#endif
+		}
+	#endif
 
-	#if	USE_UKF
-		K7.KalmanInit( angles, startBias, 1e-1, 1e-8, 1e-12 );
-	#else
-		K7.KalmanInit( angles, startBias, 1e-2, 1e-4, 1e-7 );
+		K7.KalmanInit( angles, startBias, tuneParams[0], tuneParams[1], tuneParams[2] );
+
+	#if	USE_STEADY_GAIN && !USE_UKF && !USE_MEKF && !USE_FIXED && !USE_VECTOR_MEAS
+		K7.setSteadyStateGain( true );
 	#endif
 
-		clock_gettime( CLOCK_REALTIME, &t2 );
+	#if	USE_ALIGNMENT
+		/* kalman7's form, mekf6 takes it to its error state */
+		if ( aligned )
+			K7.setCovarianceMatrix( alignP );
+	#endif
 
+	#if	USE_CALIB_CACHE && !USE_UKF && !USE_MEKF && !USE_FIXED
+		/* the bias is known, and the attitude is as good as the accels and mags
+		 * it comes from: with P = I the first updates would kick the bias away */
+		if ( cached && !aligned ) {
+			Matrix<FT,7,7>	P;
+			K7.getCovarianceMatrix(P);
+			P.block<4,4>(0,0)	= 1e-2*Matrix<FT,4,4>::Identity();
+			P.block<3,3>(4,4)	= CALCACHE_BIAS_VAR*Matrix<FT,3,3>::Identity();
+			K7.setCovarianceMatrix(P);
+		}
+	#endif
 
-	while(1) {
+	/* angles measured so far: roll and pitch from the accels, yaw from the mags */
+	Matrix<FT,3,1>	measAngles	= angles;
+	double			rawHeading	= angles(2);
 
-		if ( !s.getGyros(g) )	{ printf("Error get gyros\n"); return -3; }
-		if ( !s.getAccels(a) )	{ printf("Error get accel\n"); return -2; }
-		if ( !s.getMagns(mr) )	{ printf("Error get magn\n"); return -4; }
+#if	MAGCALIB_BACKGROUND
+	MagCalibUpdate	calibUpdate;
+	unsigned		calibVersion	= calibPublished.getVersion();
+	const unsigned	calibVersionAtStart	= calibVersion;
 
-		calibM.processInput(mr, m);
+	pthread_t	calibrator;
+	calibRunning	= true;
+	if ( pthread_create( &calibrator, NULL, magCalibThread, NULL ) != 0 ) {
+		printf("Error starting calibration thread\n");
+		return false;
+	}
+#endif
 
-		util::accelToPR( a, angles );
+	pthread_t	reader;
+	readerRunning	= true;
+	readerError		= false;
+	if ( pthread_create( &reader, NULL, slowSensorReader, NULL ) != 0 ) {
+		printf("Error starting sensor thread\n");
+	#if	MAGCALIB_BACKGROUND
+		calibRunning	= false;
+		pthread_join( calibrator, NULL );
+	#endif
+		return false;
+	}
+
+	double	tFilter	= util::monotonicTime();	/* time the filter has been predicted to */
+	double	tNext	= tFilter;
+	gPrev	= g;
+
+	bool	ok = true;
+	while(1) {
 
-		double rawHeading = angles(2)	= processMagn( m, angles );
+		tNext	+= 1.0/FILTER_GYRO_RATE;
+		sleepUntil( tNext );
+
+		if ( !s.getGyros(g) )	{ printf("Error get gyros\n"); ok = false; break; }
+		double	tGyro	= util::monotonicTime();
 
 		#ifdef	KAL_DONT_USE_MAG
 			g(2) = 0;
-			angles(2) = 0;
 		#endif
 
-		clock_gettime( CLOCK_REALTIME, &t1 );
-		double	dt = getElapsedTime( &t2, &t1 );
-		t2 = t1;
-
-		K7.KalmanUpdate( i, angles, dt );
-		K7.getStateVector(X);
-		
-		angles	= util::quatToEuler( correct45Deg( X.start<4>() ) );
-
-		//cout << "angp: " << util::quatToEuler( X.start<4>() )*180/M_PI << endl;
-		//cout << "angn: " << angles*180/M_PI << endl;
-
-		/**
-		 * Send data through network.
-		 * This format avoids little/big endian problems
-		 */
-		static char	netStr[1024];
-		sprintf(netStr,"Roll:%lf Pitch:%lf Yaw:%lf Bias1:%lf Bias2:%lf Bias3:%lf Ax:%lf Ay:%lf Az:%lf RH:%lf",
-			angles(0), angles(1), angles(2),
-			X(4), X(5), X(6),
-			a(0), a(1), a(2),
-			rawHeading );
-
-		udp.Send( netStr, strlen(netStr) );
+		/** apply the slow sensor samples taken up to now, in order **/
+		util::SensorEvent	ev;
+		while ( events.popUntil( tGyro, ev ) )
+		{
+			/* events read while the last gyro step was running may be a bit older
+			 * than tFilter, they are applied at tFilter */
+			if ( ev.t > tFilter ) {
+				K7.KalmanPredict( i, gPrev, ev.t - tFilter );
+				tFilter	= ev.t;
+			}
+
+			if ( ev.type == EV_ACCEL )
+			{
+				a	= ev.v;
+			#if	USE_VECTOR_MEAS
+				K7.KalmanUpdateVectors( i, a, m, 1.0/FILTER_ACCEL_RATE, 0x1 );
+			#else
+				util::accelToPR( a, angles );
+				measAngles(0)	= angles(0);
+				measAngles(1)	= angles(1);
+
+			#ifdef	KAL_DONT_USE_MAG
+				measAngles(2)	= 0;
+				K7.KalmanUpdate( i, measAngles, 1.0/FILTER_ACCEL_RATE, 0x7 );
+			#else
+				K7.KalmanUpdate( i, measAngles, 1.0/FILTER_ACCEL_RATE, 0x3 );
+			#endif
+			#endif
+				nUpd++;
+			}
+			else
+			{
+			#if	MAGCALIB_BACKGROUND
+				if ( calibPublished.readIfNewer( calibUpdate, calibVersion ) ) {
+					magT		= calibUpdate.transform;
+					magParams	= calibUpdate.params;
+				}
+			#endif
+				magT.apply( ev.v, m );
+			#if	USE_VECTOR_MEAS
+				K7.KalmanUpdateVectors( i, a, m, 1.0/FILTER_MAG_RATE, 0x2 );
+			#else
+				rawHeading		= processMagn( m, measAngles );
+				measAngles(2)	= rawHeading;
+
+				K7.KalmanUpdate( i, measAngles, 1.0/FILTER_MAG_RATE, 0x4 );
+			#endif
+				continue;
+			}
+
+			K7.getStateVector(X);
+			angles	= util::quatToEuler( correct45Deg( X.start<4>() ) );
+
+			/**
+			 * Send data through network, once per accel update.
+			 * This format avoids little/big endian problems
+			 */
+			static char	netStr[1024];
+			sprintf(netStr,"Roll:%lf Pitch:%lf Yaw:%lf Bias1:%lf Bias2:%lf Bias3:%lf Ax:%lf Ay:%lf Az:%lf RH:%lf",
+				angles(0), angles(1), angles(2),
+				X(4), X(5), X(6),
+				a(0), a(1), a(2),
+				rawHeading );
+
+			udp.Send( netStr, strlen(netStr) );
 #if 1
-		//show debug info once a while
-		if ( i % 20 == 0 ) {
-			cout << "dt: " << dt << endl;
-			cout << "Roll : " << 180/3.14*angles(0) << endl;
-			cout << "Pitch: " << 180/3.14*angles(1) << endl;
-			cout << "Yaw:   " << 180/3.14*angles(2) << endl << endl;
-
-			cout << "Raw yaw: " << 180/3.14*rawHeading << endl;
-			cout << "Gyros: " << g << endl;
-		}
+			//show debug info once a while
+			if ( nUpd % 20 == 0 ) {
+				cout << "gyro steps: " << i << endl;
+				cout << "Roll : " << 180/3.14*angles(0) << endl;
+				cout << "Pitch: " << 180/3.14*angles(1) << endl;
+				cout << "Yaw:   " << 180/3.14*angles(2) << endl << endl;
+
+				cout << "Raw yaw: " << 180/3.14*rawHeading << endl;
+				cout << "Gyros: " << g << endl;
+			}
 #endif
-		/////////////////
-		K7.KalmanPredict( i, g, dt );
+		}
+
+		/** integrate the gyros up to this sample, holding the previous one **/
+		K7.KalmanPredict( i, gPrev, tGyro - tFilter );
+		tFilter	= tGyro;
+		gPrev	= g;
+
+		/* don't try to catch up after a stall, just restart the schedule */
+		if ( tNext < tGyro - 1.0/FILTER_GYRO_RATE )
+			tNext	= tGyro;
+
+	#if	USE_CALIB_CACHE
+		/* once a second after settling, what we have now for this temperature */
+		if ( i >= CALCACHE_SETTLE*FILTER_GYRO_RATE && ( i % FILTER_GYRO_RATE ) == 0 &&
+			 s.getTemperature(temp) ) {
+			K7.getStateVector(X);
+			cv.start<3>()	= X.block<3,1>(4,0);
+			cv.block<MagCalib::numParams,1>(3,0)	= magParams;
+			calCache.update( temp, cv );
+		}
+	#endif
+
+		if ( readerError )	{ ok = false; break; }
 
 		if ( util::kbhit() )	{
 			getchar();
 			break;
 		}
-		usleep(1e3);
 		i++;
 	}
 
-	return true;
+	readerRunning	= false;
+	pthread_join( reader, NULL );
+
+#if	MAGCALIB_BACKGROUND
+	calibRunning	= false;
+	pthread_join( calibrator, NULL );
+
+	/* the refined calibration, for the other modes, and for the next
+	 * start once the thread has published at least one */
+	applyMagCalibration();
+	if ( calibPublished.getVersion() != calibVersionAtStart )
+		magValid	= true;
+#endif
+
+#if	USE_CALIB_CACHE || MAGCALIB_BACKGROUND
+	if ( !saveStore() )
+		printf("Error saving calibration store\n");
+#endif
+
+	return ok;
 }
 
 bool	doMagCalibration()
@@ -233,6 +679,9 @@ bool	doMagCalibration()
 	Matrix<FT,3,1>	mRaw,mCal;
 	int i = 0;
 
+	/* only samples in directions not seen yet go to the calibrator */
+	calib::DirectionSelector	sel( MAGCALIB_EST_AMPLITUDE );
+
 	while(1)
 	{
 		i++;
@@ -240,7 +689,8 @@ bool	doMagCalibration()
 			printf("Err get mag\n");
 			return false;
 		}
-		calibM.estimateParams(mRaw);
+		if ( sel.accept(mRaw) )
+			calibM.estimateParams(mRaw);
 		calibM.processInput(mRaw, mCal);
 
 		
@@ -248,7 +698,9 @@ bool	doMagCalibration()
 			s.flipMagns();
 			Matrix<FT,9,1>	p; calibM.getParams(p);
 			cout << "Params: \n" << p << "\n";
-			cout << "Magn angle: " << 180/3.14*atan2(mCal(1),mCal(0)) << "\n\n\n";
+			cout << "Magn angle: " << 180/3.14*atan2(mCal(1),mCal(0)) << "\n";
+			printf("Coverage: %.0f%% (%d samples used), press a key to stop when close to 100%%\n\n\n",
+					(float)sel.getCoverage(), sel.getAccepted() );
 		}
 
 		if ( util::kbhit() ) {
@@ -259,8 +711,12 @@ bool	doMagCalibration()
 		usleep(5e3);
 	}
 	
+	applyMagCalibration();
+
+	magValid	= true;
+
 	//save calibration
-	if ( !calibM.saveParameters( MAGCALIB_FILENAME ) ) {
+	if ( !saveStore() ) {
 		printf("Error saving calibration parameters\n");
 		return false;
 	} else
@@ -275,6 +731,24 @@ int main(int argc, char **argv)
 	if ( !s.init() ) {
 		printf("Error init sensing\n"); return -1;
 	}
+	applyMagCalibration();
+	{
+		util::CalibStore	store;
+		if ( !store.open( STORE_FILENAME ) )
+			printf("No calibration store: %s\n", store.getError());
+		else {
+		#if	USE_CALIB_CACHE
+			if ( calCache.load( store, "cache" ) )
+				printf("Calibration cache loaded\n");
+		#endif
+			const FT	*t	= store.find( TUNE_RECORD, 1, 3 );
+			if ( t != NULL ) {
+				for (int k=0; k < 3; k++)
+					tuneParams[k]	= t[k];
+				printf("Filter noise from %s\n", TUNE_RECORD);
+			}
+		}
+	}
 	getchar();
 	while(1)
 	{
@@ -307,11 +781,19 @@ int main(int argc, char **argv)
 				doFiltering();
 				break;
 			case	'6':
-				if ( !calibM.loadParameters( MAGCALIB_FILENAME ) ) {
-					printf("Error loading calibration data\n"); break;
-				} else
+			{
+				util::CalibStore	store;
+				if ( !store.open( STORE_FILENAME ) ) {
+					printf("Error loading calibration data: %s\n", store.getError()); break;
+				} else if ( !calibM.loadParameters( store ) ) {
+					printf("No mag calibration in %s\n", STORE_FILENAME); break;
+				} else {
+					magValid	= true;
+					applyMagCalibration();
 					printf("Calibration data loaded\n");
+				}
 				break;
+			}
 			case	'9':
 				printf("--- Exiting....\n");
 				return 0;
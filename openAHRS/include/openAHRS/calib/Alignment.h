@@ -0,0 +1,235 @@
+#ifndef _calib_alignment_h_
+#define _calib_alignment_h_
+
+/*
+ *  Start-up alignment: stationary detection, gyro bias and initial attitude
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+/**
+ * Runs before the filter starts. Accel and gyro samples go to addSample(),
+ * magnetometer samples, at their own rate, to addMagn(). Once the last W
+ * inertial samples are still, that is the variance of every accel and gyro
+ * axis over them is below the thresholds given, the board is taken as
+ * stationary and, from the means over that window:
+ *
+ *	- the gyro bias is the mean gyro rate
+ *	- the attitude comes in closed form from the mean accel and the mean of
+ *	  the last WM mags, util::triad(). Without a usable field (not enough
+ *	  mags yet, or the field along gravity) yaw is left at 0
+ *	- getCovariance() gives kalman7's P from the noise measured over the
+ *	  window: the variance of the means, not of single samples
+ *
+ * instead of starting the filter from one sample of each sensor and an
+ * identity P, and waiting for it to converge. WM should span about the
+ * same time as W: W*magRate/inertialRate.
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include <Eigen/Core>
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+
+
+namespace openAHRS { namespace calib
+{
+
+	template <int W, int WM>
+	class	Alignment
+	{
+	public:
+		/**
+		* @param accelVarMax	Largest variance of an accel axis over the window
+		*						for it to be still, accel units squared
+		* @param gyroVarMax		Same for the gyros, (rad/s)^2
+		*/
+		Alignment( FT accelVarMax, FT gyroVarMax )
+		{
+			this->accelVarMax	= accelVarMax;
+			this->gyroVarMax	= gyroVarMax;
+			reset();
+		}
+
+		/** start over, e.g. to align again after the board was moved */
+		void	reset() {
+			nInertial	= nMagn	= 0;
+			aligned		= false;
+		}
+
+		/**
+		* Add an accel and gyro sample.
+		*
+		* @return	true once aligned, from then on samples are ignored until reset()
+		*/
+		bool	addSample( const Matrix<FT,3,1> &a, const Matrix<FT,3,1> &g )
+		{
+			if ( aligned )
+				return true;
+
+			accels.col( nInertial % W )	= a;
+			gyros.col( nInertial % W )	= g;
+			nInertial++;
+
+			if ( nInertial >= W )
+				check();
+			return aligned;
+		}
+
+		/** add a magnetometer sample, calibrated */
+		void	addMagn( const Matrix<FT,3,1> &m )
+		{
+			if ( aligned )
+				return;
+			magns.col( nMagn % WM )	= m;
+			nMagn++;
+		}
+
+		inline bool	isAligned() const { return aligned; }
+
+		/** inertial samples given so far */
+		inline int	getSamples() const { return nInertial; }
+
+		/** whether yaw came from the magnetometers */
+		inline bool	hasHeading() const { return heading; }
+
+		inline void	getBias( Matrix<FT,3,1> &b ) const { b = gyroMean; }
+		inline void	getQuaternion( Matrix<FT,4,1> &q ) const { q = quat; }
+		inline void	getAngles( Matrix<FT,3,1> &e ) const { e = util::quatToEuler( quat ); }
+
+		/** means over the window, to measure with them as the filter will */
+		inline void	getMeanAccel( Matrix<FT,3,1> &a ) const { a = accelMean; }
+		inline void	getMeanMagn( Matrix<FT,3,1> &m ) const { m = magnMean; }
+
+		/**
+		* Covariance of the start, as kalman7 keeps it: [ q; bias ]
+		* The attitude variance is the larger of tilt (accel noise) and yaw
+		* (mag noise, over the horizontal field) of the means, a quarter of
+		* it for each quaternion component, the bias variance is the gyro's
+		* over the window length.
+		*
+		* @param P		Output
+		* @param minAttVar	Floor of the attitude variance, rad^2, for what the
+		*					noise doesn't show (calibration errors)
+		* @param minBiasVar	Floor of the bias variance, (rad/s)^2
+		*/
+		void	getCovariance( Matrix<FT,7,7> &P, FT minAttVar = 0, FT minBiasVar = 0 ) const
+		{
+			FT	att		= std::max( attVar, minAttVar );
+			FT	bias	= std::max( gyroVar/W, minBiasVar );
+
+			P.setZero();
+			P.template block<4,4>(0,0)	= ( att/4 )*Matrix<FT,4,4>::Identity();
+			P.template block<3,3>(4,4)	= bias*Matrix<FT,3,3>::Identity();
+		}
+
+		/** mean variance of an axis over the window, single samples */
+		inline FT	getAccelVariance() const { return accelVar; }
+		inline FT	getGyroVariance() const { return gyroVar; }
+
+	private:
+		Matrix<FT,3,W>	accels, gyros;		/* ring buffers */
+		Matrix<FT,3,WM>	magns;
+		int				nInertial, nMagn;
+
+		FT		accelVarMax, gyroVarMax;
+
+		bool	aligned, heading;
+		Matrix<FT,3,1>	accelMean, gyroMean, magnMean;
+		Matrix<FT,4,1>	quat;
+		FT		accelVar, gyroVar, attVar;
+
+		/* mean and per-axis variance of n columns, two passes for float */
+		template <int N>
+		static void	stats( const Matrix<FT,3,N> &v, int n, Matrix<FT,3,1> &mean, Matrix<FT,3,1> &var )
+		{
+			mean.setZero();
+			for (int i=0; i < n; i++)
+				mean	+= v.col(i);
+			mean	/= n;
+
+			var.setZero();
+			for (int i=0; i < n; i++)
+				for (int k=0; k < 3; k++) {
+					FT	d	= v(k,i) - mean(k);
+					var(k)	+= d*d;
+				}
+			var	/= ( n > 1 ) ? n - 1 : 1;
+		}
+
+		void	check()
+		{
+			Matrix<FT,3,1>	aVar, gVar, mVar;
+			stats( accels, W, accelMean, aVar );
+			stats( gyros, W, gyroMean, gVar );
+
+			if ( aVar.maxCoeff() > accelVarMax || gVar.maxCoeff() > gyroVarMax )
+				return;
+
+			FT	aNorm	= accelMean.norm();
+			if ( aNorm == 0 )
+				return;
+
+			accelVar	= aVar.sum()/3;
+			gyroVar		= gVar.sum()/3;
+			attVar		= accelVar/( aNorm*aNorm*W );
+
+			/** attitude, with yaw from the mags if there are enough of them **/
+			heading	= false;
+			if ( nMagn >= WM )
+			{
+				stats( magns, WM, magnMean, mVar );
+				heading	= util::triad( accelMean, magnMean, quat );
+
+				if ( heading ) {
+					/* field across gravity: what sets yaw. The axis signs of
+					 * accels and mags differ, compare them as triad() does */
+					Matrix<FT,3,1>	gu, hu;
+					util::accelToVector( accelMean, gu );
+					util::magnToVector( magnMean, hu );
+					FT	c		= gu.dot( hu );
+					FT	hh		= magnMean.squaredNorm()*( 1 - c*c );
+					FT	yawVar	= ( mVar.sum()/3 )/( hh*WM );
+					attVar	= std::max( attVar, yawVar );
+				}
+			}
+			if ( !heading ) {
+				Matrix<FT,3,1>	e;
+				util::accelToPR( accelMean, e );
+				e(2)	= 0;
+				quat	= util::eulerToQuat( e );
+				magnMean.setZero();
+			}
+
+			aligned	= true;
+		}
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}}; /* namespace calib, namespace openAHRS */
+
+
+#endif /* _calib_alignment_h_ */
@@ -0,0 +1,293 @@
+#ifndef _calib_directionselector_h_
+#define _calib_directionselector_h_
+
+/*
+ *  Sample selection by direction for the sphere/ellipsoid calibrators
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+/**
+ * Goes in front of Sphere, Ellipsoid, UKFEllipsoid or StreamEllipsoid:
+ *
+ *		if ( sel.accept( meas ) )
+ *			SP.estimateParams( meas );
+ *
+ * The direction of each sample from the centre is binned on a geodesic grid
+ * (the vertices of a subdivided icosahedron, 12, 42, 162 or 642 of them for
+ * level 0 to 3, nearly equal areas), and a sample is accepted only while its
+ * bin has fewer than perBin samples. A sensor sitting in one orientation then
+ * adds nothing after the first few samples, instead of taking CPU time and
+ * pulling the fit towards that side. getCoverage() tells how much of the
+ * sphere has been seen, to know when to stop.
+ *
+ * The bin of a direction is a table lookup on a cube map (face, then a cell
+ * of the face) built by the constructor, no search per sample.
+ *
+ * The centre is the middle of the bounding box of all samples given to
+ * accept() unless set with setCenter(). A sample that enlarges the bounding
+ * box is always accepted: it is new geometry by definition, and the bins
+ * are not reliable while the centre is still moving. One turn about two of
+ * the axes settles it; a slow sweep from one pole to the other does not,
+ * the box stays open on one side until the end: start calibration with the
+ * turns, or set the centre. Samples closer to the
+ * centre than half the expected radius are not binned, which is what keeps
+ * the noise of a sensor sitting still (bounding box and centre around that
+ * one sample) from filling every bin.
+ */
+
+#include <math.h>
+#include <vector>
+
+#include <Eigen/Core>
+USING_PART_OF_NAMESPACE_EIGEN
+
+
+namespace openAHRS { namespace calib
+{
+
+	class	DirectionSelector
+	{
+	public:
+		/**
+		* @param radius		Expected radius, field magnitude in sensor units,
+		*					the estAmpl given to the calibrator
+		* @param level		Icosahedron subdivisions, 0..3: 12, 42, 162 or 642 bins
+		* @param perBin		Samples accepted per bin
+		*/
+		DirectionSelector( FT radius, int level = 2, int perBin = 4 )
+		{
+			if ( level < 0 )	level = 0;
+			if ( level > 3 )	level = 3;
+			maxPerBin	= perBin;
+			minRadius2	= radius*radius/4;
+
+			buildGrid( level );
+
+			/* cells of about a third of the bin spacing */
+			cells	= 4 << level;
+			lut.resize( 6*cells*cells );
+			for (int f=0; f < 6; f++)
+				for (int i=0; i < cells; i++)
+					for (int j=0; j < cells; j++)
+					{
+						double	d[3];
+						int		axis = f/2, a = ( axis + 1 ) % 3, b = ( axis + 2 ) % 3;
+						d[axis]	= ( f & 1 ) ? -1 : 1;
+						d[a]	= ( 2*( i + 0.5 )/cells ) - 1;
+						d[b]	= ( 2*( j + 0.5 )/cells ) - 1;
+						lut[ ( f*cells + i )*cells + j ]	= nearestVertex( d );
+					}
+
+			autoCenter	= true;
+			center.setZero();
+			reset();
+		}
+
+		/** forget all samples, keeps a centre set with setCenter() */
+		void	reset()
+		{
+			count.assign( vertices.size()/3, 0 );
+			filled		= 0;
+			accepted	= rejected	= 0;
+			haveBox		= false;
+		}
+
+		/** fixed centre from now on, the offset estimate of the calibrator for instance */
+		void	setCenter( const Matrix<FT,3,1> &c )
+		{
+			center		= c;
+			autoCenter	= false;
+		}
+
+		/**
+		* Decide on a sample.
+		*
+		* @param meas	Raw measurement
+		* @return		true if it adds to the coverage and should go to the calibrator
+		*/
+		bool	accept( const Matrix<FT,3,1> &meas )
+		{
+			bool	grown	= false;
+			if ( autoCenter )
+			{
+				grown	= !haveBox;
+				for (int k=0; k < 3; k++) {
+					if ( !haveBox || meas(k) < boxMin(k) )	{ boxMin(k) = meas(k);	grown = true; }
+					if ( !haveBox || meas(k) > boxMax(k) )	{ boxMax(k) = meas(k);	grown = true; }
+				}
+				haveBox	= true;
+				center	= ( boxMin + boxMax )/2;
+			}
+
+			Matrix<FT,3,1>	d	= meas - center;
+			int		b		= ( d.squaredNorm() >= minRadius2 ) ? binOf( d ) : -1;
+			bool	room	= ( b >= 0 ) && ( count[b] < maxPerBin );
+
+			if ( room && ( count[b]++ == 0 ) )
+				filled++;
+
+			if ( room || grown ) {
+				accepted++;
+				return true;
+			}
+			rejected++;
+			return false;
+		}
+
+		/**
+		* Bin of a direction, -1 for a zero vector
+		*
+		* @param d		Direction, any length
+		*/
+		int		binOf( const Matrix<FT,3,1> &d ) const
+		{
+			FT	ax	= fabs( d(0) ), ay = fabs( d(1) ), az = fabs( d(2) );
+
+			int	axis	= 0;
+			FT	m		= ax;
+			if ( ay > m )	{ axis = 1; m = ay; }
+			if ( az > m )	{ axis = 2; m = az; }
+			if ( !( m > 0 ) )
+				return -1;
+
+			int	f	= 2*axis + ( d(axis) < 0 );
+			FT	u	= d( ( axis + 1 ) % 3 )/m;
+			FT	v	= d( ( axis + 2 ) % 3 )/m;
+
+			int	i	= (int)( ( u + 1 )*cells/2 );
+			int	j	= (int)( ( v + 1 )*cells/2 );
+			if ( i >= cells )	i = cells - 1;
+			if ( j >= cells )	j = cells - 1;
+
+			return lut[ ( f*cells + i )*cells + j ];
+		}
+
+		/** percentage of bins with at least one sample */
+		inline FT	getCoverage() const { return 100*(FT)filled/numBins(); }
+
+		inline int	numBins() const { return vertices.size()/3; }
+		inline int	getAccepted() const { return accepted; }
+		inline int	getRejected() const { return rejected; }
+
+		/** centre of bin b, unit vector */
+		void	getBinDirection( int b, Matrix<FT,3,1> &d ) const {
+			d	<< vertices[3*b], vertices[3*b + 1], vertices[3*b + 2];
+		}
+
+	private:
+		std::vector<double>			vertices;	/* x,y,z of each bin centre */
+		std::vector<unsigned short>	lut;		/* bin of each cube map cell */
+		int							cells;		/* cells per cube face edge */
+
+		std::vector<int>	count;
+		int					maxPerBin;
+		FT					minRadius2;	/* (radius/2)^2 */
+		int					filled;
+		int					accepted, rejected;
+
+		bool			autoCenter;
+		bool			haveBox;
+		Matrix<FT,3,1>	center, boxMin, boxMax;
+
+		int		addVertex( double x, double y, double z )
+		{
+			double	n	= sqrt( x*x + y*y + z*z );
+			x /= n;	y /= n;	z /= n;
+
+			for (unsigned int i=0; i < vertices.size(); i += 3)
+				if ( fabs( vertices[i] - x ) < 1e-9 && fabs( vertices[i+1] - y ) < 1e-9 &&
+					 fabs( vertices[i+2] - z ) < 1e-9 )
+					return i/3;
+
+			vertices.push_back( x );
+			vertices.push_back( y );
+			vertices.push_back( z );
+			return vertices.size()/3 - 1;
+		}
+
+		/** icosahedron, each triangle split in 4 per level */
+		void	buildGrid( int level )
+		{
+			const double	t	= ( 1 + sqrt( 5.0 ) )/2;
+			const double	v[12][3] = {
+				{ -1,  t,  0 }, {  1,  t,  0 }, { -1, -t,  0 }, {  1, -t,  0 },
+				{  0, -1,  t }, {  0,  1,  t }, {  0, -1, -t }, {  0,  1, -t },
+				{  t,  0, -1 }, {  t,  0,  1 }, { -t,  0, -1 }, { -t,  0,  1 } };
+			const int		f[20][3] = {
+				{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+				{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+				{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+				{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+
+			vertices.clear();
+			std::vector<int>	faces;
+			for (int i=0; i < 12; i++)
+				addVertex( v[i][0], v[i][1], v[i][2] );
+			for (int i=0; i < 20; i++)
+				for (int k=0; k < 3; k++)
+					faces.push_back( f[i][k] );
+
+			for (int l=0; l < level; l++)
+			{
+				std::vector<int>	next;
+				for (unsigned int i=0; i < faces.size(); i += 3)
+				{
+					int	a	= faces[i], b = faces[i+1], c = faces[i+2];
+					int	ab	= midpoint( a, b ), bc = midpoint( b, c ), ca = midpoint( c, a );
+
+					int	nf[12]	= { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca };
+					next.insert( next.end(), nf, nf + 12 );
+				}
+				faces.swap( next );
+			}
+		}
+
+		int		midpoint( int a, int b )
+		{
+			return addVertex( vertices[3*a] + vertices[3*b], vertices[3*a+1] + vertices[3*b+1],
+								vertices[3*a+2] + vertices[3*b+2] );
+		}
+
+		int		nearestVertex( const double d[3] ) const
+		{
+			int		best	= 0;
+			double	bestDot	= -1e30;
+			for (unsigned int i=0; i < vertices.size(); i += 3)
+			{
+				/* d need not be normalized, only the order matters */
+				double	dot	= vertices[i]*d[0] + vertices[i+1]*d[1] + vertices[i+2]*d[2];
+				if ( dot > bestDot ) {
+					bestDot	= dot;
+					best	= i/3;
+				}
+			}
+			return best;
+		}
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}}; /* namespace calib, namespace openAHRS */
+
+
+#endif /* _calib_directionselector_h_ */
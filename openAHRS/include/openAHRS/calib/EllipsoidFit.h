@@ -0,0 +1,487 @@
+#ifndef _calib_ellipsoidfit_h_
+#define _calib_ellipsoidfit_h_
+
+/*
+ *  Batch algebraic ellipsoid fit, to calibrate a whole magnetometer or
+ *  accelerometer log at once or to seed UKFEllipsoid.
+ *  Link with '-lpthread' when a thread pool is used.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+/**
+ * Ellipsoid specific least squares fit, Q. Li and J. G. Griffiths,
+ * "Least squares ellipsoid specific fitting", 2004.
+ *
+ * The quadric a*x^2 + b*y^2 + c*z^2 + 2f*yz + 2g*xz + 2h*xy + 2p*x + 2q*y + 2r*z + d = 0
+ * is fitted by minimizing the algebraic distance v'*D'*D*v, with D one row of
+ * [ x^2 y^2 z^2 2yz 2xz 2xy 2x 2y 2z 1 ] per sample, under the constraint
+ * 4J - I^2 = 1 that only ellipsoids satisfy (for ratios between the axes up to 2).
+ * That is a generalized eigenproblem on the 6 quadratic terms once the 4
+ * linear ones are eliminated, solved here in symmetric form with Jacobi rotations.
+ *
+ * The only pass over the data is the accumulation of the 10x10 scatter matrix
+ * D'*D, split in fixed chunks over a util::ThreadPool. Everything after that is
+ * small and done in double, whatever FT is: the scatter matrix of thousands of
+ * samples is far too badly conditioned for float.
+ *
+ * The result is given in the state layout of UKFEllipsoid (see its processInput()),
+ * which can be started from it with UKFEllipsoid::init( meas_noise, x0, ... ).
+ * calib::Ellipsoid uses the same layout except for X(0), which is 1/X(0) there.
+ */
+
+#include <math.h>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/threadpool.h>
+
+
+namespace openAHRS { namespace calib
+{
+
+	class	EllipsoidFit
+	{
+	public:
+		static const int	L			= 9;	/* UKFEllipsoid state size */
+
+		/* samples per job. Fixed, so that the sums are always added in the
+		 * same order and the result does not depend on the number of threads */
+		static const int	chunkSize	= 2048;
+
+		EllipsoidFit() {
+			X.setZero();
+			residual	= 0;
+		}
+
+		/**
+		* Fit an ellipsoid to the samples.
+		*
+		* @param meas		Samples, raw sensor readings
+		* @param n			Number of samples, at least 10
+		* @param pool		Threads to spread the passes over the data on,
+		*					NULL to do everything on the calling thread
+		* @return	false if the samples do not determine an ellipsoid (too few,
+		*			on a plane, ...), the previous result is kept then
+		*/
+		bool	fit( const Matrix<FT,3,1> *meas, int n, util::ThreadPool *pool = NULL )
+		{
+			if ( n < 10 )
+				return false;
+
+			data	= meas;
+			nData	= n;
+			chunks.resize( ( n + chunkSize - 1 )/chunkSize );
+
+			/** centre and scale, so that the scatter matrix stays well conditioned **/
+			run( pool, sumJob );
+
+			double	s[3] = { 0, 0, 0 }, ss = 0;
+			for (unsigned int c=0; c < chunks.size(); c++) {
+				for (int k=0; k < 3; k++)
+					s[k]	+= chunks[c].s[k];
+				ss	+= chunks[c].ss;
+			}
+			for (int k=0; k < 3; k++) {
+				s[k]	/= n;
+				mean[k]	= meas[0](k) + s[k];	/* sums are relative to the first sample */
+			}
+			scale	= sqrt( ss/n - s[0]*s[0] - s[1]*s[1] - s[2]*s[2] );
+			if ( !( scale > 0 ) )
+				return false;
+
+			/** scatter matrix of the normalized samples, upper triangle **/
+			run( pool, scatterJob );
+
+			double	S[10][10];
+			for (int i=0; i < 10; i++)
+				for (int j=i; j < 10; j++) {
+					double	t = 0;
+					for (unsigned int c=0; c < chunks.size(); c++)
+						t	+= chunks[c].D[i][j];
+					S[i][j] = S[j][i] = t;
+				}
+
+			Matrix<FT,L,1>	Xnew;
+			if ( !fitScatter( S, mean, scale, Xnew ) )
+				return false;
+			X	= Xnew;
+
+			/** rms of |out| - 1 over the samples **/
+			run( pool, residualJob );
+
+			double	r = 0;
+			for (unsigned int c=0; c < chunks.size(); c++)
+				r	+= chunks[c].res;
+			residual	= sqrt( r/n );
+
+			return true;
+		}
+
+		/**
+		* Calibrate a sample with the fitted parameters, same as UKFEllipsoid::processInput()
+		*
+		* @param meas	Measurement to process
+		* @param out	Where to write the calibrated output
+		*/
+		void	processInput( const Matrix<FT,3,1> &meas, Matrix<FT,3,1> &out ) const
+		{
+			FT	xCent	= meas(0) - X(stateOffsetX);
+			FT	yCent	= meas(1) - X(stateOffsetY);
+			FT	zCent	= meas(2) - X(stateOffsetZ);
+
+			out(0)	=	xCent/X(0);
+			out(1)	=	( X(1)*yCent + X(3)*xCent )/X(0);
+			out(2)	=	( X(2)*zCent + X(4)*xCent + X(5)*yCent )/X(0);
+		}
+
+		/** fitted parameters, in the UKFEllipsoid state layout */
+		void	getStateVector( Matrix<FT,L,1> &x ) const { x = X; }
+
+		/** rms of |calibrated sample| - 1 over the samples of the last fit */
+		FT		getResidual() const { return residual; }
+
+		/**
+		* The fit alone, for callers that accumulate the scatter matrix
+		* themselves (see StreamEllipsoid).
+		*
+		* @param S		Scatter matrix of the samples ( m - ref )/scale,
+		*				rows [ x^2 y^2 z^2 2yz 2xz 2xy 2x 2y 2z 1 ]
+		* @param ref	Origin the samples were taken relative to
+		* @param scale	Their scale, about the radius keeps S well conditioned
+		* @param X		Result, UKFEllipsoid state layout, only written on success
+		*/
+		static bool	fitScatter( const double S[10][10], const double ref[3], double scale,
+								Matrix<FT,L,1> &X )
+		{
+			Matrix<double,3,3>	M;
+			double				o[3];
+			if ( !solve( S, M, o ) )
+				return false;
+
+			/* back to sensor units */
+			M	/= scale*scale;
+			for (int k=0; k < 3; k++)
+				o[k]	= ref[k] + scale*o[k];
+
+			return toState( M, o, X );
+		}
+
+	private:
+
+		/* partial sums of one chunk of samples */
+		struct	Chunk
+		{
+			double	s[3];		/* sum of the samples, relative to the first one */
+			double	ss;			/* and of their squared norm */
+			double	D[10][10];	/* scatter matrix, upper triangle */
+			double	res;		/* sum of squared residuals */
+		};
+
+		Matrix<FT,L,1>	X;
+		FT				residual;
+
+		const Matrix<FT,3,1>	*data;
+		int						nData;
+		std::vector<Chunk>		chunks;
+		double					mean[3];
+		double					scale;
+
+		static const int	stateOffsetX		= 6;
+		static const int	stateOffsetY		= 7;
+		static const int	stateOffsetZ		= 8;
+
+		void	run( util::ThreadPool *pool, util::ThreadPool::IndexJob job )
+		{
+			if ( pool != NULL )
+				pool->parallelFor( chunks.size(), job, this );
+			else
+				for (unsigned int c=0; c < chunks.size(); c++)
+					job( c, this );
+		}
+
+		inline void	chunkRange( int c, int &first, int &last ) const
+		{
+			first	= c*chunkSize;
+			last	= first + chunkSize;
+			if ( last > nData )
+				last	= nData;
+		}
+
+		static void	sumJob( int c, void *arg )
+		{
+			EllipsoidFit	*f	= (EllipsoidFit *)arg;
+			Chunk			&ch	= f->chunks[c];
+			int				first, last;
+			f->chunkRange( c, first, last );
+
+			ch.s[0] = ch.s[1] = ch.s[2] = ch.ss = 0;
+			for (int i=first; i < last; i++) {
+				double	dx	= f->data[i](0) - f->data[0](0);
+				double	dy	= f->data[i](1) - f->data[0](1);
+				double	dz	= f->data[i](2) - f->data[0](2);
+				ch.s[0]	+= dx;
+				ch.s[1]	+= dy;
+				ch.s[2]	+= dz;
+				ch.ss	+= dx*dx + dy*dy + dz*dz;
+			}
+		}
+
+		static void	scatterJob( int c, void *arg )
+		{
+			EllipsoidFit	*f	= (EllipsoidFit *)arg;
+			Chunk			&ch	= f->chunks[c];
+			int				first, last;
+			f->chunkRange( c, first, last );
+
+			for (int i=0; i < 10; i++)
+				for (int j=i; j < 10; j++)
+					ch.D[i][j]	= 0;
+
+			double	is	= 1/f->scale;
+			for (int k=first; k < last; k++)
+			{
+				double	x	= ( f->data[k](0) - f->mean[0] )*is;
+				double	y	= ( f->data[k](1) - f->mean[1] )*is;
+				double	z	= ( f->data[k](2) - f->mean[2] )*is;
+
+				double	d[10]	= { x*x, y*y, z*z, 2*y*z, 2*x*z, 2*x*y, 2*x, 2*y, 2*z, 1 };
+
+				for (int i=0; i < 10; i++)
+					for (int j=i; j < 10; j++)
+						ch.D[i][j]	+= d[i]*d[j];
+			}
+		}
+
+		static void	residualJob( int c, void *arg )
+		{
+			EllipsoidFit	*f	= (EllipsoidFit *)arg;
+			Chunk			&ch	= f->chunks[c];
+			int				first, last;
+			f->chunkRange( c, first, last );
+
+			ch.res	= 0;
+			Matrix<FT,3,1>	out;
+			for (int i=first; i < last; i++) {
+				f->processInput( f->data[i], out );
+				double	e	= sqrt( (double)( out(0)*out(0) + out(1)*out(1) + out(2)*out(2) ) ) - 1;
+				ch.res	+= e*e;
+			}
+		}
+
+		/**
+		* Constrained fit on the scatter matrix.
+		*
+		* @param S		Scatter matrix
+		* @param M		Ellipsoid matrix, (m - o)'*M*(m - o) = 1 on the surface
+		* @param o		Ellipsoid centre
+		*/
+		static bool	solve( const double S[10][10], Matrix<double,3,3> &M, double o[3] )
+		{
+			Matrix<double,6,6>	S11;
+			Matrix<double,6,4>	S12;
+			Matrix<double,4,4>	S22;
+			for (int i=0; i < 10; i++)
+				for (int j=0; j < 10; j++) {
+					if ( i < 6 && j < 6 )
+						S11(i,j)		= S[i][j];
+					else if ( i < 6 )
+						S12(i,j-6)		= S[i][j];
+					else if ( j >= 6 )
+						S22(i-6,j-6)	= S[i][j];
+				}
+
+			/** eliminate the linear terms: v2 = -inv(S22)*S12'*v1 **/
+			Matrix<double,4,4>	S22i	= S22.inverse();
+			Matrix<double,4,6>	E		= S22i*S12.transpose();
+			Matrix<double,6,6>	Sr		= S11 - S12*E;
+
+			/** Sr*v1 = l*C1*v1, with Sr = G*G' and w = G'*v1 this is
+			 * inv(G)*C1*inv(G)'*w = (1/l)*w, symmetric. The ellipsoid is the
+			 * only positive eigenvalue */
+			Matrix<double,6,6>	G;
+			if ( !cholesky6( Sr, G ) )
+				return false;
+			Matrix<double,6,6>	Gi	= G.inverse();
+
+			Matrix<double,6,6>	C1;
+			C1.setZero();
+			C1(0,0) = C1(1,1) = C1(2,2) = -1;
+			C1(0,1) = C1(1,0) = C1(0,2) = C1(2,0) = C1(1,2) = C1(2,1) = 1;
+			C1(3,3) = C1(4,4) = C1(5,5) = -4;
+
+			Matrix<double,6,6>	N	= Gi*C1*Gi.transpose();
+			Matrix<double,6,6>	V;
+			jacobiEigen( N, V );
+
+			int	best = 0;
+			for (int i=1; i < 6; i++)
+				if ( N(i,i) > N(best,best) )
+					best	= i;
+			if ( !( N(best,best) > 0 ) )
+				return false;
+
+			Matrix<double,6,1>	v1	= Gi.transpose()*V.col( best );
+			Matrix<double,4,1>	v2	= -E*v1;
+
+			/** quadric to centre and matrix **/
+			Matrix<double,3,3>	A;
+			A	<< v1(0), v1(5), v1(4),
+				   v1(5), v1(1), v1(3),
+				   v1(4), v1(3), v1(2);
+			Matrix<double,3,1>	b;
+			b	<< v2(0), v2(1), v2(2);
+
+			Matrix<double,3,1>	c	= -A.inverse()*b;
+			double	k	= c.dot( A*c ) - v2(3);
+			if ( !( fabs( k ) > 0 ) )
+				return false;
+
+			M	= A/k;
+			for (int i=0; i < 3; i++)
+				o[i]	= c(i);
+			return true;
+		}
+
+		/**
+		* M = T'*T/X(0)^2 with T = [ 1 0 0 ; X(3) X(1) 0 ; X(4) X(5) X(2) ],
+		* the transform UKFEllipsoid::processInput() applies
+		*/
+		static bool	toState( const Matrix<double,3,3> &M, const double o[3], Matrix<FT,L,1> &X )
+		{
+			/* T' = [ t00 0 0 ; c b1 0 ; d e b2 ] with T'^t*T' = M, from the last row up */
+			if ( !( M(2,2) > 0 ) )
+				return false;
+			double	b2	= sqrt( M(2,2) );
+			double	e	= M(1,2)/b2;
+			double	d	= M(0,2)/b2;
+
+			double	b1s	= M(1,1) - e*e;
+			if ( !( b1s > 0 ) )
+				return false;
+			double	b1	= sqrt( b1s );
+			double	c	= ( M(0,1) - d*e )/b1;
+
+			double	t00s	= M(0,0) - c*c - d*d;
+			if ( !( t00s > 0 ) )
+				return false;
+			double	t00	= sqrt( t00s );
+
+			/* T = T'/t00, so that T(0,0) = 1 */
+			X(0)	= 1/t00;
+			X(1)	= b1/t00;
+			X(2)	= b2/t00;
+			X(3)	= c/t00;
+			X(4)	= d/t00;
+			X(5)	= e/t00;
+			X(stateOffsetX)	= o[0];
+			X(stateOffsetY)	= o[1];
+			X(stateOffsetZ)	= o[2];
+			return true;
+		}
+
+		/** M = G*G', G lower triangular. false if M is not positive definite */
+		static bool	cholesky6( const Matrix<double,6,6> &M, Matrix<double,6,6> &G )
+		{
+			G.setZero();
+			for (int j=0; j < 6; j++)
+			{
+				double	s = M(j,j);
+				for (int k=0; k < j; k++)
+					s	-= G(j,k)*G(j,k);
+				if ( !( s > 0 ) )
+					return false;
+				G(j,j)	= sqrt( s );
+
+				for (int i=j+1; i < 6; i++) {
+					double	t = M(i,j);
+					for (int k=0; k < j; k++)
+						t	-= G(i,k)*G(j,k);
+					G(i,j)	= t/G(j,j);
+				}
+			}
+			return true;
+		}
+
+		/**
+		* Cyclic Jacobi eigenvalue iteration on a symmetric matrix.
+		* A is left (nearly) diagonal with the eigenvalues, the columns of V
+		* are the eigenvectors
+		*/
+		static void	jacobiEigen( Matrix<double,6,6> &A, Matrix<double,6,6> &V )
+		{
+			V.setIdentity();
+
+			for (int sweep=0; sweep < 50; sweep++)
+			{
+				double	off = 0, diag = 0;
+				for (int p=0; p < 6; p++) {
+					diag	+= A(p,p)*A(p,p);
+					for (int q=p+1; q < 6; q++)
+						off	+= A(p,q)*A(p,q);
+				}
+				if ( off <= 1e-30*diag )
+					break;
+
+				for (int p=0; p < 5; p++)
+					for (int q=p+1; q < 6; q++)
+					{
+						if ( A(p,q) == 0 )
+							continue;
+
+						/* rotation that zeroes A(p,q) */
+						double	theta	= ( A(q,q) - A(p,p) )/( 2*A(p,q) );
+						double	t		= 1/( fabs( theta ) + sqrt( theta*theta + 1 ) );
+						if ( theta < 0 )
+							t	= -t;
+						double	c	= 1/sqrt( t*t + 1 );
+						double	s	= t*c;
+
+						for (int k=0; k < 6; k++) {
+							double	akp = A(k,p), akq = A(k,q);
+							A(k,p)	= c*akp - s*akq;
+							A(k,q)	= s*akp + c*akq;
+						}
+						for (int k=0; k < 6; k++) {
+							double	apk = A(p,k), aqk = A(q,k);
+							A(p,k)	= c*apk - s*aqk;
+							A(q,k)	= s*apk + c*aqk;
+						}
+						for (int k=0; k < 6; k++) {
+							double	vkp = V(k,p), vkq = V(k,q);
+							V(k,p)	= c*vkp - s*vkq;
+							V(k,q)	= s*vkp + c*vkq;
+						}
+					}
+			}
+		}
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}}; /* namespace calib, namespace openAHRS */
+
+
+#endif /* _calib_ellipsoidfit_h_ */
@@ -0,0 +1,189 @@
+#ifndef _calib_sensortransform_h_
+#define _calib_sensortransform_h_
+
+/*
+ *  Affine transform of raw sensor samples: axes, units, calibration, mounting
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+/**
+ * out = A*in + b, one per sensor. Every step between the A/D and the filter
+ * (swapping and negating axes, counts to units, the ellipsoid correction of
+ * a calibrator, the rotation of the board in the vehicle) is affine, and so
+ * is a chain of them: build each step with the functions below, chain them
+ * with then(), once, and each sample costs 9 multiply-adds instead of one
+ * pass per step. Build the chain again when one of the steps changes, a new
+ * calibration for instance.
+ *
+ *		SensorTransform	t	= SensorTransform::axes( 1,-1, 0,-1, 2,1 )
+ *								.then( SensorTransform::ellipsoid( X ) )
+ *								.then( SensorTransform::rotation( R ) );
+ *
+ * apply() on arrays goes through util::affineBatch(), a loop the compiler
+ * vectorizes, for whole logs or blocks of samples.
+ */
+
+#include <Eigen/Core>
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+
+
+namespace openAHRS { namespace calib
+{
+
+	class	SensorTransform
+	{
+	public:
+		/** identity */
+		SensorTransform() {
+			A.setIdentity();
+			b.setZero();
+		}
+
+		SensorTransform( const Matrix<FT,3,3> &A_, const Matrix<FT,3,1> &b_ ) : A(A_), b(b_) { }
+
+		/**
+		* Axis remap: out(k) = sign_k * in(axis_k).
+		* axes( 1,-1, 0,-1, 2,1 ) is out = [ -in(1) -in(0) in(2) ]
+		*
+		* @param ax,sx		Input axis and sign (1 or -1) of output X
+		* @param ay,sy		Same for output Y
+		* @param az,sz		Same for output Z
+		*/
+		static SensorTransform	axes( int ax, FT sx, int ay, FT sy, int az, FT sz )
+		{
+			SensorTransform	t;
+			t.A.setZero();
+			t.A(0,ax)	= sx;
+			t.A(1,ay)	= sy;
+			t.A(2,az)	= sz;
+			return t;
+		}
+
+		/** per axis gain, counts or volts to units */
+		static SensorTransform	scale( FT sx, FT sy, FT sz )
+		{
+			SensorTransform	t;
+			t.A(0,0)	= sx;
+			t.A(1,1)	= sy;
+			t.A(2,2)	= sz;
+			return t;
+		}
+
+		/** out = in + offset, a bias */
+		static SensorTransform	offset( const Matrix<FT,3,1> &o )
+		{
+			SensorTransform	t;
+			t.b	= o;
+			return t;
+		}
+
+		/**
+		* Rotation of the sensor frame, mounting of the board in the vehicle
+		*
+		* @param R		Rotation matrix, body = R*sensor
+		*/
+		static SensorTransform	rotation( const Matrix<FT,3,3> &R )
+		{
+			Matrix<FT,3,1>	zero;
+			zero.setZero();
+			return SensorTransform( R, zero );
+		}
+
+		/**
+		* The correction of UKFEllipsoid, StreamEllipsoid and EllipsoidFit,
+		* same output as their processInput(): the 1/radius, shear and offset
+		* of the state folded into A and b.
+		*
+		* @param X				State vector of the calibrator
+		* @param invRadius		true if X(0) is 1/radius, as in calib::Ellipsoid
+		*/
+		static SensorTransform	ellipsoid( const Matrix<FT,9,1> &X, bool invRadius = false )
+		{
+			FT	g	= invRadius ? X(0) : 1/X(0);
+
+			SensorTransform	t;
+			t.A	<<	g,			0,			0,
+					g*X(3),		g*X(1),		0,
+					g*X(4),		g*X(5),		g*X(2);
+
+			Matrix<FT,3,1>	o;
+			o	<< X(6), X(7), X(8);
+			t.b	= -( t.A*o );
+			return t;
+		}
+
+		/**
+		* This transform followed by next, next.A*( A*in + b ) + next.b
+		*/
+		SensorTransform	then( const SensorTransform &next ) const
+		{
+			return SensorTransform( next.A*A, next.A*b + next.b );
+		}
+
+		inline void	apply( const Matrix<FT,3,1> &in, Matrix<FT,3,1> &out ) const
+		{
+			out	= A*in + b;
+		}
+
+		/** straight from the A/D, no vector to fill first */
+		inline void	apply( FT x, FT y, FT z, Matrix<FT,3,1> &out ) const
+		{
+			out(0)	= A(0,0)*x + A(0,1)*y + A(0,2)*z + b(0);
+			out(1)	= A(1,0)*x + A(1,1)*y + A(1,2)*z + b(1);
+			out(2)	= A(2,0)*x + A(2,1)*y + A(2,2)*z + b(2);
+		}
+
+		/**
+		* Block of samples, see util::affineBatch()
+		*
+		* @param in		x[n] y[n] z[n]
+		* @param out	Same layout, must not overlap in
+		* @param n		Number of samples
+		*/
+		void	apply( const FT *in, FT *out, size_t n ) const
+		{
+			FT	a[9], o[3];
+			for (int i=0; i < 3; i++) {
+				for (int j=0; j < 3; j++)
+					a[3*i + j]	= A(i,j);
+				o[i]	= b(i);
+			}
+			util::affineBatch( a, o, in, out, n );
+		}
+
+		inline const Matrix<FT,3,3> &	getMatrix() const { return A; }
+		inline const Matrix<FT,3,1> &	getOffset() const { return b; }
+
+	private:
+		Matrix<FT,3,3>	A;
+		Matrix<FT,3,1>	b;
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}}; /* namespace calib, namespace openAHRS */
+
+
+#endif /* _calib_sensortransform_h_ */
@@ -0,0 +1,230 @@
+#ifndef _calib_streamellipsoid_h_
+#define _calib_streamellipsoid_h_
+
+/*
+ *  Streaming ellipsoid calibration, constant cost per sample
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+/**
+ * Drop-in for UKFEllipsoid (estimateParams(), processInput(), getStateVector(),
+ * same state layout) that only adds each sample to the scatter matrix of
+ * EllipsoidFit, the second and fourth order moments of the samples: 55
+ * multiply-adds, no filter step. The ellipsoid is fitted again from those
+ * sums every setSolveInterval() samples, and when getStateVector() is called
+ * with samples added since the last fit. processInput() uses the last fit,
+ * so it stays cheap too.
+ *
+ * The sums are kept in double, relative to the first sample, and rescaled
+ * to the spread of the samples before each fit. With setDecay() below 1 older
+ * samples fade out, so that the calibration can be left running and follow
+ * slow changes.
+ */
+
+#include <Eigen/Core>
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/calib/EllipsoidFit.h>
+
+
+namespace openAHRS { namespace calib
+{
+
+	class	StreamEllipsoid
+	{
+	public:
+		static const int	L			= 9;	/* same state as UKFEllipsoid */
+
+		StreamEllipsoid() {
+			solveInterval	= 256;
+			decay			= 1;
+
+			Matrix<FT,3,1>	bias;
+			bias.setZero();
+			init( bias, 1 );
+		}
+
+		/**
+		* Start over, with a sphere until the first fit.
+		*
+		* @param estBias		Estimated bias for X,Y,Z
+		* @param estAmpl		Estimated radius
+		*/
+		void	init( const Matrix<FT,3,1> &estBias, FT estAmpl )
+		{
+			Matrix<FT,L,1>	x0;
+			x0(0) = estAmpl;
+			x0(1) = x0(2) = 1.0;
+			x0(3) = x0(4) = x0(5) = 0.0;
+			x0(stateOffsetX) = estBias(0);
+			x0(stateOffsetY) = estBias(1);
+			x0(stateOffsetZ) = estBias(2);
+
+			init( x0 );
+		}
+
+		/**
+		* Start over, with the given parameters until the first fit.
+		*
+		* @param x0		Initial state, see processInput() for its layout
+		*/
+		void	init( const Matrix<FT,L,1> &x0 )
+		{
+			X		= x0;
+			nSamples	= 0;
+			sinceFit	= 0;
+			for (int i=0; i < 10; i++)
+				for (int j=0; j < 10; j++)
+					S[i][j]	= 0;
+		}
+
+		/** fit again every this many samples, 0 to fit only in getStateVector() */
+		inline void	setSolveInterval( int samples ) { solveInterval = samples; }
+
+		/**
+		* Weight of the past, applied to the sums every solve interval (or every
+		* 256 samples without one). 1 keeps everything, the default
+		*/
+		inline void	setDecay( FT factor ) { decay = factor; }
+
+		/**
+		* Add a measurement.
+		*
+		* @param meas			Measurement to process for parameter estimation
+		*/
+		void	estimateParams( const Matrix<FT,3,1> &meas )
+		{
+			if ( nSamples == 0 )
+				for (int k=0; k < 3; k++)
+					ref[k]	= meas(k);
+
+			double	x	= meas(0) - ref[0];
+			double	y	= meas(1) - ref[1];
+			double	z	= meas(2) - ref[2];
+
+			double	d[10]	= { x*x, y*y, z*z, 2*y*z, 2*x*z, 2*x*y, 2*x, 2*y, 2*z, 1 };
+
+			for (int i=0; i < 10; i++)
+				for (int j=i; j < 10; j++)
+					S[i][j]	+= d[i]*d[j];
+
+			nSamples++;
+			sinceFit++;
+
+			int	interval	= ( solveInterval > 0 ) ? solveInterval : 256;
+			if ( ( nSamples % interval ) == 0 ) {
+				if ( solveInterval > 0 )
+					solve();
+				if ( decay != 1 )
+					for (int i=0; i < 10; i++)
+						for (int j=i; j < 10; j++)
+							S[i][j]	*= decay;
+			}
+		}
+
+		/**
+		* Process input data using the last fitted parameters.
+		*
+		* @param meas	Measurement to process
+		* @param out	Where to write the calibrated output
+		*/
+		void	processInput( const Matrix<FT,3,1> &meas, Matrix<FT,3,1> &out ) const
+		{
+			FT	xCent	= meas(0) - X(stateOffsetX);
+			FT	yCent	= meas(1) - X(stateOffsetY);
+			FT	zCent	= meas(2) - X(stateOffsetZ);
+
+			out(0)	=	xCent/X(0);
+			out(1)	=	( X(1)*yCent + X(3)*xCent )/X(0);
+			out(2)	=	( X(2)*zCent + X(4)*xCent + X(5)*yCent )/X(0);
+		}
+
+		/** fits first if samples were added since the last fit */
+		void	getStateVector( Matrix<FT,L,1> &x ) {
+			if ( sinceFit > 0 )
+				solve();
+			x = X;
+		}
+
+		void	setStateVector( const Matrix<FT,L,1> &x ) { X = x; }
+
+		/** samples added since init() */
+		inline int	getSampleCount() const { return nSamples; }
+
+		/**
+		* Fit from the sums now. Until the samples determine an ellipsoid
+		* the previous parameters are kept.
+		*
+		* @return	true if the parameters were updated
+		*/
+		bool	solve()
+		{
+			sinceFit	= 0;
+
+			/* the weight of a sample is the 1*1 term, the first
+			 * order sums are the 2x*1 terms */
+			double	w	= S[9][9];
+			if ( w <= 0 )
+				return false;
+
+			double	m[3]	= { S[6][9]/(2*w), S[7][9]/(2*w), S[8][9]/(2*w) };
+			double	var		= ( S[0][9] + S[1][9] + S[2][9] )/w - m[0]*m[0] - m[1]*m[1] - m[2]*m[2];
+			if ( !( var > 0 ) )
+				return false;
+			double	scale	= sqrt( var );
+
+			/* the samples ( m - ref )/scale: quadratic terms over scale^2, linear over scale */
+			double	g[10];
+			for (int i=0; i < 10; i++)
+				g[i]	= ( i < 6 ) ? 1/var : ( i < 9 ) ? 1/scale : 1;
+
+			double	Sn[10][10];
+			for (int i=0; i < 10; i++)
+				for (int j=i; j < 10; j++)
+					Sn[i][j] = Sn[j][i] = S[i][j]*g[i]*g[j];
+
+			return EllipsoidFit::fitScatter( Sn, ref, scale, X );
+		}
+
+	private:
+		Matrix<FT,L,1>	X;
+
+		double	S[10][10];	/* scatter matrix of the samples - ref, upper triangle */
+		double	ref[3];		/* first sample */
+		int		nSamples;
+		int		sinceFit;	/* samples added since the last fit */
+
+		int		solveInterval;
+		FT		decay;
+
+		static const int	stateOffsetX		= 6;
+		static const int	stateOffsetY		= 7;
+		static const int	stateOffsetZ		= 8;
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}}; /* namespace calib, namespace openAHRS */
+
+
+#endif /* _calib_streamellipsoid_h_ */
@@ -0,0 +1,216 @@
+#ifndef _calib_temperaturecache_h_
+#define _calib_temperaturecache_h_
+
+/*
+ *  Calibration parameters by temperature, for a warm start
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+/**
+ * Gyro biases and calibrator states drift with temperature, and every
+ * cold start the filter finds them again from scratch. This keeps a
+ * parameter vector (whatever the user packs in it, gyro bias then
+ * ellipsoid parameters for instance) per temperature bin:
+ *
+ *	- update() adds converged values to the bin of the current
+ *	  temperature, a running mean over the last setMaxWeight() updates
+ *	  so that it follows aging too. The mean of the temperatures they
+ *	  came at is kept with them
+ *	- lookup() interpolates linearly between the two bins whose mean
+ *	  temperatures are nearest on each side, or takes the nearest one
+ *	  if there is none on one side (no extrapolation), to start the
+ *	  filter and calibrators from there
+ *
+ * Interpolating at the mean temperatures instead of the bin centres
+ * keeps a bin that has only seen one end of its range, the first bin
+ * of a warm-up for instance, from being off by half a bin of drift.
+ * Bins are binWidth wide, centred on tMin, tMin + binWidth, ... and
+ * temperatures out of range go to the first or last bin.
+ * save() and load() keep the bins as a record of a util::CalibStore,
+ * with tMin and binWidth to refuse a cache laid out differently.
+ */
+
+#include <math.h>
+
+#include <Eigen/Core>
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/calibstore.h>
+
+
+namespace openAHRS { namespace calib
+{
+
+	template <int L, int Bins>
+	class	TemperatureCache
+	{
+	public:
+		typedef Matrix<FT,L,1>	Vector;
+
+		/**
+		* @param tMin		Centre of the first bin, same units as the temperatures given
+		* @param binWidth	Bin width
+		*/
+		TemperatureCache( FT tMin, FT binWidth )
+		{
+			this->tMin		= tMin;
+			this->binWidth	= binWidth;
+			maxWeight		= 100;
+			clear();
+		}
+
+		void	clear() {
+			values.setZero();
+			for (int b=0; b < Bins; b++) {
+				count[b]	= 0;
+				tMean[b]	= 0;
+			}
+		}
+
+		/** updates a bin averages over, more is smoother and slower to follow changes */
+		inline void	setMaxWeight( int n ) { maxWeight = ( n < 1 ) ? 1 : n; }
+
+		/** bin whose centre is nearest to temp */
+		int		binOf( FT temp ) const
+		{
+			int	b	= (int)floor( ( temp - tMin )/binWidth + 0.5 );
+			if ( b < 0 )		b = 0;
+			if ( b >= Bins )	b = Bins - 1;
+			return b;
+		}
+
+		inline FT	binCenter( int b ) const { return tMin + b*binWidth; }
+
+		/** updates averaged into bin b, capped at setMaxWeight() */
+		inline int	getCount( int b ) const { return count[b]; }
+
+		/** mean temperature of the updates of bin b */
+		inline FT	getTemperature( int b ) const { return tMean[b]; }
+
+		/**
+		* Refine the bin of temp with a new value.
+		*
+		* @param temp	Temperature the value was found at
+		* @param v		Parameters
+		*/
+		void	update( FT temp, const Vector &v )
+		{
+			int	b	= binOf( temp );
+			if ( count[b] < maxWeight )
+				count[b]++;
+
+			values.col(b)	+= ( v - values.col(b) )/count[b];
+			tMean[b]		+= ( temp - tMean[b] )/count[b];
+		}
+
+		/**
+		* Parameters for a temperature.
+		*
+		* @param temp	Temperature
+		* @param v		Output, unchanged if false is returned
+		* @return		false if no bin has data yet
+		*/
+		bool	lookup( FT temp, Vector &v ) const
+		{
+			/* bins with data nearest to temp, at or below it and above it */
+			int	lo = -1, hi = -1;
+			for (int b=0; b < Bins; b++)
+			{
+				if ( count[b] == 0 )
+					continue;
+				if ( tMean[b] <= temp ) {
+					if ( lo < 0 || tMean[b] > tMean[lo] )	lo = b;
+				} else {
+					if ( hi < 0 || tMean[b] < tMean[hi] )	hi = b;
+				}
+			}
+
+			if ( lo < 0 && hi < 0 )
+				return false;
+
+			if ( lo < 0 )			v	= values.col(hi);
+			else if ( hi < 0 )		v	= values.col(lo);
+			else {
+				FT	w	= ( temp - tMean[lo] )/( tMean[hi] - tMean[lo] );
+				v	= ( 1 - w )*values.col(lo) + w*values.col(hi);
+			}
+			return true;
+		}
+
+		/** add the bins to w as record name */
+		void	save( util::CalibStoreWriter &w, const char *name ) const
+		{
+			Matrix<FT,L+2,Bins+1>	m;
+			pack( m );
+			w.add( name, m );
+		}
+
+		/** fails, leaving the cache alone, if s has no such record or it is for other bins */
+		bool	load( const util::CalibStore &s, const char *name )
+		{
+			const FT	*p	= s.find( name, L+2, Bins+1 );
+			if ( p == NULL )
+				return false;
+
+			/* column-major, L+2 values per bin */
+			const FT	*layout	= p + (L+2)*Bins;
+			if ( layout[0] != tMin || layout[1] != binWidth )
+				return false;
+
+			for (int b=0; b < Bins; b++) {
+				const FT	*c	= p + (L+2)*b;
+				count[b]	= (int)c[0];
+				tMean[b]	= c[1];
+				for (int i=0; i < L; i++)
+					values(i,b)	= c[2+i];
+			}
+			return true;
+		}
+
+	private:
+		Matrix<FT,L,Bins>	values;
+		int					count[Bins];
+		FT					tMean[Bins];	/* mean temperature of the updates */
+		int					maxWeight;
+		FT					tMin, binWidth;
+
+		/* one column per bin, count, mean temperature and values, and a last one with the layout */
+		void	pack( Matrix<FT,L+2,Bins+1> &m ) const
+		{
+			m.setZero();
+			for (int b=0; b < Bins; b++) {
+				m(0,b)	= count[b];
+				m(1,b)	= tMean[b];
+				m.template block<L,1>(2,b)	= values.col(b);
+			}
+			m(0,Bins)	= tMin;
+			m(1,Bins)	= binWidth;
+		}
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}}; /* namespace calib, namespace openAHRS */
+
+
+#endif /* _calib_temperaturecache_h_ */
@@ -39,6 +39,15 @@
 #include <Eigen/Cholesky>
 USING_PART_OF_NAMESPACE_EIGEN
 
+#include <openAHRS/util/cholesky.h>
+#include <openAHRS/util/covariance.h>
+
+/** set to 1 to carry the Cholesky factor of P instead of P (square-root UKF),
+ * no factorization is done per sample then. Recommended for FT=float */
+#ifndef	UKFELLIPSOID_SQUARE_ROOT
+	#define	UKFELLIPSOID_SQUARE_ROOT	0
+#endif
+
 
 namespace openAHRS { namespace calib 
 {
@@ -49,15 +58,23 @@ namespace openAHRS { namespace calib
 		static const int	L			= 9;	/* order */
 
 		void	getCovarianceMatrix( Matrix<FT,L,L>	&cm ) {
+		#if UKFELLIPSOID_SQUARE_ROOT
+			cm	= S*S.transpose();
+		#else
 			cm	= P;
+		#endif
 		}
 		
 		void	setCovarianceMatrix( const Matrix<FT,L,L>	&cm ) {
 			P = cm;
+		#if UKFELLIPSOID_SQUARE_ROOT
+			util::choleskyFactor( P, S );
+		#endif
 		}
 
 	public:
 		UKFEllipsoid() {
+			factorErrors	= 0;
 			UKF_lambda	= UKF_alpha*UKF_alpha*(L + UKF_kappa) - L;
 			UKF_Ws0		= UKF_lambda/(L+UKF_lambda);
 			UKF_Wc0		= UKF_Ws0 + ( 1- UKF_alpha*UKF_alpha + UKF_beta );
@@ -77,21 +94,42 @@ namespace openAHRS { namespace calib
 		void		init( FT meas_noise, const Matrix<FT,3,1> &estBias, FT estAmpl,
 						FT variance1, FT variance2, FT PstartVariance )
 		{
-			R = meas_noise;
-			P.setIdentity();
-			P *= PstartVariance;
-			I.setIdentity();
+			Matrix<FT,L,1>	x0;
 
 			/* if distortions from a perfect sphere are small this helps for
 			 * filter convergence */
-			X(1) = X(2) = 1.0;
-			X(3) = X(4) = X(5) = 0.0;
+			x0(1) = x0(2) = 1.0;
+			x0(3) = x0(4) = x0(5) = 0.0;
 
 			// 1/radius estimate0
-			X(0) = estAmpl;
-			X(stateOffsetX) = estBias(0);
-			X(stateOffsetY) = estBias(1);
-			X(stateOffsetZ) = estBias(2);
+			x0(0) = estAmpl;
+			x0(stateOffsetX) = estBias(0);
+			x0(stateOffsetY) = estBias(1);
+			x0(stateOffsetZ) = estBias(2);
+
+			init( meas_noise, x0, variance1, variance2, PstartVariance );
+		}
+
+		/**
+		* Init from a full state estimate, from EllipsoidFit for instance.
+		* Starting that close, PstartVariance can be small and the filter
+		* converges in one pass.
+		*
+		* @param meas_noise		Measurement noise variance
+		* @param x0				Initial state, see processInput() for its layout
+		*/
+		void		init( FT meas_noise, const Matrix<FT,L,1> &x0,
+						FT variance1, FT variance2, FT PstartVariance )
+		{
+			R = meas_noise;
+			factorErrors = 0;
+			P.setIdentity();
+			P *= PstartVariance;
+			S.setIdentity();
+			S *= sqrt(PstartVariance);
+			I.setIdentity();
+
+			X = x0;
 
 			/** This tells the filter to believe the initial estimates for
 			 * the states that need only small corrections */
@@ -119,6 +157,9 @@ namespace openAHRS { namespace calib
 			/** Calculate sigma points **/
 			SP.block<L,1>(0,0)	= X;
 
+		#if UKFELLIPSOID_SQUARE_ROOT
+			sqMatrix	= sqWeigth*S;
+		#else
 			#if 1
 				Matrix<FT,L,L>	temp;
 				temp	= 16384*P;
@@ -133,6 +174,7 @@ namespace openAHRS { namespace calib
 				printf("ERR POSITIVE DEF\n");
 				exit(-1);
 			}
+		#endif
 
 			for (int i=1; i < L+1; i++)
 				SP.block<L,1>(0,i) = X + sqMatrix.block<L,1>(0,i-1);
@@ -140,7 +182,30 @@ namespace openAHRS { namespace calib
 				SP.block<L,1>(0,i) = X - sqMatrix.block<L,1>(0,i-L-1);
 
 			/* Q 'trick'. System evolution matrix is identity */
+		#if UKFELLIPSOID_SQUARE_ROOT
+			/* Q is diagonal (see init()), one rank-1 update per non-zero entry */
+			Matrix<FT,L,L>	S_q = S;
+			for (int i=0; i < L; i++) {
+				if ( Q(i,i) > 0 ) {
+					Matrix<FT,L,1>	e;
+					e.setZero();
+					e(i) = 1;
+					if ( !util::choleskyUpdate( S, e, Q(i,i) ) ) {
+						/* zero pivot in S, do it the long way */
+						Matrix<FT,L,2*L>	SQ;
+						SQ.setZero();
+						SQ.block<L,L>(0,0) = S_q;
+						for (int j=0; j < L; j++)
+							if ( Q(j,j) > 0 )
+								SQ(j,L+j) = sqrt( Q(j,j) );
+						util::triangularize( SQ, S );
+						break;
+					}
+				}
+			}
+		#else
 			P = P + Q;
+		#endif
 
 			/* Project sigma points through h */
 			FT	gamma[2*L + 1];
@@ -157,20 +222,26 @@ namespace openAHRS { namespace calib
 				
 			}
 
-			/* Weight sigma points */
-			FT	Z = UKF_Ws0*gamma[0];
+			/* Weight sigma points, relative to the central one to avoid
+			 * cancellation between Ws0 and Wsi */
+			FT	Z = 0;
 			for (int i=1; i < 2*L+1; i++)
-				Z += UKF_Wsi*gamma[i];
+				Z += gamma[i] - gamma[0];
+			Z = gamma[0] + UKF_Wsi*Z;
 
-			/* Weight sigma points for P */
-			FT	Pzz	= UKF_Wc0*( gamma[0] - Z)*(gamma[0] - Z) + R;
-			Matrix<FT,L,1>	Pxz;
-			Pxz	= UKF_Wc0*( SP.block<L,1>(0,0) - X ) * (gamma[0] - Z);
-			for (int i=1; i < 2*L+1; i++) {
-				Pzz	+= UKF_Wci*( gamma[i] - Z ) * (gamma[i]-Z);
-				Pxz	+= UKF_Wci*( SP.block<L,1>(0,i) - X ) * (gamma[i]-Z);
+			/* Centred deviations, then covariances as D*W*D' */
+			for (int i=0; i < 2*L+1; i++) {
+				dSP.block<L,1>(0,i) = SP.block<L,1>(0,i) - X;
+				dGamma(0,i) = gamma[i] - Z;
 			}
 
+			Matrix<FT,1,1>	Pzz1;
+			Matrix<FT,L,1>	Pxz;
+			util::weightedCovariance( dGamma, UKF_Wc0, UKF_Wci, Pzz1 );
+			util::weightedCrossCovariance( dSP, dGamma, UKF_Wc0, UKF_Wci, Pxz );
+
+			FT	Pzz	= Pzz1(0,0) + R;
+
 			Matrix<FT,L,1> K = Pxz * (1/Pzz);
 			X += K*(-Z);
 
@@ -178,7 +249,21 @@ namespace openAHRS { namespace calib
 /*			if ( Z > 0.5 )
 				printf("Error muy alto: %f\n" , (float)Z);*/
 
+		#if UKFELLIPSOID_SQUARE_ROOT
+			/* P = P - K*Pzz*K'. If the downdate fails factor the whole P
+			 * instead: directions round-off made negative are dropped
+			 * (Q fills them again on the next sample) and counted, see
+			 * getFactorErrors() */
+			Matrix<FT,L,L>	S_bak = S;
+			if ( !util::choleskyUpdate( S, K, -Pzz ) ) {
+				P = S_bak*S_bak.transpose() - K*Pzz*K.transpose();
+				if ( !P.llt().isPositiveDefinite() )
+					factorErrors++;
+				util::choleskyFactor( P, S );
+			}
+		#else
 			P = P - K*Pzz*K.transpose();
+		#endif
 			
 			return;
 
@@ -227,6 +312,13 @@ namespace openAHRS { namespace calib
 			out(2)	=	( X(2)*zCent + X(4)*xCent + X(5)*yCent )/X(0);
 		}
 
+		/**
+		 * Square-root mode: samples after which P was not positive
+		 * definite (round-off, float) and had to be trimmed. Always 0
+		 * otherwise, the dense form stops instead.
+		 */
+		int		getFactorErrors() const { return factorErrors; }
+
 		/** Just for debugging **/
 		void	getStateVector( Matrix<FT,L,1> &x ) { x = X; };
 		void	setStateVector( const Matrix<FT,L,1>	&x ) { X = x; }
@@ -237,10 +329,13 @@ namespace openAHRS { namespace calib
 		FT				R;	/* measurement noise variance */
 
 		Matrix<FT,L,L>	P;	/* state covariance matrix */
+		Matrix<FT,L,L>	S;	/* lower Cholesky factor of P, square-root mode only */
 		Matrix<FT,L,1>	X;	/* state Vector */
 
 		Matrix<FT,L,L>	I;	/* identity matrix */
 
+		int				factorErrors;	/* see getFactorErrors() */
+
 		/* what each element in X means
 		 * only some of them listed */
 		static const int	stateScaleFactor	= 0;
@@ -262,6 +357,8 @@ namespace openAHRS { namespace calib
 
 		Matrix<FT,L,L>			sqMatrix;	/* preallocate square root matrix */
 		Matrix<FT,L,2*L + 1>	SP;	/* preallocate sigma points */
+		Matrix<FT,L,2*L + 1>	dSP;	/* centred deviations of SP */
+		Matrix<FT,1,2*L + 1>	dGamma;	/* centred deviations of the projected points */
 
 	public:
 		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -27,6 +27,11 @@
 #include <Eigen/LU>
 #include <Eigen/Cholesky>
 
+#include <openAHRS/util/cholesky.h>
+#include <openAHRS/util/covariance.h>
+#include <openAHRS/kalman/UKFbatch.h>
+#include <openAHRS/kalman/UKFsigma.h>
+
 USING_PART_OF_NAMESPACE_EIGEN
 
 /**
@@ -41,13 +46,40 @@ USING_PART_OF_NAMESPACE_EIGEN
  *		state is the state vector, data is the custom input data to the UKF Predict function, dt is delta time.
  *		The function must return the predicted state according to the arguments passed.
  *
+ *	Optionally T can also provide measureBatch() and predictStateBatch(), which project
+ *	all the 2*numStates+1 sigma points in a single call (see UKFbatch.h). They are
+ *	detected at compile time and used instead of the per point functions.
+ *
+ * If squareRoot is true the filter carries the lower Cholesky factor S of P (P = S*S')
+ * instead of P itself (square-root UKF, van der Merwe). S is propagated with a
+ * triangularization of the weighted sigma point deviations and rank-1 Cholesky
+ * updates/downdates, so P is never re-factored and always stays positive
+ * definite, which allows running with FT=float. The price is a slower step:
+ * the triangularization and the rank-1 updates cost more than the dense
+ * outer products and inverse, about a third more at L=7 on a PC
+ * (test-ukfsqrt: 2.9 against 2.0 us per step with FT=double).
+ *
+ * With setSigmaPointReuse(true) the sigma points propagated by KalmanPredict()
+ * are used as they are by the following KalmanUpdate(), instead of drawing a new
+ * set from the predicted covariance. To keep that set consistent with P, the process
+ * noise is added to the covariance before the prediction sigma points are drawn
+ * (x' = f(x+w) rather than x' = f(x)+w, the same for small dt). That saves one
+ * factorization and one sigma point generation per predict+update cycle.
+ * KalmanStep() does a predict and an update in one call, reusing the sigma points.
+ *
+ * SigmaSet selects the sigma points (see UKFsigma.h): the symmetric 2L+1 set
+ * (default), the spherical simplex set with L+2 points or the cubature set
+ * with 2L points. The smaller sets save model evaluations at some accuracy cost.
+ *
  */
 
 template <class T, 
 	const int numStates,		/* num states */
 	const int numInputs,		/* num inputs */
 	const int numPredInputs,	/* num inputs for prediction */
-	bool checkForPositiveDefinite = true /* if true then check for positive definite matrix before Cholesky() */
+	bool checkForPositiveDefinite = true, /* if true then check for positive definite matrix before Cholesky() */
+	bool squareRoot = false,	/* if true then propagate the Cholesky factor of P instead of P, slower, see above */
+	template <int> class SigmaSet = openAHRS::UKFSymmetricSet	/* sigma point set */
 	>
 class UKF
 {
@@ -58,7 +90,8 @@ private:
 	enum { 
 		L = numStates,	/* number of states to track */
 		M = numInputs,  //numInputs;	/* number of inputs to KF */
-		N = numPredInputs
+		N = numPredInputs,
+		NP = SigmaSet<numStates>::K	/* number of sigma points */
 	};
 
 	Matrix<FT,L,L>	Q;	/* process noise cov matrix */
@@ -66,38 +99,64 @@ private:
 
 	Matrix<FT,L,L>	P;	/* state covariance matrix */
 
-	/** UKF constants **/
-	static const FT	UKF_alpha	= 1e-3;
-	static const FT	UKF_beta	= 2.0;
-	static const FT	UKF_kappa	= 0.0;
+	/** square-root mode only **/
+	Matrix<FT,L,L>	S;		/* lower Cholesky factor of P */
+	Matrix<FT,L,L>	sqrtQ;	/* lower Cholesky factor of Q */
+	Matrix<FT,M,M>	sqrtR;	/* lower Cholesky factor of R */
+
+	/** UKF constants, see setScaling() **/
+	FT	UKF_alpha;
+	FT	UKF_beta;
+	FT	UKF_kappa;
 		
-	FT	sqWeight;	/* sqrt(L+lambda) */
-	FT	UKF_lambda;
+	FT	sqWeight;	/* spread of the sigma points, sqrt(L+lambda) for the symmetric set */
 	FT	UKF_Ws0;
 	FT	UKF_Wc0;
 	FT	UKF_Wsi;
 	FT	UKF_Wci;
 
 	Matrix<FT,L,L>			sqMatrix;	/* preallocate square root matrix */
-	Matrix<FT,L,2*L + 1>	SP;	/* preallocate sigma points */
-	Matrix<FT,M,2*L + 1>	Ysp;
-	Matrix<FT,L,2*L + 1>	Xsp;
+	Matrix<FT,L,NP>	SP;	/* preallocate sigma points */
+	Matrix<FT,M,NP>	Ysp;
+	Matrix<FT,L,NP>	Xsp;
+	Matrix<FT,L,NP>	dXsp;	/* centred deviations, for covariance reconstruction */
+	Matrix<FT,M,NP>	dYsp;
+
+	bool	reuseSigmaPoints;	/* see setSigmaPointReuse() */
+	bool	haveXsp;			/* Xsp holds the points of the last predict, usable by the next update */
+	bool	sequentialUpdate;	/* see setSequentialUpdate() */
 
 	/** measurement variance */
 	Matrix<FT,L,1>	X;	/* state Vector */
 
 public:
 	inline	UKF() {
-		/* nothing */
+		UKF_alpha	= 1e-3;
+		UKF_beta	= 2.0;
+		UKF_kappa	= 0.0;
+
+		reuseSigmaPoints	= false;
+		haveXsp				= false;
+		sequentialUpdate	= false;
 	}
 
 	inline void	getStateVector( Matrix<FT,L,1> &v ) {
 		v = X;
 	}
 
+	inline void	getCovarianceMatrix( Matrix<FT,L,L> &cm ) {
+		if ( squareRoot )
+			cm = S*S.transpose();
+		else
+			cm = P;
+	}
+
 	void	printMatrices() {
+		Matrix<FT,L,L>	cm;
+		getCovarianceMatrix( cm );
+
 		std::cout << "X:\n" << X << std::endl;
-		std::cout << "P:\n" << P << std::endl;
+		std::cout << "P:\n" << cm << std::endl;
 		std::cout << "Q:\n" << Q << std::endl;
 		std::cout << "R:\n" << R << std::endl;
 	}
@@ -108,36 +167,83 @@ public:
 	 */
 	void	KalmanInit()
 	{
+		calcWeights();
 
-			UKF_lambda	= UKF_alpha*UKF_alpha*(L + UKF_kappa) - L;
-			UKF_Ws0		= UKF_lambda/(L+UKF_lambda);
-			UKF_Wc0		= UKF_Ws0 + ( 1.0 - UKF_alpha*UKF_alpha + UKF_beta );
-			UKF_Wsi		= 1.0/((double)2.0*(L+UKF_lambda));
-			UKF_Wci		= UKF_Wsi;
-			sqWeight	= sqrt( L + UKF_lambda );
-		
 
 		sqMatrix.setZero();
 		Ysp.setZero();
 		Xsp.setZero();
+		dYsp.setZero();
+		dXsp.setZero();
 		SP.setZero();
 
 		P.setIdentity();
+		S.setIdentity();
 
 		R.setIdentity();
 		Q.setIdentity();
+		sqrtR.setIdentity();
+		sqrtQ.setIdentity();
+
+		haveXsp = false;
+	}
+
+	/**
+	 * Set the sigma point spread (scaled unscented transform).
+	 * Defaults are alpha = 1e-3, beta = 2, kappa = 0.
+	 * With FT=float use a larger alpha (0.5..1): with 1e-3 the sigma points
+	 * are only 1e-3 standard deviations apart, and single precision round-off
+	 * in the model functions swamps the weighted mean.
+	 */
+	void	setScaling( FT alpha, FT beta, FT kappa )
+	{
+		UKF_alpha	= alpha;
+		UKF_beta	= beta;
+		UKF_kappa	= kappa;
+		calcWeights();
+		haveXsp = false;
+	}
+
+	/**
+	 * Reuse the propagated sigma points of KalmanPredict() in the next KalmanUpdate().
+	 * Process noise is then applied before propagation, see the notes at the top.
+	 * The update then sees the propagated spread as it is, so with FT=float
+	 * a larger alpha is a must (see setScaling()).
+	 */
+	void	setSigmaPointReuse( bool reuse )
+	{
+		reuseSigmaPoints	= reuse;
+		haveXsp				= false;
 	}
 
 	inline void	setStateVector( Matrix<FT,L,1>	&st ) {
 		X = st;
+		haveXsp = false;
+	}
+
+	/* factors are computed here once, never inside predict/update */
+	inline void	setCovarianceMatrix( const Matrix<FT,L,L> &cm ) {
+		P = cm;
+		haveXsp = false;
+		if ( squareRoot )
+			openAHRS::util::choleskyFactor( P, S );
 	}
 
 	inline void	setProcessCovariance( Matrix<FT,L,L> &sQ ) {
 		Q = sQ;
+		if ( squareRoot )
+			openAHRS::util::choleskyFactor( Q, sqrtQ );
 	}
 
 	inline void	setMeasurementCovariance( Matrix<FT,M,M> &sR ) {
 		R = sR;
+		if ( squareRoot )
+			openAHRS::util::choleskyFactor( R, sqrtR );
+	}
+
+	/** Access to the model instance, for models with parameters of their own */
+	inline T &	getModel() {
+		return filterData;
 	}
 
 
@@ -150,6 +256,79 @@ public:
 	 *
 	 */
 	void	KalmanUpdate( int iter, const Matrix<FT,M,1> &inData, FT dt )
+	{
+		update( inData, dt, sequentialUpdate, ~0u );
+	}
+
+	/**
+	 * Kalman - Update state with some of the measurement components only.
+	 * Always sequential, see setSequentialUpdate().
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param inData	Current measured input
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param axisMask	Bit i set to use inData(i), for example to leave out a saturated channel
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,M,1> &inData, FT dt, unsigned int axisMask )
+	{
+		update( inData, dt, true, axisMask );
+	}
+
+	/**
+	 * Process the measurement components as successive scalar updates,
+	 * conditioning on one component at a time, instead of inverting (or
+	 * factoring) the MxM innovation covariance. Only the diagonal of R is
+	 * used: exact when R is diagonal, as in all the filters here.
+	 * Pzz is formed directly, also in square-root mode, so with FT=float
+	 * use a larger alpha (see setScaling()).
+	 */
+	inline void	setSequentialUpdate( bool seq ) {
+		sequentialUpdate = seq;
+	}
+
+	/** 
+	 * Kalman - Predict state 
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param inPred		Measurements for prediction
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanPredict( int iter, const Matrix<FT,N,1> &inPred, FT dt )
+	{
+		predict( inPred, dt, reuseSigmaPoints );
+	}
+
+	/**
+	 * Kalman - Predict, then update with the sigma points of the prediction.
+	 * Always reuses the sigma points, regardless of setSigmaPointReuse().
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param inPred		Measurements for prediction
+	 * @param inData		Current measured input
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanStep( int iter, const Matrix<FT,N,1> &inPred, const Matrix<FT,M,1> &inData, FT dt )
+	{
+		bool	reuse = reuseSigmaPoints;
+
+		predict( inPred, dt, true );
+
+		reuseSigmaPoints = true;
+		KalmanUpdate( iter, inData, dt );
+		reuseSigmaPoints = reuse;
+	}
+
+
+
+private:
+	/**
+	 * Update. If sequential is true the components of inData with their bit
+	 * set in axisMask are processed one by one, see setSequentialUpdate().
+	 */
+	void	update( const Matrix<FT,M,1> &inData, FT dt, bool sequential, unsigned int axisMask )
 	{
 		Matrix<FT,M,1>	angleError;
 		Matrix<FT,M,M>	Pzz;
@@ -158,38 +337,89 @@ public:
 		Matrix<FT,M,M>	Pzz_inv;
 		Matrix<FT,L,M> K;
 
-		recalculateSigmaPoints();
+		if ( reuseSigmaPoints && haveXsp )
+			SP = Xsp;		/* already centred on X with covariance P */
+		else
+			recalculateSigmaPoints( false );
 
-			/* Project sigma points through h */
-			for (int i=0; i < 2*L+1; i++) {
-				Ysp.template block<M,1>(0,i) = filterData.measure( SP.template block<L,1>(0,i), dt );
-			}
+		haveXsp = false;
+
+			/* Project sigma points through h, in one call if T provides measureBatch() */
+			openAHRS::UKFMeasureCall< openAHRS::UKFHasMeasureBatch<T,L,M,NP>::value >::call( filterData, SP, Ysp, dt );
 			
-			/* Weight sigma points */
+			/* Weight sigma points, relative to the central one.
+			 * Same as Ws0*Y0 + Wsi*sum(Yi) since weights add up to 1, but
+			 * without cancellation between the huge Ws0 and Wsi (matters in float) */
 			Y.setZero();
-			for (int i=1; i < 2*L+1; i++)
-				Y += Ysp.template block<M,1>(0,i);
+			for (int i=1; i < NP; i++)
+				Y += Ysp.template block<M,1>(0,i) - Ysp.template block<M,1>(0,0);
 			
 			Y *= UKF_Wsi;
-			Y += UKF_Ws0 * Ysp.template block<M,1>(0,0);
+			Y += Ysp.template block<M,1>(0,0);
 
-			/* Weight sigma points for P */
+			/* Centred deviations, then covariances as D*W*D' */
+			for (int i=0; i < NP; i++) {
+				dYsp.template block<M,1>(0,i) = Ysp.template block<M,1>(0,i) - Y;
+				dXsp.template block<L,1>(0,i) = SP.template block<L,1>(0,i) - X;
+			}
+
+			openAHRS::util::weightedCrossCovariance( dXsp, dYsp, UKF_Wc0, UKF_Wci, Pxz );
 
-			/* TODO: optimize */
-			Pzz.setZero();
-			Pxz.setZero();
-			for (int i=1; i < 2*L+1; i++) {
-				Pzz	+= ( Ysp.template block<M,1>(0,i) - Y ) * (Ysp.template block<M,1>(0,i) - Y).transpose();
-				Pxz	+= ( SP.template block<L,1>(0,i) - X ) * ( Ysp.template block<M,1>(0,i) - Y ).transpose();
+			if ( sequential )
+			{
+				updateSequential( inData - Y, Pxz, axisMask );
+				return;
 			}
-			
-			Pzz *= UKF_Wci;
-			Pxz *= UKF_Wci;
 
-			Pzz += UKF_Wc0*( Ysp.template block<M,1>(0,0) - Y)*(Ysp.template block<M,1>(0,0) - Y).transpose() ;
+			if ( squareRoot )
+			{
+				/** Square-root form: factor of Pzz, gain by substitution, downdate S **/
+				Matrix<FT,M,M>			Szz;
+				Matrix<FT,M,NP-1 + M>	devZ;
+				Matrix<FT,M,1>			dz;
+				FT	sqWci = sqrt( UKF_Wci );
+
+				devZ.template block<M,NP-1>(0,0) = sqWci*dYsp.template block<M,NP-1>(0,1);
+				devZ.template block<M,M>(0,NP-1) = sqrtR;
+
+				openAHRS::util::triangularize( devZ, Szz );
+
+				dz = dYsp.template block<M,1>(0,0);
+				if ( !openAHRS::util::choleskyUpdate( Szz, dz, UKF_Wc0 ) )
+				{
+					/* round-off in the downdate, factor the whole Pzz instead */
+					openAHRS::util::weightedCovariance( dYsp, UKF_Wc0, UKF_Wci, Pzz );
+					Pzz += R;
+					openAHRS::util::choleskyFactor( Pzz, Szz );
+
+					for (int j=0; j < M; j++)
+						if ( !(Szz(j,j) > 0) ) {
+							innovationError( Pzz );
+							return;
+						}
+				}
+
+				openAHRS::util::choleskySolveRight( Szz, Pxz, K );
+
+				X += K*( inData - Y );
+
+				/* P = P - (K*Szz)*(K*Szz)' */
+				Matrix<FT,L,M>	U = K*Szz;
+				Matrix<FT,L,1>	u;
+				Matrix<FT,L,L>	S_bak = S;
+				for (int j=0; j < M; j++) {
+					u = U.template block<L,1>(0,j);
+					if ( !openAHRS::util::choleskyUpdate( S, u, -1 ) ) {
+						factorError( S_bak );
+						break;
+					}
+				}
+
+				return;
+			}
+
+			openAHRS::util::weightedCovariance( dYsp, UKF_Wc0, UKF_Wci, Pzz );
 			Pzz += R;
-			
-			Pxz	+= UKF_Wc0*( SP.template block<L,1>(0,0) - X ) * (Ysp. template block<M,1>(0,0) - Y).transpose();
 
 			Pzz.computeInverse( &Pzz_inv );
 			K = Pxz * Pzz_inv;
@@ -203,86 +433,212 @@ public:
 
 	}
 
-	/** 
-	 * Kalman - Predict state 
-	 *
-	 * @param iter			Current iteration number, only for testing purposes.
-	 * @param inPred		Measurements for prediction
-	 * @param dt			Time between consecutive kalman updates
+	/**
+	 * Sequential update: z is conditioned on one component j at a time, each
+	 * one a scalar update with s = Pzz(j,j) + R(j,j). The innovations, Pzz and
+	 * Pxz of the remaining components are conditioned on z(j) as well, so the
+	 * result is the same as the full update for a diagonal R.
 	 *
+	 * @param e			Innovation, inData - Y
+	 * @param Pxz		Cross covariance, overwritten
+	 * @param axisMask	Components to use
 	 */
-	void	KalmanPredict( int iter, const Matrix<FT,N,1> &inPred, FT dt )
+	void	updateSequential( Matrix<FT,M,1> e, Matrix<FT,L,M> &Pxz, unsigned int axisMask )
 	{
-		recalculateSigmaPoints();
-		
-		/* Project sigma points through h */
-		for (int i=0; i < 2*L+1; i++) {
-			Xsp.template block<L,1>(0,i) = filterData.predictState( SP.template block<L,1>(0,i), inPred, dt );
-		}
+		Matrix<FT,M,M>	Pzz;
+		Matrix<FT,M,1>	pz;
+		Matrix<FT,L,1>	px;
+
+		openAHRS::util::weightedCovariance( dYsp, UKF_Wc0, UKF_Wci, Pzz );
+
+		for (int j=0; j < M; j++)
+		{
+			if ( !(axisMask & (1u << j)) )
+				continue;
+
+			FT	s = Pzz(j,j) + R(j,j);
+			if ( !(s > 0) )
+				continue;
+
+			pz = Pzz.template block<M,1>(0,j);
+			px = Pxz.template block<L,1>(0,j);
 
-		/* Weight sigma points */
-		X = UKF_Ws0 * Xsp.template block<L,1>(0,0);
-		for (int i=1; i < 2*L+1; i++) {
-			X += UKF_Wsi * Xsp.template block<L,1>(0,i);
+			X += px*( e(j)/s );
+			e -= pz*( e(j)/s );
+
+			Pzz -= pz*pz.transpose()/s;
+			Pxz -= px*pz.transpose()/s;
+
+			/* P = P - px*px'/s */
+			if ( squareRoot )
+			{
+				Matrix<FT,L,L>	S_bak = S;
+				if ( !openAHRS::util::choleskyUpdate( S, px, -1/s ) )
+					factorError( S_bak );
+			}
+			else
+				P -= px*px.transpose()/s;
 		}
+	}
 
-		/** Calculate P **/
-		/** TODO: optimize */
-		P.setZero();
+	/**
+	 * Prediction. If noiseFirst is true Q is added before drawing the sigma points
+	 * and the propagated points are kept for the next update.
+	 */
+	void	predict( const Matrix<FT,N,1> &inPred, FT dt, bool noiseFirst )
+	{
+		recalculateSigmaPoints( noiseFirst );
 		
-		for (int i=1; i < 2*L + 1; i++)
-			P += UKF_Wci*( Xsp.template block<L,1>(0,i) - X ) * ( Xsp.template block<L,1>(0,i) - X ).transpose();
+		/* Project sigma points through f, in one call if T provides predictStateBatch() */
+		openAHRS::UKFPredictCall< openAHRS::UKFHasPredictBatch<T,L,N,NP>::value >::call( filterData, SP, inPred, Xsp, dt );
 
-		//P *= UKF_Wci;
-		P += UKF_Wc0 * ( Xsp.template block<L,1>(0,0) - X ) * ( Xsp.template block<L,1>(0,0) - X ).transpose();
-		
-		P += Q;
+		/* Weight sigma points, relative to the central one (see KalmanUpdate) */
+		X.setZero();
+		for (int i=1; i < NP; i++) {
+			X += Xsp.template block<L,1>(0,i) - Xsp.template block<L,1>(0,0);
+		}
+		X *= UKF_Wsi;
+		X += Xsp.template block<L,1>(0,0);
 
+		/* Centred deviations */
+		for (int i=0; i < NP; i++)
+			dXsp.template block<L,1>(0,i) = Xsp.template block<L,1>(0,i) - X;
 
-	}
+		haveXsp = noiseFirst;
 
+		if ( squareRoot )
+		{
+			/** Square-root form: S = tria( [ sqrt(Wci)*(Xsp_i - X), sqrt(Q) ] ), then Wc0 update **/
+			Matrix<FT,L,1>		dx;
+			FT	sqWci = sqrt( UKF_Wci );
 
+			if ( noiseFirst )
+			{
+				/* Q is already in the spread of the points */
+				Matrix<FT,L,NP-1>	devX;
+				devX = sqWci*dXsp.template block<L,NP-1>(0,1);
 
-private:
-	/** Recalcs sigma points for filtering */
-	void	recalculateSigmaPoints() 
+				openAHRS::util::triangularize( devX, S );
+			}
+			else
+			{
+				Matrix<FT,L,NP-1 + L>	devX;
+				devX.template block<L,NP-1>(0,0) = sqWci*dXsp.template block<L,NP-1>(0,1);
+				devX.template block<L,L>(0,NP-1) = sqrtQ;
+
+				openAHRS::util::triangularize( devX, S );
+			}
+
+			dx = dXsp.template block<L,1>(0,0);
+			Matrix<FT,L,L>	S_bak = S;
+			if ( !openAHRS::util::choleskyUpdate( S, dx, UKF_Wc0 ) )
+				factorError( S_bak );
+
+			return;
+		}
+
+		/** Calculate P = D*W*D' + Q **/
+		openAHRS::util::weightedCovariance( dXsp, UKF_Wc0, UKF_Wci, P );
+		if ( !noiseFirst )
+			P += Q;
+	}
+
+	/** Weights for the current alpha, beta, kappa */
+	void	calcWeights()
 	{
-		
-	#if 0
-		Matrix<FT,L,L>	temp;
-		temp = (L+UKF_lambda)*P;
-		
-		sqMatrix = temp.llt().matrixL();
-	#else
+		SigmaSet<L>::weights( UKF_alpha, UKF_beta, UKF_kappa,
+								UKF_Ws0, UKF_Wc0, UKF_Wsi, UKF_Wci, sqWeight );
+	}
+
+	/**
+	 * Recalcs sigma points for filtering
+	 *
+	 * @param addQ	Draw them from P+Q instead of P
+	 */
+	void	recalculateSigmaPoints( bool addQ ) 
+	{
+		Matrix<FT,L,L>	Pd = P;
+
+		if ( squareRoot )
+		{
+			if ( addQ ) {
+				/* factor of S*S' + Q, by rank-1 updates with the columns of sqrt(Q).
+				 * Column j starts at row j, so this is cheap (and trivial for a diagonal Q) */
+				Matrix<FT,L,1>	q;
+				sqMatrix = S;
+				for (int j=0; j < L; j++) {
+					q = sqrtQ.template block<L,1>(0,j);
+					if ( !openAHRS::util::choleskyUpdate( sqMatrix, q, 1 ) ) {
+						/* zero pivot in S, do it the long way */
+						Matrix<FT,L,2*L>	SQ;
+						SQ.template block<L,L>(0,0) = S;
+						SQ.template block<L,L>(0,L) = sqrtQ;
+						openAHRS::util::triangularize( SQ, sqMatrix );
+						break;
+					}
+				}
+			}
+			else
+				sqMatrix = S;
+		}
+		else
+		{
+			if ( addQ )
+				Pd += Q;
+
 		#if 1
 			Matrix<FT,L,L> temp;
-			temp = 16384*P;			// scaling - is this neccesary?
-			sqMatrix = temp.llt().matrixL()*sqWeight/128;
+			temp = 16384*Pd;			// scaling - is this neccesary?
+			sqMatrix = temp.llt().matrixL();
+			sqMatrix /= 128;
 		#else
-			sqMatrix	= sqWeight*P.llt().matrixL();
+			sqMatrix	= Pd.llt().matrixL();
 		#endif
-	#endif
+		}
 
-			/** Calculate sigma points **/
-			SP.template block<L,1>(0,0)	= X;
-			
-			if ( checkForPositiveDefinite )
+			if ( checkForPositiveDefinite && !squareRoot )
 			{
-				if ( !P.llt().isPositiveDefinite() ) {
+				if ( !Pd.llt().isPositiveDefinite() ) {
 					printf("Err positive def\n");
-					std::cout << P << std::endl;
+					std::cout << Pd << std::endl;
 					exit(-1);
 				}
 			}
 
-			for (int i=1; i < L+1; i++) {
-				SP.template block<L,1>(0,i) = X + sqMatrix.template block<L,1>(0,i-1);
-			}
-			for (int i=L+1; i < 2*L + 1; i++) {
-				SP.template block<L,1>(0,i) = X - sqMatrix.template block<L,1>(0,i-L-1);
-			}
+			/** Calculate sigma points **/
+			SigmaSet<L>::generate( X, sqMatrix, sqWeight, SP );
 	}
 	
+	/**
+	 * Square-root mode: a downdate would make P indefinite (round-off, float).
+	 * Stop like the non square-root path does if checks are enabled, otherwise
+	 * keep the previous (larger, so conservative) factor.
+	 */
+	void	factorError( const Matrix<FT,L,L> &S_bak )
+	{
+		if ( checkForPositiveDefinite ) {
+			printf("Err positive def\n");
+			std::cout << S*S.transpose() << std::endl;
+			exit(-1);
+		}
+
+		S = S_bak;
+	}
+
+	/**
+	 * Square-root mode: the innovation covariance is not positive definite,
+	 * so there is no gain to compute. Stop if checks are enabled, as for P,
+	 * otherwise the measurement is left out.
+	 */
+	void	innovationError( const Matrix<FT,M,M> &Pzz )
+	{
+		if ( checkForPositiveDefinite ) {
+			printf("Err positive def\n");
+			std::cout << Pzz << std::endl;
+			exit(-1);
+		}
+	}
+
 public:
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
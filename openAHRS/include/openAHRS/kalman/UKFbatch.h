@@ -0,0 +1,159 @@
+#ifndef _oukf_batch_h_
+#define	_oukf_batch_h_
+
+/*
+ *  Sigma point model callbacks for the UKF template, per point or batched.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+/**
+ * A model policy T may provide, besides (or instead of) measure() and
+ * predictState(), the batch forms that process all the K sigma points at once:
+ *
+ *	void measureBatch( const Matrix<FT,L,K> &sp, Matrix<FT,M,K> &out, FT dt )
+ *
+ *	void predictStateBatch( const Matrix<FT,L,K> &sp, const Matrix<FT,N,1> &data,
+ *							Matrix<FT,L,K> &out, FT dt )
+ *
+ * Column i of out must hold the result for column i of sp. They can be static
+ * or (const) member functions, or function templates on K
+ * (template <int K> void measureBatch(...), static or not), so that one model works
+ * with any sigma point set. If the exact signature is found it is used,
+ * otherwise the UKF falls back to calling the per point form K times.
+ */
+
+namespace openAHRS {
+
+	typedef char	UKFBatchYes[1];
+	typedef char	UKFBatchNo[2];
+
+	/** true if T has measureBatch() with the signature above */
+	template <class T, int L, int M, int K>
+	struct	UKFHasMeasureBatch
+	{
+		typedef void (*StaticFn)( const Matrix<FT,L,K> &, Matrix<FT,M,K> &, FT );
+		typedef void (T::*MemberFn)( const Matrix<FT,L,K> &, Matrix<FT,M,K> &, FT );
+		typedef void (T::*ConstMemberFn)( const Matrix<FT,L,K> &, Matrix<FT,M,K> &, FT ) const;
+
+		template <class U, StaticFn>		struct	CheckS {};
+		template <class U, MemberFn>		struct	CheckM {};
+		template <class U, ConstMemberFn>	struct	CheckC {};
+
+		template <class U> static UKFBatchYes &	testS( CheckS<U, &U::measureBatch> * );
+		template <class U> static UKFBatchNo &	testS( ... );
+		template <class U> static UKFBatchYes &	testM( CheckM<U, &U::measureBatch> * );
+		template <class U> static UKFBatchNo &	testM( ... );
+		template <class U> static UKFBatchYes &	testC( CheckC<U, &U::measureBatch> * );
+		template <class U> static UKFBatchNo &	testC( ... );
+		template <class U> static UKFBatchYes &	testT( CheckS<U, &U::template measureBatch<K> > * );
+		template <class U> static UKFBatchNo &	testT( ... );
+		template <class U> static UKFBatchYes &	testTM( CheckM<U, &U::template measureBatch<K> > * );
+		template <class U> static UKFBatchNo &	testTM( ... );
+
+		enum { value =	sizeof( testS<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testM<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testC<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testT<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testTM<T>(0) ) == sizeof(UKFBatchYes) };
+	};
+
+	/** true if T has predictStateBatch() with the signature above */
+	template <class T, int L, int N, int K>
+	struct	UKFHasPredictBatch
+	{
+		typedef void (*StaticFn)( const Matrix<FT,L,K> &, const Matrix<FT,N,1> &, Matrix<FT,L,K> &, FT );
+		typedef void (T::*MemberFn)( const Matrix<FT,L,K> &, const Matrix<FT,N,1> &, Matrix<FT,L,K> &, FT );
+		typedef void (T::*ConstMemberFn)( const Matrix<FT,L,K> &, const Matrix<FT,N,1> &, Matrix<FT,L,K> &, FT ) const;
+
+		template <class U, StaticFn>		struct	CheckS {};
+		template <class U, MemberFn>		struct	CheckM {};
+		template <class U, ConstMemberFn>	struct	CheckC {};
+
+		template <class U> static UKFBatchYes &	testS( CheckS<U, &U::predictStateBatch> * );
+		template <class U> static UKFBatchNo &	testS( ... );
+		template <class U> static UKFBatchYes &	testM( CheckM<U, &U::predictStateBatch> * );
+		template <class U> static UKFBatchNo &	testM( ... );
+		template <class U> static UKFBatchYes &	testC( CheckC<U, &U::predictStateBatch> * );
+		template <class U> static UKFBatchNo &	testC( ... );
+		template <class U> static UKFBatchYes &	testT( CheckS<U, &U::template predictStateBatch<K> > * );
+		template <class U> static UKFBatchNo &	testT( ... );
+		template <class U> static UKFBatchYes &	testTM( CheckM<U, &U::template predictStateBatch<K> > * );
+		template <class U> static UKFBatchNo &	testTM( ... );
+
+		enum { value =	sizeof( testS<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testM<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testC<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testT<T>(0) ) == sizeof(UKFBatchYes) ||
+						sizeof( testTM<T>(0) ) == sizeof(UKFBatchYes) };
+	};
+
+	/** Projection of all sigma points through h(), batched or per point */
+	template <bool batch>
+	struct	UKFMeasureCall
+	{
+		template <class T, int L, int M, int K>
+		static inline void	call( T &f, const Matrix<FT,L,K> &sp, Matrix<FT,M,K> &out, FT dt )
+		{
+			f.measureBatch( sp, out, dt );	/* also deduces K for a template */
+		}
+	};
+
+	template <>
+	struct	UKFMeasureCall<false>
+	{
+		template <class T, int L, int M, int K>
+		static inline void	call( T &f, const Matrix<FT,L,K> &sp, Matrix<FT,M,K> &out, FT dt )
+		{
+			for (int i=0; i < K; i++)
+				out.template block<M,1>(0,i) = f.measure( sp.template block<L,1>(0,i), dt );
+		}
+	};
+
+	/** Projection of all sigma points through f(), batched or per point */
+	template <bool batch>
+	struct	UKFPredictCall
+	{
+		template <class T, int L, int N, int K>
+		static inline void	call( T &f, const Matrix<FT,L,K> &sp, const Matrix<FT,N,1> &data,
+									Matrix<FT,L,K> &out, FT dt )
+		{
+			f.predictStateBatch( sp, data, out, dt );
+		}
+	};
+
+	template <>
+	struct	UKFPredictCall<false>
+	{
+		template <class T, int L, int N, int K>
+		static inline void	call( T &f, const Matrix<FT,L,K> &sp, const Matrix<FT,N,1> &data,
+									Matrix<FT,L,K> &out, FT dt )
+		{
+			for (int i=0; i < K; i++)
+				out.template block<L,1>(0,i) = f.predictState( sp.template block<L,1>(0,i), data, dt );
+		}
+	};
+
+};
+
+#endif	/* _oukf_batch_h_ */
@@ -0,0 +1,172 @@
+#ifndef _oukf_sigma_h_
+#define	_oukf_sigma_h_
+
+/*
+ *  Sigma point sets for the UKF template.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <math.h>
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+/**
+ * A sigma point set is a class template on the number of states L that provides:
+ *
+ *	enum { K = ... }	number of points
+ *
+ *	static void weights( FT alpha, FT beta, FT kappa,
+ *						 FT &Ws0, FT &Wc0, FT &Wsi, FT &Wci, FT &spread )
+ *		Mean and covariance weights of point 0 (Ws0, Wc0) and of the rest (Wsi, Wci),
+ *		which must add up to 1 (Ws0 + (K-1)*Wsi = 1), and the scale of the points.
+ *
+ *	static void generate( const Matrix<FT,L,1> &X, const Matrix<FT,L,L> &S, FT spread,
+ *						  Matrix<FT,L,K> &SP )
+ *		Fills the K points for mean X and covariance S*S'.
+ *
+ * Every set here has the same weight on all points but the first, so the UKF
+ * can keep building its covariances as D*W*D' (see util/covariance.h).
+ */
+
+namespace openAHRS {
+
+	/**
+	 * Symmetric set, 2L+1 points: X, X +/- sqrt(L+lambda)*S(:,i).
+	 * Scaled unscented transform with alpha, beta, kappa. This is the default.
+	 */
+	template <int L>
+	struct	UKFSymmetricSet
+	{
+		enum { K = 2*L + 1 };
+
+		static void	weights( FT alpha, FT beta, FT kappa,
+								FT &Ws0, FT &Wc0, FT &Wsi, FT &Wci, FT &spread )
+		{
+			FT	lambda	= alpha*alpha*(L + kappa) - L;
+
+			Ws0		= lambda/(L + lambda);
+			Wc0		= Ws0 + ( 1.0 - alpha*alpha + beta );
+			Wsi		= 1.0/((double)2.0*(L + lambda));
+			Wci		= Wsi;
+			spread	= sqrt( L + lambda );
+		}
+
+		static void	generate( const Matrix<FT,L,1> &X, const Matrix<FT,L,L> &S, FT spread,
+								Matrix<FT,L,K> &SP )
+		{
+			Matrix<FT,L,1>	d;
+
+			SP.template block<L,1>(0,0) = X;
+			for (int i=0; i < L; i++) {
+				d = spread*S.template block<L,1>(0,i);
+				SP.template block<L,1>(0,i+1)	= X + d;
+				SP.template block<L,1>(0,i+1+L)	= X - d;
+			}
+		}
+	};
+
+	/**
+	 * Spherical simplex set (Julier), L+2 points: X plus L+1 points on a
+	 * hypersphere, all with the same weight. Scaled with alpha and beta as the
+	 * symmetric set, with a zero base weight on the central point (kappa is not used).
+	 */
+	template <int L>
+	struct	UKFSimplexSet
+	{
+		enum { K = L + 2 };
+
+		static void	weights( FT alpha, FT beta, FT kappa,
+								FT &Ws0, FT &Wc0, FT &Wsi, FT &Wci, FT &spread )
+		{
+			FT	W1 = 1.0/(L + 1);	/* base weight, W0 = 0 */
+
+			Ws0		= 1 - 1/(alpha*alpha);
+			Wc0		= Ws0 + ( 1.0 - alpha*alpha + beta );
+			Wsi		= W1/(alpha*alpha);
+			Wci		= Wsi;
+			spread	= alpha/sqrt(W1);
+		}
+
+		/**
+		 * Unit point i (1..L+1) has component j (1..L)
+		 *	-1/sqrt(j*(j+1))	if i <= j
+		 *	 j/sqrt(j*(j+1))	if i == j+1
+		 *	 0					otherwise
+		 * so with v_j = S(:,j)/sqrt(j*(j+1)) point i is (i-1)*v_(i-1) - sum(v_j, j >= i),
+		 * built from the suffix sums in O(L^2).
+		 */
+		static void	generate( const Matrix<FT,L,1> &X, const Matrix<FT,L,L> &S, FT spread,
+								Matrix<FT,L,K> &SP )
+		{
+			Matrix<FT,L,L>	V;
+			Matrix<FT,L,1>	tail;
+
+			for (int j=1; j <= L; j++)
+				V.template block<L,1>(0,j-1) = S.template block<L,1>(0,j-1)*( spread/sqrt( FT(j*(j+1)) ) );
+
+			SP.template block<L,1>(0,0) = X;
+
+			tail.setZero();
+			for (int i=L+1; i >= 1; i--)
+			{
+				if ( i <= L )
+					tail += V.template block<L,1>(0,i-1);
+
+				SP.template block<L,1>(0,i) = X - tail;
+				if ( i >= 2 )
+					SP.template block<L,1>(0,i) += (i-1)*V.template block<L,1>(0,i-2);
+			}
+		}
+	};
+
+	/**
+	 * Spherical-radial cubature set, 2L points X +/- sqrt(L)*S(:,i), all with
+	 * weight 1/2L. There is no central point and no negative weight, so the
+	 * covariance weights are always positive. alpha, beta and kappa are not used.
+	 */
+	template <int L>
+	struct	UKFCubatureSet
+	{
+		enum { K = 2*L };
+
+		static void	weights( FT alpha, FT beta, FT kappa,
+								FT &Ws0, FT &Wc0, FT &Wsi, FT &Wci, FT &spread )
+		{
+			Ws0 = Wc0 = Wsi = Wci = 1.0/(2*L);
+			spread	= sqrt( FT(L) );
+		}
+
+		static void	generate( const Matrix<FT,L,1> &X, const Matrix<FT,L,L> &S, FT spread,
+								Matrix<FT,L,K> &SP )
+		{
+			Matrix<FT,L,1>	d;
+
+			for (int i=0; i < L; i++) {
+				d = spread*S.template block<L,1>(0,i);
+				SP.template block<L,1>(0,i)		= X + d;
+				SP.template block<L,1>(0,i+L)	= X - d;
+			}
+		}
+	};
+
+};
+
+#endif	/* _oukf_sigma_h_ */
@@ -26,9 +26,30 @@
 
 #include <openAHRS/kalman/UKF.h>
 #include <openAHRS/util/util.h>
+#include <openAHRS/util/quatkernel.h>
 
 USING_PART_OF_NAMESPACE_EIGEN
 
+/** set to 1 to use the square-root form of the UKF (recommended for FT=float, about a third slower, see UKF.h) */
+#ifndef	UKFST7_SQUARE_ROOT
+	#define	UKFST7_SQUARE_ROOT	0
+#endif
+
+/** sigma point set, see UKFsigma.h */
+#ifndef	UKFST7_SIGMA_SET
+	#define	UKFST7_SIGMA_SET	openAHRS::UKFSymmetricSet
+#endif
+
+/** set to 1 to reuse the predicted sigma points in the update (see UKF::setSigmaPointReuse()) */
+#ifndef	UKFST7_REUSE_SIGMA_POINTS
+	#define	UKFST7_REUSE_SIGMA_POINTS	0
+#endif
+
+/** set to 1 to process the three angles as sequential scalar updates (see UKF::setSequentialUpdate()) */
+#ifndef	UKFST7_SEQUENTIAL_UPDATE
+	#define	UKFST7_SEQUENTIAL_UPDATE	0
+#endif
+
 namespace openAHRS { 
 
 struct UKFst7_Funcs
@@ -41,25 +62,16 @@ struct UKFst7_Funcs
 	*/
 	static inline Matrix<FT,7,1>  predictState( const Matrix<FT,7,1> &state, const Matrix<FT,3,1> &gyros, FT dt )
 	{
-		// TODO: optimize
-		Matrix<FT,4,1>	quat = state.block<4,1>(0,0);
-		Matrix<FT,7,1>	ret;
-		
-		
-	//	quat.normalize();	//=> this shouldn't be neccessary
-		
-		FT	p = gyros(0) - state(4);
-		FT	q = gyros(1) - state(5);
-		FT	r = gyros(2) - state(6);
+		Matrix<FT,7,1>	ret = state;
+		Matrix<FT,3,1>	w;
 
-		/* New quaternion estimate */
-		ret.block<4,1>(0,0) = quat + util::calcQOmega( p, q, r )*quat*(dt/2);
-		ret(4) = state(4);
-		ret(5) = state(5);
-		ret(6) = state(6);
+		w	<< gyros(0) - state(4), gyros(1) - state(5), gyros(2) - state(6);
+
+		/* New quaternion estimate, bias estimates are untouched */
+		quat::quatIntegrate( ret.data(), w.data(), dt );
 
 		//renormalize quaternion
-		ret.block<4,1>(0,0) /= ret.block<4,1>(0,0).norm();
+		quat::quatNormalize( ret.data() );
 
 		return ret;
 	}
@@ -70,6 +82,78 @@ struct UKFst7_Funcs
 		//return	util::quatToEuler(temp);
 		return	util::quatToEulerNorm( temp );
 	}
+
+	/**
+	 * Batch versions of the above, used by the UKF for all the K sigma points at once.
+	 * Each state component is first gathered into its own array (structure of
+	 * arrays), so that the loops below run over contiguous data with no
+	 * dependencies between points and the compiler can vectorize them.
+	 */
+	template <int K>
+	static inline void	predictStateBatch( const Matrix<FT,7,K> &sp, const Matrix<FT,3,1> &gyros,
+											Matrix<FT,7,K> &out, FT dt )
+	{
+		FT	q0[K], q1[K], q2[K], q3[K];
+		FT	p[K], q[K], r[K];
+		const FT	h = dt/2;
+
+		for (int i=0; i < K; i++) {
+			q0[i] = sp(0,i);	q1[i] = sp(1,i);	q2[i] = sp(2,i);	q3[i] = sp(3,i);
+			p[i] = (gyros(0) - sp(4,i))*h;
+			q[i] = (gyros(1) - sp(5,i))*h;
+			r[i] = (gyros(2) - sp(6,i))*h;
+		}
+
+		/* quat + calcQOmega(p,q,r)*quat*(dt/2), expanded */
+		FT	n0[K], n1[K], n2[K], n3[K];
+		for (int i=0; i < K; i++) {
+			n0[i] = q0[i] - p[i]*q1[i] - q[i]*q2[i] - r[i]*q3[i];
+			n1[i] = q1[i] + p[i]*q0[i] + r[i]*q2[i] - q[i]*q3[i];
+			n2[i] = q2[i] + q[i]*q0[i] - r[i]*q1[i] + p[i]*q3[i];
+			n3[i] = q3[i] + r[i]*q0[i] + q[i]*q1[i] - p[i]*q2[i];
+		}
+
+		/* renormalize quaternion */
+		for (int i=0; i < K; i++) {
+			FT	inv = 1/sqrt( n0[i]*n0[i] + n1[i]*n1[i] + n2[i]*n2[i] + n3[i]*n3[i] );
+			n0[i] *= inv;	n1[i] *= inv;	n2[i] *= inv;	n3[i] *= inv;
+		}
+
+		for (int i=0; i < K; i++) {
+			out(0,i) = n0[i];	out(1,i) = n1[i];	out(2,i) = n2[i];	out(3,i) = n3[i];
+			out(4,i) = sp(4,i);	out(5,i) = sp(5,i);	out(6,i) = sp(6,i);
+		}
+	}
+
+	template <int K>
+	static inline void	measureBatch( const Matrix<FT,7,K> &sp, Matrix<FT,3,K> &out, FT dt )
+	{
+		FT	q0[K], q1[K], q2[K], q3[K];
+
+		/* same as quatToEulerNorm() */
+		for (int i=0; i < K; i++) {
+			FT	inv = 1/sqrt( sp(0,i)*sp(0,i) + sp(1,i)*sp(1,i) + sp(2,i)*sp(2,i) + sp(3,i)*sp(3,i) );
+			q0[i] = sp(0,i)*inv;	q1[i] = sp(1,i)*inv;	q2[i] = sp(2,i)*inv;	q3[i] = sp(3,i)*inv;
+		}
+
+		FT	ry[K], rx[K], sn[K], yy[K], yx[K];
+		for (int i=0; i < K; i++) {
+			ry[i] = 2*(q0[i]*q1[i] + q2[i]*q3[i]);
+			rx[i] = 1 - 2*(q1[i]*q1[i] + q2[i]*q2[i]);
+			sn[i] = 2*(q1[i]*q3[i] - q0[i]*q2[i]);
+			yy[i] = 2*(q0[i]*q3[i] + q1[i]*q2[i]);
+			yx[i] = 1 - 2*(q2[i]*q2[i] + q3[i]*q3[i]);
+
+			if ( sn[i] > 1 )	sn[i] = 1;
+			if ( sn[i] < -1 )	sn[i] = -1;
+		}
+
+		for (int i=0; i < K; i++) {
+			out(0,i) = fmath::atan2( ry[i], rx[i] );
+			out(1,i) = -fmath::asin( sn[i] );
+			out(2,i) = fmath::atan2( yy[i], yx[i] );
+		}
+	}
 };
 
 class UKFst7
@@ -81,13 +165,18 @@ public:
 		N = 3,	/* intermediate for prediction */
 	};
 private:
-	UKF< UKFst7_Funcs, L, M, N, false >	estimator;
+	UKF< UKFst7_Funcs, L, M, N, false, UKFST7_SQUARE_ROOT, UKFST7_SIGMA_SET >	estimator;
 
 public:
 		void	getStateVector( Matrix<FT,L,1> &v ) {
 			estimator.getStateVector(v);
 		}
 
+		/** replace the covariance matrix, after KalmanInit() */
+		void	setCovarianceMatrix( const Matrix<FT,L,L> &p ) {
+			estimator.setCovarianceMatrix(p);
+		}
+
 public:
 	UKFst7() 
 	{	/* simple, nearly do-nothing constructor */
@@ -116,6 +205,8 @@ public:
 		Matrix<FT,L,1>	X;
 
 		estimator.KalmanInit();
+		estimator.setSigmaPointReuse( UKFST7_REUSE_SIGMA_POINTS );
+		estimator.setSequentialUpdate( UKFST7_SEQUENTIAL_UPDATE );
 
 		R.setIdentity();
 		R	*= meas_var;
@@ -153,6 +244,20 @@ public:
 			estimator.printMatrices();
 	}
 
+	/**
+	 * Kalman - Update state with some of the angles only
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles (calculated from accel data).
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param axisMask	Bit i set to use angles(i), e.g. 0x3 to skip yaw
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask )
+	{
+		estimator.KalmanUpdate( iter, angles, dt, axisMask );
+	}
+
 	/** 
 	 * Kalman - Predict state 
 	 *
@@ -166,6 +271,21 @@ public:
 		estimator.KalmanPredict( iter, gyros, dt );
 	}
 
+	/**
+	 * Kalman - Predict with the gyros, then update with the measured angles,
+	 * drawing the sigma points only once.
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param gyros			Current measured gyro rate, including biases
+	 * @param angles		Current measured angles (calculated from accel data).
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanStep( int iter, const Matrix<FT,3,1> &gyros, const Matrix<FT,3,1> &angles, FT dt )
+	{
+		estimator.KalmanStep( iter, gyros, angles, dt );
+	}
+
 
 	public:
 		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -0,0 +1,269 @@
+/*
+ *  UKF Kalman Filter for gyro, accelerometer and magnetometer processing
+ *	Position and gyro bias tracking, gravity and magnetic field vectors
+ *	as measurements.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef __ukf_st7v_h_
+#define	__ukf_st7v_h_
+
+#include <openAHRS/kalman/UKFst7.h>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+namespace openAHRS {
+
+/**
+ * Same process model as UKFst7_Funcs, but the measurement is
+ * [ gravity ; magnetic field ], both unit vectors in body coordinates
+ * (see util::accelToVector() and util::magnToVector()), instead of the
+ * euler angles. h() is C(q)'*ref for each reference: multiplies and adds
+ * only, and nothing to wrap around +-pi. magRef is set for every update,
+ * see util::magnReference().
+ */
+struct UKFst7v_Funcs : public UKFst7_Funcs
+{
+	Matrix<FT,3,1>	magRef;		/* earth-fixed magnetic field direction */
+
+	UKFst7v_Funcs()
+	{
+		magRef	<< 1, 0, 0;
+	}
+
+	inline Matrix<FT,6,1>	measure( const Matrix<FT, 7, 1> &state, FT dt ) const
+	{
+		Matrix<FT,7,1>	sp	= state;
+		Matrix<FT,6,1>	out;
+		measureBatch<1>( sp, out, dt );
+		return out;
+	}
+
+	/**
+	 * Quaternions of the sigma points are not normalized, the quadratic
+	 * form is divided by |q|^2 instead, which makes it exact for any norm.
+	 */
+	template <int K>
+	inline void	measureBatch( const Matrix<FT,7,K> &sp, Matrix<FT,6,K> &out, FT dt ) const
+	{
+		const FT	r0 = magRef(0), r1 = magRef(1), r2 = magRef(2);
+
+		for (int i=0; i < K; i++)
+		{
+			FT	q0 = sp(0,i), q1 = sp(1,i), q2 = sp(2,i), q3 = sp(3,i);
+			FT	inv	= 1/( q0*q0 + q1*q1 + q2*q2 + q3*q3 );
+
+			/* C(q)' entries */
+			FT	c00 = q0*q0 + q1*q1 - q2*q2 - q3*q3;
+			FT	c11 = q0*q0 - q1*q1 + q2*q2 - q3*q3;
+			FT	c22 = q0*q0 - q1*q1 - q2*q2 + q3*q3;
+			FT	c01 = 2*(q1*q2 + q0*q3),	c10 = 2*(q1*q2 - q0*q3);
+			FT	c02 = 2*(q1*q3 - q0*q2),	c20 = 2*(q1*q3 + q0*q2);
+			FT	c12 = 2*(q2*q3 + q0*q1),	c21 = 2*(q2*q3 - q0*q1);
+
+			/* gravity, [0 0 1]' */
+			out(0,i)	= c02*inv;
+			out(1,i)	= c12*inv;
+			out(2,i)	= c22*inv;
+
+			out(3,i)	= ( c00*r0 + c01*r1 + c02*r2 )*inv;
+			out(4,i)	= ( c10*r0 + c11*r1 + c12*r2 )*inv;
+			out(5,i)	= ( c20*r0 + c21*r1 + c22*r2 )*inv;
+		}
+	}
+};
+
+class UKFst7v
+{
+public:
+	enum {
+		L = 7,	/* order, states */
+		M = 6,	/* inputs */
+		N = 3,	/* intermediate for prediction */
+	};
+private:
+	UKF< UKFst7v_Funcs, L, M, N, false, UKFST7_SQUARE_ROOT, UKFST7_SIGMA_SET >	estimator;
+
+public:
+		void	getStateVector( Matrix<FT,L,1> &v ) {
+			estimator.getStateVector(v);
+		}
+
+		/** replace the covariance matrix, after KalmanInit() */
+		void	setCovarianceMatrix( const Matrix<FT,L,L> &p ) {
+			estimator.setCovarianceMatrix(p);
+		}
+
+public:
+	UKFst7v()
+	{	/* simple, nearly do-nothing constructor */
+	}
+
+
+	/**
+	 * Init kalman variables and state, as UKFst7::KalmanInit().
+	 *
+	 * @param startAngle	Initial angle estimate		[roll,pitch,yaw]'
+	 * @param startBias		Initial gyro bias estimate	[biasP,biasQ,biasR]'
+	 * @param meas_variance	Measurement variance, of each unit vector component
+	 * @param process_bias_var	variance for the process bias estimate
+	 * @param process_quat_var	variance for the quaternion estimate
+	 */
+	void	KalmanInit( Matrix<FT,3,1> &startAngle,
+						Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var )
+	{
+		/* temp matrices */
+		Matrix<FT,L,L>	Q;
+		Matrix<FT,L,1>	X;
+
+		estimator.KalmanInit();
+		estimator.setSigmaPointReuse( UKFST7_REUSE_SIGMA_POINTS );
+		estimator.setSequentialUpdate( UKFST7_SEQUENTIAL_UPDATE );
+
+		setVectorVariance( meas_var, meas_var );
+
+		/** noise model covariance matrix  **/
+		Q.setIdentity();
+
+		Q		*= process_quat_var;
+		Q(4,4)	 = process_bias_var;
+		Q(5,5)	 = process_bias_var;
+		Q(6,6)	 = process_bias_var;
+
+
+		/** initial estimate and bias **/
+		X.block<4,1>(0,0)	= util::eulerToQuat( startAngle );
+		X.block<3,1>(4,0)	= startBias;
+
+		estimator.setStateVector( X );
+		estimator.setProcessCovariance( Q );
+	}
+
+	/**
+	 * Measurement variance of each unit vector component, see kalman7::setVectorVariance()
+	 */
+	void	setVectorVariance( FT accel_var, FT magn_var )
+	{
+		Matrix<FT,M,M>	R;
+		R.setZero();
+		for (int i=0; i < 3; i++) {
+			R(i,i)		= accel_var;
+			R(3+i,3+i)	= magn_var;
+		}
+		estimator.setMeasurementCovariance( R );
+	}
+
+	/**
+	 * Kalman - Update state with the gravity and magnetic field directions,
+	 * see kalman7::KalmanUpdateVectors()
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param accels	Accelerometer data, as passed to util::accelToPR()
+	 * @param magns		Calibrated magnetometer data, as passed to util::calcHeading()
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param vecMask	Bit 0 to use accels, bit 1 to use magns
+	 *
+	 */
+	void	KalmanUpdateVectors( int iter, const Matrix<FT,3,1> &accels,
+								const Matrix<FT,3,1> &magns, FT dt, unsigned int vecMask )
+	{
+		Matrix<FT,M,1>	z;
+		unsigned int	axisMask;
+
+		makeMeasurement( accels, magns, vecMask, z, axisMask );
+
+		if ( axisMask == 0x3f )
+			estimator.KalmanUpdate( iter, z, dt );
+		else
+			estimator.KalmanUpdate( iter, z, dt, axisMask );
+	}
+
+	/**
+	 * Kalman - Predict state
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param gyros			Current measured gyro rate, including biases
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanPredict( int iter, const Matrix<FT,3,1> &gyros, FT dt )
+	{
+		estimator.KalmanPredict( iter, gyros, dt );
+	}
+
+	/**
+	 * Kalman - Predict with the gyros, then update with both vectors,
+	 * drawing the sigma points only once.
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param gyros			Current measured gyro rate, including biases
+	 * @param accels		Accelerometer data
+	 * @param magns			Calibrated magnetometer data
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanStep( int iter, const Matrix<FT,3,1> &gyros, const Matrix<FT,3,1> &accels,
+						const Matrix<FT,3,1> &magns, FT dt )
+	{
+		Matrix<FT,M,1>	z;
+		unsigned int	axisMask;
+
+		makeMeasurement( accels, magns, 0x3, z, axisMask );
+		estimator.KalmanStep( iter, gyros, z, dt );
+	}
+
+private:
+	/** measurement vector and the UKF component mask for vecMask */
+	void	makeMeasurement( const Matrix<FT,3,1> &accels, const Matrix<FT,3,1> &magns,
+							unsigned int vecMask, Matrix<FT,M,1> &z, unsigned int &axisMask )
+	{
+		Matrix<FT,3,1>	v;
+
+		z.setZero();
+		axisMask = 0;
+
+		if ( vecMask & 0x1 ) {
+			util::accelToVector( accels, v );
+			z.start<3>()	= v;
+			axisMask		|= 0x07;
+		}
+		if ( vecMask & 0x2 ) {
+			util::magnToVector( magns, v );
+			z.end<3>()		= v;
+			axisMask		|= 0x38;
+
+			/* reference at the current tilt, see kalman7::KalmanUpdateVectors() */
+			Matrix<FT,L,1>	X;
+			estimator.getStateVector( X );
+			Matrix<FT,4,1>	q	= X.start<4>();
+			quat::quatNormalize( q.data() );
+			util::magnReference( q, v, estimator.getModel().magRef );
+		}
+	}
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+};
+
+};
+
+#endif	/* __ukf_st7v_h_ */
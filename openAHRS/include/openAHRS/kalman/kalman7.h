@@ -60,6 +60,91 @@ public:
 	 */
 	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt );
 
+	/**
+	 * Kalman - Update state with some of the angles only, one scalar update per axis.
+	 * Always sequential, see setSequentialUpdate().
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles (calculated from accel data).
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param axisMask	Bit i set to use angles(i), e.g. 0x3 to skip yaw when
+	 *					the magnetometer can't be trusted.
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask );
+
+	/**
+	 * Process the three angles as successive scalar updates instead of
+	 * inverting the 3x3 innovation covariance. Same result since R is diagonal,
+	 * but cheaper.
+	 */
+	inline void	setSequentialUpdate( bool seq ) { sequentialUpdate = seq; }
+
+	/**
+	 * Steady-state gain mode, off by default. Once the trace of P changes by
+	 * less than a relative tolerance over a number of consecutive updates
+	 * (see setSteadyStateLimits()), the gain of each axis from its last full
+	 * update is kept and P is frozen: KalmanPredict() only integrates the
+	 * quaternion and KalmanUpdate() only applies the cached gain, no
+	 * covariance work at all. Full propagation resumes, from the frozen P,
+	 * as soon as an innovation falls outside the gate or the bias corrected
+	 * angular rate exceeds its limit. Meant for a platform at rest or moving
+	 * slowly. KalmanUpdateVectors() always runs in full.
+	 */
+	inline void	setSteadyStateGain( bool on ) {
+		steadyEnabled = on;
+		if ( !on )
+			leaveSteadyState();
+	}
+
+	/**
+	 * Convergence test and gates of the steady-state gain mode.
+	 *
+	 * @param traceTol	Relative change of trace(P) between two full updates
+	 *					of the same axes taken as converged
+	 * @param cycles	Consecutive converged updates before the gain is frozen
+	 * @param innovGate	Largest innovation, in standard deviations of the
+	 *					innovation at the time the gain was frozen
+	 * @param rateGate	Largest bias corrected angular rate, rad/s
+	 */
+	inline void	setSteadyStateLimits( FT traceTol, int cycles, FT innovGate, FT rateGate ) {
+		steadyTol		= traceTol;
+		steadyCycles	= cycles;
+		steadyInnovGate	= innovGate;
+		steadyRateGate	= rateGate;
+	}
+
+	/** true while running on the cached gain, see setSteadyStateGain() */
+	inline bool	isSteadyState() { return steady; }
+
+	/**
+	 * Kalman - Update state with the gravity and magnetic field directions.
+	 * Alternative to the angle measurements: the normalized sensor vectors
+	 * are compared against the earth-fixed references rotated into the body
+	 * frame, so there are no trig calls and no angle wraparound. One scalar
+	 * update per vector component. The magnetic reference is taken from the
+	 * measurement itself at the current tilt (see util::magnReference()),
+	 * so the magnetometer corrects yaw only and no inclination is needed.
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param accels	Accelerometer data, as passed to util::accelToPR()
+	 * @param magns		Calibrated magnetometer data, as passed to util::calcHeading()
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param vecMask	Bit 0 to use accels, bit 1 to use magns
+	 *
+	 */
+	void	KalmanUpdateVectors( int iter, const Matrix<FT,3,1> &accels,
+								const Matrix<FT,3,1> &magns, FT dt, unsigned int vecMask );
+
+	/**
+	 * Measurement variance of each unit vector component for
+	 * KalmanUpdateVectors(). KalmanInit() sets both to meas_var.
+	 */
+	inline void	setVectorVariance( FT accel_var, FT magn_var ) {
+		accelVar = accel_var;
+		magnVar  = magn_var;
+	}
+
 	/** 
 	 * Kalman - Predict state 
 	 *
@@ -77,6 +162,17 @@ public:
 	/**
 	 * Public access to state vector
 	 */
+
+	inline void	getCovarianceMatrix( Matrix<FT,7,7> &p ) { p = P; }
+	/**
+	 * Public access to covariance matrix
+	 */
+
+	/**
+	 * Replace the covariance matrix, after KalmanInit(), to start with a
+	 * smaller bias variance when the bias is known from an earlier run
+	 */
+	inline void	setCovarianceMatrix( const Matrix<FT,7,7> &p ) { P = p; leaveSteadyState(); }
 private:
 	Matrix<FT,7,1>	X;	/* state vector */
 			/**
@@ -103,6 +199,27 @@ private:
 	/** measurement variance */
 	FT	meas_variance;
 
+	/** vector measurements, see KalmanUpdateVectors() */
+	FT	accelVar;
+	FT	magnVar;
+
+	bool	sequentialUpdate;	/* see setSequentialUpdate() */
+
+	/** steady-state gain mode, see setSteadyStateGain() */
+	bool			steadyEnabled;
+	bool			steady;			/* running on the cached gain */
+	int				steadyCount;	/* consecutive converged updates */
+	FT				lastTrace[8];	/* trace(P) after the last full update, per axis mask */
+	Matrix<FT,7,3>	Kss;			/* gain of each axis from its last full update */
+	Matrix<FT,3,1>	Sss;			/* and its innovation variance */
+	unsigned int	gainAxes;		/* axes with a cached gain */
+	bool			gainsJoint;		/* cached from a joint update, not scalar ones */
+
+	FT		steadyTol;
+	int		steadyCycles;
+	FT		steadyInnovGate;
+	FT		steadyRateGate;
+
 
 private:
 	/** 
@@ -128,6 +245,58 @@ private:
 	void	predictState( Matrix<FT,7,1> &X, 
 					const Matrix<FT,3,1> &gyros, FT dt );
 
+	/**
+	* Inverse of a symmetric 3x3 matrix by cofactors, from its lower triangle.
+	*
+	* @param S			Source matrix
+	* @param inv		Destination matrix, full
+	*/
+	void	invertSym3( const Matrix<FT,3,3> &S, Matrix<FT,3,3> &inv );
+
+	/**
+	* Copy the lower triangle of a symmetric matrix into the upper one.
+	* The predict/update kernels only compute the lower triangle of P.
+	*
+	* @param M			Source/destination matrix
+	*/
+	void	mirrorLower( Matrix<FT,7,7> &M );
+
+	/**
+	* One scalar measurement update, z = h*q + noise, linearized at X0.
+	* Reads and updates the lower triangle of P only, call mirrorLower() after the last one.
+	*
+	* @param h			Measurement row regarding quaternion state
+	* @param innov		Innovation at X0
+	* @param r			Measurement variance
+	* @param X0			State the innovation and h were calculated at
+	* @param axis		Angle the measurement is, to cache its gain, -1 for none
+	*/
+	void	scalarUpdate( const Matrix<FT,1,4> &h, FT innov, FT r,
+					const Matrix<FT,7,1> &X0, int axis );
+
+	/**
+	* Update with the cached gains, see setSteadyStateGain().
+	*
+	* @param angles		Measured angles
+	* @param axisMask	Axes to use
+	* @param joint		true for a joint update, false for sequential ones
+	* @return	false if the innovation gate was exceeded, or there is no
+	*			gain for these axes, and a full update is needed
+	*/
+	bool	steadyUpdate( const Matrix<FT,3,1> &angles, unsigned int axisMask, bool joint );
+
+	/**
+	* Convergence test after a full update, freezes the gain when it passes.
+	*
+	* @param axisMask	Axes the update used
+	*/
+	void	checkConvergence( unsigned int axisMask );
+
+	inline void	leaveSteadyState() {
+		steady		= false;
+		steadyCount	= 0;
+	}
+
 	public:
 		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
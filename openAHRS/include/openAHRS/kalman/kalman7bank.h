@@ -0,0 +1,445 @@
+/*
+ *  N independent kalman7 filters in structure-of-arrays layout,
+ *	advanced together by each predict/update call.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef __kalman7bank_h_
+#define	__kalman7bank_h_
+
+#include <iostream>
+#include <math.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/util/quatkernel.h>
+
+namespace openAHRS {
+
+/**
+ * N kalman7 filters, each element of state, covariance and gain stored as
+ * an array over the filters, x[n] for filter n. The covariance and gain
+ * algebra are then loops over n with no dependency between iterations,
+ * which the compiler vectorizes across filters: with N a multiple of the
+ * vector width (4 floats or 2 doubles for SSE, twice that for AVX) one call
+ * costs about what one kalman7 call does per vector of filters.
+ *
+ * Per filter, the arithmetic is the one in kalman7, in the same order, so
+ * the results are bit for bit those of N separate kalman7 instances, unless
+ * the compiler contracts multiply-adds into FMAs differently in the two
+ * (-ffp-contract=off rules it out). The nonlinear parts, quaternion
+ * integration and normalization, calcQMeas() and quatToEuler(), go through
+ * the same functions as kalman7, one filter at a time.
+ *
+ * Inputs are structure-of-arrays too, as the util batch conversions:
+ * gyros[k*N + n] is component k of filter n, same for angles.
+ *
+ * The object holds about 230*N FT's, allocate it with new for large N.
+ * KalmanUpdateVectors() has no bank version.
+ */
+template <int N>
+class kalman7Bank
+{
+public:
+	kalman7Bank()
+	{
+		sequentialUpdate	= false;
+		for (int n=0; n < N; n++)
+			r[n]	= 0.01;		//just to initialize it
+	}
+
+	/**
+	 * Init filter n, as kalman7::KalmanInit().
+	 * The filters can be given different tunings.
+	 *
+	 * @param n				Filter index, 0..N-1
+	 * @param startAngle	Initial angle estimate		[roll,pitch,yaw]'
+	 * @param startBias		Initial gyro bias estimate	[biasP,biasQ,biasR]'
+	 * @param meas_var		Measurement variance.
+	 * @param process_bias_var	variance for the process bias estimate
+	 * @param process_quat_var	variance for the quaternion estimate
+	 */
+	void	KalmanInit( int n, Matrix<FT,3,1> &startAngle,
+						Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var )
+	{
+		r[n]	= meas_var;
+		wq[n]	= process_quat_var;
+		wb[n]	= process_bias_var;
+
+		for (int c=0; c < 7; c++)
+			for (int i=c; i < 7; i++)
+				P[i][c][n]	= ( i == c ) ? 1 : 0;
+
+		Matrix<FT,4,1>	q	= util::eulerToQuat( startAngle );
+		for (int i=0; i < 4; i++)
+			X[i][n]		= q(i);
+		for (int i=0; i < 3; i++)
+			X[4+i][n]	= startBias(i);
+	}
+
+	/**
+	 * Kalman - Predict state of all the filters, as kalman7::KalmanPredict()
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param gyros		Current measured gyro rates, including biases, gyros[k*N + n]
+	 * @param dt		Time between consecutive kalman updates
+	 */
+	void	KalmanPredict( int iter, const FT *gyros, FT dt )
+	{
+		/** A = [ A11 A12 ; 0 I ] at the current estimate, see kalman7::calcA() **/
+		for (int n=0; n < N; n++)
+		{
+			FT	hx	= dt*( gyros[n] - X[4][n] )/2;
+			FT	hy	= dt*( gyros[N + n] - X[5][n] )/2;
+			FT	hz	= dt*( gyros[2*N + n] - X[6][n] )/2;
+
+			A[0][0][n] = 1;		A[0][1][n] = -hx;	A[0][2][n] = -hy;	A[0][3][n] = -hz;
+			A[1][0][n] = hx;	A[1][1][n] = 1;		A[1][2][n] = hz;	A[1][3][n] = -hy;
+			A[2][0][n] = hy;	A[2][1][n] = -hz;	A[2][2][n] = 1;		A[2][3][n] = hx;
+			A[3][0][n] = hz;	A[3][1][n] = hy;	A[3][2][n] = -hx;	A[3][3][n] = 1;
+
+			FT	q0	= dt*X[0][n]/2;
+			FT	q1	= dt*X[1][n]/2;
+			FT	q2	= dt*X[2][n]/2;
+			FT	q3	= dt*X[3][n]/2;
+
+			A[0][4][n] =  q1;	A[0][5][n] =  q2;	A[0][6][n] =  q3;
+			A[1][4][n] = -q0;	A[1][5][n] =  q3;	A[1][6][n] = -q2;
+			A[2][4][n] = -q3;	A[2][5][n] = -q0;	A[2][6][n] =  q1;
+			A[3][4][n] =  q2;	A[3][5][n] = -q1;	A[3][6][n] = -q0;
+		}
+
+		/** state, one filter at a time through the same kernel as kalman7::predictState() **/
+		for (int n=0; n < N; n++)
+		{
+			FT	q[4]	= { X[0][n], X[1][n], X[2][n], X[3][n] };
+			FT	w[3]	= { gyros[n] - X[4][n], gyros[N + n] - X[5][n], gyros[2*N + n] - X[6][n] };
+
+			quat::quatIntegrate( q, w, dt );
+			X[0][n] = q[0];		X[1][n] = q[1];		X[2][n] = q[2];		X[3][n] = q[3];
+		}
+
+		/** P = A*P*A' + W, the same steps as kalman7::KalmanPredict() **/
+		for (int c=0; c < 7; c++)
+			for (int i=0; i < 4; i++)
+			{
+				for (int n=0; n < N; n++)
+					B[i][c][n]	= 0;
+				for (int k=0; k < 7; k++)
+				{
+					const int	hi	= ( k >= c ) ? k : c;
+					const int	lo	= ( k >= c ) ? c : k;
+					for (int n=0; n < N; n++)
+						B[i][c][n]	+= A[i][k][n]*P[hi][lo][n];
+				}
+			}
+
+		for (int c=0; c < 4; c++)
+			for (int i=c; i < 4; i++)
+			{
+				for (int n=0; n < N; n++)
+					P[i][c][n]	= 0;
+				for (int k=0; k < 7; k++)
+					for (int n=0; n < N; n++)
+						P[i][c][n]	+= B[i][k][n]*A[c][k][n];
+			}
+
+		for (int c=0; c < 4; c++)
+			for (int i=4; i < 7; i++)
+				for (int n=0; n < N; n++)
+					P[i][c][n]	= B[c][i][n];
+
+		/* W is diagonal */
+		for (int i=0; i < 7; i++)
+			for (int n=0; n < N; n++)
+				P[i][i][n]	+= ( i < 4 ) ? wq[n] : wb[n];
+	}
+
+	/**
+	 * Kalman - Update state of all the filters, as kalman7::KalmanUpdate()
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles, angles[k*N + n]
+	 * @param dt		Time between consecutive kalman updates.
+	 */
+	void	KalmanUpdate( int iter, const FT *angles, FT dt )
+	{
+		if ( sequentialUpdate ) {
+			KalmanUpdate( iter, angles, dt, 0x7 );
+			return;
+		}
+
+		normalizeQuats();
+		calcQMeasAndError( angles );
+
+		/** P*H', H = [ Hq 0 ] **/
+		for (int j=0; j < 3; j++)
+			for (int i=0; i < 7; i++)
+			{
+				const FT	*P0 = lower(i,0), *P1 = lower(i,1), *P2 = lower(i,2), *P3 = lower(i,3);
+				for (int n=0; n < N; n++)
+					PHt[i][j][n]	= P0[n]*Hq[j][0][n] + P1[n]*Hq[j][1][n] +
+									  P2[n]*Hq[j][2][n] + P3[n]*Hq[j][3][n];
+			}
+
+		/** H*P*H' + R, lower triangle **/
+		for (int j=0; j < 3; j++)
+			for (int i=j; i < 3; i++)
+				for (int n=0; n < N; n++)
+					Sm[i][j][n]	= Hq[i][0][n]*PHt[0][j][n] + Hq[i][1][n]*PHt[1][j][n] +
+								  Hq[i][2][n]*PHt[2][j][n] + Hq[i][3][n]*PHt[3][j][n] +
+								  ( ( i == j ) ? r[n] : 0 );
+
+		/** inverse by cofactors, see kalman7::invertSym3() **/
+		for (int n=0; n < N; n++)
+		{
+			FT	c00	= Sm[1][1][n]*Sm[2][2][n] - Sm[2][1][n]*Sm[2][1][n];
+			FT	c10	= Sm[2][0][n]*Sm[2][1][n] - Sm[1][0][n]*Sm[2][2][n];
+			FT	c20	= Sm[1][0][n]*Sm[2][1][n] - Sm[2][0][n]*Sm[1][1][n];
+			FT	c11	= Sm[0][0][n]*Sm[2][2][n] - Sm[2][0][n]*Sm[2][0][n];
+			FT	c21	= Sm[1][0][n]*Sm[2][0][n] - Sm[0][0][n]*Sm[2][1][n];
+			FT	c22	= Sm[0][0][n]*Sm[1][1][n] - Sm[1][0][n]*Sm[1][0][n];
+
+			FT	id	= 1/( Sm[0][0][n]*c00 + Sm[1][0][n]*c10 + Sm[2][0][n]*c20 );
+
+			inv[0][0][n] = c00*id;
+			inv[1][0][n] = inv[0][1][n] = c10*id;
+			inv[2][0][n] = inv[0][2][n] = c20*id;
+			inv[1][1][n] = c11*id;
+			inv[2][1][n] = inv[1][2][n] = c21*id;
+			inv[2][2][n] = c22*id;
+		}
+
+		for (int n=0; n < N; n++)
+			if ( isnan( inv[0][0][n] ) )
+				std::cout << "NAN" << std::endl;
+
+		/** K = P*H'*inv, then the state **/
+		for (int j=0; j < 3; j++)
+			for (int i=0; i < 7; i++)
+				for (int n=0; n < N; n++)
+					K[i][j][n]	= PHt[i][0][n]*inv[0][j][n] + PHt[i][1][n]*inv[1][j][n] +
+								  PHt[i][2][n]*inv[2][j][n];
+
+		for (int i=0; i < 7; i++)
+			for (int n=0; n < N; n++)
+				X[i][n]	+= K[i][0][n]*err[0][n] + K[i][1][n]*err[1][n] + K[i][2][n]*err[2][n];
+
+		normalizeQuats();
+
+		/** Joseph form, P - G - G' + K*S*K', lower triangle **/
+		for (int j=0; j < 3; j++)
+		{
+			const FT	*S0 = lowerS(0,j), *S1 = lowerS(1,j), *S2 = lowerS(2,j);
+			for (int i=0; i < 7; i++)
+				for (int n=0; n < N; n++)
+					KS[i][j][n]	= K[i][0][n]*S0[n] + K[i][1][n]*S1[n] + K[i][2][n]*S2[n];
+		}
+
+		for (int c=0; c < 7; c++)
+			for (int i=c; i < 7; i++)
+				for (int n=0; n < N; n++)
+				{
+					FT	g	= K[i][0][n]*PHt[c][0][n] + K[i][1][n]*PHt[c][1][n] + K[i][2][n]*PHt[c][2][n];
+					FT	gt	= K[c][0][n]*PHt[i][0][n] + K[c][1][n]*PHt[i][1][n] + K[c][2][n]*PHt[i][2][n];
+					FT	ksk	= KS[i][0][n]*K[c][0][n] + KS[i][1][n]*K[c][1][n] + KS[i][2][n]*K[c][2][n];
+
+					P[i][c][n]	+= ksk - g - gt;
+				}
+	}
+
+	/**
+	 * Kalman - Update state with some of the angles only, one scalar update
+	 * per axis, as kalman7::KalmanUpdate() with axisMask. Same mask for all filters.
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles, angles[k*N + n]
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param axisMask	Bit i set to use angles i
+	 */
+	void	KalmanUpdate( int iter, const FT *angles, FT dt, unsigned int axisMask )
+	{
+		normalizeQuats();
+		calcQMeasAndError( angles );
+
+		for (int i=0; i < 4; i++)
+			for (int n=0; n < N; n++)
+				X0[i][n]	= X[i][n];
+
+		for (int j=0; j < 3; j++)
+			if ( axisMask & (1 << j) )
+				scalarUpdate( j );
+
+		normalizeQuats();
+	}
+
+	/** see kalman7::setSequentialUpdate() */
+	inline void	setSequentialUpdate( bool seq ) { sequentialUpdate = seq; }
+
+public:
+	/**
+	 * Public access to the state vector of filter n
+	 */
+	inline void	getStateVector( int n, Matrix<FT,7,1> &x ) const
+	{
+		for (int i=0; i < 7; i++)
+			x(i)	= X[i][n];
+	}
+
+	/**
+	 * Public access to the covariance matrix of filter n
+	 */
+	inline void	getCovarianceMatrix( int n, Matrix<FT,7,7> &p ) const
+	{
+		for (int c=0; c < 7; c++)
+			for (int i=c; i < 7; i++)
+				p(i,c) = p(c,i)	= P[i][c][n];
+	}
+
+	/**
+	 * All the states, state element i of filter n at [i*N + n]. The first 4*N
+	 * are the quaternions in the layout util::quatToEulerBatch() takes.
+	 */
+	inline const FT	*getStates() const { return &X[0][0]; }
+
+private:
+	FT	X[7][N];		/* state vectors, as kalman7 */
+	FT	P[7][7][N];		/* covariances, lower triangle (i >= c) only */
+
+	FT	r[N];			/* measurement variance */
+	FT	wq[N];			/* process noise, quaternion */
+	FT	wb[N];			/* process noise, bias */
+
+	bool	sequentialUpdate;
+
+	/** temporaries, here rather than on the stack because of their size **/
+	FT	A[4][7][N];		/* rows 0..3 of the transition matrix */
+	FT	B[4][7][N];		/* A(0..3,:)*P */
+	FT	Hq[3][4][N];	/* measurement matrix, quaternion part */
+	FT	err[3][N];		/* angle innovations */
+	FT	PHt[7][3][N];
+	FT	Sm[3][3][N];	/* innovation covariance, lower triangle */
+	FT	inv[3][3][N];
+	FT	K[7][3][N];
+	FT	KS[7][3][N];
+	FT	X0[4][N];		/* linearization point of the sequential updates */
+	FT	u[7][N];		/* P*h' of one scalar update */
+
+	/** P(i,c) of all filters, i and c in any order */
+	inline const FT	*lower( int i, int c ) const
+	{
+		return ( i >= c ) ? P[i][c] : P[c][i];
+	}
+
+	/** Sm(i,j) of all filters, i and j in any order */
+	inline const FT	*lowerS( int i, int j ) const
+	{
+		return ( i >= j ) ? Sm[i][j] : Sm[j][i];
+	}
+
+	void	normalizeQuats()
+	{
+		for (int n=0; n < N; n++)
+		{
+			FT	q[4]	= { X[0][n], X[1][n], X[2][n], X[3][n] };
+			quat::quatNormalize( q );
+			X[0][n] = q[0];		X[1][n] = q[1];		X[2][n] = q[2];		X[3][n] = q[3];
+		}
+	}
+
+	/** Hq and the angle innovations at the current (normalized) quaternions */
+	void	calcQMeasAndError( const FT *angles )
+	{
+		for (int n=0; n < N; n++)
+		{
+			Matrix<FT,4,1>	q;
+			q	<< X[0][n], X[1][n], X[2][n], X[3][n];
+
+			Matrix<FT,3,4>	H	= util::calcQMeas( q );
+			for (int j=0; j < 3; j++)
+				for (int k=0; k < 4; k++)
+					Hq[j][k][n]	= H(j,k);
+
+			Matrix<FT,3,1>	predAngles	= util::quatToEuler( q );
+			for (int j=0; j < 3; j++)
+				err[j][n]	= util::calcAngleError( angles[j*N + n], predAngles(j) );
+		}
+	}
+
+	/**
+	 * Scalar update with row j of Hq, as kalman7::scalarUpdate().
+	 * A filter whose innovation variance isn't positive is left untouched.
+	 */
+	void	scalarUpdate( int j )
+	{
+		for (int i=0; i < 7; i++)
+		{
+			const FT	*P0 = lower(i,0), *P1 = lower(i,1), *P2 = lower(i,2), *P3 = lower(i,3);
+			for (int n=0; n < N; n++)
+			{
+				FT	t	= 0;
+				t	+= P0[n]*Hq[j][0][n];
+				t	+= P1[n]*Hq[j][1][n];
+				t	+= P2[n]*Hq[j][2][n];
+				t	+= P3[n]*Hq[j][3][n];
+				u[i][n]	= t;
+			}
+		}
+
+		FT	s[N], g[N];
+		for (int n=0; n < N; n++)
+		{
+			s[n]	= Hq[j][0][n]*u[0][n] + Hq[j][1][n]*u[1][n] +
+					  Hq[j][2][n]*u[2][n] + Hq[j][3][n]*u[3][n] + r[n];
+
+			FT	res	= err[j][n] - ( Hq[j][0][n]*( X[0][n] - X0[0][n] ) + Hq[j][1][n]*( X[1][n] - X0[1][n] ) +
+									Hq[j][2][n]*( X[2][n] - X0[2][n] ) + Hq[j][3][n]*( X[3][n] - X0[3][n] ) );
+			g[n]	= res/s[n];
+		}
+
+		for (int n=0; n < N; n++)
+			if ( !( s[n] > 0 ) )
+				std::cout << "NAN" << std::endl;
+
+		for (int i=0; i < 7; i++)
+			for (int n=0; n < N; n++)
+				X[i][n]	= ( s[n] > 0 ) ? X[i][n] + u[i][n]*g[n] : X[i][n];
+
+		/* P - u*u'/s */
+		for (int c=0; c < 7; c++)
+			for (int i=c; i < 7; i++)
+				for (int n=0; n < N; n++)
+				{
+					FT	d	= u[i][n]*u[c][n]/s[n];
+					P[i][c][n]	= ( s[n] > 0 ) ? P[i][c][n] - d : P[i][c][n];
+				}
+	}
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+};
+
+#endif	/* __kalman7bank_h_ */
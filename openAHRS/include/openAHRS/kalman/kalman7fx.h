@@ -0,0 +1,185 @@
+/*
+ *  7-state Kalman Filter for gyro and accelerometer processing
+ *	Position and gyro bias tracking. Fixed point version.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef __kalman7fx_h_
+#define	__kalman7fx_h_
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/util/fixed.h>
+
+/**
+ * Per-state scaling, as powers of two. The filter runs on the scaled state
+ * D*x, D = diag( 2^QUAT x4, 2^BIAS x3 ), so the covariance it keeps is D*P*D.
+ * Pick them so that the steady state variances of both groups end up
+ * well inside the covariance format (FCOV) while the initial P still fits.
+ */
+#ifndef	KALMAN7FX_QUAT_SCALE
+	#define	KALMAN7FX_QUAT_SCALE	2
+#endif
+
+#ifndef	KALMAN7FX_BIAS_SCALE
+	#define	KALMAN7FX_BIAS_SCALE	0
+#endif
+
+namespace openAHRS {
+
+/**
+ * kalman7 in fixed point, for targets with no FPU. Same model, same tuning
+ * arguments, and the same interface, so it can run next to kalman7 on the same
+ * data (see tests/test-kal7fx). The *Fx() entry points take fixed point input
+ * directly and use no floating point at all.
+ *
+ * The update is always done as sequential scalar updates (kalman7's
+ * setSequentialUpdate(true)), which needs one division per axis instead of
+ * a 3x3 inverse. The predict uses the same block structure as kalman7.
+ *
+ * Formats (see util/fixed.h): quaternion FQUAT, bias FRATE, angles FANGLE,
+ * scaled covariance FCOV, gains FGAIN. Every store saturates.
+ *
+ * Accuracy budget, per step, in double precision terms:
+ *	- quaternion rounding 9.3e-10, angle rounding 3.7e-9 rad
+ *	- atan2 polynomial 2e-8 rad
+ *	- covariance rounding 1.5e-8/4^QUAT_SCALE on the attitude block,
+ *	  which is the one that decides the gains
+ * All well below the measurement noise (1e-1 rad std with the usual tuning).
+ * Over the test-kal7 run the attitude stays within 2e-6 rad of kalman7 and
+ * the bias within 1e-5 rad/s, tests/test-kal7fx fails beyond that (with
+ * FT=float it allows 4e-6 rad, kalman7's own rounding). Without scaling
+ * (both 0) it is about 2e-5 rad; with QUAT_SCALE 3 the initial P saturates
+ * and the first seconds differ.
+ *
+ * Speed on the AVR32 has not been measured, there are no cycle counts for
+ * it. The only timings are from a PC, where kalman7 has a hardware FPU and
+ * kalman7fx takes about twice as long per step (test-kal7fx). That says
+ * nothing about a target without an FPU, which is what kalman7fx is for.
+ */
+class kalman7fx
+{
+
+public:
+	enum {
+		FCOV	= 26,	/* Q5.26, scaled covariance, +-32 */
+		FGAIN	= 24,	/* Q7.24, scaled kalman gain, +-128 */
+
+		QUAT_SCALE	= KALMAN7FX_QUAT_SCALE,
+		BIAS_SCALE	= KALMAN7FX_BIAS_SCALE,
+	};
+
+	kalman7fx();	/* simple, nearly do-nothing constructor */
+
+	/**
+	 * Init kalman variables and state, as kalman7::KalmanInit()
+	 *
+	 * @param startAngle	Initial angle estimate		[roll,pitch,yaw]'
+	 * @param startBias		Initial gyro bias estimate	[biasP,biasQ,biasR]'
+	 * @param meas_variance	Measurement variance.
+	 * @param process_bias_var	variance for the process bias estimate
+	 * @param process_quat_var	variance for the quaternion estimate
+	 */
+	void	KalmanInit( Matrix<FT,3,1> &startAngle,
+						Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var );
+
+	/**
+	 * Kalman - Update state
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles (calculated from accel data).
+	 * @param dt		Time between consecutive kalman updates.
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt );
+
+	/**
+	 * Kalman - Update state with some of the angles only
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles (calculated from accel data).
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param axisMask	Bit i set to use angles(i), e.g. 0x3 to skip yaw
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask );
+
+	/**
+	 * Kalman - Predict state
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param gyros			Current measured gyro rate, including biases
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanPredict( int iter, const Matrix<FT,3,1> &gyros,
+							FT dt );
+
+	/**
+	 * Fixed point update
+	 *
+	 * @param angles	Measured angles, FANGLE
+	 * @param axisMask	Bit i set to use angles[i]
+	 */
+	void	KalmanUpdateFx( const fixed::fx angles[3], unsigned int axisMask );
+
+	/**
+	 * Fixed point predict
+	 *
+	 * @param gyros		Measured gyro rate including biases, FRATE
+	 * @param dt		Time step, FTIME
+	 */
+	void	KalmanPredictFx( const fixed::fx gyros[3], fixed::fx dt );
+
+public:
+	void	getStateVector( Matrix<FT,7,1>	&x );
+	/**
+	 * Public access to state vector
+	 */
+
+	void	getCovarianceMatrix( Matrix<FT,7,7> &p );
+	/**
+	 * Public access to covariance matrix, unscaled
+	 */
+
+	void	setCovarianceMatrix( const Matrix<FT,7,7> &p );
+	/**
+	 * Replace the covariance matrix after KalmanInit(), unscaled as
+	 * getCovarianceMatrix(), saturated to the FCOV range
+	 */
+
+	inline const fixed::fx	*getQuatFx() const { return q; }
+	inline const fixed::fx	*getBiasFx() const { return bias; }
+	/**
+	 * Fixed point state, FQUAT and FRATE
+	 */
+
+private:
+	fixed::fx	q[4];		/* quaternion, FQUAT */
+	fixed::fx	bias[3];	/* gyro bias estimate, FRATE */
+
+	fixed::fx	P[7][7];	/* scaled covariance, FCOV */
+	fixed::fx	W[7];		/* scaled process noise, diagonal, FCOV */
+	fixed::fx	R[3];		/* measurement noise, diagonal, FCOV */
+};
+
+};
+
+#endif	/* __kalman7fx_h_ */
@@ -0,0 +1,153 @@
+/*
+ *  Multiplicative (error-state) Kalman Filter for gyro and accelerometer
+ *	processing. Attitude and gyro bias tracking, 6-state covariance.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef __mekf6_h_
+#define	__mekf6_h_
+
+#include <openAHRS/util/util.h>
+
+namespace openAHRS {
+
+/**
+ * Same model and interface as kalman7, but the attitude is kept as a unit
+ * quaternion outside of the filter and the covariance is over a 3-D attitude
+ * error instead of the 4 quaternion components:
+ *
+ *	q_true	= q (x) [ 1, dtheta/2 ]		dtheta in body axes
+ *	dx		= [ dtheta ; dbias ]		P is 6x6
+ *
+ * Each update estimates dx, folds it into q and the bias (renormalizing q once)
+ * and starts again from dx = 0. P has no direction along the quaternion norm,
+ * so it stays full rank.
+ */
+class mekf6
+{
+
+public:
+	mekf6();	/* simple, nearly do-nothing constructor */
+
+	/**
+	 * Init kalman variables and state.
+	 *
+	 * @param startAngle	Initial angle estimate		[roll,pitch,yaw]'
+	 * @param startBias		Initial gyro bias estimate	[biasP,biasQ,biasR]'
+	 * @param meas_variance	Measurement variance.
+	 *
+	 * @param process_bias_var	variance for the process bias estimate
+	 * @param process_quat_var	variance for the quaternion estimate, as for kalman7.
+	 *							The attitude error variance is 4 times this.
+	 */
+	void	KalmanInit( Matrix<FT,3,1> &startAngle,
+						Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var );
+
+	/**
+	 * Kalman - Update state
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles (calculated from accel data).
+	 * @param dt		Time between consecutive kalman updates.
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt );
+
+	/**
+	 * Kalman - Update state with some of the angles only, one scalar update per axis.
+	 *
+	 * @param iter		Current iteration number, only for testing purposes.
+	 * @param angles	Current measured angles (calculated from accel data).
+	 * @param dt		Time between consecutive kalman updates.
+	 * @param axisMask	Bit i set to use angles(i), e.g. 0x3 to skip yaw.
+	 *
+	 */
+	void	KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask );
+
+	/**
+	 * Process the three angles as successive scalar updates, see kalman7.
+	 */
+	inline void	setSequentialUpdate( bool seq ) { sequentialUpdate = seq; }
+
+	/**
+	 * Kalman - Predict state
+	 *
+	 * @param iter			Current iteration number, only for testing purposes.
+	 * @param gyros			Current measured gyro rate, including biases
+	 * @param dt			Time between consecutive kalman updates
+	 *
+	 */
+	void	KalmanPredict( int iter, const Matrix<FT,3,1> &gyros,
+							FT dt );
+
+public:
+	inline void	getStateVector( Matrix<FT,7,1>	&x ) { x.start<4>() = q; x.end<3>() = bias; }
+	/**
+	 * Public access to state vector, [ quaternion ; bias ] as kalman7
+	 */
+
+	inline void	getCovarianceMatrix( Matrix<FT,6,6> &p ) { p = P; }
+	/**
+	 * Public access to covariance matrix, [ dtheta ; dbias ]
+	 */
+
+	inline void	setCovarianceMatrix( const Matrix<FT,6,6> &p ) { P = p; }
+	void		setCovarianceMatrix( const Matrix<FT,7,7> &p );
+	/**
+	 * Replace the covariance matrix, after KalmanInit(). The 7x7 one is
+	 * kalman7's, [ q ; bias ], taken to [ dtheta ; dbias ] at the current
+	 * attitude: dtheta = 2*vec( q^-1 (x) dq )
+	 */
+
+private:
+	Matrix<FT,4,1>	q;		/* attitude, unit quaternion */
+	Matrix<FT,3,1>	bias;	/* gyro bias estimate */
+
+	Matrix<FT,6,6>	P;		/* error covariance */
+	Matrix<FT,6,1>	W;		/* process noise, diagonal */
+	Matrix<FT,3,1>	R;		/* measurement noise, diagonal */
+
+	bool	sequentialUpdate;	/* see setSequentialUpdate() */
+
+private:
+	/**
+	* Measurement jacobian d[roll,pitch,yaw]/ddtheta at q,
+	* which is the body rate to euler rate matrix.
+	*
+	* @param Ha			Destination matrix, the bias columns are zero
+	*/
+	void	calcH( Matrix<FT,3,3> &Ha );
+
+	/**
+	* Fold an estimated error into q and the bias
+	*
+	* @param dx			Error estimate [ dtheta ; dbias ]
+	*/
+	void	applyError( const Matrix<FT,6,1> &dx );
+
+	public:
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+};
+
+};
+
+#endif	/* __mekf6_h_ */
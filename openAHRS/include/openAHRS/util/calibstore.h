@@ -0,0 +1,186 @@
+/*
+ *  Calibration store: named matrices in one binary file, with a header
+ *  and checksums, written atomically and read in place through mmap()
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__ahrs_calibstore_h_
+#define	__ahrs_calibstore_h_
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <vector>
+
+/**
+ * File layout, all in the byte order of the machine that wrote it:
+ *
+ *	header		32 bytes, see StoreHeader
+ *	records		numRecords times:
+ *					name		24 bytes, NUL padded
+ *					rows, cols	uint32 each
+ *					data		rows*cols FT, column-major as Eigen keeps
+ *								them, padded to 8 bytes
+ *
+ * The header carries the format version, a byte order marker and
+ * sizeof(FT), so that a file from another machine or built with another
+ * FT is refused instead of read as garbage, and a CRC-32 of itself and
+ * one of the records. CalibStore::open() checks all of that, and that
+ * the records exactly fill the file, before anything is used: a torn or
+ * corrupt file does not load, partly or at all.
+ *
+ * CalibStoreWriter::save() writes a temporary file next to the target,
+ * syncs it and renames it over the target, so a crash or power loss
+ * leaves either the old file or the new one.
+ */
+
+namespace openAHRS { namespace util
+{
+	struct	StoreHeader
+	{
+		char		magic[4];		/* "OACS" */
+		uint32_t	version;
+		uint32_t	byteOrder;		/* 0x01020304 as written */
+		uint32_t	scalarSize;		/* sizeof(FT) */
+		uint32_t	numRecords;
+		uint32_t	dataSize;		/* bytes after the header */
+		uint32_t	dataCrc;		/* CRC-32 of those bytes */
+		uint32_t	headerCrc;		/* CRC-32 of the 28 bytes above */
+	};
+
+	struct	StoreRecord
+	{
+		char		name[24];
+		uint32_t	rows, cols;
+	};
+
+	/**
+	 * CRC-32 (IEEE 802.3, as zlib), crc is the value so far to continue one
+	 */
+	uint32_t	crc32( const void *data, size_t len, uint32_t crc = 0 );
+
+	/**
+	 * Reads a store. The file stays mapped while the object is open, and
+	 * find() returns pointers into it, the data is never copied or parsed.
+	 */
+	class	CalibStore
+	{
+		public:
+			CalibStore();
+			~CalibStore();
+
+			/**
+			 * Map and check a store, closing the one open before.
+			 *
+			 * @return	false if the file is missing or not a valid store for
+			 *			this build, see getError() for why
+			 */
+			bool	open( const char *fileName );
+			void	close();
+
+			inline bool	isOpen() const { return base != NULL; }
+
+			/** why open() failed */
+			inline const char *	getError() const { return error; }
+
+			/**
+			 * Data of a record, in place.
+			 *
+			 * @param name	Record name
+			 * @param rows	Expected rows
+			 * @param cols	Expected columns
+			 * @return		NULL if there is no such record or it has another size
+			 */
+			const FT *	find( const char *name, int rows, int cols ) const;
+
+			/** copy a record to a matrix of the same size */
+			template <class T>
+			bool	get( const char *name, T &m ) const
+			{
+				const FT	*p	= find( name, m.rows(), m.cols() );
+				if ( p == NULL )
+					return false;
+				memcpy( m.data(), p, sizeof(FT)*m.rows()*m.cols() );
+				return true;
+			}
+
+			inline int	numRecords() const { return records.size(); }
+			const char *	recordName( int i ) const;
+			void	recordSize( int i, int &rows, int &cols ) const;
+			const FT *	recordData( int i ) const;
+
+		private:
+			void		*base;
+			size_t		length;
+			const char	*error;
+
+			std::vector<const StoreRecord *>	records;
+
+			/* not copyable, the mapping is ours */
+			CalibStore( const CalibStore & );
+			CalibStore &	operator=( const CalibStore & );
+	};
+
+	/**
+	 * Builds a store in memory, save() writes it.
+	 */
+	class	CalibStoreWriter
+	{
+		public:
+			/**
+			 * Add a record, or replace the one with the same name.
+			 *
+			 * @param name	Up to 23 characters
+			 * @param data	rows*cols values, column-major
+			 */
+			void	add( const char *name, const FT *data, int rows, int cols );
+
+			template <class T>
+			inline void	add( const char *name, const T &m ) {
+				add( name, m.data(), m.rows(), m.cols() );
+			}
+
+			/**
+			 * Add the records of s not added yet, to rewrite a store
+			 * keeping what this program doesn't know about
+			 */
+			void	keep( const CalibStore &s );
+
+			/**
+			 * Write the store, atomically: fileName is replaced only once
+			 * all of the new one is on disk
+			 */
+			bool	save( const char *fileName ) const;
+
+		private:
+			struct	Entry
+			{
+				StoreRecord		rec;
+				std::vector<FT>	data;
+			};
+			std::vector<Entry>	entries;
+
+			bool	has( const char *name ) const;
+	};
+
+}};
+
+#endif	/* __ahrs_calibstore_h_ */
@@ -0,0 +1,214 @@
+/*
+ *  Cholesky factor helpers for square-root filters
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__cholesky_h_
+#define	__cholesky_h_
+
+#include <math.h>
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+/**
+ * All the factors handled here are lower triangular, S such that P = S*S'.
+ * Everything works in place on fixed size matrices, nothing is allocated.
+ */
+
+namespace openAHRS { namespace util
+{
+	/**
+	 * Plain Cholesky factorization, P = S*S'.
+	 * Columns with a non-positive pivot are zeroed instead of failing,
+	 * so semi-definite matrices (for example a noise matrix with some
+	 * zero variances) can be factored too.
+	 *
+	 * @param P		Symmetric input matrix, only the lower triangle is read
+	 * @param S		Lower triangular output factor
+	 */
+	template <int n>
+	void	choleskyFactor( const Matrix<FT,n,n> &P, Matrix<FT,n,n> &S )
+	{
+		S.setZero();
+		for (int j=0; j < n; j++)
+		{
+			FT	d = P(j,j);
+			for (int k=0; k < j; k++)
+				d -= S(j,k)*S(j,k);
+
+			if ( d <= 0 )
+				continue;	/* leave column at zero */
+
+			d = sqrt(d);
+			S(j,j) = d;
+
+			for (int i=j+1; i < n; i++) {
+				FT	s = P(i,j);
+				for (int k=0; k < j; k++)
+					s -= S(i,k)*S(j,k);
+				S(i,j) = s/d;
+			}
+		}
+	}
+
+	/**
+	 * Rank-1 update/downdate of a Cholesky factor:
+	 *	S*S' <- S*S' + weight*x*x'
+	 *
+	 * A negative weight means downdate. On failure (the result would not
+	 * be positive definite, or S has a zero pivot where x is not zero)
+	 * false is returned and S is left half-updated, callers should keep
+	 * a copy if they need to recover.
+	 *
+	 * @param S			Lower triangular factor, updated in place
+	 * @param x			Update vector (passed by value, it is used as scratch)
+	 * @param weight	Weight of the update, sign selects update/downdate
+	 */
+	template <int n>
+	bool	choleskyUpdate( Matrix<FT,n,n> &S, Matrix<FT,n,1> x, FT weight )
+	{
+		FT	sign = 1;
+		if ( weight < 0 ) {
+			sign	= -1;
+			weight	= -weight;
+		}
+		x *= sqrt(weight);
+
+		/* leading zeros in x leave those columns untouched */
+		int	k0 = 0;
+		while ( k0 < n && x(k0) == 0 )
+			k0++;
+
+		for (int k=k0; k < n; k++)
+		{
+			if ( !(S(k,k) > 0) )
+				return false;
+
+			FT	r2	= S(k,k)*S(k,k) + sign*x(k)*x(k);
+			if ( !(r2 > 0) )
+				return false;
+
+			FT	r	= sqrt(r2);
+			FT	c	= r/S(k,k);
+			FT	s	= x(k)/S(k,k);
+			S(k,k)	= r;
+
+			for (int i=k+1; i < n; i++) {
+				S(i,k)	= ( S(i,k) + sign*s*x(i) )/c;
+				x(i)	= c*x(i) - s*S(i,k);
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Triangularize a compound square root matrix (LQ decomposition by
+	 * Householder reflections), so that S*S' = A*A'.
+	 * This is the 'qr' step of the square-root UKF.
+	 *
+	 * @param A		n x k matrix, k >= n (passed by value, used as scratch)
+	 * @param S		Lower triangular n x n output, positive diagonal
+	 */
+	template <int n, int k>
+	void	triangularize( Matrix<FT,n,k> A, Matrix<FT,n,n> &S )
+	{
+		for (int i=0; i < n; i++)
+		{
+			/* reflect row i so that A(i,i+1..k-1) become zero */
+			FT	sigma = 0;
+			for (int j=i+1; j < k; j++)
+				sigma += A(i,j)*A(i,j);
+
+			if ( sigma > 0 )
+			{
+				FT	alpha = sqrt( A(i,i)*A(i,i) + sigma );
+				if ( A(i,i) > 0 )
+					alpha = -alpha;
+
+				/* v = x - alpha*e1, kept in row i of A (v(0) apart) */
+				FT	v0		= A(i,i) - alpha;
+				FT	vtv		= v0*v0 + sigma;
+
+				for (int r=i+1; r < n; r++)
+				{
+					FT	dot = A(r,i)*v0;
+					for (int j=i+1; j < k; j++)
+						dot += A(r,j)*A(i,j);
+
+					dot *= 2/vtv;
+
+					A(r,i) -= dot*v0;
+					for (int j=i+1; j < k; j++)
+						A(r,j) -= dot*A(i,j);
+				}
+
+				A(i,i) = alpha;
+			}
+
+			/* positive diagonal */
+			if ( A(i,i) < 0 )
+				for (int r=i; r < n; r++)
+					A(r,i) = -A(r,i);
+		}
+
+		for (int c=0; c < n; c++)
+			for (int r=0; r < n; r++)
+				S(r,c) = ( r < c ) ? 0 : A(r,c);
+	}
+
+	/**
+	 * Solves X*(S*S') = B for X by forward and back substitution,
+	 * avoiding the explicit inverse of S*S'.
+	 * Used to compute the kalman gain K = Pxz*inv(Pzz) from the factor of Pzz.
+	 *
+	 * @param S		Lower triangular m x m factor
+	 * @param B		r x m right hand side
+	 * @param X		r x m result
+	 */
+	template <int r, int m>
+	void	choleskySolveRight( const Matrix<FT,m,m> &S, const Matrix<FT,r,m> &B, Matrix<FT,r,m> &X )
+	{
+		for (int row=0; row < r; row++)
+		{
+			FT	t[m];
+
+			/* S*t = b' */
+			for (int i=0; i < m; i++) {
+				FT	s = B(row,i);
+				for (int j=0; j < i; j++)
+					s -= S(i,j)*t[j];
+				t[i] = s/S(i,i);
+			}
+
+			/* S'*x' = t */
+			for (int i=m-1; i >= 0; i--) {
+				FT	s = t[i];
+				for (int j=i+1; j < m; j++)
+					s -= S(j,i)*X(row,j);
+				X(row,i) = s/S(i,i);
+			}
+		}
+	}
+
+}};
+
+#endif	/* __cholesky_h_ */
@@ -0,0 +1,104 @@
+/*
+ *  Weighted covariance reconstruction for sigma point filters
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__covariance_h_
+#define	__covariance_h_
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+/**
+ * Sigma point covariances are built from the centred deviation matrices
+ * D = [ X0-x, X1-x, ... ] as one weighted product D*W*D', where
+ * W = diag( w0, wi, wi, ... ): the central point has its own weight,
+ * the rest share the same one.
+ */
+
+namespace openAHRS { namespace util
+{
+	/**
+	 * Symmetric weighted covariance P = D*W*D'.
+	 * Only the lower triangle is computed, then mirrored.
+	 *
+	 * @param D		n x k centred deviations, column 0 is the central point
+	 * @param w0	Weight of column 0
+	 * @param wi	Weight of the other columns
+	 * @param P		n x n output
+	 */
+	template <int n, int k>
+	void	weightedCovariance( const Matrix<FT,n,k> &D, FT w0, FT wi, Matrix<FT,n,n> &P )
+	{
+		/* transposed copy so the inner products run over contiguous memory */
+		Matrix<FT,k,n>	Dt = D.transpose();
+
+		for (int j=0; j < n; j++)
+		{
+			for (int i=j; i < n; i++)
+			{
+				FT	s = 0;
+				for (int c=1; c < k; c++)
+					s += Dt(c,i)*Dt(c,j);
+
+				P(i,j) = wi*s + w0*Dt(0,i)*Dt(0,j);
+			}
+		}
+
+		for (int j=1; j < n; j++)
+			for (int i=0; i < j; i++)
+				P(i,j) = P(j,i);
+	}
+
+	/**
+	 * Weighted cross covariance Pxy = Dx*W*Dy'.
+	 * Written as inner products over transposed copies of the deviations,
+	 * which keeps the loops contiguous for any n,m,k.
+	 *
+	 * @param Dx	n x k centred deviations of the first variable
+	 * @param Dy	m x k centred deviations of the second variable
+	 * @param w0	Weight of column 0
+	 * @param wi	Weight of the other columns
+	 * @param Pxy	n x m output
+	 */
+	template <int n, int m, int k>
+	void	weightedCrossCovariance( const Matrix<FT,n,k> &Dx, const Matrix<FT,m,k> &Dy,
+									FT w0, FT wi, Matrix<FT,n,m> &Pxy )
+	{
+		Matrix<FT,k,n>	Dxt = Dx.transpose();
+		Matrix<FT,k,m>	Dyt = Dy.transpose();
+
+		for (int j=0; j < m; j++)
+		{
+			for (int i=0; i < n; i++)
+			{
+				FT	s = 0;
+				for (int c=1; c < k; c++)
+					s += Dxt(c,i)*Dyt(c,j);
+
+				Pxy(i,j) = wi*s + w0*Dxt(0,i)*Dyt(0,j);
+			}
+		}
+	}
+
+}};
+
+#endif	/* __covariance_h_ */
@@ -0,0 +1,143 @@
+/*
+ *  Timestamped sensor event queue, for running filter predict and
+ *  update steps at different rates.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__ahrs_eventqueue_h_
+#define	__ahrs_eventqueue_h_
+
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+namespace openAHRS { namespace util
+{
+	/**
+	 * Monotonic time in seconds, for event timestamps
+	 */
+	inline double	monotonicTime()
+	{
+		struct timespec	ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return 1.0*ts.tv_sec + 1e-9*ts.tv_nsec;
+	}
+
+	/**
+	 * One sensor sample and the time it was taken
+	 */
+	struct	SensorEvent
+	{
+		double			t;		/* timestamp, see monotonicTime() */
+		int				type;	/* sensor, defined by the user */
+		Matrix<FT,3,1>	v;		/* sample */
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	/**
+	 * Fixed size queue of sensor events, from one producer thread to one
+	 * consumer thread, without a lock. Samples are pushed by the thread
+	 * doing the slow sensor reads and popped by the filter loop, in time
+	 * order, once the filter has been predicted up to their timestamp.
+	 * The producer must push in time order, as a single reader thread
+	 * timestamping its reads does, so the ring stays sorted with nothing
+	 * to move.
+	 *
+	 * head is only written by push() and tail only by popUntil(), each
+	 * side just reads the other's index, with a barrier between copying
+	 * an event and moving the index past it. Neither side ever waits.
+	 * When the ring is full push() drops the new event: the producer
+	 * can't free the oldest slot, the consumer may be copying it.
+	 *
+	 * Capacity must be a power of two.
+	 */
+	template <int Capacity>
+	class	SensorEventRing
+	{
+		private:
+			SensorEvent			ev[Capacity];
+			volatile unsigned	head;		/* events pushed, free running */
+			volatile unsigned	tail;		/* events popped */
+			volatile int		dropped;
+
+			/* Capacity must divide 2^32 for the free running indices */
+			typedef char	capacityIsPowerOfTwo[ ( Capacity & ( Capacity - 1 ) ) == 0 ? 1 : -1 ];
+
+		public:
+			SensorEventRing() {
+				head	= tail	= 0;
+				dropped	= 0;
+			}
+
+			/**
+			 * Queue an event, from the producer thread only.
+			 *
+			 * @param e		event to queue, not older than the last one pushed
+			 * @return	false if the ring was full and e was dropped
+			 */
+			bool	push( const SensorEvent &e )
+			{
+				unsigned	h	= head;
+				if ( h - tail == (unsigned)Capacity ) {
+					dropped++;
+					return false;
+				}
+
+				ev[ h & ( Capacity - 1 ) ]	= e;
+				__sync_synchronize();
+				head	= h + 1;
+				return true;
+			}
+
+			/**
+			 * Take the oldest event if it is not newer than t, from the
+			 * consumer thread only.
+			 *
+			 * @param t		time the filter has been predicted to
+			 * @param e		where to store the event
+			 * @return	true if an event was taken
+			 */
+			bool	popUntil( double t, SensorEvent &e )
+			{
+				unsigned	tl	= tail;
+				if ( head == tl )
+					return false;
+				__sync_synchronize();
+
+				const SensorEvent	&oldest	= ev[ tl & ( Capacity - 1 ) ];
+				if ( oldest.t > t )
+					return false;
+
+				e	= oldest;
+				__sync_synchronize();
+				tail	= tl + 1;
+				return true;
+			}
+
+			/** number of events dropped because the ring was full */
+			int		getDropped() { return dropped; }
+	};
+
+}};
+
+#endif	/* __ahrs_eventqueue_h_ */
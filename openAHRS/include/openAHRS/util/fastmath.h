@@ -0,0 +1,200 @@
+/*
+ *  Polynomial approximations of atan2, asin, sin and cos
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__fastmath_h_
+#define	__fastmath_h_
+
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * Set to 1 (FAST_MATH, next to FLOAT_TYPE in the top Makefile) to have
+ * the library use these approximations instead of libm, through fmath
+ * below. Mostly for targets without an FPU, where libm doubles are
+ * emulated in software and dominate the cycle count.
+ */
+#ifndef	FAST_MATH
+	#define	FAST_MATH	0
+#endif
+
+/** same as util.h **/
+#ifndef	C_PI
+	#define C_PI    3.14159265358979323846264338327950288419716939937511
+#endif
+
+/**
+ * Minimax polynomials, evaluated with multiplies, adds and selects only
+ * (plus one sqrt in fastAsin()), so that loops calling them over plain
+ * arrays can be vectorized by the compiler. Maximum absolute error, in
+ * double precision, over the whole input range:
+ *
+ *	fastAtan2()		3.8e-8 rad
+ *	fastAsin()		3.8e-8 rad
+ *	fastSinCos()	3.3e-9
+ *	fastSqrt()		4.4e-16 relative, not for vectorized loops
+ *
+ * In float the rounding of the evaluation itself dominates, up to 1e-6.
+ * See tests/test-utilbatch, which measures them against libm.
+ */
+
+namespace openAHRS { namespace util
+{
+	template <class T>
+	inline T	fastAbs( T x )
+	{
+		return ( x < 0 ) ? -x : x;
+	}
+
+	/**
+	 * atan2( y, x ), same quadrants as libm, atan2( 0, 0 ) = 0
+	 */
+	template <class T>
+	inline T	fastAtan2( T y, T x )
+	{
+		T	ax	= fastAbs( x );
+		T	ay	= fastAbs( y );
+		T	mx	= ( ax > ay ) ? ax : ay;
+		T	mn	= ( ax > ay ) ? ay : ax;
+
+		/* atan( a ) on [0,1], odd polynomial in a */
+		T	a	= mn / ( ( mx > 0 ) ? mx : T(1) );
+		T	s	= a*a;
+		T	r	= a*( T(0.99999933567690191) + s*( T(-0.33329861147739498) +
+					s*( T(0.19946569534407965) + s*( T(-0.13908647868573473) +
+					s*( T(0.096422417399634364) + s*( T(-0.055912903967967761) +
+					s*( T(0.021863340221556036) + s*T(-0.0040546685957912358) ) ) ) ) ) ) );
+
+		r	= ( ay > ax ) ? T(C_PI/2) - r : r;
+		r	= ( x < 0 ) ? T(C_PI) - r : r;
+		return ( y < 0 ) ? -r : r;
+	}
+
+	/**
+	 * asin( x ), x is clamped to [-1,1]
+	 */
+	template <class T>
+	inline T	fastAsin( T x )
+	{
+		x	= ( x > 1 ) ? T(1) : x;
+		x	= ( x < -1 ) ? T(-1) : x;
+
+		return fastAtan2( x, T( sqrt( 1 - x*x ) ) );
+	}
+
+	/**
+	 * Sine and cosine of x, any x within a few turns of zero
+	 * (the reduction to [-pi,pi] goes through an int)
+	 */
+	template <class T>
+	inline void	fastSinCos( T x, T &s, T &c )
+	{
+		/* to [-pi,pi] */
+		T	k	= T( int( x*T(1/(2*C_PI)) + ( ( x < 0 ) ? T(-0.5) : T(0.5) ) ) );
+		x	-= k*T(2*C_PI);
+
+		/* to [-pi/2,pi/2]: sin(pi - x) = sin(x), cos(pi - x) = -cos(x) */
+		T	sgn	= 1;
+		sgn	= ( fastAbs( x ) > T(C_PI/2) ) ? T(-1) : sgn;
+		x	= ( x > T(C_PI/2) ) ? T(C_PI) - x : x;
+		x	= ( x < T(-C_PI/2) ) ? T(-C_PI) - x : x;
+
+		T	x2	= x*x;
+		s	= x*( T(0.9999999766014791) + x2*( T(-0.16666647640537946) +
+				x2*( T(0.0083328999061734622) + x2*( T(-0.00019800902120860155) +
+				x2*T(2.5904961982706334e-06) ) ) ) );
+		c	= sgn*( T(0.99999999978234511) + x2*( T(-0.49999999361917813) +
+				x2*( T(0.04166663636990707) + x2*( T(-0.0013888362668534322) +
+				x2*( T(2.4760220022270897e-05) + x2*T(-2.6052444991292152e-07) ) ) ) ) );
+	}
+
+	/**
+	 * sqrt( x ), 0 for x <= 0. Initial guess for 1/sqrt( x ) from the
+	 * exponent bits, then Newton steps y = y*( 1.5 - x*y*y/2 ), each
+	 * one squaring the relative error: 3.4e-2, 1.8e-3, 4.7e-6, 3.3e-11, 1e-16.
+	 */
+	inline float	fastSqrt( float x )
+	{
+		union { float f; int32_t i; }	u;
+		u.f	= x;
+		u.i	= 0x5f3759df - ( u.i >> 1 );
+
+		float	y	= u.f;
+		float	hx	= x/2;
+		y	= y*( 1.5f - hx*y*y );
+		y	= y*( 1.5f - hx*y*y );
+		y	= y*( 1.5f - hx*y*y );
+
+		return ( x > 0 ) ? x*y : 0;
+	}
+
+	inline double	fastSqrt( double x )
+	{
+		union { double f; int64_t i; }	u;
+		u.f	= x;
+		u.i	= 0x5fe6eb50c7b537a9LL - ( u.i >> 1 );
+
+		double	y	= u.f;
+		double	hx	= x/2;
+		y	= y*( 1.5 - hx*y*y );
+		y	= y*( 1.5 - hx*y*y );
+		y	= y*( 1.5 - hx*y*y );
+		y	= y*( 1.5 - hx*y*y );
+
+		return ( x > 0 ) ? x*y : 0;
+	}
+
+}};
+
+/**
+ * What the library calls instead of libm: libm itself, or the
+ * approximations above with FAST_MATH set.
+ */
+namespace openAHRS { namespace fmath
+{
+#if	FAST_MATH
+	template <class T>	inline T	atan2( T y, T x )	{ return util::fastAtan2( y, x ); }
+	template <class T>	inline T	sqrt( T x )			{ return util::fastSqrt( x ); }
+
+	template <class T>
+	inline T	asin( T x )
+	{
+		x	= ( x > 1 ) ? T(1) : x;
+		x	= ( x < -1 ) ? T(-1) : x;
+		return util::fastAtan2( x, util::fastSqrt( 1 - x*x ) );
+	}
+
+	template <class T>	inline void	sinCos( T x, T &s, T &c )	{ util::fastSinCos( x, s, c ); }
+#else
+	template <class T>	inline T	atan2( T y, T x )	{ return ::atan2( y, x ); }
+	template <class T>	inline T	sqrt( T x )			{ return ::sqrt( x ); }
+	template <class T>	inline T	asin( T x )			{ return ::asin( x ); }
+
+	template <class T>
+	inline void	sinCos( T x, T &s, T &c )
+	{
+		s	= ::sin( x );
+		c	= ::cos( x );
+	}
+#endif
+}};
+
+#endif	/* __fastmath_h_ */
@@ -0,0 +1,169 @@
+/*
+ *  Fixed point (Q format) arithmetic and quaternion helpers,
+ *  for targets without an FPU. See kalman/kalman7fx.h
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__ahrs_fixed_h_
+#define	__ahrs_fixed_h_
+
+#include <stdint.h>
+#include <math.h>
+
+/**
+ * Values are signed 32 bit integers with a fixed number of fractional bits F,
+ * value = x / 2^F. Products are taken in 64 bits, rounded, and saturated when
+ * stored back to 32 bits. Dot products accumulate the full 64 bit products
+ * and round only once.
+ *
+ * The formats are chosen per quantity:
+ *
+ *	FQUAT	Q1.30	quaternion components		+-2,		res 9.3e-10
+ *	FANGLE	Q3.28	angles and angle errors		+-8 rad,	res 3.7e-9 rad
+ *	FRATE	Q7.24	rates and gyro biases		+-128 rad/s, res 6.0e-8 rad/s
+ *	FTIME	Q1.30	time steps					+-2 s
+ *	FJAC	Q7.24	euler/quaternion jacobian	+-128
+ *
+ * The float conversions are only meant for the filter's boundaries,
+ * nothing in the helpers below uses floating point.
+ */
+
+namespace openAHRS { namespace fixed
+{
+	typedef	int32_t	fx;		/* Q format value */
+	typedef	int64_t	fx2;	/* double width product / accumulator */
+
+	enum {
+		FQUAT	= 30,
+		FANGLE	= 28,
+		FRATE	= 24,
+		FTIME	= 30,
+		FJAC	= 24,
+	};
+
+	/** saturation limits */
+	static const fx	FX_MAX		= 0x7fffffff;
+
+	/** pi in FANGLE */
+	static const fx	PI_ANGLE	= 843314857;
+
+	/** saturate to the 32 bit range */
+	inline fx	sat( fx2 a )
+	{
+		if ( a > FX_MAX )	return FX_MAX;
+		if ( a < -FX_MAX )	return -FX_MAX;
+		return (fx)a;
+	}
+
+	/** shift right by S with rounding, or left if S < 0 */
+	template <int S>
+	inline fx2	shr( fx2 a )
+	{
+		if ( S > 0 )
+			return ( a + ( (fx2)1 << ( S > 0 ? S-1 : 0 ) ) ) >> ( S > 0 ? S : 0 );
+		else
+			return a << ( S < 0 ? -S : 0 );
+	}
+
+	/** a*b, a in Fa, b in Fb, result in Fr */
+	template <int Fa, int Fb, int Fr>
+	inline fx	mul( fx a, fx b )
+	{
+		return sat( shr<Fa+Fb-Fr>( (fx2)a*b ) );
+	}
+
+	/** a/b, a in Fa, b in Fb, result in Fr. Saturates on division by zero */
+	template <int Fa, int Fb, int Fr>
+	inline fx	div( fx a, fx b )
+	{
+		if ( b == 0 )
+			return ( a >= 0 ) ? FX_MAX : -FX_MAX;
+		return sat( shr<Fa-Fb-Fr>( (fx2)a ) / b );
+	}
+
+	/** convert from floating point to F, saturating */
+	template <int F>
+	inline fx	fromFloat( double v )
+	{
+		v	= ldexp( v, F );
+		if ( v > FX_MAX )	return FX_MAX;
+		if ( v < -FX_MAX )	return -FX_MAX;
+		return (fx)floor( v + 0.5 );
+	}
+
+	/** convert from F to floating point */
+	template <int F>
+	inline double	toFloat( fx a )
+	{
+		return ldexp( (double)a, -F );
+	}
+
+	/** angle difference plus - minus wrapped to +-pi, as util::calcAngleError(). FANGLE */
+	inline fx	calcAngleError( fx plus, fx minus )
+	{
+		if ( (minus > PI_ANGLE/2) && (plus < -PI_ANGLE/2) )
+			return	( plus - minus ) + 2*PI_ANGLE;	/* in this order, or it overflows */
+		else if ( (minus < -PI_ANGLE/2) && (plus > PI_ANGLE/2) )
+			return	( plus - minus ) - 2*PI_ANGLE;
+		else
+			return	plus - minus;
+	}
+
+	/**
+	 * Integer square root, floor( sqrt(a) ), a >= 0.
+	 * sqrt of a value in 2F gives the value in F.
+	 */
+	fx2		isqrt( fx2 a );
+
+	/**
+	 * atan2( y, x ), y and x in any common format, result in FANGLE.
+	 * Polynomial on the first octant, error below 3e-8 rad.
+	 */
+	fx		atan2( fx y, fx x );
+
+	/**
+	 * Normalize a quaternion in FQUAT
+	 */
+	void	quatNormalize( fx q[4] );
+
+	/**
+	 * Unit quaternion (FQUAT) to [ roll pitch yaw ] (FANGLE), as util::quatToEuler()
+	 */
+	void	quatToEuler( const fx q[4], fx e[3] );
+
+	/**
+	 * d[roll pitch yaw]/dq at a unit quaternion (FQUAT), as util::calcQMeas(), in FJAC.
+	 * The roll and yaw rows are written as (K1*dK - K*dK1)/(K1^2 + K^2) for
+	 * atan2(K,K1), which needs no nested divisions.
+	 */
+	void	calcQMeas( const fx q[4], fx H[3][4] );
+
+	/**
+	 * Omega integration q = q + calcQOmega(w)*q*dt/2, as kalman7::predictState()
+	 *
+	 * @param q		quaternion, FQUAT
+	 * @param w		bias-corrected rates, FRATE
+	 * @param dt	time step, FTIME
+	 */
+	void	quatIntegrate( fx q[4], const fx w[3], fx dt );
+
+}};
+
+#endif	/* __ahrs_fixed_h_ */
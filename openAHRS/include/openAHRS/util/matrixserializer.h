@@ -30,6 +30,12 @@ namespace	openAHRS	{
 namespace	util		{
 namespace	MatrixSerializer
 {
+	/**
+	 * Raw FT values, no header: only for files written and read by the
+	 * same build. Calibration and state go to a util::CalibStore instead.
+	 *
+	 * @return false on any short write, including one only reported by fclose()
+	 */
 	template <class T>
 	bool	save( const T &m, const char *fileName )
 	{
@@ -37,18 +43,15 @@ namespace	MatrixSerializer
 		if ( f == NULL )
 			return false;
 
-		bool	ret = true;
+		size_t	n	= m.rows()*m.cols();
+		bool	ret	= ( fwrite( m.data(), sizeof(m.data()[0]), n, f ) == n );
 
-		if ( fwrite( m.data(), m.rows()*m.cols(), sizeof(m.data()[0]), f ) != sizeof(m.data()[0]) ) {
-		//if ( fwrite( m.data(), m.rows()*m.cols(), sizeof(1), f ) != sizeof(1) ) {
-			ret = false; goto out;
-		}
-	
-	out:
-		fclose(f);
+		if ( fclose(f) != 0 )
+			ret = false;
 		return ret;
 	}
 
+	/** @return false if the file is shorter or longer than m */
 	template <class T>
 	bool	load( T &m, const char *fileName )
 	{
@@ -56,12 +59,10 @@ namespace	MatrixSerializer
 		if ( f == NULL )
 			return false;
 
-		bool	ret = true;
-		if ( fread( m.data(), m.rows()*m.cols(), sizeof(m.data()[0]), f ) != sizeof(m.data()[0]) ) {
-			ret = false; goto out;
-		}
+		size_t	n	= m.rows()*m.cols();
+		bool	ret	= ( fread( m.data(), sizeof(m.data()[0]), n, f ) == n ) &&
+					  ( fgetc(f) == EOF );
 
-	out:
 		fclose(f);
 		return ret;
 	}
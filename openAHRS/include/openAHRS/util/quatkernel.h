@@ -0,0 +1,394 @@
+/*
+ *  Quaternion and rotation kernels, inline, with SSE/AVX2 versions
+ *  of the most used ones.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__quatkernel_h_
+#define	__quatkernel_h_
+
+#include <math.h>
+#include <openAHRS/util/fastmath.h>
+
+/**
+ * Which versions to use:
+ *	0	portable versions only
+ *	1	SSE for float, one quaternion per register (needs __SSE__)
+ *	2	as 1, plus double: AVX2 (__AVX2__), one quaternion per register,
+ *		or SSE2 (__SSE2__), two registers per quaternion
+ * Anything else (the AVR32 for instance) gets the portable versions.
+ * On one quaternion at a time the double versions are no faster than what
+ * the compiler makes of the portable code (see tests/test-quatbench),
+ * hence not the default.
+ */
+#ifndef	QUATKERNEL_SIMD
+	#define	QUATKERNEL_SIMD	1
+#endif
+
+#if	( QUATKERNEL_SIMD >= 1 ) && defined(__SSE__)
+	#include <xmmintrin.h>
+	#define	QUATKERNEL_SSE		1
+#else
+	#define	QUATKERNEL_SSE		0
+#endif
+
+#if	( QUATKERNEL_SIMD >= 2 ) && defined(__AVX2__)
+	#include <immintrin.h>
+	#define	QUATKERNEL_AVX2		1
+#else
+	#define	QUATKERNEL_AVX2		0
+#endif
+
+#if	( QUATKERNEL_SIMD >= 2 ) && defined(__SSE2__) && !QUATKERNEL_AVX2
+	#include <emmintrin.h>
+	#define	QUATKERNEL_SSE2		1
+#else
+	#define	QUATKERNEL_SSE2		0
+#endif
+
+/**
+ * Quaternions are [ e0 ex ey ez ] (scalar first) as everywhere else in
+ * openAHRS, products are Hamilton products, and C(q) is the body to
+ * earth-fixed rotation, so that
+ *	quatRotate( q, v )		= C(q)*v	= q (x) [0 v] (x) q*
+ *	quatRotateInv( q, v )	= C(q)'*v
+ *	quatToDCM( q )			= C(q)', earth-fixed to body, the direction of util::calcDCM()
+ *
+ * Everything works on plain arrays, so Eigen vectors can be passed with
+ * &X(0) or .data(), in place when the argument names say so.
+ * No allocation, no state.
+ */
+
+namespace openAHRS { namespace quat
+{
+	/**
+	 * Portable versions, also used for the operations with no SIMD version.
+	 * Templates so that both float and double SIMD overloads below can fall back on them.
+	 */
+	namespace scalar
+	{
+		/** r = a (x) b, r may not alias a or b */
+		template <class T>
+		inline void	multiply( const T a[4], const T b[4], T r[4] )
+		{
+			r[0]	= a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+			r[1]	= a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+			r[2]	= a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+			r[3]	= a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+		}
+
+		/** q = q (x) [ 1 w*dt/2 ], q + calcQOmega(w)*q*dt/2 */
+		template <class T>
+		inline void	integrate( T q[4], const T w[3], T dt )
+		{
+			T	h[4] = { 1, w[0]*dt/2, w[1]*dt/2, w[2]*dt/2 };
+			T	r[4];
+			multiply( q, h, r );
+			q[0] = r[0];	q[1] = r[1];	q[2] = r[2];	q[3] = r[3];
+		}
+
+		template <class T>
+		inline void	normalize( T q[4] )
+		{
+			T	inv	= 1/fmath::sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+			q[0] *= inv;	q[1] *= inv;	q[2] *= inv;	q[3] *= inv;
+		}
+
+		/** C(q)' written as a quadratic form, exact for a unit quaternion */
+		template <class T>
+		inline void	toDCM( const T q[4], T C[9] )
+		{
+			T	q00 = q[0]*q[0], q11 = q[1]*q[1], q22 = q[2]*q[2], q33 = q[3]*q[3];
+			T	q01 = q[0]*q[1], q02 = q[0]*q[2], q03 = q[0]*q[3];
+			T	q12 = q[1]*q[2], q13 = q[1]*q[3], q23 = q[2]*q[3];
+
+			C[0] = q00 + q11 - q22 - q33;	C[1] = 2*(q12 + q03);			C[2] = 2*(q13 - q02);
+			C[3] = 2*(q12 - q03);			C[4] = q00 - q11 + q22 - q33;	C[5] = 2*(q23 + q01);
+			C[6] = 2*(q13 + q02);			C[7] = 2*(q23 - q01);			C[8] = q00 - q11 - q22 + q33;
+		}
+
+		template <class T>
+		inline void	rotateInv( const T q[4], const T v[3], T r[3] )
+		{
+			T	C[9];
+			toDCM( q, C );
+			r[0]	= C[0]*v[0] + C[1]*v[1] + C[2]*v[2];
+			r[1]	= C[3]*v[0] + C[4]*v[1] + C[5]*v[2];
+			r[2]	= C[6]*v[0] + C[7]*v[1] + C[8]*v[2];
+		}
+
+		template <class T>
+		inline void	rotate( const T q[4], const T v[3], T r[3] )
+		{
+			T	C[9];
+			toDCM( q, C );
+			r[0]	= C[0]*v[0] + C[3]*v[1] + C[6]*v[2];
+			r[1]	= C[1]*v[0] + C[4]*v[1] + C[7]*v[2];
+			r[2]	= C[2]*v[0] + C[5]*v[1] + C[8]*v[2];
+		}
+	}
+
+	/*************************************************************************
+	 * Multiply
+	 *	r = b0*a + b1*[-a1 a0 a3 -a2] + b2*[-a2 -a3 a0 a1] + b3*[-a3 a2 -a1 a0]
+	 * a is the one kept in registers, b is broadcast: in the filters a is the
+	 * attitude, coming from the previous kernel call, and b a small increment
+	 * just built from scalars, which would stall a vector load.
+	 */
+
+	/** r = a (x) b, r may alias a or b */
+	inline void	quatMultiply( const float a[4], const float b[4], float r[4] )
+	{
+	#if	QUATKERNEL_SSE
+		const __m128	s1	= _mm_set_ps( -1,  1,  1, -1 );	/* _set_ is highest lane first */
+		const __m128	s2	= _mm_set_ps(  1,  1, -1, -1 );
+		const __m128	s3	= _mm_set_ps(  1, -1,  1, -1 );
+
+		__m128	A	= _mm_loadu_ps( a );
+		__m128	R	= _mm_mul_ps( _mm_set1_ps( b[0] ), A );
+		R	= _mm_add_ps( R, _mm_mul_ps( _mm_set1_ps( b[1] ),
+					_mm_mul_ps( s1, _mm_shuffle_ps( A, A, _MM_SHUFFLE(2,3,0,1) ) ) ) );
+		R	= _mm_add_ps( R, _mm_mul_ps( _mm_set1_ps( b[2] ),
+					_mm_mul_ps( s2, _mm_shuffle_ps( A, A, _MM_SHUFFLE(1,0,3,2) ) ) ) );
+		R	= _mm_add_ps( R, _mm_mul_ps( _mm_set1_ps( b[3] ),
+					_mm_mul_ps( s3, _mm_shuffle_ps( A, A, _MM_SHUFFLE(0,1,2,3) ) ) ) );
+		_mm_storeu_ps( r, R );
+	#else
+		float	t[4];
+		scalar::multiply( a, b, t );
+		r[0] = t[0];	r[1] = t[1];	r[2] = t[2];	r[3] = t[3];
+	#endif
+	}
+
+	inline void	quatMultiply( const double a[4], const double b[4], double r[4] )
+	{
+	#if	QUATKERNEL_AVX2
+		const __m256d	s1	= _mm256_set_pd( -1,  1,  1, -1 );
+		const __m256d	s2	= _mm256_set_pd(  1,  1, -1, -1 );
+		const __m256d	s3	= _mm256_set_pd(  1, -1,  1, -1 );
+
+		__m256d	A	= _mm256_loadu_pd( a );
+		__m256d	R	= _mm256_mul_pd( _mm256_set1_pd( b[0] ), A );
+		R	= _mm256_add_pd( R, _mm256_mul_pd( _mm256_set1_pd( b[1] ),
+					_mm256_mul_pd( s1, _mm256_permute4x64_pd( A, _MM_SHUFFLE(2,3,0,1) ) ) ) );
+		R	= _mm256_add_pd( R, _mm256_mul_pd( _mm256_set1_pd( b[2] ),
+					_mm256_mul_pd( s2, _mm256_permute4x64_pd( A, _MM_SHUFFLE(1,0,3,2) ) ) ) );
+		R	= _mm256_add_pd( R, _mm256_mul_pd( _mm256_set1_pd( b[3] ),
+					_mm256_mul_pd( s3, _mm256_permute4x64_pd( A, _MM_SHUFFLE(0,1,2,3) ) ) ) );
+		_mm256_storeu_pd( r, R );
+	#elif	QUATKERNEL_SSE2
+		/* [r0 r1] and [r2 r3]:
+		 *	lo	= b0*Alo + b1*[-a1  a0] + b2*[-a2 -a3] + b3*[-a3  a2]
+		 *	hi	= b0*Ahi + b1*[ a3 -a2] + b2*[ a0  a1] + b3*[-a1  a0] */
+		const __m128d	mp	= _mm_set_pd(  1, -1 );		/* [-1  1], _set_ is highest lane first */
+		const __m128d	pm	= _mm_set_pd( -1,  1 );		/* [ 1 -1] */
+
+		__m128d	Alo	= _mm_loadu_pd( a );
+		__m128d	Ahi	= _mm_loadu_pd( a+2 );
+		__m128d	SAlo	= _mm_shuffle_pd( Alo, Alo, 1 );
+		__m128d	SAhi	= _mm_shuffle_pd( Ahi, Ahi, 1 );
+		__m128d	B0 = _mm_set1_pd( b[0] ), B1 = _mm_set1_pd( b[1] );
+		__m128d	B2 = _mm_set1_pd( b[2] ), B3 = _mm_set1_pd( b[3] );
+
+		__m128d	lo	= _mm_mul_pd( B0, Alo );
+		lo	= _mm_add_pd( lo, _mm_mul_pd( B1, _mm_mul_pd( mp, SAlo ) ) );
+		lo	= _mm_sub_pd( lo, _mm_mul_pd( B2, Ahi ) );
+		lo	= _mm_add_pd( lo, _mm_mul_pd( B3, _mm_mul_pd( mp, SAhi ) ) );
+
+		__m128d	hi	= _mm_mul_pd( B0, Ahi );
+		hi	= _mm_add_pd( hi, _mm_mul_pd( B1, _mm_mul_pd( pm, SAhi ) ) );
+		hi	= _mm_add_pd( hi, _mm_mul_pd( B2, Alo ) );
+		hi	= _mm_add_pd( hi, _mm_mul_pd( B3, _mm_mul_pd( mp, SAlo ) ) );
+
+		_mm_storeu_pd( r, lo );
+		_mm_storeu_pd( r+2, hi );
+	#else
+		double	t[4];
+		scalar::multiply( a, b, t );
+		r[0] = t[0];	r[1] = t[1];	r[2] = t[2];	r[3] = t[3];
+	#endif
+	}
+
+	/*************************************************************************
+	 * Normalize. float: rsqrt estimate plus one Newton step (about 1 ulp).
+	 * double: there is no double rsqrt below AVX-512 and the three Newton
+	 * steps it needs cost as much as a sqrt, so one sqrt and one division.
+	 */
+
+	inline void	quatNormalize( float q[4] )
+	{
+	#if	QUATKERNEL_SSE
+		__m128	Q	= _mm_loadu_ps( q );
+		__m128	n	= _mm_mul_ps( Q, Q );
+		n	= _mm_add_ps( n, _mm_shuffle_ps( n, n, _MM_SHUFFLE(2,3,0,1) ) );
+		n	= _mm_add_ps( n, _mm_shuffle_ps( n, n, _MM_SHUFFLE(1,0,3,2) ) );	/* |q|^2 in all lanes */
+
+		/* y = y*( 1.5 - 0.5*n*y^2 ) */
+		__m128	y	= _mm_rsqrt_ps( n );
+		__m128	t	= _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), n ), _mm_mul_ps( y, y ) );
+		y	= _mm_mul_ps( y, _mm_sub_ps( _mm_set1_ps( 1.5f ), t ) );
+
+		_mm_storeu_ps( q, _mm_mul_ps( Q, y ) );
+	#else
+		scalar::normalize( q );
+	#endif
+	}
+
+	inline void	quatNormalize( double q[4] )
+	{
+	#if	QUATKERNEL_AVX2
+		__m256d	Q	= _mm256_loadu_pd( q );
+		__m256d	n	= _mm256_mul_pd( Q, Q );
+		n	= _mm256_add_pd( n, _mm256_permute4x64_pd( n, _MM_SHUFFLE(2,3,0,1) ) );
+		n	= _mm256_add_pd( n, _mm256_permute4x64_pd( n, _MM_SHUFFLE(1,0,3,2) ) );
+
+		__m256d	inv	= _mm256_div_pd( _mm256_set1_pd( 1.0 ), _mm256_sqrt_pd( n ) );
+		_mm256_storeu_pd( q, _mm256_mul_pd( Q, inv ) );
+	#elif	QUATKERNEL_SSE2
+		__m128d	lo	= _mm_loadu_pd( q );
+		__m128d	hi	= _mm_loadu_pd( q+2 );
+		__m128d	n	= _mm_add_pd( _mm_mul_pd( lo, lo ), _mm_mul_pd( hi, hi ) );
+		n	= _mm_add_pd( n, _mm_shuffle_pd( n, n, 1 ) );
+
+		__m128d	inv	= _mm_div_pd( _mm_set1_pd( 1.0 ), _mm_sqrt_pd( n ) );
+		_mm_storeu_pd( q, _mm_mul_pd( lo, inv ) );
+		_mm_storeu_pd( q+2, _mm_mul_pd( hi, inv ) );
+	#else
+		scalar::normalize( q );
+	#endif
+	}
+
+	/*************************************************************************
+	 * Omega integration
+	 */
+
+	/**
+	 * q = q + calcQOmega(w)*q*dt/2 = q (x) [ 1 w*dt/2 ], as kalman7::predictState()
+	 *
+	 * @param q		Quaternion, in place
+	 * @param w		Bias corrected rates [p q r]
+	 * @param dt	Time step
+	 */
+	template <class T>
+	inline void	quatIntegrate( T q[4], const T w[3], T dt )
+	{
+		T	h[4] = { 1, w[0]*(dt/2), w[1]*(dt/2), w[2]*(dt/2) };
+		quatMultiply( q, h, q );
+	}
+
+	/*************************************************************************
+	 * Rotations and conversions, portable only: for one vector the DCM form
+	 * is already shorter than two SIMD products.
+	 */
+
+	/** r = C(q)*v, body to earth-fixed. q normalized */
+	template <class T>
+	inline void	quatRotate( const T q[4], const T v[3], T r[3] )
+	{
+		scalar::rotate( q, v, r );
+	}
+
+	/** r = C(q)'*v, earth-fixed to body. q normalized */
+	template <class T>
+	inline void	quatRotateInv( const T q[4], const T v[3], T r[3] )
+	{
+		scalar::rotateInv( q, v, r );
+	}
+
+	/** C = C(q)', earth-fixed to body, row major. q normalized */
+	template <class T>
+	inline void	quatToDCM( const T q[4], T C[9] )
+	{
+		scalar::toDCM( q, C );
+	}
+
+	/** Inverse of quatToDCM(), Shepperd's method, e0 >= 0 */
+	template <class T>
+	inline void	dcmToQuat( const T C[9], T q[4] )
+	{
+		T	tr	= C[0] + C[4] + C[8];
+
+		if ( ( tr >= C[0] ) && ( tr >= C[4] ) && ( tr >= C[8] ) ) {
+			T	s	= 2*fmath::sqrt( 1 + tr );		/* 4*e0 */
+			q[0]	= s/4;
+			q[1]	= ( C[5] - C[7] )/s;
+			q[2]	= ( C[6] - C[2] )/s;
+			q[3]	= ( C[1] - C[3] )/s;
+		} else if ( ( C[0] >= C[4] ) && ( C[0] >= C[8] ) ) {
+			T	s	= 2*fmath::sqrt( 1 + C[0] - C[4] - C[8] );		/* 4*ex */
+			q[0]	= ( C[5] - C[7] )/s;
+			q[1]	= s/4;
+			q[2]	= ( C[1] + C[3] )/s;
+			q[3]	= ( C[2] + C[6] )/s;
+		} else if ( C[4] >= C[8] ) {
+			T	s	= 2*fmath::sqrt( 1 - C[0] + C[4] - C[8] );		/* 4*ey */
+			q[0]	= ( C[6] - C[2] )/s;
+			q[1]	= ( C[1] + C[3] )/s;
+			q[2]	= s/4;
+			q[3]	= ( C[5] + C[7] )/s;
+		} else {
+			T	s	= 2*fmath::sqrt( 1 - C[0] - C[4] + C[8] );		/* 4*ez */
+			q[0]	= ( C[1] - C[3] )/s;
+			q[1]	= ( C[2] + C[6] )/s;
+			q[2]	= ( C[5] + C[7] )/s;
+			q[3]	= s/4;
+		}
+
+		if ( q[0] < 0 ) {
+			q[0] = -q[0];	q[1] = -q[1];	q[2] = -q[2];	q[3] = -q[3];
+		}
+	}
+
+	/** [ roll pitch yaw ], as util::quatToEuler(). q normalized */
+	template <class T>
+	inline void	quatToEuler( const T q[4], T e[3] )
+	{
+		/** ROLL **/
+		e[0]	= fmath::atan2( 2*(q[0]*q[1] + q[2]*q[3]), 1 - 2*(q[1]*q[1] + q[2]*q[2]) );
+
+		/** PITCH **/
+		T	temp	= 2*(q[1]*q[3] - q[0]*q[2]);
+		if ( temp > 1 )		temp = 1;
+		if ( temp < -1 )	temp = -1;
+		e[1]	= -fmath::asin( temp );
+
+		/** YAW **/
+		e[2]	= fmath::atan2( 2*(q[0]*q[3] + q[1]*q[2]), 1 - 2*(q[2]*q[2] + q[3]*q[3]) );
+	}
+
+	/** [ roll pitch yaw ] to quaternion, as util::eulerToQuat() */
+	template <class T>
+	inline void	eulerToQuat( const T e[3], T q[4] )
+	{
+		T	Cr, Sr, Cp, Sp, Cy, Sy;
+
+		fmath::sinCos( T( e[0]/2 ), Sr, Cr );
+		fmath::sinCos( T( e[1]/2 ), Sp, Cp );
+		fmath::sinCos( T( e[2]/2 ), Sy, Cy );
+
+		q[0]	= Cr*Cp*Cy + Sr*Sp*Sy;
+		q[1]	= Sr*Cp*Cy - Cr*Sp*Sy;
+		q[2]	= Cr*Sp*Cy + Sr*Cp*Sy;
+		q[3]	= Cr*Cp*Sy - Sr*Sp*Cy;
+	}
+
+}};
+
+#endif	/* __quatkernel_h_ */
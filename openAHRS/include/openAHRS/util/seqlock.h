@@ -0,0 +1,126 @@
+/*
+ *  Sequence lock: one thread publishes a value, others read it without
+ *  ever waiting on a lock.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__ahrs_seqlock_h_
+#define	__ahrs_seqlock_h_
+
+#include <sched.h>
+
+namespace openAHRS { namespace util
+{
+	/**
+	 * A value written by one thread and read by any number of others.
+	 * The writer bumps a counter to odd, copies the value in and bumps
+	 * it to even again. A reader copies the value out between two reads
+	 * of the counter, and the copy is good if the counter was even and
+	 * did not change. Nobody takes a lock: the writer never waits, and
+	 * a reader that raced a write gets false from tryRead() and tries
+	 * again later, so a control loop can poll it at full rate.
+	 *
+	 * T must be plain data, copied with its assignment operator: a
+	 * reader may copy it while it is half written (the copy is then
+	 * thrown away), so no pointers to things the writer frees.
+	 * Only one thread may write.
+	 */
+	template <class T>
+	class	SeqLock
+	{
+		private:
+			volatile unsigned	seq;	/* odd while a write is in progress */
+			T					value;
+
+		public:
+			SeqLock() { seq = 0; }
+
+			/**
+			 * Publish a new value, from the writer thread only
+			 */
+			void	write( const T &v )
+			{
+				seq++;
+				__sync_synchronize();
+				value	= v;
+				__sync_synchronize();
+				seq++;
+			}
+
+			/**
+			 * One attempt at reading, never waits.
+			 *
+			 * @param v		where to copy the value. Garbage if false is returned
+			 * @return	false if a write was in progress
+			 */
+			bool	tryRead( T &v ) const
+			{
+				unsigned	s	= seq;
+				if ( s & 1 )
+					return false;
+				__sync_synchronize();
+				v	= value;
+				__sync_synchronize();
+				return ( seq == s );
+			}
+
+			/**
+			 * Poll for a value written since the one last read.
+			 *
+			 * @param v			where to copy the value, only changed if true is returned
+			 * @param version	version last read by the caller, 0 at first. Updated
+			 * @return	true if a newer value was copied to v
+			 */
+			bool	readIfNewer( T &v, unsigned &version ) const
+			{
+				unsigned	s	= seq;
+				if ( ( s & 1 ) || ( s/2 == version ) )
+					return false;
+
+				T	tmp;
+				__sync_synchronize();
+				tmp	= value;
+				__sync_synchronize();
+				if ( seq != s )
+					return false;
+
+				v		= tmp;
+				version	= s/2;
+				return true;
+			}
+
+			/**
+			 * Read, retrying until no write gets in the way. Yields between
+			 * attempts, the writer may need the CPU to finish. Not for loops
+			 * that must not wait, use tryRead() there.
+			 */
+			void	read( T &v ) const
+			{
+				while ( !tryRead(v) )
+					sched_yield();
+			}
+
+			/** number of values written so far */
+			unsigned	getVersion() const { return seq/2; }
+	};
+
+}};
+
+#endif	/* __ahrs_seqlock_h_ */
@@ -0,0 +1,217 @@
+/*
+ *  Fixed size pool of worker threads for running independent jobs,
+ *  parameter sweeps and batch fits for instance.
+ *  Link with '-lpthread'
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__ahrs_threadpool_h_
+#define	__ahrs_threadpool_h_
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+namespace openAHRS { namespace util
+{
+	/**
+	 * Number of processors online, at least 1
+	 */
+	inline int	numProcessors()
+	{
+		long	n	= sysconf( _SC_NPROCESSORS_ONLN );
+		return ( n > 0 ) ? (int)n : 1;
+	}
+
+	/**
+	 * Worker threads taking jobs from a FIFO queue. A job is a function
+	 * and an argument, it runs on whichever thread is free first, so
+	 * jobs must not depend on each other or share unprotected data.
+	 * The threads are started by the constructor and stay until the
+	 * pool is destroyed, waiting on a condition variable when idle.
+	 */
+	class	ThreadPool
+	{
+		public:
+			typedef void	(*Job)( void *arg );
+			typedef void	(*IndexJob)( int i, void *arg );
+
+		private:
+			struct	Task
+			{
+				Job		job;
+				void	*arg;
+			};
+
+			/* one index of parallelFor() */
+			struct	ForTask
+			{
+				IndexJob	job;
+				int			i;
+				void		*arg;
+			};
+
+			std::deque<Task>		queue;
+			std::vector<pthread_t>	threads;
+
+			int				pending;	/* queued plus running */
+			bool			quit;
+
+			pthread_mutex_t	mutex;
+			pthread_cond_t	hasWork;
+			pthread_cond_t	allDone;
+
+			static void	*worker( void *p )
+			{
+				ThreadPool	*pool	= (ThreadPool *)p;
+
+				pthread_mutex_lock( &pool->mutex );
+				for (;;)
+				{
+					while ( pool->queue.empty() && !pool->quit )
+						pthread_cond_wait( &pool->hasWork, &pool->mutex );
+
+					if ( pool->queue.empty() )
+						break;		/* quit, and nothing left to do */
+
+					Task	t	= pool->queue.front();
+					pool->queue.pop_front();
+
+					pthread_mutex_unlock( &pool->mutex );
+					t.job( t.arg );
+					pthread_mutex_lock( &pool->mutex );
+
+					if ( --pool->pending == 0 )
+						pthread_cond_broadcast( &pool->allDone );
+				}
+				pthread_mutex_unlock( &pool->mutex );
+
+				return NULL;
+			}
+
+			static void	runForTask( void *p )
+			{
+				ForTask	*t	= (ForTask *)p;
+				t->job( t->i, t->arg );
+			}
+
+			/* not copyable */
+			ThreadPool( const ThreadPool & );
+			ThreadPool &	operator=( const ThreadPool & );
+
+		public:
+			/**
+			 * @param nThreads	number of worker threads, 0 for one per processor
+			 */
+			ThreadPool( int nThreads = 0 )
+			{
+				pending	= 0;
+				quit	= false;
+
+				pthread_mutex_init( &mutex, NULL );
+				pthread_cond_init( &hasWork, NULL );
+				pthread_cond_init( &allDone, NULL );
+
+				if ( nThreads <= 0 )
+					nThreads	= numProcessors();
+
+				for (int i=0; i < nThreads; i++) {
+					pthread_t	th;
+					if ( pthread_create( &th, NULL, worker, this ) == 0 )
+						threads.push_back( th );
+				}
+			}
+
+			/** runs what is still queued, then stops the threads */
+			~ThreadPool()
+			{
+				pthread_mutex_lock( &mutex );
+				quit	= true;
+				pthread_cond_broadcast( &hasWork );
+				pthread_mutex_unlock( &mutex );
+
+				for (unsigned int i=0; i < threads.size(); i++)
+					pthread_join( threads[i], NULL );
+
+				pthread_cond_destroy( &allDone );
+				pthread_cond_destroy( &hasWork );
+				pthread_mutex_destroy( &mutex );
+			}
+
+			/** number of worker threads */
+			inline int	size() const { return threads.size(); }
+
+			/**
+			 * Queue a job. If no thread could be started it runs right here.
+			 *
+			 * @param job	function to run
+			 * @param arg	its argument, must stay valid until the job is done
+			 */
+			void	submit( Job job, void *arg )
+			{
+				if ( threads.empty() ) {
+					job( arg );
+					return;
+				}
+
+				Task	t;
+				t.job	= job;
+				t.arg	= arg;
+
+				pthread_mutex_lock( &mutex );
+				queue.push_back( t );
+				pending++;
+				pthread_cond_signal( &hasWork );
+				pthread_mutex_unlock( &mutex );
+			}
+
+			/** wait until every job submitted so far has finished */
+			void	wait()
+			{
+				pthread_mutex_lock( &mutex );
+				while ( pending > 0 )
+					pthread_cond_wait( &allDone, &mutex );
+				pthread_mutex_unlock( &mutex );
+			}
+
+			/**
+			 * job( i, arg ) for i = 0..n-1, spread over the threads,
+			 * returns when all of them are done. Each i is a separate job,
+			 * so that short and long ones balance out; keep them coarse.
+			 */
+			void	parallelFor( int n, IndexJob job, void *arg )
+			{
+				std::vector<ForTask>	tasks( n );
+
+				for (int i=0; i < n; i++) {
+					tasks[i].job	= job;
+					tasks[i].i		= i;
+					tasks[i].arg	= arg;
+					submit( runForTask, &tasks[i] );
+				}
+				wait();
+			}
+	};
+
+}};
+
+#endif	/* __ahrs_threadpool_h_ */
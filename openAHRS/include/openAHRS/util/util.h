@@ -25,6 +25,7 @@
 #ifndef	__util_h_
 #define	__util_h_
 
+#include <stddef.h>
 #include <Eigen/Core>
 
 USING_PART_OF_NAMESPACE_EIGEN
@@ -121,9 +122,99 @@ namespace openAHRS { namespace util
 	float	calcHeading( const Matrix<FT,3,1> &magn, const Matrix<FT,3,1> &attitude );
 
 	/**
-	 * Normalize quaternion
+	 * Earth-fixed vector seen in body coordinates, and its jacobian, such that
+	 *	v = C(q)'*ref
+	 *	H = [ dv\de0 dv\dex dv\dey dv\dez ]
+	 * Written as a quadratic form in q: only multiplies and adds,
+	 * and exact for a unit quaternion.
 	 *
-	 * NOT USED
+	 * @param q		[e0 ex ey ez]', normalized
+	 * @param ref	Vector in earth-fixed coordinates
+	 * @param v		Output, ref in body coordinates
+	 * @param H		Output, jacobian regarding quaternion state
+	 */
+	void	calcVectorMeas( const Matrix<FT,4,1> &q, const Matrix<FT,3,1> &ref,
+							Matrix<FT,3,1> &v, Matrix<FT,3,4> &H );
+
+	/**
+	 * Accelerometer and magnetometer data to unit vectors in the body frame
+	 * of the attitude quaternion, with the axis signs accelToPR() and
+	 * calcHeading() assume. Gravity is then [0 0 1]' in earth-fixed
+	 * coordinates and the magnetic field [cos(incl) 0 sin(incl)]'
+	 *
+	 * @param accels	Accelerometer data, input
+	 * @param magn		Magnetometer data, input
+	 * @param v			Output unit vector
+	 */
+	void	accelToVector( const Matrix<FT,3,1> &accels, Matrix<FT,3,1> &v );
+	void	magnToVector( const Matrix<FT,3,1> &magn, Matrix<FT,3,1> &v );
+
+	/**
+	 * Earth-fixed magnetic field reference for a measured field direction:
+	 * the measurement rotated to earth-fixed coordinates with the current
+	 * attitude, keeping only north and down. Used as the reference for the
+	 * very same measurement, the residual is then horizontal, so magnetic
+	 * errors (or a wrong inclination) only affect yaw, as with calcHeading().
+	 *
+	 * @param q		Current attitude, normalized
+	 * @param m		Magnetic field direction in body coordinates, see magnToVector()
+	 * @param ref	Output, unit vector [north 0 down]'
+	 */
+	void	magnReference( const Matrix<FT,4,1> &q, const Matrix<FT,3,1> &m,
+							Matrix<FT,3,1> &ref );
+
+	/**
+	 * Attitude from one gravity and one magnetic field direction, closed
+	 * form (TRIAD): gravity is matched exactly, the field only sets yaw,
+	 * so the inclination doesn't need to be known. Same frames and axis
+	 * signs as accelToVector() and magnToVector().
+	 *
+	 * @param accels	Accelerometer data, averaged for a good start
+	 * @param magn		Magnetometer data, calibrated
+	 * @param q			Output, [e0 ex ey ez]', normalized
+	 * @return			false if the two are (nearly) parallel, q is then unchanged
+	 */
+	bool	triad( const Matrix<FT,3,1> &accels, const Matrix<FT,3,1> &magn,
+					Matrix<FT,4,1> &q );
+
+	/**
+	 * Batch forms of quatToEuler(), quatToEulerNorm(), eulerToQuat(),
+	 * accelToPR() and calcHeading(), for whole logs at once.
+	 * Arrays are structure of arrays: each component is n values long
+	 * and they follow each other, e.g. q = [ e0[n] ex[n] ey[n] ez[n] ]
+	 * and angles = [ roll[n] pitch[n] yaw[n] ].
+	 * atan2, asin, sin and cos are the approximations in fastmath.h,
+	 * so the loops vectorize; see there for the error bounds.
+	 * eulerToQuatBatch() may return -q instead of q for angles out of [-pi,pi].
+	 * Input and output arrays must not overlap.
+	 *
+	 * @param q			Quaternions, 4 components
+	 * @param angles	Euler angles, 3 components. accelToPRBatch() leaves yaw alone
+	 * @param accels	Accelerometer data, 3 components
+	 * @param magn		Magnetometer data, 3 components
+	 * @param heading	Output of calcHeadingBatch(), n values. May be angles+2*n
+	 * @param n			Number of samples
+	 */
+	void	quatToEulerBatch( const FT *q, FT *angles, size_t n );
+	void	quatToEulerNormBatch( const FT *q, FT *angles, size_t n );
+	void	eulerToQuatBatch( const FT *angles, FT *q, size_t n );
+	void	accelToPRBatch( const FT *accels, FT *angles, size_t n );
+	void	calcHeadingBatch( const FT *magn, const FT *angles, FT *heading, size_t n );
+
+	/**
+	 * out = A*v + b for n 3-vectors, structure of arrays as above.
+	 * This is the block form of calib::SensorTransform.
+	 *
+	 * @param A		3x3 matrix, row-major
+	 * @param b		Offset, 3 values
+	 * @param v		Input, 3 components
+	 * @param out	Output, 3 components, must not overlap v
+	 * @param n		Number of samples
+	 */
+	void	affineBatch( const FT *A, const FT *b, const FT *v, FT *out, size_t n );
+
+	/**
+	 * Normalize quaternion, see quat::quatNormalize()
 	 */
 	void	quatNormalize( Matrix<FT,4,1> &q );
 
@@ -24,6 +24,7 @@
 
 
 #include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/util/quatkernel.h>
 
 
 #include <Eigen/Core>
@@ -39,6 +40,15 @@ namespace openAHRS {
 	kalman7::kalman7()
 	{
 		meas_variance = 0.01;	//just to initialize it
+		sequentialUpdate = false;
+		accelVar = magnVar = meas_variance;
+
+		steadyEnabled	= false;
+		steady			= false;
+		steadyCount		= 0;
+		gainAxes		= 0;
+		gainsJoint		= false;
+		setSteadyStateLimits( 1e-3, 50, 3, 0.2 );
 	}
 
 	void	kalman7::KalmanInit( Matrix<FT,3,1> &startAngle, 
@@ -55,6 +65,8 @@ namespace openAHRS {
 		R.setIdentity();
 		R	*= meas_variance;
 
+		accelVar = magnVar = meas_variance;
+
 		/** noise model covariance matrix  **/
 		W.setIdentity();
 		
@@ -69,18 +81,22 @@ namespace openAHRS {
 		/** initial estimate and bias **/
 		X.block<4,1>(0,0)	= util::eulerToQuat( startAngle );
 		X.block<3,1>(4,0)	= startBias;
+
+		/* P starts over, so does the convergence test */
+		leaveSteadyState();
+		gainAxes	= 0;
+		for (int i=0; i < 8; i++)
+			lastTrace[i]	= 0;
 	}
 
 	void	kalman7::predictState( Matrix<FT,7,1> &X, 
 					const Matrix<FT,3,1> &gyros, FT dt )
 	{
-		Matrix<FT,4,1>	quat = X.block<4,1>(0,0);
-		FT	p = gyros(0) - X(4);
-		FT	q = gyros(1) - X(5);
-		FT	r = gyros(2) - X(6);
+		Matrix<FT,3,1>	w;
+		w	<< gyros(0) - X(4), gyros(1) - X(5), gyros(2) - X(6);
 
-		/* New quaternion estimate */
-		X.block<4,1>(0,0) = quat + util::calcQOmega( p, q, r )*quat*dt/2;
+		/* New quaternion estimate, quat + calcQOmega( p, q, r )*quat*dt/2 */
+		quat::quatIntegrate( X.data(), w.data(), dt );
 	
 		/* bias estimates are untouched */
 	}
@@ -117,6 +133,14 @@ namespace openAHRS {
 
 	void	kalman7::KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt )
 	{
+		if ( sequentialUpdate ) {
+			KalmanUpdate( iter, angles, dt, 0x7 );
+			return;
+		}
+
+		if ( steady && steadyUpdate( angles, 0x7, true ) )
+			return;
+
 		/*if ( iter == 0 )
 		{
 			cout << "A\n" << A << endl;
@@ -130,7 +154,7 @@ namespace openAHRS {
 
 		/** Renormalize quaternion **/
 		q	= X.start<4>();
-		q.normalize();
+		quat::quatNormalize( q.data() );
 		X.start<4>()	= q;
 
 		/*** KALMAN UPDATE **/
@@ -138,17 +162,39 @@ namespace openAHRS {
 		/*- R should be weighted depending on angle,
 		 * since real inputs are accels */
 
-		H.block<3,4>(0,0)	= util::calcQMeas( q );
+		/* H = [ Hq 0 ], the bias columns are always zero,
+		 * so only the first 4 columns of P take part */
+		Matrix<FT,3,4>	Hq	= util::calcQMeas( q );
+		H.block<3,4>(0,0)	= Hq;
+
+		Matrix<FT,7,3>	PHt;	/* P*H' */
+		for (int j=0; j < 3; j++)
+			for (int i=0; i < 7; i++)
+				PHt(i,j) = P(i,0)*Hq(j,0) + P(i,1)*Hq(j,1) + P(i,2)*Hq(j,2) + P(i,3)*Hq(j,3);
 
+		Matrix<FT,3,3>	Sm;		/* H*P*H' + R, lower triangle then mirrored */
+		for (int j=0; j < 3; j++)
+			for (int i=j; i < 3; i++)
+				Sm(i,j) = Hq(i,0)*PHt(0,j) + Hq(i,1)*PHt(1,j) + Hq(i,2)*PHt(2,j) + Hq(i,3)*PHt(3,j) + R(i,j);
+		Sm(0,1) = Sm(1,0);	Sm(0,2) = Sm(2,0);	Sm(1,2) = Sm(2,1);
 
-		Matrix<FT,7,3>	Ht	= H.transpose();
 		Matrix<FT,3,3> inv;
-		( H*P*Ht + R ).computeInverse( &inv );
+		invertSym3( Sm, inv );
 
 		if ( isnan( inv(0,0) ) )
 			cout << "NAN" << endl;
 		
-		K	= P*Ht * inv;	
+		/* K = P*H'*inv, written out so that kalman7Bank can follow the same arithmetic */
+		for (int j=0; j < 3; j++)
+			for (int i=0; i < 7; i++)
+				K(i,j) = PHt(i,0)*inv(0,j) + PHt(i,1)*inv(1,j) + PHt(i,2)*inv(2,j);
+
+		if ( steadyEnabled ) {
+			Kss		= K;
+			Sss		<< Sm(0,0), Sm(1,1), Sm(2,2);
+			gainAxes	= 0x7;
+			gainsJoint	= true;
+		}
 		/*if ( iter == 0 ) {
 			cout << "P\n" << P << endl;
 			cout << "R\n" << R << endl;
@@ -163,7 +209,8 @@ namespace openAHRS {
 		angleErr(1)	= util::calcAngleError( angles(1), predAngles(1) );
 		angleErr(2)	= util::calcAngleError( angles(2), predAngles(2) );
 
-		X	= X + K*angleErr;
+		for (int i=0; i < 7; i++)
+			X(i) += K(i,0)*angleErr(0) + K(i,1)*angleErr(1) + K(i,2)*angleErr(2);
 
 /*		if ( iter == 0 )
 			cout << "X\n" << X << endl;*/
@@ -172,28 +219,332 @@ namespace openAHRS {
 	
 		/** Renormalize Quaternion **/
 		q	= X.start<4>();
-		q.normalize();
+		quat::quatNormalize( q.data() );
 		X.start<4>()	= q;
 
 		#if 0
 			P	= ( I - K*H ) * P;	/* Using this might not be right if 
 									calculation problems arise */
 		#else
-			P	= ( I - K*H ) * P * (( I - K*H ).transpose()) + K*R*(K.transpose());
+			/* Joseph form, ( I - K*H ) * P * (( I - K*H ).transpose()) + K*R*(K.transpose()),
+			 * expanded as P - G - G' + K*S*K' with G = K*(P*H')' and S = H*P*H' + R.
+			 * Still valid for any K, but with no 7x7 products: only the lower
+			 * triangle is computed, then mirrored */
+			Matrix<FT,7,3>	KS;
+			for (int j=0; j < 3; j++)
+				for (int i=0; i < 7; i++)
+					KS(i,j) = K(i,0)*Sm(0,j) + K(i,1)*Sm(1,j) + K(i,2)*Sm(2,j);
+
+			for (int c=0; c < 7; c++)
+				for (int r=c; r < 7; r++)
+				{
+					FT	g	= K(r,0)*PHt(c,0) + K(r,1)*PHt(c,1) + K(r,2)*PHt(c,2);
+					FT	gt	= K(c,0)*PHt(r,0) + K(c,1)*PHt(r,1) + K(c,2)*PHt(r,2);
+					FT	ksk	= KS(r,0)*K(c,0) + KS(r,1)*K(c,1) + KS(r,2)*K(c,2);
+
+					P(r,c)	+= ksk - g - gt;
+				}
+			mirrorLower( P );
 		#endif
-		
+
+		checkConvergence( 0x7 );
+	}
+
+
+	void	kalman7::KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask )
+	{
+		if ( steady && steadyUpdate( angles, axisMask, false ) )
+			return;
+
+		/* gains from a joint update do not apply to sequential ones */
+		if ( gainsJoint ) {
+			gainAxes	= 0;
+			gainsJoint	= false;
+		}
+
+		/** Renormalize quaternion **/
+		q	= X.start<4>();
+		quat::quatNormalize( q.data() );
+		X.start<4>()	= q;
+
+		/** linearization and innovation at the predicted state, for all axes **/
+		Matrix<FT,3,4>	Hq	= util::calcQMeas( q );
+
+		Matrix<FT,3,1>	predAngles	= util::quatToEuler( q );
+		angleErr(0)	= util::calcAngleError( angles(0), predAngles(0) );
+		angleErr(1)	= util::calcAngleError( angles(1), predAngles(1) );
+		angleErr(2)	= util::calcAngleError( angles(2), predAngles(2) );
+
+		Matrix<FT,7,1>	X0 = X;
+
+		for (int j=0; j < 3; j++)
+			if ( axisMask & (1 << j) )
+				scalarUpdate( Hq.block<1,4>(j,0), angleErr(j), R(j,j), X0, j );
+		mirrorLower( P );
+
+		/** Renormalize Quaternion **/
+		q	= X.start<4>();
+		quat::quatNormalize( q.data() );
+		X.start<4>()	= q;
+
+		checkConvergence( axisMask & 0x7 );
+	}
+
+
+	void	kalman7::KalmanUpdateVectors( int iter, const Matrix<FT,3,1> &accels,
+								const Matrix<FT,3,1> &magns, FT dt, unsigned int vecMask )
+	{
+		/* no cached gains for the vector measurements */
+		leaveSteadyState();
+
+		/** Renormalize quaternion **/
+		q	= X.start<4>();
+		quat::quatNormalize( q.data() );
+		X.start<4>()	= q;
+
+		Matrix<FT,7,1>	X0 = X;
+		Matrix<FT,3,1>	z, zPred, ref;
+		Matrix<FT,3,4>	Hq;
+
+		/** gravity, [0 0 1]' earth-fixed **/
+		if ( vecMask & 0x1 )
+		{
+			util::accelToVector( accels, z );
+			ref	<< 0, 0, 1;
+			util::calcVectorMeas( q, ref, zPred, Hq );
+
+			for (int j=0; j < 3; j++)
+				scalarUpdate( Hq.block<1,4>(j,0), z(j) - zPred(j), accelVar, X0, -1 );
+		}
+
+		/** magnetic field, linearized at the same X0 **/
+		if ( vecMask & 0x2 )
+		{
+			util::magnToVector( magns, z );
+			util::magnReference( q, z, ref );
+			util::calcVectorMeas( q, ref, zPred, Hq );
+
+			for (int j=0; j < 3; j++)
+				scalarUpdate( Hq.block<1,4>(j,0), z(j) - zPred(j), magnVar, X0, -1 );
+		}
+
+		mirrorLower( P );
+
+		/** Renormalize Quaternion **/
+		q	= X.start<4>();
+		quat::quatNormalize( q.data() );
+		X.start<4>()	= q;
+	}
+
+
+	void	kalman7::scalarUpdate( const Matrix<FT,1,4> &h, FT innov, FT r,
+					const Matrix<FT,7,1> &X0, int axis )
+	{
+		/* u = P*h', h = [ h 0 0 0 ], so only the first 4 columns of P are needed.
+		 * Only the lower triangle of P is kept up to date here, the caller mirrors it */
+		Matrix<FT,7,1>	u;
+		for (int i=0; i < 7; i++)
+		{
+			FT	t = 0;
+			for (int k=0; k < 4; k++)
+				t += ( i >= k ? P(i,k) : P(k,i) )*h(k);
+			u(i) = t;
+		}
+
+		FT	s	= h(0)*u(0) + h(1)*u(1) + h(2)*u(2) + h(3)*u(3) + r;
+
+		if ( !(s > 0) ) {
+			cout << "NAN" << endl;
+			return;
+		}
+
+		/* residual against the state already corrected by the previous
+		 * measurements, same linearization: equal to the batch update for a diagonal R */
+		FT	res	= innov - ( h(0)*( X(0) - X0(0) ) + h(1)*( X(1) - X0(1) ) +
+							h(2)*( X(2) - X0(2) ) + h(3)*( X(3) - X0(3) ) );
+
+		X	+= u*(res/s);
+
+		if ( steadyEnabled && ( axis >= 0 ) ) {
+			for (int i=0; i < 7; i++)
+				Kss(i,axis)	= u(i)/s;
+			Sss(axis)	= s;
+			gainAxes	|= 1 << axis;
+		}
+
+		/* P = (I-k*h)*P*(I-k*h)' + k*r*k' reduces to P - u*u'/s for a scalar */
+		for (int c=0; c < 7; c++)
+			for (int r=c; r < 7; r++)
+				P(r,c) -= u(r)*u(c)/s;
+	}
+
+
+	bool	kalman7::steadyUpdate( const Matrix<FT,3,1> &angles, unsigned int axisMask, bool joint )
+	{
+		axisMask	&= 0x7;
+
+		/* the gains must have been cached by the same kind of update */
+		if ( ( joint != gainsJoint ) || ( ( gainAxes & axisMask ) != axisMask ) ) {
+			leaveSteadyState();
+			return false;
+		}
+
+		/** Renormalize quaternion **/
+		q	= X.start<4>();
+		quat::quatNormalize( q.data() );
+		X.start<4>()	= q;
+
+		Matrix<FT,3,1>	predAngles	= util::quatToEuler( q );
+		angleErr(0)	= util::calcAngleError( angles(0), predAngles(0) );
+		angleErr(1)	= util::calcAngleError( angles(1), predAngles(1) );
+		angleErr(2)	= util::calcAngleError( angles(2), predAngles(2) );
+
+		/** innovation gate: something moved, the frozen P no longer holds **/
+		for (int j=0; j < 3; j++)
+			if ( ( axisMask & (1 << j) ) &&
+				 !( angleErr(j)*angleErr(j) <= steadyInnovGate*steadyInnovGate*Sss(j) ) )
+			{
+				leaveSteadyState();
+				return false;
+			}
+
+		if ( joint )
+		{
+			for (int i=0; i < 7; i++)
+				X(i) += Kss(i,0)*angleErr(0) + Kss(i,1)*angleErr(1) + Kss(i,2)*angleErr(2);
+		}
+		else
+		{
+			/* same residual as scalarUpdate(), each gain was cached after the previous axes */
+			Matrix<FT,3,4>	Hq	= util::calcQMeas( q );
+			Matrix<FT,7,1>	X0 = X;
+
+			for (int j=0; j < 3; j++)
+				if ( axisMask & (1 << j) )
+				{
+					FT	res	= angleErr(j) - ( Hq(j,0)*( X(0) - X0(0) ) + Hq(j,1)*( X(1) - X0(1) ) +
+										Hq(j,2)*( X(2) - X0(2) ) + Hq(j,3)*( X(3) - X0(3) ) );
+					for (int i=0; i < 7; i++)
+						X(i) += Kss(i,j)*res;
+				}
+		}
+
+		/** Renormalize Quaternion **/
+		q	= X.start<4>();
+		quat::quatNormalize( q.data() );
+		X.start<4>()	= q;
+
+		return true;
+	}
+
+
+	void	kalman7::checkConvergence( unsigned int axisMask )
+	{
+		if ( !steadyEnabled )
+			return;
+
+		/* P after an update depends on which axes were used, so compare
+		 * with the last update of the same axes only */
+		FT	tr	= P(0,0) + P(1,1) + P(2,2) + P(3,3) + P(4,4) + P(5,5) + P(6,6);
+		FT	d	= tr - lastTrace[axisMask];
+		lastTrace[axisMask]	= tr;
+
+		if ( fabs( d ) <= steadyTol*tr )
+			steadyCount++;
+		else
+			steadyCount = 0;
+
+		if ( steadyCount >= steadyCycles )
+			steady	= true;
+	}
+
+
+	void	kalman7::invertSym3( const Matrix<FT,3,3> &S, Matrix<FT,3,3> &inv )
+	{
+		/* cofactors from the lower triangle */
+		FT	c00	= S(1,1)*S(2,2) - S(2,1)*S(2,1);
+		FT	c10	= S(2,0)*S(2,1) - S(1,0)*S(2,2);
+		FT	c20	= S(1,0)*S(2,1) - S(2,0)*S(1,1);
+		FT	c11	= S(0,0)*S(2,2) - S(2,0)*S(2,0);
+		FT	c21	= S(1,0)*S(2,0) - S(0,0)*S(2,1);
+		FT	c22	= S(0,0)*S(1,1) - S(1,0)*S(1,0);
+
+		FT	id	= 1/( S(0,0)*c00 + S(1,0)*c10 + S(2,0)*c20 );
+
+		inv(0,0) = c00*id;
+		inv(1,0) = inv(0,1) = c10*id;
+		inv(2,0) = inv(0,2) = c20*id;
+		inv(1,1) = c11*id;
+		inv(2,1) = inv(1,2) = c21*id;
+		inv(2,2) = c22*id;
+	}
+
+
+	void	kalman7::mirrorLower( Matrix<FT,7,7> &M )
+	{
+		for (int c=1; c < 7; c++)
+			for (int r=0; r < c; r++)
+				M(r,c) = M(c,r);
 	}
 
 
 	void	kalman7::KalmanPredict( int iter, const Matrix<FT,3,1> &gyros, FT dt )
 	{
+		if ( steady )
+		{
+			/* slow enough: the state only, P stays frozen */
+			FT	wx = gyros(0) - X(4), wy = gyros(1) - X(5), wz = gyros(2) - X(6);
+			if ( wx*wx + wy*wy + wz*wz <= steadyRateGate*steadyRateGate ) {
+				predictState( X, gyros, dt );
+				return;
+			}
+			leaveSteadyState();
+		}
+
 		/** Predict **/
+		/* linearize at the current estimate, which is not the one from the
+		 * last update when several predicts run in a row (see AHRSs/avr32) */
+		q	= X.start<4>();
 		calcA( A, gyros, q, dt );
 
 		/** only update quaternion-relevant data in our state vector **/
 		predictState( X, gyros, dt );
 		
-		P	= A*P*(A.transpose()) + W;
+		/**
+		 * P = A*P*A' + W, with A = [ A11 A12 ; 0 I ] (4+3 blocks):
+		 *	B	= [ A11 A12 ]*P		(4x7)
+		 *	P11	= B*[ A11 A12 ]'	only the lower triangle
+		 *	P21	= B(:,4..6)'		the bias rows are not changed by A
+		 *	P22	= P22
+		 */
+		Matrix<FT,4,7>	B;
+		for (int c=0; c < 7; c++)
+			for (int r=0; r < 4; r++)
+			{
+				FT	s = 0;
+				for (int k=0; k < 7; k++)
+					s += A(r,k)*P(k,c);
+				B(r,c) = s;
+			}
+
+		for (int c=0; c < 4; c++)
+			for (int r=c; r < 4; r++)
+			{
+				FT	s = 0;
+				for (int k=0; k < 7; k++)
+					s += B(r,k)*A(c,k);
+				P(r,c) = s;
+			}
+
+		for (int c=0; c < 4; c++)
+			for (int r=4; r < 7; r++)
+				P(r,c) = B(c,r);
+
+		for (int c=0; c < 7; c++)
+			for (int r=c; r < 7; r++)
+				P(r,c) += W(r,c);
+
+		mirrorLower( P );
 
 
 
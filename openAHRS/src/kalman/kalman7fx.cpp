@@ -0,0 +1,244 @@
+/*
+ *  7-state Kalman Filter for gyro and accelerometer processing
+ *	Position and gyro bias tracking. Fixed point version.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+#include <openAHRS/kalman/kalman7fx.h>
+
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+using namespace openAHRS::fixed;
+
+namespace openAHRS {
+
+	kalman7fx::kalman7fx()
+	{
+	}
+
+	void	kalman7fx::KalmanInit( Matrix<FT,3,1> &startAngle,
+						Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var )
+	{
+		/** P = D*I*D, W = D*W*D **/
+		for (int r=0; r < 7; r++)
+			for (int c=0; c < 7; c++)
+				P[r][c]	= 0;
+
+		for (int i=0; i < 4; i++) {
+			P[i][i]	= fromFloat<FCOV>( ldexp( 1.0, 2*QUAT_SCALE ) );
+			W[i]	= fromFloat<FCOV>( ldexp( process_quat_var, 2*QUAT_SCALE ) );
+		}
+		for (int i=4; i < 7; i++) {
+			P[i][i]	= fromFloat<FCOV>( ldexp( 1.0, 2*BIAS_SCALE ) );
+			W[i]	= fromFloat<FCOV>( ldexp( process_bias_var, 2*BIAS_SCALE ) );
+		}
+
+		for (int i=0; i < 3; i++)
+			R[i]	= fromFloat<FCOV>( meas_var );
+
+		/** initial estimate and bias **/
+		Matrix<FT,4,1>	q0	= util::eulerToQuat( startAngle );
+		for (int i=0; i < 4; i++)
+			q[i]	= fromFloat<FQUAT>( q0(i) );
+		for (int i=0; i < 3; i++)
+			bias[i]	= fromFloat<FRATE>( startBias(i) );
+	}
+
+	void	kalman7fx::KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt )
+	{
+		KalmanUpdate( iter, angles, dt, 0x7 );
+	}
+
+	void	kalman7fx::KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask )
+	{
+		fx	a[3];
+		for (int i=0; i < 3; i++)
+			a[i]	= fromFloat<FANGLE>( angles(i) );
+
+		KalmanUpdateFx( a, axisMask );
+	}
+
+	void	kalman7fx::KalmanPredict( int iter, const Matrix<FT,3,1> &gyros, FT dt )
+	{
+		fx	g[3];
+		for (int i=0; i < 3; i++)
+			g[i]	= fromFloat<FRATE>( gyros(i) );
+
+		KalmanPredictFx( g, fromFloat<FTIME>( dt ) );
+	}
+
+	void	kalman7fx::KalmanUpdateFx( const fx angles[3], unsigned int axisMask )
+	{
+		/** Renormalize quaternion **/
+		quatNormalize( q );
+
+		/** linearization and innovation at the predicted state **/
+		fx	Hq[3][4];
+		calcQMeas( q, Hq );
+
+		fx	predAngles[3], angleErr[3];
+		quatToEuler( q, predAngles );
+		for (int j=0; j < 3; j++)
+			angleErr[j]	= calcAngleError( angles[j], predAngles[j] );
+
+		/**
+		 * Sequential scalar updates as kalman7, on the scaled state.
+		 * h = [ Hq(j,:)/2^QUAT_SCALE 0 0 0 ]: Hq read in FJAC+QUAT_SCALE.
+		 * dx is the scaled state correction so far, FANGLE.
+		 */
+		fx	dx[7] = { 0, 0, 0, 0, 0, 0, 0 };
+
+		for (int j=0; j < 3; j++)
+		{
+			if ( !(axisMask & (1 << j)) )
+				continue;
+
+			const fx	*h	= Hq[j];
+			fx			u[7];	/* P*h', FCOV */
+
+			for (int r=0; r < 7; r++)
+				u[r]	= sat( shr<FJAC+QUAT_SCALE>( (fx2)P[r][0]*h[0] + (fx2)P[r][1]*h[1] +
+													 (fx2)P[r][2]*h[2] + (fx2)P[r][3]*h[3] ) );
+
+			fx	s	= sat( shr<FJAC+QUAT_SCALE>( (fx2)h[0]*u[0] + (fx2)h[1]*u[1] +
+												 (fx2)h[2]*u[2] + (fx2)h[3]*u[3] ) + R[j] );
+			if ( s <= 0 )
+				continue;
+
+			/* residual against the correction already made by the previous axes */
+			fx	res	= sat( (fx2)angleErr[j] - shr<FJAC+QUAT_SCALE>( (fx2)h[0]*dx[0] + (fx2)h[1]*dx[1] +
+																	(fx2)h[2]*dx[2] + (fx2)h[3]*dx[3] ) );
+
+			fx	k[7];	/* gain, FGAIN */
+			for (int r=0; r < 7; r++) {
+				k[r]	= div<FCOV,FCOV,FGAIN>( u[r], s );
+				dx[r]	= sat( (fx2)dx[r] + mul<FGAIN,FANGLE,FANGLE>( k[r], res ) );
+			}
+
+			/* P = P - k*u', lower triangle then mirrored */
+			for (int c=0; c < 7; c++)
+				for (int r=c; r < 7; r++) {
+					P[r][c]	= sat( (fx2)P[r][c] - mul<FGAIN,FCOV,FCOV>( k[r], u[c] ) );
+					P[c][r]	= P[r][c];
+				}
+		}
+
+		/** back to the unscaled state **/
+		for (int i=0; i < 4; i++)
+			q[i]	= sat( (fx2)q[i] + shr<FANGLE+QUAT_SCALE-FQUAT>( dx[i] ) );
+		for (int i=0; i < 3; i++)
+			bias[i]	= sat( (fx2)bias[i] + shr<FANGLE+BIAS_SCALE-FRATE>( dx[4+i] ) );
+
+		/** Renormalize Quaternion **/
+		quatNormalize( q );
+	}
+
+	void	kalman7fx::KalmanPredictFx( const fx gyros[3], fx dt )
+	{
+		fx	w[3];	/* bias corrected rates, FRATE */
+		for (int i=0; i < 3; i++)
+			w[i]	= sat( (fx2)gyros[i] - bias[i] );
+
+		/**
+		 * Top 4 rows of the scaled transition matrix, FQUAT
+		 *	A11 = I + calcQOmega(w)*dt/2
+		 *	A12 = dt/2*[ q1 q2 q3 ; -q0 q3 -q2 ; -q3 -q0 q1 ; q2 -q1 -q0 ]*2^(QUAT_SCALE-BIAS_SCALE)
+		 * the bottom rows are [ 0 I ].
+		 */
+		const fx	one	= (fx)1 << FQUAT;
+		fx	p	= mul<FRATE,FTIME,FQUAT-1>( w[0], dt );
+		fx	qq	= mul<FRATE,FTIME,FQUAT-1>( w[1], dt );
+		fx	r	= mul<FRATE,FTIME,FQUAT-1>( w[2], dt );
+
+		fx	d[4];
+		for (int i=0; i < 4; i++)
+			d[i]	= mul<FTIME,FQUAT,FQUAT-1+QUAT_SCALE-BIAS_SCALE>( dt, q[i] );
+
+		fx	A[4][7] = {
+			{ one,	-p,		-qq,	-r,		 d[1],	 d[2],	 d[3] },
+			{ p,	one,	r,		-qq,	-d[0],	 d[3],	-d[2] },
+			{ qq,	-r,		one,	p,		-d[3],	-d[0],	 d[1] },
+			{ r,	qq,		-p,		one,	 d[2],	-d[1],	-d[0] } };
+
+		/** only update quaternion-relevant data in our state vector **/
+		quatIntegrate( q, w, dt );
+
+		/** P = A*P*A' + W, with the same blocks as kalman7 **/
+		fx	B[4][7];
+		for (int c=0; c < 7; c++)
+			for (int i=0; i < 4; i++)
+			{
+				fx2	s = 0;
+				for (int k=0; k < 7; k++)
+					s += (fx2)A[i][k]*P[k][c];
+				B[i][c]	= sat( shr<FQUAT>( s ) );
+			}
+
+		for (int c=0; c < 4; c++)
+			for (int i=c; i < 4; i++)
+			{
+				fx2	s = 0;
+				for (int k=0; k < 7; k++)
+					s += (fx2)B[i][k]*A[c][k];
+				P[i][c]	= sat( shr<FQUAT>( s ) );
+				P[c][i]	= P[i][c];
+			}
+
+		for (int c=0; c < 4; c++)
+			for (int i=4; i < 7; i++) {
+				P[i][c]	= B[c][i];
+				P[c][i]	= B[c][i];
+			}
+
+		for (int i=0; i < 7; i++)
+			P[i][i]	= sat( (fx2)P[i][i] + W[i] );
+	}
+
+	void	kalman7fx::getStateVector( Matrix<FT,7,1> &x )
+	{
+		for (int i=0; i < 4; i++)
+			x(i)	= toFloat<FQUAT>( q[i] );
+		for (int i=0; i < 3; i++)
+			x(4+i)	= toFloat<FRATE>( bias[i] );
+	}
+
+	void	kalman7fx::getCovarianceMatrix( Matrix<FT,7,7> &p )
+	{
+		for (int r=0; r < 7; r++)
+			for (int c=0; c < 7; c++)
+				p(r,c)	= ldexp( toFloat<FCOV>( P[r][c] ),
+							-( r < 4 ? QUAT_SCALE : BIAS_SCALE ) - ( c < 4 ? QUAT_SCALE : BIAS_SCALE ) );
+	}
+
+	void	kalman7fx::setCovarianceMatrix( const Matrix<FT,7,7> &p )
+	{
+		for (int r=0; r < 7; r++)
+			for (int c=0; c < 7; c++)
+				P[r][c]	= fromFloat<FCOV>( ldexp( p(r,c),
+							( r < 4 ? QUAT_SCALE : BIAS_SCALE ) + ( c < 4 ? QUAT_SCALE : BIAS_SCALE ) ) );
+	}
+
+};
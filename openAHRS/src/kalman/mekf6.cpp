@@ -0,0 +1,250 @@
+/*
+ *  Multiplicative (error-state) Kalman Filter for gyro and accelerometer
+ *	processing. Attitude and gyro bias tracking, 6-state covariance.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+
+#include <openAHRS/kalman/mekf6.h>
+#include <openAHRS/util/quatkernel.h>
+#include <openAHRS/util/fastmath.h>
+
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+
+using namespace std;	//for debugging
+
+namespace openAHRS {
+
+	mekf6::mekf6()
+	{
+		sequentialUpdate = false;
+	}
+
+	void	mekf6::KalmanInit( Matrix<FT,3,1> &startAngle,
+						Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var )
+	{
+		P.setIdentity();
+
+		R.setConstant( meas_var );
+
+		/** noise model covariance, dtheta ~ 2*dq **/
+		W.start<3>().setConstant( 4*process_quat_var );
+		W.end<3>().setConstant( process_bias_var );
+
+		/** initial estimate and bias **/
+		q		= util::eulerToQuat( startAngle );
+		bias	= startBias;
+	}
+
+	void	mekf6::setCovarianceMatrix( const Matrix<FT,7,7> &p )
+	{
+		/* J = d[ dtheta ; dbias ]/d[ q ; bias ] */
+		Matrix<FT,6,7>	J;
+		J.setZero();
+		J.block<3,4>(0,0)	<<	-q[1],	 q[0],	 q[3],	-q[2],
+								-q[2],	-q[3],	 q[0],	 q[1],
+								-q[3],	 q[2],	-q[1],	 q[0];
+		J.block<3,4>(0,0)	*= 2;
+		J.block<3,3>(3,4)	= Matrix<FT,3,3>::Identity();
+
+		P	= J*p*J.transpose();
+	}
+
+	void	mekf6::calcH( Matrix<FT,3,3> &Ha )
+	{
+		/* roll = atan2( y, x ), its sine and cosine without the angle */
+		FT	y		= 2*(q[0]*q[1] + q[2]*q[3]);
+		FT	x		= 1 - 2*(q[1]*q[1] + q[2]*q[2]);
+		FT	n		= fmath::sqrt( x*x + y*y );
+		FT	sp		= 2*(q[1]*q[3] - q[0]*q[2]);	/* -sin(pitch) */
+
+		if ( sp > 1 )	sp = 1;
+		if ( sp < -1 )	sp = -1;
+
+		FT	sr	= ( n > 0 ) ? y/n : 0;
+		FT	cr	= ( n > 0 ) ? x/n : 1;
+		FT	cp	= fmath::sqrt( 1 - sp*sp );
+
+		/* keep away from the singularity at +-90 deg pitch */
+		if ( cp < 1e-3 )
+			cp = 1e-3;
+
+		FT	tp	= -sp/cp;
+
+		Ha	<<	1,	sr*tp,	cr*tp,
+				0,	cr,		-sr,
+				0,	sr/cp,	cr/cp;
+	}
+
+	void	mekf6::applyError( const Matrix<FT,6,1> &dx )
+	{
+		/* q = q (x) [ 1, dtheta/2 ] */
+		FT	dq[4]	= { 1, dx(0)/2, dx(1)/2, dx(2)/2 };
+		quat::quatMultiply( q.data(), dq, q.data() );
+
+		/** Renormalize quaternion **/
+		quat::quatNormalize( q.data() );
+		bias	+= dx.end<3>();
+	}
+
+	void	mekf6::KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt )
+	{
+		if ( sequentialUpdate ) {
+			KalmanUpdate( iter, angles, dt, 0x7 );
+			return;
+		}
+
+		/*** KALMAN UPDATE **/
+
+		/* H = [ Ha 0 ], only the attitude columns of P take part */
+		Matrix<FT,3,3>	Ha;
+		calcH( Ha );
+
+		Matrix<FT,6,3>	PHt	= P.block<6,3>(0,0)*Ha.transpose();
+		Matrix<FT,3,3>	S	= Ha*PHt.block<3,3>(0,0);
+		S(0,0) += R(0);
+		S(1,1) += R(1);
+		S(2,2) += R(2);
+
+		Matrix<FT,3,3> inv;
+		S.computeInverse( &inv );
+
+		if ( isnan( inv(0,0) ) )
+			cout << "NAN" << endl;
+
+		Matrix<FT,6,3>	K	= PHt*inv;
+
+		/** predicted quaternion to euler for error calculation **/
+		Matrix<FT,3,1>	predAngles	= util::quatToEuler( q );
+		Matrix<FT,3,1>	angleErr;
+		angleErr(0)	= util::calcAngleError( angles(0), predAngles(0) );
+		angleErr(1)	= util::calcAngleError( angles(1), predAngles(1) );
+		angleErr(2)	= util::calcAngleError( angles(2), predAngles(2) );
+
+		Matrix<FT,6,1>	dx	= K*angleErr;
+		applyError( dx );
+
+		/* Joseph form expanded as in kalman7, P - G - G' + K*S*K' */
+		Matrix<FT,6,6>	G	= K*PHt.transpose();
+		Matrix<FT,6,3>	KS	= K*S;
+
+		for (int c=0; c < 6; c++)
+			for (int r=c; r < 6; r++)
+			{
+				P(r,c)	+= ( KS(r,0)*K(c,0) + KS(r,1)*K(c,1) + KS(r,2)*K(c,2) ) - G(r,c) - G(c,r);
+				P(c,r)	= P(r,c);
+			}
+	}
+
+
+	void	mekf6::KalmanUpdate( int iter, const Matrix<FT,3,1> &angles, FT dt, unsigned int axisMask )
+	{
+		Matrix<FT,3,3>	Ha;
+		calcH( Ha );
+
+		Matrix<FT,3,1>	predAngles	= util::quatToEuler( q );
+		Matrix<FT,3,1>	angleErr;
+		angleErr(0)	= util::calcAngleError( angles(0), predAngles(0) );
+		angleErr(1)	= util::calcAngleError( angles(1), predAngles(1) );
+		angleErr(2)	= util::calcAngleError( angles(2), predAngles(2) );
+
+		Matrix<FT,6,1>	dx;
+		dx.setZero();
+
+		for (int j=0; j < 3; j++)
+		{
+			if ( !(axisMask & (1 << j)) )
+				continue;
+
+			Matrix<FT,1,3>	h	= Ha.block<1,3>(j,0);
+			Matrix<FT,6,1>	u	= P.block<6,3>(0,0)*h.transpose();	/* P*h' */
+			FT				s	= ( h*u.start<3>() )(0,0) + R(j);
+
+			if ( !(s > 0) ) {
+				cout << "NAN" << endl;
+				continue;
+			}
+
+			/* residual against the error already estimated by the previous axes */
+			FT	res	= angleErr(j) - ( h*dx.start<3>() )(0,0);
+
+			dx	+= u*(res/s);
+
+			for (int c=0; c < 6; c++)
+				for (int r=c; r < 6; r++)
+				{
+					P(r,c)	-= u(r)*u(c)/s;
+					P(c,r)	= P(r,c);
+				}
+		}
+
+		applyError( dx );
+	}
+
+
+	void	mekf6::KalmanPredict( int iter, const Matrix<FT,3,1> &gyros, FT dt )
+	{
+		Matrix<FT,3,1>	w	= gyros - bias;
+
+		/** q = q (x) exp( w*dt/2 ), exact for a constant rate over dt **/
+		FT	wn	= fmath::sqrt( w.squaredNorm() );
+		FT	c, s;
+		fmath::sinCos( wn*dt/2, s, c );
+		s	= ( wn*dt > 1e-6 ) ? s/wn : dt/2;
+		FT	dq[4]	= { c, w(0)*s, w(1)*s, w(2)*s };
+		quat::quatMultiply( q.data(), dq, q.data() );
+
+		/**
+		 * P = Phi*P*Phi' + W, with Phi = [ F -dt*I ; 0 I ] and F = I - dt*[w x]:
+		 *	Ta	= F*Paa - dt*Pba,	Tb = F*Pab - dt*Pbb
+		 *	Paa	= Ta*F' - dt*Tb,	Pab = Tb,	Pbb = Pbb
+		 */
+		Matrix<FT,3,3>	F;
+		F	<<	1,			dt*w(2),	-dt*w(1),
+				-dt*w(2),	1,			dt*w(0),
+				dt*w(1),	-dt*w(0),	1;
+
+		Matrix<FT,3,3>	Ta	= F*P.block<3,3>(0,0) - dt*P.block<3,3>(3,0);
+		Matrix<FT,3,3>	Tb	= F*P.block<3,3>(0,3) - dt*P.block<3,3>(3,3);
+		Matrix<FT,3,3>	Paa	= Ta*F.transpose() - dt*Tb;
+
+		for (int c=0; c < 3; c++)
+			for (int r=c; r < 3; r++)
+			{
+				P(r,c)	= Paa(r,c);
+				P(c,r)	= Paa(r,c);
+			}
+
+		P.block<3,3>(0,3)	= Tb;
+		P.block<3,3>(3,0)	= Tb.transpose();
+
+		for (int i=0; i < 6; i++)
+			P(i,i)	+= W(i);
+	}
+
+
+};
@@ -0,0 +1,332 @@
+/*
+ *  Calibration store, see calibstore.h
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <openAHRS/util/calibstore.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+
+namespace openAHRS { namespace util
+{
+	static const char		storeMagic[4]	= { 'O', 'A', 'C', 'S' };
+	static const uint32_t	storeVersion	= 1;
+	static const uint32_t	storeByteOrder	= 0x01020304;
+
+	/* data of a record, padded so that the next record header stays aligned */
+	static size_t	paddedSize( uint32_t rows, uint32_t cols )
+	{
+		size_t	n	= sizeof(FT)*rows*cols;
+		return ( n + 7 ) & ~(size_t)7;
+	}
+
+	/* CRC-32 of each byte value (reflected polynomial 0xEDB88320), constant
+	 * so that stores can be opened and saved from several threads at once */
+	static const uint32_t	crcTable[256]	=
+	{
+		0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+		0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+		0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+		0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+		0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+		0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+		0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+		0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+		0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+		0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+		0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+		0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+		0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+		0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+		0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+		0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+		0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+		0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+		0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+		0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+		0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+		0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+		0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+		0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+		0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+		0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+		0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+		0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+		0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+		0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+		0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+		0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+		0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+		0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+		0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+		0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+		0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+		0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+		0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+		0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+		0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+		0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+		0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+	};
+
+	uint32_t	crc32( const void *data, size_t len, uint32_t crc )
+	{
+		const uint8_t	*p	= (const uint8_t *)data;
+		crc	= ~crc;
+		for (size_t i=0; i < len; i++)
+			crc	= crcTable[ ( crc ^ p[i] ) & 0xFF ] ^ ( crc >> 8 );
+		return ~crc;
+	}
+
+	/*************************** CalibStore ***************************/
+
+	CalibStore::CalibStore()
+	{
+		base	= NULL;
+		length	= 0;
+		error	= "not open";
+	}
+
+	CalibStore::~CalibStore()
+	{
+		close();
+	}
+
+	void	CalibStore::close()
+	{
+		if ( base != NULL )
+			munmap( base, length );
+		base	= NULL;
+		length	= 0;
+		records.clear();
+	}
+
+	bool	CalibStore::open( const char *fileName )
+	{
+		close();
+
+		int	fd	= ::open( fileName, O_RDONLY );
+		if ( fd < 0 ) {
+			error	= "cannot open file";
+			return false;
+		}
+
+		struct stat	st;
+		if ( fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof(StoreHeader) ) {
+			::close( fd );
+			error	= "file too short";
+			return false;
+		}
+
+		length	= st.st_size;
+		base	= mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+		::close( fd );		/* the mapping stays */
+		if ( base == MAP_FAILED ) {
+			base	= NULL;
+			error	= "mmap failed";
+			return false;
+		}
+
+		const StoreHeader	*h		= (const StoreHeader *)base;
+		const char			*data	= (const char *)base + sizeof(StoreHeader);
+
+		if ( memcmp( h->magic, storeMagic, 4 ) != 0 )
+			error	= "not a calibration store";
+		else if ( h->headerCrc != crc32( h, offsetof( StoreHeader, headerCrc ) ) )
+			error	= "header corrupt";
+		else if ( h->byteOrder != storeByteOrder )
+			error	= "written on a machine of other byte order";
+		else if ( h->version != storeVersion )
+			error	= "unknown format version";
+		else if ( h->scalarSize != sizeof(FT) )
+			error	= "written with another FT";
+		else if ( sizeof(StoreHeader) + h->dataSize != length )
+			error	= "file size does not match the header";
+		else if ( h->dataCrc != crc32( data, h->dataSize ) )
+			error	= "data corrupt";
+		else
+		{
+			/* walk the records, they must fill the data exactly */
+			size_t	pos	= 0;
+			error	= NULL;
+			for (uint32_t i=0; i < h->numRecords && error == NULL; i++)
+			{
+				if ( pos + sizeof(StoreRecord) > h->dataSize ) {
+					error	= "record out of the file";
+					break;
+				}
+				const StoreRecord	*r	= (const StoreRecord *)( data + pos );
+				pos	+= sizeof(StoreRecord);
+
+				if ( memchr( r->name, 0, sizeof(r->name) ) == NULL ||
+					 r->rows > h->dataSize || r->cols > h->dataSize ||
+					 pos + paddedSize( r->rows, r->cols ) > h->dataSize ) {
+					error	= "record out of the file";
+					break;
+				}
+				pos	+= paddedSize( r->rows, r->cols );
+				records.push_back( r );
+			}
+			if ( error == NULL && pos != h->dataSize )
+				error	= "data after the last record";
+		}
+
+		if ( error != NULL ) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	const FT *	CalibStore::find( const char *name, int rows, int cols ) const
+	{
+		for (unsigned int i=0; i < records.size(); i++)
+		{
+			const StoreRecord	*r	= records[i];
+			if ( strcmp( r->name, name ) == 0 ) {
+				if ( (int)r->rows != rows || (int)r->cols != cols )
+					return NULL;
+				return (const FT *)( r + 1 );
+			}
+		}
+		return NULL;
+	}
+
+	const char *	CalibStore::recordName( int i ) const
+	{
+		return records[i]->name;
+	}
+
+	void	CalibStore::recordSize( int i, int &rows, int &cols ) const
+	{
+		rows	= records[i]->rows;
+		cols	= records[i]->cols;
+	}
+
+	const FT *	CalibStore::recordData( int i ) const
+	{
+		return (const FT *)( records[i] + 1 );
+	}
+
+	/************************ CalibStoreWriter ************************/
+
+	bool	CalibStoreWriter::has( const char *name ) const
+	{
+		for (unsigned int i=0; i < entries.size(); i++)
+			if ( strcmp( entries[i].rec.name, name ) == 0 )
+				return true;
+		return false;
+	}
+
+	void	CalibStoreWriter::add( const char *name, const FT *data, int rows, int cols )
+	{
+		Entry	e;
+		memset( &e.rec, 0, sizeof(e.rec) );
+		strncpy( e.rec.name, name, sizeof(e.rec.name) - 1 );
+		e.rec.rows	= rows;
+		e.rec.cols	= cols;
+		e.data.assign( data, data + rows*cols );
+
+		for (unsigned int i=0; i < entries.size(); i++)
+			if ( strcmp( entries[i].rec.name, e.rec.name ) == 0 ) {
+				entries[i]	= e;
+				return;
+			}
+		entries.push_back( e );
+	}
+
+	void	CalibStoreWriter::keep( const CalibStore &s )
+	{
+		for (int i=0; i < s.numRecords(); i++)
+		{
+			if ( has( s.recordName(i) ) )
+				continue;
+			int	rows, cols;
+			s.recordSize( i, rows, cols );
+			add( s.recordName(i), s.recordData(i), rows, cols );
+		}
+	}
+
+	bool	CalibStoreWriter::save( const char *fileName ) const
+	{
+		/** the whole file in memory first, for the checksum **/
+		std::vector<char>	data;
+		for (unsigned int i=0; i < entries.size(); i++)
+		{
+			const Entry	&e	= entries[i];
+			size_t		pos	= data.size();
+
+			data.resize( pos + sizeof(StoreRecord) + paddedSize( e.rec.rows, e.rec.cols ), 0 );
+			memcpy( &data[pos], &e.rec, sizeof(StoreRecord) );
+			if ( !e.data.empty() )
+				memcpy( &data[pos + sizeof(StoreRecord)], &e.data[0], sizeof(FT)*e.data.size() );
+		}
+
+		StoreHeader	h;
+		memcpy( h.magic, storeMagic, 4 );
+		h.version		= storeVersion;
+		h.byteOrder		= storeByteOrder;
+		h.scalarSize	= sizeof(FT);
+		h.numRecords	= entries.size();
+		h.dataSize		= data.size();
+		h.dataCrc		= crc32( data.empty() ? NULL : &data[0], data.size() );
+		h.headerCrc		= crc32( &h, offsetof( StoreHeader, headerCrc ) );
+
+		/** temporary file, synced, then renamed over the old one **/
+		std::string	tmp	= std::string( fileName ) + ".tmp";
+
+		FILE	*f	= fopen( tmp.c_str(), "wb" );
+		if ( f == NULL )
+			return false;
+
+		bool	ok	= ( fwrite( &h, sizeof(h), 1, f ) == 1 );
+		if ( ok && !data.empty() )
+			ok	= ( fwrite( &data[0], 1, data.size(), f ) == data.size() );
+		ok	= ok && ( fflush( f ) == 0 ) && ( fsync( fileno( f ) ) == 0 );
+		ok	= ( fclose( f ) == 0 ) && ok;
+
+		if ( ok )
+			ok	= ( rename( tmp.c_str(), fileName ) == 0 );
+		if ( !ok ) {
+			remove( tmp.c_str() );
+			return false;
+		}
+
+		/* and the directory entry, for the rename to survive a power loss */
+		std::string	dir	= fileName;
+		size_t		slash	= dir.rfind( '/' );
+		dir	= ( slash == std::string::npos ) ? "." : dir.substr( 0, slash + 1 );
+
+		int	fd	= ::open( dir.c_str(), O_RDONLY );
+		if ( fd >= 0 ) {
+			fsync( fd );
+			::close( fd );
+		}
+
+		return true;
+	}
+
+}};
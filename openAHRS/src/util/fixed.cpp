@@ -0,0 +1,212 @@
+/*
+ *  Fixed point (Q format) arithmetic and quaternion helpers,
+ *  for targets without an FPU. See kalman/kalman7fx.h
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <openAHRS/util/fixed.h>
+
+namespace openAHRS { namespace fixed
+{
+	fx2		isqrt( fx2 a )
+	{
+		if ( a <= 0 )
+			return 0;
+
+		uint64_t	v	= a;
+		uint64_t	res	= 0;
+		uint64_t	bit	= (uint64_t)1 << 62;
+
+		while ( bit > v )
+			bit >>= 2;
+
+		while ( bit != 0 ) {
+			if ( v >= res + bit ) {
+				v	-= res + bit;
+				res	= ( res >> 1 ) + bit;
+			} else
+				res	>>= 1;
+			bit >>= 2;
+		}
+
+		return res;
+	}
+
+	/**
+	 * atan(t) for t in [0,1] (FQUAT), result in FANGLE.
+	 * Abramowitz & Stegun 4.4.49, |error| <= 2e-8
+	 */
+	static fx	atanPoly( fx t )
+	{
+		static const fx	c[8] = {	/* FQUAT */
+			1073741108, -357876604, 214174299, -149341741,
+			103530234, -60032783, 23473316, -4353012 };
+
+		fx	t2	= mul<FQUAT,FQUAT,FQUAT>( t, t );
+		fx2	p	= c[7];
+
+		for (int i=6; i >= 0; i--)
+			p	= c[i] + shr<FQUAT>( p*t2 );
+
+		return sat( shr<2*FQUAT - FANGLE>( p*t ) );
+	}
+
+	fx		atan2( fx y, fx x )
+	{
+		fx2	ax	= ( x < 0 ) ? -(fx2)x : x;
+		fx2	ay	= ( y < 0 ) ? -(fx2)y : y;
+
+		if ( ( ax == 0 ) && ( ay == 0 ) )
+			return 0;
+
+		fx	a;
+		if ( ay > ax )
+			a	= PI_ANGLE/2 - atanPoly( ( ax << FQUAT )/ay );
+		else
+			a	= atanPoly( ( ay << FQUAT )/ax );
+
+		if ( x < 0 )
+			a	= PI_ANGLE - a;
+
+		return ( y < 0 ) ? -a : a;
+	}
+
+	void	quatNormalize( fx q[4] )
+	{
+		fx2	n2	= (fx2)q[0]*q[0] + (fx2)q[1]*q[1] + (fx2)q[2]*q[2] + (fx2)q[3]*q[3];	/* 2*FQUAT */
+		fx2	e	= shr<FQUAT>( n2 ) - ( (fx2)1 << FQUAT );	/* |q|^2 - 1, FQUAT */
+		fx	inv;	/* 1/|q|, FQUAT */
+
+		if ( ( e < ( (fx2)1 << (FQUAT-10) ) ) && ( e > -( (fx2)1 << (FQUAT-10) ) ) )
+		{
+			/* close to unit norm, as after a predict: second order series,
+			 * 1/sqrt(1+e) ~ 1 - e/2 + 3e^2/8, error below e^3 */
+			inv	= sat( ( (fx2)1 << FQUAT ) - e/2 + shr<FQUAT+3>( 3*e*e ) );
+		}
+		else
+		{
+			fx	n	= isqrt( n2 );		/* FQUAT */
+			if ( n == 0 )
+				return;
+
+			/* one division */
+			inv	= sat( ( (fx2)1 << (2*FQUAT) )/n );
+		}
+
+		for (int i=0; i < 4; i++)
+			q[i]	= mul<FQUAT,FQUAT,FQUAT>( q[i], inv );
+	}
+
+	void	quatToEuler( const fx q[4], fx e[3] )
+	{
+		const fx2	one	= (fx2)1 << FQUAT;
+
+		/** ROLL **/
+		e[0]	= atan2( sat( shr<FQUAT-1>( (fx2)q[0]*q[1] + (fx2)q[2]*q[3] ) ),
+						 sat( one - shr<FQUAT-1>( (fx2)q[1]*q[1] + (fx2)q[2]*q[2] ) ) );
+
+		/** PITCH, -asin(T) = -atan2( T, sqrt(1 - T^2) ) **/
+		fx2	T	= shr<FQUAT-1>( (fx2)q[1]*q[3] - (fx2)q[0]*q[2] );
+		if ( T > one )		T = one;
+		if ( T < -one )		T = -one;
+
+		e[1]	= -atan2( T, isqrt( ( one << FQUAT ) - T*T ) );
+
+		/** YAW **/
+		e[2]	= atan2( sat( shr<FQUAT-1>( (fx2)q[0]*q[3] + (fx2)q[1]*q[2] ) ),
+						 sat( one - shr<FQUAT-1>( (fx2)q[2]*q[2] + (fx2)q[3]*q[3] ) ) );
+	}
+
+	/**
+	 * One row of calcQMeas() for atan2( K, K1 ):
+	 * (K1*dK - K*dK1)/(K1^2 + K^2), inputs in FQUAT.
+	 * dK and dK1 are passed halved, the division to FJAC+1 makes up for it
+	 */
+	static void	atan2Row( fx K, fx K1, const fx dK[4], const fx dK1[4], fx row[4] )
+	{
+		fx	den	= sat( shr<FQUAT>( (fx2)K1*K1 + (fx2)K*K ) );
+
+		for (int i=0; i < 4; i++)
+			row[i]	= div<FQUAT,FQUAT,FJAC+1>( sat( shr<FQUAT>( (fx2)K1*dK[i] - (fx2)K*dK1[i] ) ), den );
+	}
+
+	void	calcQMeas( const fx q[4], fx H[3][4] )
+	{
+		const fx2	one	= (fx2)1 << FQUAT;
+
+		fx	e0 = q[0], ex = q[1], ey = q[2], ez = q[3];
+
+		/** droll/dq **/
+		{
+			fx	K	= sat( shr<FQUAT-1>( (fx2)e0*ex + (fx2)ey*ez ) );
+			fx	K1	= sat( one - shr<FQUAT-1>( (fx2)ex*ex + (fx2)ey*ey ) );
+			fx	dK[4], dK1[4];
+
+			/* dK = 2*[ ex e0 ez ey ], dK1 = [ 0 -4ex -4ey 0 ], halved */
+			dK[0] = ex;		dK[1] = e0;		dK[2] = ez;		dK[3] = ey;
+			dK1[0] = 0;		dK1[1] = sat( -2*(fx2)ex );	dK1[2] = sat( -2*(fx2)ey );	dK1[3] = 0;
+
+			atan2Row( K, K1, dK, dK1, H[0] );
+		}
+
+		/** dpitch/dq = 2*[ ey -ez e0 -ex ]/sqrt(1 - T^2), halved as well **/
+		{
+			fx2	T	= shr<FQUAT-1>( (fx2)ex*ez - (fx2)e0*ey );
+			if ( T > one )		T = one;
+			if ( T < -one )		T = -one;
+
+			fx	D	= isqrt( ( one << FQUAT ) - T*T );
+
+			H[1][0]	= div<FQUAT,FQUAT,FJAC+1>(  ey, D );
+			H[1][1]	= div<FQUAT,FQUAT,FJAC+1>( -ez, D );
+			H[1][2]	= div<FQUAT,FQUAT,FJAC+1>(  e0, D );
+			H[1][3]	= div<FQUAT,FQUAT,FJAC+1>( -ex, D );
+		}
+
+		/** dyaw/dq **/
+		{
+			fx	K	= sat( shr<FQUAT-1>( (fx2)e0*ez + (fx2)ex*ey ) );
+			fx	K1	= sat( one - shr<FQUAT-1>( (fx2)ey*ey + (fx2)ez*ez ) );
+			fx	dK[4], dK1[4];
+
+			/* dK = 2*[ ez ey ex e0 ], dK1 = [ 0 0 -4ey -4ez ], halved */
+			dK[0] = ez;		dK[1] = ey;		dK[2] = ex;		dK[3] = e0;
+			dK1[0] = 0;		dK1[1] = 0;		dK1[2] = sat( -2*(fx2)ey );	dK1[3] = sat( -2*(fx2)ez );
+
+			atan2Row( K, K1, dK, dK1, H[2] );
+		}
+	}
+
+	void	quatIntegrate( fx q[4], const fx w[3], fx dt )
+	{
+		/* w*dt/2, in FQUAT */
+		fx	p	= mul<FRATE,FTIME,FQUAT-1>( w[0], dt );
+		fx	qq	= mul<FRATE,FTIME,FQUAT-1>( w[1], dt );
+		fx	r	= mul<FRATE,FTIME,FQUAT-1>( w[2], dt );
+
+		fx2	q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+		q[0]	= sat( q0 + shr<FQUAT>( - p*q1 - qq*q2 - r*q3 ) );
+		q[1]	= sat( q1 + shr<FQUAT>(   p*q0 + r*q2 - qq*q3 ) );
+		q[2]	= sat( q2 + shr<FQUAT>(  qq*q0 - r*q1 + p*q3 ) );
+		q[3]	= sat( q3 + shr<FQUAT>(   r*q0 + qq*q1 - p*q2 ) );
+	}
+
+}};
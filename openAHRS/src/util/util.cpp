@@ -23,6 +23,8 @@
 
 
 #include <openAHRS/util/util.h>
+#include <openAHRS/util/quatkernel.h>
+#include <openAHRS/util/fastmath.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -138,7 +140,7 @@ namespace openAHRS { namespace util
 				std::cout << "Err NAN Sqrt\n";
 			
 			/** TODO: check for NaN **/
-			FT	D	= sqrt(_T);
+			FT	D	= fmath::sqrt(_T);
 
 			ret(1,0)	=  2*ey/D;
 			ret(1,1)	= -2*ez/D;
@@ -176,48 +178,14 @@ namespace openAHRS { namespace util
 	
 	Matrix<FT,3,1>		quatToEulerNorm( Matrix<FT,4,1> q )
 	{
-		q.normalize();
-		Matrix<FT,3,1>	ret;
-		
-		/** ROLL **/
-		ret[0]	=	atan2( 2*(q[0]*q[1] + q[2]*q[3]),
-							1 - 2*(q[1]*q[1] + q[2]*q[2]) );
-		/** PITCH **/
-		FT	temp	= 2*(q[1]*q[3] - q[0]*q[2]);
-		if ( temp > 1.0 )
-			temp  = 1.0;
-		if ( temp < -1.0 )
-			temp = -1.0;
-
-		ret[1]	=	-asin( temp );
-
-		/** YAW **/
-		ret[2]	=	atan2( 2*(q[0]*q[3] + q[1]*q[2]),
-							1 - 2*(q[2]*q[2] + q[3]*q[3]) );
-
-		return ret;
+		quat::quatNormalize( q.data() );
+		return quatToEuler( q );
 	}
 
 	Matrix<FT,3,1>		quatToEuler( const Matrix<FT,4,1> &q )
 	{
 		Matrix<FT,3,1>	ret;
-		
-		/** ROLL **/
-		ret[0]	=	atan2( 2*(q[0]*q[1] + q[2]*q[3]),
-							1 - 2*(q[1]*q[1] + q[2]*q[2]) );
-		/** PITCH **/
-		FT	temp	= 2*(q[1]*q[3] - q[0]*q[2]);
-		if ( temp > 1.0 )
-			temp  = 1.0;
-		if ( temp < -1.0 )
-			temp = -1.0;
-
-		ret[1]	=	-asin( temp );
-
-		/** YAW **/
-		ret[2]	=	atan2( 2*(q[0]*q[3] + q[1]*q[2]),
-							1 - 2*(q[2]*q[2] + q[3]*q[3]) );
-
+		quat::quatToEuler( q.data(), ret.data() );
 		return ret;
 	}
 
@@ -230,41 +198,23 @@ namespace openAHRS { namespace util
 	Matrix<FT,4,1>		eulerToQuat( const Matrix<FT,3,1> &e )
 	{
 		Matrix<FT,4,1>	ret;
-
-		FT	r	= e[0]/2;
-		FT	p	= e[1]/2;
-		FT	y	= e[2]/2;
-
-		FT	Cr	= cos(r);
-		FT	Cp	= cos(p);
-		FT	Cy	= cos(y);
-
-		FT	Sr	= sin(r);
-		FT	Sp	= sin(p);
-		FT	Sy	= sin(y);
-
-		ret[0]	=	Cr*Cp*Cy + Sr*Sp*Sy;
-		ret[1]	=	Sr*Cp*Cy - Cr*Sp*Sy;
-		ret[2]	=	Cr*Sp*Cy + Sr*Cp*Sy;
-		ret[3]	=	Cr*Cp*Sy - Sr*Sp*Cy;
-
+		quat::eulerToQuat( e.data(), ret.data() );
 		return ret;
 	}
 
 	void	accelToPR( const Matrix<FT,3,1> &accels, Matrix<FT,3,1> &angles )
 	{
-		angles(0)	= atan2( -accels[1], accels[2] );
-		angles(1)	= asin( -accels[0]/accels.norm() );
+		angles(0)	= fmath::atan2( -accels[1], accels[2] );
+		angles(1)	= fmath::asin( -accels[0]/fmath::sqrt( accels.squaredNorm() ) );
 	}
 
 
 	float	calcHeading( const Matrix<FT,3,1> &magn, const Matrix<FT,3,1> &attitude )
 	{
 		//precalculate
-		float	Cp	= cos( attitude[1] );
-		float	Sp	= sin( attitude[1] );
-		float	Cr	= cos( attitude[0] );
-		float	Sr	= sin( attitude[0] );
+		float	Cp, Sp, Cr, Sr;
+		fmath::sinCos( float( attitude[1] ), Sp, Cp );
+		fmath::sinCos( float( attitude[0] ), Sr, Cr );
 
 		/**
 		 * Convert to earth fixed frame
@@ -275,19 +225,84 @@ namespace openAHRS { namespace util
 	//	cout << "Hx: " << Hx << endl;
 	//	cout << "Hy: " << Hy << endl;
 
-		return	atan2(-Hy,Hx);
+		return	fmath::atan2(-Hy,Hx);
+	}
+
+
+	void	calcVectorMeas( const Matrix<FT,4,1> &q, const Matrix<FT,3,1> &ref,
+							Matrix<FT,3,1> &v, Matrix<FT,3,4> &H )
+	{
+		FT	e0 = q[0], ex = q[1], ey = q[2], ez = q[3];
+		FT	r0 = ref[0], r1 = ref[1], r2 = ref[2];
+
+		/** dv/dq, each entry linear in q (times 2) **/
+		FT	a	= 2*( e0*r0 + ez*r1 - ey*r2 );
+		FT	b	= 2*( ex*r0 + ey*r1 + ez*r2 );
+		FT	c	= 2*( -ey*r0 + ex*r1 - e0*r2 );
+		FT	d	= 2*( -ez*r0 + e0*r1 + ex*r2 );
+
+		H	<<	a,	b,	c,	d,
+				d,	-c,	b,	-a,
+				-c,	-d,	a,	b;
+
+		/** v is quadratic, so v = H*q/2 **/
+		v[0]	= ( a*e0 + b*ex + c*ey + d*ez )/2;
+		v[1]	= ( d*e0 - c*ex + b*ey - a*ez )/2;
+		v[2]	= ( -c*e0 - d*ex + a*ey + b*ez )/2;
+	}
+
+	void	accelToVector( const Matrix<FT,3,1> &accels, Matrix<FT,3,1> &v )
+	{
+		v	= accels/accels.norm();
+		v[1]	= -v[1];
+	}
+
+	void	magnToVector( const Matrix<FT,3,1> &magn, Matrix<FT,3,1> &v )
+	{
+		v	= magn/magn.norm();
+		v[2]	= -v[2];
+	}
+
+	void	magnReference( const Matrix<FT,4,1> &q, const Matrix<FT,3,1> &m,
+							Matrix<FT,3,1> &ref )
+	{
+		Matrix<FT,3,1>	h;
+		quat::quatRotate( q.data(), m.data(), h.data() );
+
+		ref	<< fmath::sqrt( h[0]*h[0] + h[1]*h[1] ), 0, h[2];
+	}
+
+
+	bool	triad( const Matrix<FT,3,1> &accels, const Matrix<FT,3,1> &magn,
+					Matrix<FT,4,1> &q )
+	{
+		Matrix<FT,3,1>	g, h;
+		accelToVector( accels, g );
+		magnToVector( magn, h );
+
+		/* body triad: down, east = down x field, and north = east x down.
+		 * In earth-fixed coordinates these are [0 0 1], [0 1 0], [1 0 0] */
+		FT	e[3]	= { g[1]*h[2] - g[2]*h[1], g[2]*h[0] - g[0]*h[2], g[0]*h[1] - g[1]*h[0] };
+		FT	n		= fmath::sqrt( e[0]*e[0] + e[1]*e[1] + e[2]*e[2] );
+		if ( n < 1e-3 )
+			return false;
+		e[0] /= n;	e[1] /= n;	e[2] /= n;
+
+		FT	nth[3]	= { e[1]*g[2] - e[2]*g[1], e[2]*g[0] - e[0]*g[2], e[0]*g[1] - e[1]*g[0] };
+
+		/* C(q)' maps those to the body triad, its columns are north, east, down */
+		FT	C[9]	= { nth[0], e[0], g[0],
+						nth[1], e[1], g[1],
+						nth[2], e[2], g[2] };
+		quat::dcmToQuat( C, q.data() );
+		quat::quatNormalize( q.data() );
+		return true;
 	}
 
 
 	void	quatNormalize( Matrix<FT,4,1> &q )
 	{
-		FT	norm	= sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] +
-						q[3]*q[3] );
-		q = q / norm;
-/*		q[0]	/= norm;
-		q[1]	/= norm;
-		q[2]	/= norm;
-		q[3]	/= norm;*/
+		quat::quatNormalize( q.data() );
 	}
 
 
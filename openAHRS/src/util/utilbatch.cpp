@@ -0,0 +1,148 @@
+/*
+ *  Batch attitude conversions, structure of arrays
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/util/fastmath.h>
+
+#include <math.h>
+
+/**
+ * Every loop below is straight-line code over contiguous arrays, with
+ * no calls into libm but sqrt, so the compiler can vectorize them.
+ * The Makefile builds this file with -O3 -fno-math-errno -fno-trapping-math
+ * for that (the selects in fastmath.h are only if-converted without
+ * trapping math), and the arrays are __restrict__: there are too many
+ * of them for the compiler to check for overlap at run time.
+ */
+
+namespace openAHRS { namespace util
+{
+	void	quatToEulerBatch( const FT * __restrict__ q, FT * __restrict__ angles, size_t n )
+	{
+		const FT	*e0 = q, *ex = q + n, *ey = q + 2*n, *ez = q + 3*n;
+		FT	*roll = angles, *pitch = angles + n, *yaw = angles + 2*n;
+
+		for (size_t i=0; i < n; i++)
+		{
+			/** ROLL **/
+			roll[i]		= fastAtan2( 2*(e0[i]*ex[i] + ey[i]*ez[i]),
+								1 - 2*(ex[i]*ex[i] + ey[i]*ey[i]) );
+			/** PITCH, fastAsin() clamps **/
+			pitch[i]	= -fastAsin( 2*(ex[i]*ez[i] - e0[i]*ey[i]) );
+
+			/** YAW **/
+			yaw[i]		= fastAtan2( 2*(e0[i]*ez[i] + ex[i]*ey[i]),
+								1 - 2*(ey[i]*ey[i] + ez[i]*ez[i]) );
+		}
+	}
+
+	void	quatToEulerNormBatch( const FT * __restrict__ q, FT * __restrict__ angles, size_t n )
+	{
+		const FT	*e0 = q, *ex = q + n, *ey = q + 2*n, *ez = q + 3*n;
+		FT	*roll = angles, *pitch = angles + n, *yaw = angles + 2*n;
+
+		for (size_t i=0; i < n; i++)
+		{
+			FT	inv	= 1/sqrt( e0[i]*e0[i] + ex[i]*ex[i] + ey[i]*ey[i] + ez[i]*ez[i] );
+			FT	a = e0[i]*inv, b = ex[i]*inv, c = ey[i]*inv, d = ez[i]*inv;
+
+			roll[i]		= fastAtan2( 2*(a*b + c*d), 1 - 2*(b*b + c*c) );
+			pitch[i]	= -fastAsin( 2*(b*d - a*c) );
+			yaw[i]		= fastAtan2( 2*(a*d + b*c), 1 - 2*(c*c + d*d) );
+		}
+	}
+
+	void	eulerToQuatBatch( const FT * __restrict__ angles, FT * __restrict__ q, size_t n )
+	{
+		const FT	*roll = angles, *pitch = angles + n, *yaw = angles + 2*n;
+		FT	*e0 = q, *ex = q + n, *ey = q + 2*n, *ez = q + 3*n;
+
+		for (size_t i=0; i < n; i++)
+		{
+			FT	Cr, Sr, Cp, Sp, Cy, Sy;
+
+			fastSinCos( roll[i]/2, Sr, Cr );
+			fastSinCos( pitch[i]/2, Sp, Cp );
+			fastSinCos( yaw[i]/2, Sy, Cy );
+
+			e0[i]	= Cr*Cp*Cy + Sr*Sp*Sy;
+			ex[i]	= Sr*Cp*Cy - Cr*Sp*Sy;
+			ey[i]	= Cr*Sp*Cy + Sr*Cp*Sy;
+			ez[i]	= Cr*Cp*Sy - Sr*Sp*Cy;
+		}
+	}
+
+	void	accelToPRBatch( const FT * __restrict__ accels, FT * __restrict__ angles, size_t n )
+	{
+		const FT	*ax = accels, *ay = accels + n, *az = accels + 2*n;
+		FT	*roll = angles, *pitch = angles + n;
+
+		for (size_t i=0; i < n; i++)
+		{
+			FT	norm	= sqrt( ax[i]*ax[i] + ay[i]*ay[i] + az[i]*az[i] );
+
+			roll[i]		= fastAtan2( -ay[i], az[i] );
+			pitch[i]	= fastAsin( -ax[i]/norm );
+		}
+	}
+
+	void	calcHeadingBatch( const FT * __restrict__ magn, const FT * __restrict__ angles,
+							FT * __restrict__ heading, size_t n )
+	{
+		const FT	*mx = magn, *my = magn + n, *mz = magn + 2*n;
+		const FT	*roll = angles, *pitch = angles + n;
+
+		for (size_t i=0; i < n; i++)
+		{
+			FT	Sr, Cr, Sp, Cp;
+
+			fastSinCos( roll[i], Sr, Cr );
+			fastSinCos( pitch[i], Sp, Cp );
+
+			/** Convert to earth fixed frame **/
+			FT	Hx	= mx[i]*Cp + my[i]*Sp*Sr - mz[i]*Sp*Cr;
+			FT	Hy	= my[i]*Cr + mz[i]*Sr;
+
+			heading[i]	= fastAtan2( -Hy, Hx );
+		}
+	}
+
+	void	affineBatch( const FT *A, const FT *b, const FT * __restrict__ v,
+						FT * __restrict__ out, size_t n )
+	{
+		const FT	*x = v, *y = v + n, *z = v + 2*n;
+		FT	*ox = out, *oy = out + n, *oz = out + 2*n;
+
+		/* coefficients in locals, the compiler can't tell they don't alias out */
+		const FT	a00 = A[0], a01 = A[1], a02 = A[2], b0 = b[0];
+		const FT	a10 = A[3], a11 = A[4], a12 = A[5], b1 = b[1];
+		const FT	a20 = A[6], a21 = A[7], a22 = A[8], b2 = b[2];
+
+		for (size_t i=0; i < n; i++)
+		{
+			ox[i]	= a00*x[i] + a01*y[i] + a02*z[i] + b0;
+			oy[i]	= a10*x[i] + a11*y[i] + a12*z[i] + b1;
+			oz[i]	= a20*x[i] + a21*y[i] + a22*z[i] + b2;
+		}
+	}
+
+}};
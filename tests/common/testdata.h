@@ -0,0 +1,160 @@
+/*
+ *	Synthetic data and timing shared by the tests and util/tune:
+ *	the test-kal7 trajectory with noisy accelerometer, angle and gyro
+ *	readings, and a nanosecond clock.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#ifndef	__ahrs_testdata_h_
+#define	__ahrs_testdata_h_
+
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+#include <openAHRS/util/util.h>
+
+namespace openAHRS { namespace testdata
+{
+	/** x in (-2*PI, 2*PI) wrapped to (-PI, PI] */
+	static inline FT	limitPI( FT x )
+	{
+		if ( ( x > C_PI ) && ( x <= 2*C_PI ) )
+			return	x - 2*C_PI;
+		else if ( ( x < -C_PI ) && ( x > -2*C_PI ) )
+			return	2*C_PI + x;
+		else
+			return x;
+	}
+
+	/** monotonic clock, ns */
+	static inline double	nowNs()
+	{
+		struct timespec	ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return 1e9*ts.tv_sec + ts.tv_nsec;
+	}
+
+	/**
+	 * The trajectory of test-kal7: roll, pitch and yaw rates of slow
+	 * sinusoids, integrated with a fixed step, and the sensor readings
+	 * along it with gaussian noise of the given variance. Gyros carry a
+	 * constant bias, [3 5 7]' rad/s unless changed.
+	 *
+	 * Call step() or hold() once per sample, then the measure*() that
+	 * are needed. The noise is drawn in the order they are called, the
+	 * tests call them as test-kal7 did: accels, angles, gyros.
+	 */
+	class	Trajectory
+	{
+		public:
+			/**
+			 * @param dt		time step, s
+			 * @param measVar	variance of the sensor noise
+			 * @param roll,pitch,yaw	starting attitude, rad
+			 */
+			Trajectory( FT dt, FT measVar, FT roll = 0, FT pitch = 0, FT yaw = 0 )
+			{
+				this->dt	= dt;
+				stdDev		= sqrt( measVar );
+				angles		<< roll, pitch, yaw;
+				rates.setZero();
+				gyroBias	<< 3,5,7;
+			}
+
+			/** move with the rates of sample k of the test-kal7 trajectory */
+			void	step( int k )
+			{
+				rates	<< 0.03*sin(2*0.02*C_PI*k*dt),
+						   0.5*cos(2*0.2*C_PI*k*dt+0.3),
+						   0.1*cos(2*0.07*C_PI*k*dt + 0.14 );
+				integrate();
+			}
+
+			/** stay at rest for one sample */
+			void	hold()
+			{
+				rates.setZero();
+				integrate();
+			}
+
+			/** accelerometer reading at the current attitude, gravity only */
+			Matrix<FT,3,1>	measureAccels()
+			{
+				Matrix<FT,3,1>	a;
+				a	<< -9.8*sin(angles(1)),
+					   -9.8*sin(angles(0))*cos(angles(1)),
+					   9.8*cos(angles(0))*cos(angles(1));
+				return a + util::randomVector3( 0, stdDev );
+			}
+
+			/**
+			 * [roll pitch yaw]' as the software computes them from accels,
+			 * with yaw from the true one plus noise
+			 */
+			Matrix<FT,3,1>	measureAngles( const Matrix<FT,3,1> &accels )
+			{
+				Matrix<FT,3,1>	m;
+				util::accelToPR( accels, m );
+				m(2)	= angles(2) + util::randomNormal()*stdDev;
+
+				FT	temp = -accels[0]/accels.norm();
+				if ( temp > 1 )		temp = 1;
+				if ( temp < -1 )	temp = -1;
+				m(1)	= asin(temp);
+				return m;
+			}
+
+			/** gyro reading, rad/s, bias included */
+			Matrix<FT,3,1>	measureGyros()
+			{
+				return rates + util::randomVector3( 0, stdDev ) + gyroBias;
+			}
+
+			/** true [roll pitch yaw]' */
+			const Matrix<FT,3,1> &	getAngles() const { return angles; }
+
+			/** true angular rates of the last step, rad/s */
+			const Matrix<FT,3,1> &	getRates() const { return rates; }
+
+			const Matrix<FT,3,1> &	getGyroBias() const { return gyroBias; }
+			void	setGyroBias( const Matrix<FT,3,1> &b ) { gyroBias = b; }
+
+		private:
+			void	integrate()
+			{
+				for (int i=0; i < 3; i++)
+					angles(i)	= limitPI( angles(i) + rates(i)*dt );
+			}
+
+			FT				dt;
+			FT				stdDev;
+			Matrix<FT,3,1>	angles;
+			Matrix<FT,3,1>	rates;
+			Matrix<FT,3,1>	gyroBias;
+
+		public:
+			EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+}};
+
+#endif	/* __ahrs_testdata_h_ */
@@ -0,0 +1,252 @@
+/*
+ *	calib::Alignment and util::triad(): TRIAD against known attitudes,
+ *	stationary detection on a board that is handled and then put down,
+ *	and the time kalman7 takes to get the attitude right after power-on,
+ *	started as the AVR32 AHRS used to (one sample of each sensor, P = I)
+ *	and from the alignment.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/calib/Alignment.h>
+
+using namespace openAHRS;
+
+static const FT	dt				= 1.0/50;
+static const int	MAG_DECIMATION	= 5;		/* mags at 10Hz */
+static const FT	meas_variance	= 0.01;		/* angles */
+static const FT	accelNoise		= 0.1;		/* m/s^2 */
+static const FT	gyroNoise		= 0.01;		/* rad/s */
+static const FT	magNoise		= 0.01;		/* of a unit field */
+
+/* magnetic inclination, rad */
+#define	INCLINATION	0.6
+
+/* 1s window, as the AVR32 AHRS */
+typedef	calib::Alignment<50,10>	Align;
+
+/** sensor data for an attitude, with the axis signs of test-kal7vec */
+static void	sense( const Matrix<FT,3,1> &e, Matrix<FT,3,1> &a, Matrix<FT,3,1> &m, bool noise )
+{
+	FT	roll = e(0), pitch = e(1);
+	a	<< -9.8*sin(pitch),
+		   -9.8*sin(roll)*cos(pitch),
+		   9.8*cos(roll)*cos(pitch);
+
+	Matrix<FT,3,1>	magRef;
+	Matrix<FT,3,4>	H;
+	magRef	<< cos(INCLINATION), 0, sin(INCLINATION);
+	util::calcVectorMeas( util::eulerToQuat( e ), magRef, m, H );
+	m(2)	= -m(2);
+
+	if ( noise ) {
+		a	+= util::randomVector3( 0, accelNoise );
+		m	+= util::randomVector3( 0, magNoise );
+	}
+}
+
+/** largest angle error, rad */
+static FT	attitudeError( const Matrix<FT,4,1> &q, const Matrix<FT,3,1> &real )
+{
+	Matrix<FT,3,1>	e	= util::quatToEulerNorm( q );
+	FT	err	= 0;
+	for (int k=0; k < 3; k++)
+		err	= std::max( err, FT( fabs( util::calcAngleError( e(k), real(k) ) ) ) );
+	return err;
+}
+
+/**
+ * Power-on at rest at attitude real, with gyro bias. Seconds from power-on
+ * until the attitude error stays below tol, -1 if not within the run.
+ * Cold is the old start, else the filter starts once aligned.
+ */
+static FT	timeToAttitude( const Matrix<FT,3,1> &real, const Matrix<FT,3,1> &bias,
+							bool cold, FT tol, FT &peak )
+{
+	const int	N	= 60*50;	/* a minute */
+
+	kalman7	K;
+	Align	al( 0.05, 1e-3 );
+	bool	started	= false;
+
+	Matrix<FT,3,1>	a, m, g, angles;
+	Matrix<FT,7,1>	X;
+
+	int	lastBad	= 0;
+	peak	= 0;
+	for (int i=0; i < N; i++)
+	{
+		sense( real, a, m, true );
+		g	= bias + util::randomVector3( 0, gyroNoise );
+
+		util::accelToPR( a, angles );
+		angles(2)	= util::calcHeading( m, angles );
+
+		if ( !started )
+		{
+			if ( cold ) {
+				Matrix<FT,3,1>	b	= g;
+				K.KalmanInit( angles, b, meas_variance, 1e-4, 1e-7 );
+				started	= true;
+			} else {
+				if ( i % MAG_DECIMATION == 0 )
+					al.addMagn( m );
+				if ( al.addSample( a, g ) ) {
+					Matrix<FT,3,1>	e, b;
+					Matrix<FT,7,7>	P;
+					al.getAngles( e );
+					al.getBias( b );
+					K.KalmanInit( e, b, meas_variance, 1e-4, 1e-7 );
+					al.getCovariance( P, 1e-4, 1e-6 );
+					K.setCovarianceMatrix( P );
+					started	= true;
+				}
+			}
+			if ( !started ) {
+				lastBad	= i + 1;	/* no attitude yet */
+				continue;
+			}
+		} else {
+			K.KalmanUpdate( i, angles, dt );
+		}
+
+		K.getStateVector( X );
+		FT	err	= attitudeError( X.start<4>(), real );
+		if ( err > tol )
+			lastBad	= i + 1;
+		peak	= std::max( peak, err );
+
+		K.KalmanPredict( i, g, dt );
+	}
+
+	if ( lastBad >= N - 50 )
+		return -1;		/* not settled */
+	return lastBad*dt;
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	/** TRIAD, noiseless, all over the sphere **/
+	{
+		FT	errMax	= 0;
+		for (int i=0; i < 1000; i++)
+		{
+			Matrix<FT,3,1>	e	= util::randomVector3( 0, 1 );
+			e(1)	= fmod( e(1), FT(1.5) );	/* away from gimbal lock for the Euler check */
+
+			Matrix<FT,3,1>	a, m;
+			Matrix<FT,4,1>	q;
+			sense( e, a, m, false );
+			if ( !util::triad( a, m, q ) ) {
+				ok	= false;
+				continue;
+			}
+			errMax	= std::max( errMax, attitudeError( q, e ) );
+		}
+		printf( "TRIAD, 1000 attitudes: max error %g rad\n", double(errMax) );
+		ok	= ok && ( errMax < ( sizeof(FT) == 4 ? 1e-3 : 1e-6 ) );
+
+		/* field along gravity: no yaw */
+		Matrix<FT,3,1>	a, m;
+		Matrix<FT,4,1>	q;
+		a	<< 0, 0, 9.8;
+		m	<< 0, 0, -1;
+		ok	= ok && !util::triad( a, m, q );
+	}
+
+	/** handled for 3s, then put down **/
+	{
+		Align	al( 0.05, 1e-3 );
+		Matrix<FT,3,1>	e, a, m, g, bias;
+		bias	<< 0.03, -0.02, 0.01;
+		e		<< 0.3, -0.2, 1.2;
+
+		int	alignedAt	= -1;
+		for (int i=0; i < 10*50 && alignedAt < 0; i++)
+		{
+			if ( i < 3*50 ) {
+				/* slow wobble, 0.5 rad/s peak */
+				g	<< 0.5*sin(2*C_PI*0.7*i*dt), 0.4*cos(2*C_PI*0.5*i*dt), 0.3*sin(2*C_PI*0.3*i*dt);
+				e	+= g*dt;
+			} else
+				g.setZero();
+
+			sense( e, a, m, true );
+			g	+= bias + util::randomVector3( 0, gyroNoise );
+
+			if ( i % MAG_DECIMATION == 0 )
+				al.addMagn( m );
+			if ( al.addSample( a, g ) )
+				alignedAt	= i;
+		}
+
+		Matrix<FT,3,1>	b;
+		Matrix<FT,4,1>	q;
+		al.getBias( b );
+		al.getQuaternion( q );
+
+		FT	attErr	= attitudeError( q, e );
+		FT	biasErr	= ( b - bias ).norm();
+		printf( "put down at 3.00 s, aligned at %.2f s: attitude error %.4f rad, bias error %.4f rad/s\n",
+				double( alignedAt*dt ), double(attErr), double(biasErr) );
+
+		/* not while moving, and right after a full still window */
+		ok	= ok && al.hasHeading() && ( alignedAt >= 3*50 + 49 ) && ( alignedAt < 3*50 + 60 ) &&
+			  ( attErr < 0.01 ) && ( biasErr < 0.01 );
+	}
+
+	/** power-on at rest, old start against the alignment **/
+	{
+		const FT	tol	= 1*C_PI/180;
+
+		Matrix<FT,3,1>	real, bias;
+		real	<< 0.3, -0.2, 1.2;
+		bias	<< 0.03, -0.02, 0.01;
+
+		FT	peakCold, peakAligned;
+		FT	tCold		= timeToAttitude( real, bias, true, tol, peakCold );
+		FT	tAligned	= timeToAttitude( real, bias, false, tol, peakAligned );
+
+		printf( "attitude within 1 deg after: cold start %.2f s, aligned %.2f s\n",
+				double(tCold), double(tAligned) );
+		printf( "largest attitude error:      cold start %.4f, aligned %.4f rad\n",
+				double(peakCold), double(peakAligned) );
+		ok	= ok && ( tAligned >= 0 ) && ( tAligned < 1.5 ) && ( tCold < 0 || tAligned < tCold/4 );
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
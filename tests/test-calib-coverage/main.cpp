@@ -0,0 +1,219 @@
+/*
+ *  Test program for the direction coverage sample selector: a log that
+ *	sits still in two orientations for a long time around a sweep over all
+ *	of them (a turn about each axis, then a spiral), as a hand calibration
+ *	does. UKFEllipsoid and StreamEllipsoid are run on all the samples and
+ *	on the selected ones, errors, time and coverage are compared. Also
+ *	checks that the centre of every bin maps back to that bin.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+#include <openAHRS/calib/DirectionSelector.h>
+#include <openAHRS/calib/StreamEllipsoid.h>
+#include <openAHRS/calib/UKFEllipsoid.h>
+#include <openAHRS/util/util.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+using namespace openAHRS;
+
+/** still, sweep, still */
+#define	NSTILL	8000
+#define	NSWEEP	4000
+#define	NTURN	300		/* of the sweep, for each turn about an axis */
+#define	N		( 2*NSTILL + NSWEEP )
+
+FT	noiseStdDev	= 0.01;
+
+Matrix<FT,3,1>	genMeas[N];
+Matrix<FT,9,1>	trueState;
+
+/** sample for the unit direction out, see UKFEllipsoid::processInput() */
+static void	genSample( int i, Matrix<FT,3,1> out )
+{
+	const Matrix<FT,9,1>	&X	= trueState;
+	out	/= out.norm();
+
+	FT	xCent	= X(0)*out(0);
+	FT	yCent	= ( X(0)*out(1) - X(3)*xCent )/X(1);
+	FT	zCent	= ( X(0)*out(2) - X(4)*xCent - X(5)*yCent )/X(2);
+
+	genMeas[i]	<< X(6) + xCent, X(7) + yCent, X(8) + zCent;
+	genMeas[i]	+= util::randomVector3( 0, noiseStdDev );
+}
+
+static void	genInputData()
+{
+	Matrix<FT,3,1>	d;
+	int	i = 0;
+
+	d << 0.2, 0.1, 1;
+	for (int k=0; k < NSTILL; k++)
+		genSample( i++, d );
+
+	/* a turn about each axis, as a hand calibration starts */
+	for (int axis=0; axis < 3; axis++)
+		for (int k=0; k < NTURN; k++) {
+			FT	a	= 2*C_PI*k/NTURN;
+			d( axis )				= 0;
+			d( ( axis + 1 ) % 3 )	= cos( a );
+			d( ( axis + 2 ) % 3 )	= sin( a );
+			genSample( i++, d );
+		}
+
+	/* then a spiral from pole to pole, 20 turns */
+	for (int k=0; k < NSWEEP - 3*NTURN; k++) {
+		FT	t		= ( k + 0.5 )/( NSWEEP - 3*NTURN );
+		FT	phi		= acos( 1 - 2*t );
+		FT	theta	= 2*C_PI*20*t;
+		d	<< sin(phi)*cos(theta), sin(phi)*sin(theta), cos(phi);
+		genSample( i++, d );
+	}
+
+	d << -0.3, 1, -0.2;
+	for (int k=0; k < NSTILL; k++)
+		genSample( i++, d );
+}
+
+static double	nowMs()
+{
+	struct timespec	ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return 1e3*ts.tv_sec + 1e-6*ts.tv_nsec;
+}
+
+/** largest error of |calibrated| against 1 over the sweep, noise free directions */
+static FT	calibError( const Matrix<FT,9,1> &X )
+{
+	calib::UKFEllipsoid	EL;
+	EL.setStateVector( X );
+
+	FT	err = 0;
+	for (int i=NSTILL; i < NSTILL + NSWEEP; i++) {
+		Matrix<FT,3,1>	out;
+		EL.processInput( genMeas[i], out );
+		FT	e	= fabs( out.norm() - 1 );
+		if ( e > err )
+			err	= e;
+	}
+	return err;
+}
+
+struct	Result
+{
+	FT		errUKF, errStream;
+	double	msUKF, msStream;
+};
+
+static Result	run( bool select, calib::DirectionSelector &sel )
+{
+	Result	r;
+	Matrix<FT,3,1>	offset;
+	offset << 2.5, 2.5, 2.5;
+
+	calib::UKFEllipsoid		UE;
+	calib::StreamEllipsoid	SE;
+	UE.init( 1e-6, offset, 16.5, 1e-6, 1e-9, 1e-3 );
+	SE.init( offset, 16.5 );
+
+	double	t1	= nowMs();
+	for (int i=0; i < N; i++)
+		if ( !select || sel.accept( genMeas[i] ) )
+			UE.estimateParams( genMeas[i] );
+	double	t2	= nowMs();
+
+	sel.reset();
+	for (int i=0; i < N; i++)
+		if ( !select || sel.accept( genMeas[i] ) )
+			SE.estimateParams( genMeas[i] );
+	double	t3	= nowMs();
+
+	Matrix<FT,9,1>	X;
+	UE.getStateVector( X );
+	r.errUKF	= calibError( X );
+	SE.getStateVector( X );
+	r.errStream	= calibError( X );
+	r.msUKF		= t2 - t1;
+	r.msStream	= t3 - t2;
+	return r;
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	trueState	<< 16.5, 1.3, 1.5, 0.1, -0.05, 0.08, 7, 3, 5;
+	genInputData();
+
+	calib::DirectionSelector	sel( 16.5 );
+
+	/** each bin centre is in its own bin **/
+	int	wrongBins = 0;
+	for (int b=0; b < sel.numBins(); b++) {
+		Matrix<FT,3,1>	d;
+		sel.getBinDirection( b, d );
+		wrongBins	+= ( sel.binOf( d ) != b );
+	}
+	printf("%d bins, %d bin centres map elsewhere\n", sel.numBins(), wrongBins );
+	ok	= ok && ( wrongBins == 0 );
+
+	/** coverage along the log **/
+	FT	covStill = 0, covSweep = 0;
+	for (int i=0; i < N; i++) {
+		sel.accept( genMeas[i] );
+		if ( i == NSTILL - 1 )
+			covStill	= sel.getCoverage();
+		if ( i == NSTILL + NSWEEP - 1 )
+			covSweep	= sel.getCoverage();
+	}
+	printf("coverage: %.1f%% after sitting still, %.1f%% after the sweep, %.1f%% at the end\n",
+			(double)covStill, (double)covSweep, (double)sel.getCoverage() );
+	printf("accepted %d of %d samples\n", sel.getAccepted(), N );
+
+	ok	= ok && ( covStill < 5 ) && ( covSweep > 95 );
+	ok	= ok && ( sel.getAccepted() < N/10 );
+
+	/** calibrators on all samples and on the selected ones **/
+	sel.reset();
+	Result	all	= run( false, sel );
+	sel.reset();
+	Result	selected	= run( true, sel );
+
+	printf("max calibration error   UKFEllipsoid          StreamEllipsoid\n");
+	printf("  all samples           %.5f (%6.1f ms)    %.5f (%5.2f ms)\n",
+			(double)all.errUKF, all.msUKF, (double)all.errStream, all.msStream );
+	printf("  selected              %.5f (%6.1f ms)    %.5f (%5.2f ms)\n",
+			(double)selected.errUKF, selected.msUKF, (double)selected.errStream, selected.msStream );
+
+	ok	= ok && ( selected.errStream < 1.5*all.errStream + 1e-3 );
+	ok	= ok && ( selected.errUKF < 1.5*all.errUKF + 1e-3 );
+	ok	= ok && ( selected.errStream < 5e-3 );
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ *  Test program for the batch ellipsoid fit: fits a distorted, noisy
+ *	sphere with cross-axis terms on one thread and on a pool of threads
+ *	(the results must be identical), checks the parameters found, then
+ *	runs UKFEllipsoid over the first samples once started from the fit
+ *	and once from the usual rough guess: the seeded run must end clearly
+ *	closer.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+#include <openAHRS/calib/EllipsoidFit.h>
+#include <openAHRS/calib/UKFEllipsoid.h>
+#include <openAHRS/util/util.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+using namespace openAHRS;
+
+/** how many points for test data, as test-calib-ellipsoid */
+#define	N	20000
+
+/** samples the UKF runs get. Over all N both runs end at the same state,
+ * the fit only pays off when data is short */
+#define	UKF_SAMPLES	100
+
+/** the rough guess must end at least this many times the seeded error */
+#define	SEED_GAIN	2
+
+FT	noiseStdDev	= 0.01;
+
+Matrix<FT,3,1>	genMeas[N];	//generated measurements
+Matrix<FT,9,1>	trueState;
+
+/** samples X( x ) = out for out on the unit sphere, see UKFEllipsoid::processInput() */
+void	genInputData( const Matrix<FT,9,1> &X )
+{
+	for (int i=0; i < N; i++)
+	{
+		Matrix<FT,3,1>	out	= util::randomVector3( 0, 1 );
+		out	/= out.norm();
+
+		FT	xCent	= X(0)*out(0);
+		FT	yCent	= ( X(0)*out(1) - X(3)*xCent )/X(1);
+		FT	zCent	= ( X(0)*out(2) - X(4)*xCent - X(5)*yCent )/X(2);
+
+		genMeas[i]	<< X(6) + xCent, X(7) + yCent, X(8) + zCent;
+		genMeas[i]	+= util::randomVector3( 0, noiseStdDev );
+	}
+}
+
+static double	nowMs()
+{
+	struct timespec	ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return 1e3*ts.tv_sec + 1e-6*ts.tv_nsec;
+}
+
+/** largest error of the calibrated true sphere */
+static FT	calibError( const Matrix<FT,9,1> &X )
+{
+	calib::UKFEllipsoid	EL;
+	EL.setStateVector( X );
+
+	FT	err = 0;
+	for (int i=0; i < N; i += 10)
+	{
+		/* the noise free point for genMeas[i] is not kept, the error
+		 * of |out| against 1 is close enough with the noise this small */
+		Matrix<FT,3,1>	out;
+		EL.processInput( genMeas[i], out );
+		FT	e	= fabs( out.norm() - 1 );
+		if ( e > err )
+			err	= e;
+	}
+	return err;
+}
+
+static void	printState( const char *name, const Matrix<FT,9,1> &X )
+{
+	printf("%-14s", name );
+	for (int i=0; i < 9; i++)
+		printf(" %9.5f", (double)X(i) );
+	printf("\n");
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	trueState	<< 16.5, 1.3, 1.5, 0.1, -0.05, 0.08, 7, 3, 5;
+	genInputData( trueState );
+
+	/** fit, on this thread and on a pool **/
+	calib::EllipsoidFit	fit1, fitN;
+	util::ThreadPool	pool( 4 );
+
+	double	t1	= nowMs();
+	bool	ok1	= fit1.fit( genMeas, N );
+	double	t2	= nowMs();
+	bool	okN	= fitN.fit( genMeas, N, &pool );
+	double	t3	= nowMs();
+
+	Matrix<FT,9,1>	X1, XN;
+	fit1.getStateVector( X1 );
+	fitN.getStateVector( XN );
+
+	printState( "true", trueState );
+	printState( "batch fit", X1 );
+	printf("batch fit: %.2f ms on 1 thread, %.2f ms on %d threads, residual %g\n",
+			t2 - t1, t3 - t2, pool.size(), (double)fit1.getResidual() );
+
+	ok	= ok && ok1 && okN;
+	for (int i=0; i < 9; i++) {
+		ok	= ok && ( X1(i) == XN(i) );
+		ok	= ok && ( fabs( X1(i) - trueState(i) ) < 1e-2*( 1 + fabs( trueState(i) ) ) );
+	}
+	ok	= ok && ( fit1.getResidual() < 3*noiseStdDev/trueState(0) + 1e-4 );
+
+	/** UKF started from the fit, and from a rough guess as test-calib-ukfellipsoid does,
+	 ** over the first UKF_SAMPLES **/
+	calib::UKFEllipsoid	seeded, rough;
+	Matrix<FT,3,1>	offset;
+	offset << 2.5, 2.5, 2.5;
+
+	seeded.init( 1e-6, X1, 1e-6, 1e-9, 1e-6 );
+	rough.init( 1e-6, offset, 16.5, 1e-6, 1e-9, 1e-3 );
+
+	double	t4	= nowMs();
+	for (int i=0; i < UKF_SAMPLES; i++)
+		seeded.estimateParams( genMeas[i] );
+	double	t5	= nowMs();
+	for (int i=0; i < UKF_SAMPLES; i++)
+		rough.estimateParams( genMeas[i] );
+	double	t6	= nowMs();
+
+	Matrix<FT,9,1>	Xs, Xr;
+	seeded.getStateVector( Xs );
+	rough.getStateVector( Xr );
+
+	printState( "UKF, seeded", Xs );
+	printState( "UKF, rough", Xr );
+	printf("max calibration error: batch fit %g, after %d samples UKF seeded %g (%.2f ms), UKF rough guess %g (%.2f ms)\n",
+			(double)calibError( X1 ), UKF_SAMPLES, (double)calibError( Xs ), t5 - t4,
+			(double)calibError( Xr ), t6 - t5 );
+
+	ok	= ok && ( calibError( Xs ) < 2*calibError( X1 ) );
+	ok	= ok && ( calibError( Xr ) > SEED_GAIN*calibError( Xs ) );
+
+	/** samples on a plane determine no ellipsoid **/
+	for (int i=0; i < N; i++)
+		genMeas[i](2)	= 5;
+	calib::EllipsoidFit	fitPlane;
+	bool	okPlane	= fitPlane.fit( genMeas, N, &pool );
+	printf("points on a plane: %s\n", okPlane ? "fitted" : "rejected" );
+	ok	= ok && !okPlane;
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
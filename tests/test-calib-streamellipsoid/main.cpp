@@ -0,0 +1,163 @@
+/*
+ *  Test program for the streaming ellipsoid calibration: feeds the data of
+ *	test-calib-ellipsoidfit to StreamEllipsoid and UKFEllipsoid one sample
+ *	at a time, checks that the streamed fit ends where the batch fit does,
+ *	compares the time per sample, and checks that with a decay it follows
+ *	an offset that changes half way through.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+
+#include <openAHRS/calib/StreamEllipsoid.h>
+#include <openAHRS/calib/EllipsoidFit.h>
+#include <openAHRS/calib/UKFEllipsoid.h>
+#include <openAHRS/util/util.h>
+
+#include "../common/testdata.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+/** how many points for test data */
+#define	N	20000
+
+FT	noiseStdDev	= 0.01;
+
+Matrix<FT,3,1>	genMeas[N];	//generated measurements
+
+/** samples X( x ) = out for out on the unit sphere, see UKFEllipsoid::processInput() */
+void	genInputData( const Matrix<FT,9,1> &X, int first, int last )
+{
+	for (int i=first; i < last; i++)
+	{
+		Matrix<FT,3,1>	out	= util::randomVector3( 0, 1 );
+		out	/= out.norm();
+
+		FT	xCent	= X(0)*out(0);
+		FT	yCent	= ( X(0)*out(1) - X(3)*xCent )/X(1);
+		FT	zCent	= ( X(0)*out(2) - X(4)*xCent - X(5)*yCent )/X(2);
+
+		genMeas[i]	<< X(6) + xCent, X(7) + yCent, X(8) + zCent;
+		genMeas[i]	+= util::randomVector3( 0, noiseStdDev );
+	}
+}
+
+static void	printState( const char *name, const Matrix<FT,9,1> &X )
+{
+	printf("%-16s", name );
+	for (int i=0; i < 9; i++)
+		printf(" %9.5f", (double)X(i) );
+	printf("\n");
+}
+
+static FT	maxRelDiff( const Matrix<FT,9,1> &a, const Matrix<FT,9,1> &b )
+{
+	FT	d = 0;
+	for (int i=0; i < 9; i++) {
+		FT	e	= fabs( a(i) - b(i) )/( 1 + fabs( b(i) ) );
+		if ( e > d )
+			d	= e;
+	}
+	return d;
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	Matrix<FT,9,1>	trueState;
+	trueState	<< 16.5, 1.3, 1.5, 0.1, -0.05, 0.08, 7, 3, 5;
+	genInputData( trueState, 0, N );
+
+	/** streamed, against the batch fit of the same samples **/
+	calib::StreamEllipsoid	SE;
+	calib::UKFEllipsoid		UE;
+	Matrix<FT,3,1>	offset;
+	offset << 2.5, 2.5, 2.5;
+	SE.init( offset, 16.5 );
+	UE.init( 1e-6, offset, 16.5, 1e-6, 1e-9, 1e-3 );
+
+	double	t1	= nowNs();
+	for (int i=0; i < N; i++)
+		SE.estimateParams( genMeas[i] );
+	double	t2	= nowNs();
+	for (int i=0; i < N; i++)
+		UE.estimateParams( genMeas[i] );
+	double	t3	= nowNs();
+
+	Matrix<FT,9,1>	Xs, Xu, Xb;
+	SE.getStateVector( Xs );
+	UE.getStateVector( Xu );
+
+	calib::EllipsoidFit	fit;
+	fit.fit( genMeas, N );
+	fit.getStateVector( Xb );
+
+	/* and the cost of a fit alone */
+	double	t4	= nowNs();
+	for (int i=0; i < 100; i++)
+		SE.solve();
+	double	t5	= nowNs();
+
+	printState( "true", trueState );
+	printState( "streamed", Xs );
+	printState( "batch fit", Xb );
+	printState( "UKF", Xu );
+	printf("per sample: StreamEllipsoid %.1f ns (fit every 256 included), UKFEllipsoid %.1f ns, one fit %.1f us\n",
+			(t2 - t1)/N, (t3 - t2)/N, (t5 - t4)/100/1000 );
+	printf("streamed against batch fit: max relative difference %g\n", (double)maxRelDiff( Xs, Xb ) );
+
+	ok	= ok && ( maxRelDiff( Xs, Xb ) < 1e-6 );
+
+	/** offset moves half way, only the decayed sums follow it **/
+	Matrix<FT,9,1>	moved	= trueState;
+	moved(6)	+= 1;
+	moved(8)	-= 0.5;
+	genInputData( moved, N/2, N );
+
+	calib::StreamEllipsoid	keep, fade;
+	fade.setDecay( 0.8 );
+	for (int i=0; i < N; i++) {
+		keep.estimateParams( genMeas[i] );
+		fade.estimateParams( genMeas[i] );
+	}
+
+	Matrix<FT,9,1>	Xk, Xf;
+	keep.getStateVector( Xk );
+	fade.getStateVector( Xf );
+	printState( "moved offset", moved );
+	printState( "decay 1", Xk );
+	printState( "decay 0.8", Xf );
+
+	ok	= ok && ( maxRelDiff( Xf, moved ) < 1e-2 );
+	ok	= ok && ( maxRelDiff( Xk, moved ) > 2e-2 );
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
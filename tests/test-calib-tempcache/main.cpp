@@ -0,0 +1,190 @@
+/*
+ *	calib::TemperatureCache: a gyro bias that drifts with temperature is
+ *	learned over a warm-up from 0 to 50C, then looked up at any temperature.
+ *	Then kalman7 at rest starts once cold (bias from the first gyro sample,
+ *	default covariance) and once from the cache, and the time each takes
+ *	to get the bias right is compared.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/calib/TemperatureCache.h>
+
+using namespace openAHRS;
+
+typedef	calib::TemperatureCache<3,16>	Cache;	/* 5C bins from -20C, as the AVR32 AHRS */
+
+#define	STORE_FILE	"test-calib-tempcache.cal"
+
+static const FT	dt				= 1.0/50;
+static const FT	meas_variance	= 0.01;		/* angles */
+static const FT	gyroNoise		= 0.01;		/* rad/s */
+
+/* bias of the simulated gyros, rad/s, with a bend in Y */
+static Matrix<FT,3,1>	trueBias( FT temp )
+{
+	FT	d	= temp - 25;
+	Matrix<FT,3,1>	b;
+	b	<< 0.02 + 1e-3*d, -0.01 + 5e-4*d + 2e-5*d*d, 0.005 - 8e-4*d;
+	return b;
+}
+
+/**
+ * kalman7 at rest at temp, from startBias. Seconds until the bias error
+ * stays below tol, -1 if that is not in the first half of the run.
+ * From the cache, the covariance starts as the AVR32 AHRS sets it: the
+ * bias variance of a known bias, and the attitude variance of the
+ * measurement it comes from
+ */
+static FT	settleTime( FT temp, const Matrix<FT,3,1> &startBias, bool fromCache, FT tol, FT &peak )
+{
+	const int	N	= 60*50;	/* a minute */
+
+	Matrix<FT,3,1>	angles, real, g;
+	real	<< 0.1, -0.2, 0.5;
+	angles	= real;
+
+	kalman7	K;
+	Matrix<FT,3,1>	b	= startBias;
+	K.KalmanInit( angles, b, meas_variance, 1e-6, 1e-6 );
+	if ( fromCache ) {
+		Matrix<FT,7,7>	P;
+		K.getCovarianceMatrix(P);
+		P.block<4,4>(0,0)	= meas_variance*Matrix<FT,4,4>::Identity();
+		P.block<3,3>(4,4)	= 1e-4*Matrix<FT,3,3>::Identity();
+		K.setCovarianceMatrix(P);
+	}
+
+	int	lastBad	= 0;
+	peak	= 0;
+	for (int i=0; i < N; i++)
+	{
+		angles	= real + util::randomVector3( 0, sqrt(meas_variance) );
+		K.KalmanUpdate( i, angles, dt );
+
+		g	= trueBias( temp ) + util::randomVector3( 0, gyroNoise );
+		K.KalmanPredict( i, g, dt );
+
+		Matrix<FT,7,1>	X;
+		K.getStateVector(X);
+		Matrix<FT,3,1>	e	= X.block<3,1>(4,0) - trueBias( temp );
+		if ( e.norm() > tol )
+			lastBad	= i + 1;
+		peak	= std::max( peak, FT( e.norm() ) );
+	}
+
+	if ( lastBad > N/2 )
+		return -1;		/* not settled */
+	return lastBad*dt;
+}
+
+int main()
+{
+	bool	ok	= true;
+	Cache	cache( -20, 5 );
+	Matrix<FT,3,1>	v;
+
+	if ( cache.lookup( 25, v ) ) {
+		printf( "lookup in an empty cache succeeded\n" );
+		ok	= false;
+	}
+
+	/** warm-up from 0 to 50C, a bias estimate every 0.1C with the noise of a filter's **/
+	for (FT t=0; t <= 50; t += 0.1)
+		cache.update( t, trueBias( t ) + util::randomVector3( 0, 2e-4 ) );
+
+	/* between the first and last bins seen, 1.25 and 48.75C: out of
+	 * there the nearest bin is taken as it is, no extrapolation */
+	FT	errMax	= 0;
+	for (FT t=1.25; t <= 48.75; t += 0.37)
+	{
+		if ( !cache.lookup( t, v ) ) {
+			ok	= false;
+			break;
+		}
+		errMax	= std::max( errMax, FT( ( v - trueBias( t ) ).norm() ) );
+	}
+	printf( "bias from the cache, 1.25..48.75C: max error %g rad/s\n", double(errMax) );
+	ok	= ok && ( errMax < 5e-4 );
+
+	/* out of the range seen, the nearest bin with data */
+	Matrix<FT,3,1>	vEdge;
+	cache.lookup( 70, v );
+	cache.lookup( 50, vEdge );
+	ok	= ok && ( ( v - vEdge ).norm() == 0 );
+
+	/** save and load, and refuse a cache laid out differently **/
+	{
+		Cache	loaded( -20, 5 ), other( -10, 5 );
+		Matrix<FT,3,1>	w;
+
+		util::CalibStoreWriter	wr;
+		util::CalibStore		s;
+		cache.save( wr, "cache" );
+
+		bool	saved	= wr.save( STORE_FILE ) && s.open( STORE_FILE );
+		bool	same	= saved && loaded.load( s, "cache" );
+		bool	refused	= saved && !other.load( s, "cache" ) && !loaded.load( s, "nocache" );
+		s.close();
+		remove( STORE_FILE );
+
+		cache.lookup( 23.4, v );
+		same	= same && loaded.lookup( 23.4, w ) && ( ( v - w ).norm() == 0 );
+		printf( "save/load %s, other layout %s\n", same ? "same" : "DIFFERENT",
+				refused ? "refused" : "LOADED" );
+		ok	= ok && same && refused;
+	}
+
+	/** kalman7 start at 37C, cold and from the cache **/
+	{
+		const FT	temp	= 37;
+		const FT	tol		= 0.05;	/* a few times the steady state error */
+
+		Matrix<FT,3,1>	first	= trueBias( temp ) + util::randomVector3( 0, gyroNoise );
+		cache.lookup( temp, v );
+
+		FT	peakCold, peakWarm;
+		FT	tCold	= settleTime( temp, first, false, tol, peakCold );
+		FT	tWarm	= settleTime( temp, v, true, tol, peakWarm );
+
+		printf( "bias within %g rad/s after: cold start %.2f s, from the cache %.2f s\n",
+				double(tol), double(tCold), double(tWarm) );
+		printf( "largest bias error:          cold start %.4f, from the cache %.4f rad/s\n",
+				double(peakCold), double(peakWarm) );
+		ok	= ok && ( tWarm >= 0 ) && ( tCold < 0 || tWarm <= tCold/4 );
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
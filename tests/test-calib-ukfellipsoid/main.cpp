@@ -136,6 +136,7 @@ TIME_THIS( "calib UKF",
 
 	cout << "---- Finished processing" << endl;
 	cout << "State vector:\n" << calibState[N-1] << endl << endl;
+	cout << "Covariance trimmed after " << EL.getFactorErrors() << " samples" << endl << endl;
 
 
 	cout << "Write data to disk?? (y,n): ";
@@ -0,0 +1,228 @@
+/*
+ *	util::CalibStore: records of several shapes are written and read back
+ *	in place, then the file is damaged in the ways a power loss or a bad
+ *	card would (a flipped byte, a torn write, another header) and every
+ *	one of them must be refused. Also MatrixSerializer, which must notice
+ *	a file of the wrong length.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/calibstore.h>
+#include <openAHRS/util/matrixserializer.h>
+
+using namespace openAHRS;
+
+#define	STORE_FILE	"test-calibstore.cal"
+#define	RAW_FILE	"test-calibstore.raw"
+
+static std::vector<char>	readFile( const char *fileName )
+{
+	std::vector<char>	d;
+	FILE	*f	= fopen( fileName, "rb" );
+	if ( f == NULL )
+		return d;
+	int	c;
+	while ( ( c = fgetc(f) ) != EOF )
+		d.push_back( c );
+	fclose( f );
+	return d;
+}
+
+static void	writeFile( const char *fileName, const std::vector<char> &d, size_t len )
+{
+	FILE	*f	= fopen( fileName, "wb" );
+	fwrite( &d[0], 1, len, f );
+	fclose( f );
+}
+
+/** open() must fail on this content, what is printed if not NULL */
+static bool	refused( const char *what, const std::vector<char> &d, size_t len )
+{
+	util::CalibStore	s;
+	writeFile( STORE_FILE, d, len );
+	bool	r	= !s.open( STORE_FILE );
+	if ( what != NULL )
+		printf( "%-28s %s (%s)\n", what, r ? "refused" : "LOADED", r ? s.getError() : "-" );
+	return r;
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	/** a calibration state, a covariance and a tuning row **/
+	Matrix<FT,9,1>	state;
+	Matrix<FT,7,7>	cov;
+	FT				tune[3]	= { 1e-2, 1e-4, 1e-7 };
+
+	for (int i=0; i < 9; i++)
+		state(i)	= 0.5 + i;
+	for (int r=0; r < 7; r++)
+		for (int c=0; c < 7; c++)
+			cov(r,c)	= r + 0.1*c;
+
+	{
+		util::CalibStoreWriter	w;
+		w.add( "mag.state", state );
+		w.add( "kal.cov", cov );
+		w.add( "tune.kalman7", tune, 1, 3 );
+		w.add( "mag.state", state );	/* replaces, not a second one */
+		ok	= ok && w.save( STORE_FILE );
+	}
+
+	bool	noTmp	= ( access( STORE_FILE ".tmp", F_OK ) != 0 );
+	printf( "temporary file %s\n", noTmp ? "gone" : "LEFT BEHIND" );
+	ok	= ok && noTmp;
+
+	{
+		util::CalibStore	s;
+		if ( !s.open( STORE_FILE ) ) {
+			printf( "open failed: %s\n", s.getError() );
+			return 1;
+		}
+
+		Matrix<FT,9,1>	state2;
+		Matrix<FT,7,7>	cov2;
+		bool	same	= s.get( "mag.state", state2 ) && ( state2 - state ).norm() == 0 &&
+						  s.get( "kal.cov", cov2 ) && ( cov2 - cov ).norm() == 0;
+
+		const FT	*t	= s.find( "tune.kalman7", 1, 3 );
+		same	= same && t != NULL && t[0] == tune[0] && t[1] == tune[1] && t[2] == tune[2];
+
+		/* in place, and aligned for FT */
+		bool	aligned	= t != NULL && ( (size_t)t % sizeof(FT) ) == 0;
+
+		/* wrong size or missing name */
+		bool	strict	= s.find( "kal.cov", 6, 6 ) == NULL && s.find( "nothing", 1, 1 ) == NULL;
+
+		printf( "%d records read back %s, in place %s, size checked %s\n", s.numRecords(),
+				same ? "same" : "DIFFERENT", aligned ? "aligned" : "MISALIGNED",
+				strict ? "yes" : "NO" );
+		ok	= ok && same && aligned && strict && s.numRecords() == 3;
+	}
+
+	/** keep(): rewriting one record keeps the others **/
+	{
+		util::CalibStore		old;
+		util::CalibStoreWriter	w;
+		Matrix<FT,9,1>			state2	= 2*state;
+
+		old.open( STORE_FILE );
+		w.add( "mag.state", state2 );
+		w.keep( old );
+		old.close();
+		ok	= ok && w.save( STORE_FILE );
+
+		util::CalibStore	s;
+		Matrix<FT,9,1>	state3;
+		Matrix<FT,7,7>	cov2;
+		bool	kept	= s.open( STORE_FILE ) && s.get( "mag.state", state3 ) &&
+						  ( state3 - state2 ).norm() == 0 && s.get( "kal.cov", cov2 ) &&
+						  s.find( "tune.kalman7", 1, 3 ) != NULL && s.numRecords() == 3;
+		printf( "%-28s %s\n", "rewrite of one record", kept ? "kept the others" : "LOST SOME" );
+		ok	= ok && kept;
+	}
+
+	/** damaged files **/
+	{
+		std::vector<char>	good	= readFile( STORE_FILE );
+		std::vector<char>	d;
+
+		/* every byte, header and records */
+		int	flips	= 0;
+		for (size_t i=0; i < good.size(); i++) {
+			d	= good;
+			d[i]	^= 0x10;
+			if ( refused( NULL, d, d.size() ) )
+				flips++;
+		}
+		printf( "%-28s %d of %d refused\n", "byte flipped", flips, (int)good.size() );
+		ok	= ok && ( flips == (int)good.size() );
+
+		ok	= refused( "truncated", good, good.size() - 5 ) && ok;
+		ok	= refused( "header only", good, sizeof(util::StoreHeader) ) && ok;
+		ok	= refused( "half a header", good, 10 ) && ok;
+
+		d	= good;
+		d.push_back( 0 );
+		ok	= refused( "trailing byte", d, d.size() ) && ok;
+
+		/* another FT, with the header checksum made right again */
+		d	= good;
+		util::StoreHeader	*h	= (util::StoreHeader *)&d[0];
+		h->scalarSize	= ( sizeof(FT) == 4 ) ? 8 : 4;
+		h->headerCrc	= util::crc32( h, offsetof( util::StoreHeader, headerCrc ) );
+		ok	= refused( "other FT", d, d.size() ) && ok;
+
+		d	= good;
+		h	= (util::StoreHeader *)&d[0];
+		h->version++;
+		h->headerCrc	= util::crc32( h, offsetof( util::StoreHeader, headerCrc ) );
+		ok	= refused( "newer version", d, d.size() ) && ok;
+
+		util::CalibStore	s;
+		ok	= ok && !s.open( "no-such-file.cal" );
+	}
+	remove( STORE_FILE );
+
+	/** CRC-32 check value, as zlib **/
+	uint32_t	check	= util::crc32( "123456789", 9 );
+	printf( "crc32(\"123456789\") = %08x\n", check );
+	ok	= ok && ( check == 0xCBF43926 );
+
+	/** MatrixSerializer round trip, and files of the wrong length **/
+	{
+		Matrix<FT,7,7>		cov2;
+		Matrix<FT,8,7>		big;
+		Matrix<FT,6,7>		small;
+
+		bool	same	= util::MatrixSerializer::save( cov, RAW_FILE ) &&
+						  util::MatrixSerializer::load( cov2, RAW_FILE ) &&
+						  ( cov2 - cov ).norm() == 0;
+		bool	sizes	= !util::MatrixSerializer::load( big, RAW_FILE ) &&
+						  !util::MatrixSerializer::load( small, RAW_FILE );
+		remove( RAW_FILE );
+
+		/* nowhere to write */
+		bool	noDir	= !util::MatrixSerializer::save( cov, "no-such-dir/x.raw" );
+
+		printf( "MatrixSerializer: %s, wrong lengths %s, bad path %s\n",
+				same ? "same" : "DIFFERENT", sizes ? "refused" : "LOADED",
+				noDir ? "refused" : "WRITTEN" );
+		ok	= ok && same && sizes && noDir;
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ *	util::SensorEventRing: a producer thread pushes timestamped events
+ *	as the AVR32 sensor thread does while a consumer pops them with
+ *	popUntil(). Every event must come out whole, once, in order, and
+ *	the ones not taken must be counted as dropped. Also time per pop
+ *	against a queue taking a mutex, as the AHRS used before the ring.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/eventqueue.h>
+
+using namespace openAHRS;
+
+/**
+ * Reference for the timing: sorted queue behind a mutex, oldest event
+ * dropped when full.
+ */
+template <int Capacity>
+class	MutexEventQueue
+{
+	private:
+		util::SensorEvent	ev[Capacity];	/* sorted, oldest first */
+		int					count;
+		pthread_mutex_t		mutex;
+
+	public:
+		MutexEventQueue() {
+			count	= 0;
+			pthread_mutex_init( &mutex, NULL );
+		}
+
+		~MutexEventQueue() {
+			pthread_mutex_destroy( &mutex );
+		}
+
+		void	push( const util::SensorEvent &e )
+		{
+			pthread_mutex_lock( &mutex );
+
+			if ( count == Capacity ) {
+				for (int i=1; i < Capacity; i++)
+					ev[i-1]	= ev[i];
+				count--;
+			}
+
+			/* insertion from the back, events usually arrive in order */
+			int i = count;
+			while ( ( i > 0 ) && ( ev[i-1].t > e.t ) ) {
+				ev[i]	= ev[i-1];
+				i--;
+			}
+			ev[i]	= e;
+			count++;
+
+			pthread_mutex_unlock( &mutex );
+		}
+
+		bool	popUntil( double t, util::SensorEvent &e )
+		{
+			bool	ok = false;
+
+			pthread_mutex_lock( &mutex );
+
+			if ( ( count > 0 ) && ( ev[0].t <= t ) ) {
+				e	= ev[0];
+				for (int i=1; i < count; i++)
+					ev[i-1]	= ev[i];
+				count--;
+				ok	= true;
+			}
+
+			pthread_mutex_unlock( &mutex );
+
+			return ok;
+		}
+};
+
+/* events pushed */
+#define	N		200000
+
+static	util::SensorEventRing<32>	ring;
+static	volatile bool	producerDone;
+
+static void	*producer( void * )
+{
+	util::SensorEvent	e;
+	for (int n=1; n <= N; n++) {
+		e.t		= n;
+		e.type	= n & 1;
+		e.v		<< n, n, n;
+		ring.push(e);
+		if ( n % 16 == 0 )
+			sched_yield();		/* let the consumer in on a single CPU */
+	}
+	producerDone	= true;
+	return NULL;
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	/** popUntil() leaves events newer than t **/
+	{
+		util::SensorEventRing<4>	r;
+		util::SensorEvent			e;
+		for (int n=1; n <= 5; n++) {
+			e.t	= n;
+			bool	pushed	= r.push(e);
+			ok	= ok && ( pushed == ( n <= 4 ) );
+		}
+		ok	= ok && r.getDropped() == 1;
+		ok	= ok && r.popUntil( 2.5, e ) && e.t == 1;
+		ok	= ok && r.popUntil( 2.5, e ) && e.t == 2;
+		ok	= ok && !r.popUntil( 2.5, e );
+		ok	= ok && r.popUntil( 10, e ) && e.t == 3;
+		printf( "single thread: %s\n", ok ? "ok" : "WRONG" );
+	}
+
+	/** producer and consumer threads **/
+	pthread_t	p;
+	producerDone	= false;
+	pthread_create( &p, NULL, producer, NULL );
+
+	util::SensorEvent	e;
+	int		got = 0, torn = 0, last = 0;
+	bool	order	= true;
+
+	while ( true )
+	{
+		if ( !ring.popUntil( 1e30, e ) ) {
+			if ( producerDone && !ring.popUntil( 1e30, e ) )
+				break;
+			sched_yield();
+			continue;
+		}
+		got++;
+		if ( e.v(0) != e.t || e.v(1) != e.t || e.v(2) != e.t || e.type != ( (int)e.t & 1 ) )
+			torn++;
+		if ( e.t <= last )
+			order	= false;
+		last	= (int)e.t;
+	}
+	pthread_join( p, NULL );
+
+	printf( "%d events, %d taken, %d dropped, %d torn, %s\n", N, got, ring.getDropped(),
+			torn, order ? "in order" : "OUT OF ORDER" );
+	ok	= ok && ( torn == 0 ) && order && ( got + ring.getDropped() == N );
+
+	/** cost of a push and a pop, one thread **/
+	{
+		const int	M	= 1000000;
+		util::SensorEventRing<32>	r;
+		MutexEventQueue<32>			q;
+
+		double	t1 = util::monotonicTime();
+		for (int i=0; i < M; i++) {
+			e.t	= i;
+			r.push(e);
+			r.popUntil( i, e );
+		}
+		double	t2 = util::monotonicTime();
+		for (int i=0; i < M; i++) {
+			e.t	= i;
+			q.push(e);
+			q.popUntil( i, e );
+		}
+		double	t3 = util::monotonicTime();
+
+		printf( "push and pop: ring %6.2f ns, mutex queue %6.2f ns\n",
+				1e9*(t2 - t1)/M, 1e9*(t3 - t2)/M );
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
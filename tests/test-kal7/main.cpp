@@ -171,10 +171,16 @@ int main()
 	}
 //);
 
+	/* all the states to euler angles at once, as structure of arrays */
+	static FT	qs[4*N], es[3*N];
 	for (i=0 ; i < N ; i++ )
-	{
-		output.angles[i]	= util::quatToEuler( output.state[i].start<4>() );
-	}
+		for (int k=0; k < 4; k++)
+			qs[k*N + i]	= output.state[i](k);
+
+	util::quatToEulerBatch( qs, es, N );
+
+	for (i=0 ; i < N ; i++ )
+		output.angles[i]	<< es[i], es[N + i], es[2*N + i];
 
 	cout << "End angle: \n" << output.angles[N-1] << endl;
 
@@ -0,0 +1,210 @@
+/*
+ *	Test for kalman7Bank: runs a bank of NF filters next to NF separate
+ *	kalman7 instances, each filter on its own noisy copy of the test-kal7
+ *	trajectory and with its own tuning, and checks that states and
+ *	covariances are exactly the same after every predict and update,
+ *	with joint and with sequential (masked) updates. Also reports the
+ *	time per filter and step of both.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/kalman/kalman7bank.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of filters in the bank */
+#define	NF	16
+
+/* number of points for test, same trajectory as test-kal7 */
+#define	N	2000
+
+static const FT meas_variance = 0.01;
+
+/* structure-of-arrays, as kalman7Bank takes them: [step][k*NF + filter] */
+static FT	angles[N][3*NF];
+static FT	gyros[N][3*NF];
+
+/** the test-kal7 trajectory, with new noise for every filter */
+static void	makeTempData()
+{
+	for ( int f=0; f < NF; f++ )
+	{
+		Trajectory	traj( dt, meas_variance );
+
+		for ( int i=0; i < N; i++ )
+		{
+			traj.step( i );
+
+			Matrix<FT,3,1>	accels	= traj.measureAccels();
+			Matrix<FT,3,1>	a		= traj.measureAngles( accels );
+			Matrix<FT,3,1>	g		= traj.measureGyros();
+
+			for (int k=0; k < 3; k++) {
+				angles[i][k*NF + f]	= a(k);
+				gyros[i][k*NF + f]	= g(k);
+			}
+		}
+	}
+}
+
+/** number of state and covariance elements that differ between bank and filters */
+static int	compare( const kalman7Bank<NF> &bank, kalman7 *single )
+{
+	Matrix<FT,7,1>	Xb, Xs;
+	Matrix<FT,7,7>	Pb, Ps;
+	int	diff = 0;
+
+	for (int f=0; f < NF; f++)
+	{
+		bank.getStateVector( f, Xb );
+		bank.getCovarianceMatrix( f, Pb );
+		single[f].getStateVector( Xs );
+		single[f].getCovarianceMatrix( Ps );
+
+		for (int i=0; i < 7; i++) {
+			diff	+= ( Xb(i) != Xs(i) );
+			for (int j=0; j < 7; j++)
+				diff	+= ( Pb(i,j) != Ps(i,j) );
+		}
+	}
+	return diff;
+}
+
+static void	init( kalman7Bank<NF> &bank, kalman7 *single )
+{
+	for (int f=0; f < NF; f++)
+	{
+		Matrix<FT,3,1>	angle, startBias;
+		angle		<< angles[0][f], angles[0][NF + f], angles[0][2*NF + f];
+		startBias	<< gyros[0][f], gyros[0][NF + f], gyros[0][2*NF + f];
+
+		/* a different quaternion process noise for each filter */
+		FT	quatVar	= 1e-5*( 1 + f );
+
+		bank.KalmanInit( f, angle, startBias, meas_variance, 1e-2, quatVar );
+		single[f].KalmanInit( angle, startBias, meas_variance, 1e-2, quatVar );
+	}
+}
+
+/**
+ * Runs the whole trajectory on both, joint updates (mask 0) or sequential ones
+ * with the mask alternating with mask2. Returns the number of mismatches.
+ */
+static int	run( kalman7Bank<NF> &bank, kalman7 *single, unsigned int mask, unsigned int mask2 )
+{
+	int	diff = 0;
+
+	init( bank, single );
+
+	for (int i=0; i < N; i++)
+	{
+		unsigned int	m	= ( i & 1 ) ? mask2 : mask;
+
+		if ( m == 0 )
+			bank.KalmanUpdate( i, angles[i], dt );
+		else
+			bank.KalmanUpdate( i, angles[i], dt, m );
+
+		for (int f=0; f < NF; f++)
+		{
+			Matrix<FT,3,1>	a;
+			a	<< angles[i][f], angles[i][NF + f], angles[i][2*NF + f];
+			if ( m == 0 )
+				single[f].KalmanUpdate( i, a, dt );
+			else
+				single[f].KalmanUpdate( i, a, dt, m );
+		}
+		diff	+= compare( bank, single );
+
+		bank.KalmanPredict( i, gyros[i], dt );
+		for (int f=0; f < NF; f++)
+		{
+			Matrix<FT,3,1>	g;
+			g	<< gyros[i][f], gyros[i][NF + f], gyros[i][2*NF + f];
+			single[f].KalmanPredict( i, g, dt );
+		}
+		diff	+= compare( bank, single );
+	}
+
+	return diff;
+}
+
+int main()
+{
+	makeTempData();
+
+	kalman7Bank<NF>	*bank	= new kalman7Bank<NF>;
+	kalman7			*single	= new kalman7[NF];
+
+	int	diffJoint	= run( *bank, single, 0, 0 );
+	int	diffSeq		= run( *bank, single, 0x7, 0x3 );
+
+	/* timing, joint updates */
+	init( *bank, single );
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++) {
+		bank->KalmanUpdate( i, angles[i], dt );
+		bank->KalmanPredict( i, gyros[i], dt );
+	}
+	double	t2 = nowNs();
+
+	for (int f=0; f < NF; f++)
+		for (int i=0; i < N; i++)
+		{
+			Matrix<FT,3,1>	a, g;
+			a	<< angles[i][f], angles[i][NF + f], angles[i][2*NF + f];
+			g	<< gyros[i][f], gyros[i][NF + f], gyros[i][2*NF + f];
+			single[f].KalmanUpdate( i, a, dt );
+			single[f].KalmanPredict( i, g, dt );
+		}
+	double	t3 = nowNs();
+
+	printf("FT is %s, %d filters\n", ( sizeof(FT) == sizeof(float) ) ? "float" : "double", NF );
+	printf("kalman7Bank  %8.1f ns/filter/step\n", (t2-t1)/N/NF );
+	printf("kalman7      %8.1f ns/filter/step\n", (t3-t2)/N/NF );
+	printf("mismatches: joint updates %d  sequential updates %d\n", diffJoint, diffSeq );
+
+	delete bank;
+	delete [] single;
+
+	if ( diffJoint || diffSeq ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ *	Test for the fixed point 7-state kalman filter
+ *	Runs kalman7fx next to kalman7 (with sequential updates, which is what
+ *	kalman7fx does) on the test-kal7 trajectory, and reports time per step,
+ *	attitude RMS error, and the largest difference between the two. The
+ *	difference must stay within the accuracy budget of kalman7fx.h.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/kalman/kalman7fx.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points for test, same trajectory as test-kal7 */
+#define	N	2000
+
+/* largest difference from kalman7 over the run, as documented in
+ * kalman7fx.h. With FT=float kalman7 itself is off by about 1e-6 rad */
+#define	TOLERANCE_ATTITUDE			2e-6
+#define	TOLERANCE_ATTITUDE_FLOAT	4e-6
+#define	TOLERANCE_BIAS				1e-5
+
+/* attitude RMS error against kalman7's, relative */
+#define	TOLERANCE_RMS				1e-3
+
+static const FT meas_variance = 0.01;
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+	Matrix<FT,3,1>	realAngles[N];
+
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+		input.realAngles[i]	= traj.getAngles();
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+int main()
+{
+	makeTempData();
+
+	Matrix<FT,3,1>	angle		= input.angles[0];
+	Matrix<FT,3,1>	startBias	= input.gyros[0];
+
+	kalman7		K7;
+	kalman7fx	KF;
+
+	/* first pass, both filters side by side */
+	K7.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+	K7.setSequentialUpdate( true );
+	KF.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+
+	Matrix<FT,7,1>	X7, XF;
+	double	err7 = 0, errF = 0, maxAng = 0, maxBias = 0;
+	int		nerr = 0;
+
+	for (int i=0; i < N; i++)
+	{
+		K7.KalmanUpdate( i, input.angles[i], dt );
+		KF.KalmanUpdate( i, input.angles[i], dt );
+
+		K7.getStateVector( X7 );
+		KF.getStateVector( XF );
+
+		Matrix<FT,3,1>	a7 = util::quatToEulerNorm( X7.start<4>() );
+		Matrix<FT,3,1>	aF = util::quatToEulerNorm( XF.start<4>() );
+
+		for (int k=0; k < 3; k++)
+		{
+			maxAng	= std::max( maxAng, (double)fabs( limitPI( a7(k) - aF(k) ) ) );
+			maxBias	= std::max( maxBias, (double)fabs( X7(4+k) - XF(4+k) ) );
+
+			/* error once converged, second half of the run */
+			if ( i >= N/2 ) {
+				FT	d7 = limitPI( a7(k) - input.realAngles[i](k) );
+				FT	dF = limitPI( aF(k) - input.realAngles[i](k) );
+				err7 += d7*d7;
+				errF += dF*dF;
+				nerr++;
+			}
+		}
+
+		K7.KalmanPredict( i, input.gyros[i], dt );
+		KF.KalmanPredict( i, input.gyros[i], dt );
+	}
+
+	/* timing, the fixed point filter with its fixed point entry points */
+	static fixed::fx	fxAngles[N][3], fxGyros[N][3];
+	for (int i=0; i < N; i++)
+		for (int k=0; k < 3; k++) {
+			fxAngles[i][k]	= fixed::fromFloat<fixed::FANGLE>( input.angles[i](k) );
+			fxGyros[i][k]	= fixed::fromFloat<fixed::FRATE>( input.gyros[i](k) );
+		}
+	fixed::fx	fxDt = fixed::fromFloat<fixed::FTIME>( dt );
+
+	K7.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++) {
+		K7.KalmanUpdate( i, input.angles[i], dt );
+		K7.KalmanPredict( i, input.gyros[i], dt );
+	}
+	double	t2 = nowNs();
+
+	KF.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+	double	t3 = nowNs();
+	for (int i=0; i < N; i++) {
+		KF.KalmanUpdateFx( fxAngles[i], 0x7 );
+		KF.KalmanPredictFx( fxGyros[i], fxDt );
+	}
+	double	t4 = nowNs();
+
+	double	rms7 = sqrt( err7/nerr ), rmsF = sqrt( errF/nerr );
+	bool	isFloat	= ( sizeof(FT) == sizeof(float) );
+	double	tolAng	= isFloat ? TOLERANCE_ATTITUDE_FLOAT : TOLERANCE_ATTITUDE;
+
+	printf("kalman7     %8.1f ns/step   RMS %.7f rad\n", (t2-t1)/N, rms7 );
+	printf("kalman7fx   %8.1f ns/step   RMS %.7f rad\n", (t4-t3)/N, rmsF );
+	printf("largest difference: attitude %g rad (tolerance %g), bias %g rad/s (tolerance %g)\n",
+			maxAng, tolAng, maxBias, TOLERANCE_BIAS );
+
+	if ( !( maxAng <= tolAng ) || !( maxBias <= TOLERANCE_BIAS ) ||
+		 !( fabs( rmsF - rms7 ) <= TOLERANCE_RMS*rms7 ) ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
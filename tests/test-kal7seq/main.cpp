@@ -0,0 +1,375 @@
+/*
+ *	Regression test for the sequential and masked measurement updates.
+ *	On the test-kal7 trajectory, kalman7 and the UKF (dense and square
+ *	root) run the joint update. At every step a copy of each runs the
+ *	sequential one from the same state instead: X and P must agree
+ *	within a tolerance. Then, at a few points of the run, the axisMask
+ *	overload must
+ *	- leave X and P alone when no axis is selected
+ *	- not look at the masked-out components at all
+ *	- with all axes selected, be the plain sequential update
+ *	- for the UKF, give the joint update with an infinite variance in R
+ *	  for the masked-out component
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <limits>
+#include <stdio.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/kalman/UKF.h>
+#include <openAHRS/kalman/UKFst7.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points for test, same trajectory as test-kal7 */
+#define	N	2000
+
+/* masked updates are checked every MASK_EVERY steps */
+#define	MASK_EVERY	100
+
+/* allowed difference between the joint and the sequential update,
+ * relative to the largest element, in units of epsilon */
+#define	TOLERANCE_KAL7_EPS	32
+#define	TOLERANCE_UKF_EPS	512
+
+/* variance standing in for an infinite one, relative to R. The joint
+ * update with it is off from the masked one by about 1/HUGE_VARIANCE,
+ * TOLERANCE_INF_R is allowed on top of the UKF tolerance */
+#define	HUGE_VARIANCE		1e12
+#define	TOLERANCE_INF_R		1e-10
+
+static const FT meas_variance = 0.01;
+
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+typedef UKF< UKFst7_Funcs, 7, 3, 3, false, false >	UKFDense;
+typedef UKF< UKFst7_Funcs, 7, 3, 3, false, true >	UKFSqrt;
+
+/** as UKFst7::KalmanInit(), with the measurement variance of each axis */
+template <class F>
+static void	initUKF( F &f, const Matrix<FT,3,1> &angle, const Matrix<FT,3,1> &bias,
+					const Matrix<FT,3,1> &measVar )
+{
+	Matrix<FT,7,7>	Q;
+	Matrix<FT,3,3>	R;
+	Matrix<FT,7,1>	X;
+
+	f.KalmanInit();
+	/* float needs the wider spread, see UKF::setScaling() */
+	if ( sizeof(FT) == sizeof(float) )
+		f.setScaling( 0.5, 2, 0 );
+
+	R.setZero();
+	for (int j=0; j < 3; j++)
+		R(j,j)	= measVar(j);
+
+	Q.setIdentity();
+	Q		*= 1e-5;
+	Q(4,4)	 = 1e-2;
+	Q(5,5)	 = 1e-2;
+	Q(6,6)	 = 1e-2;
+
+	X.block<4,1>(0,0)	= util::eulerToQuat( angle );
+	X.block<3,1>(4,0)	= bias;
+
+	f.setStateVector( X );
+	f.setProcessCovariance( Q );
+	f.setMeasurementCovariance( R );
+}
+
+/** largest absolute difference over the largest absolute element of ref */
+template <int R, int C>
+static FT	relDiff( const Matrix<FT,R,C> &a, const Matrix<FT,R,C> &ref )
+{
+	FT	d = 0, m = 0;
+	for (int j=0; j < C; j++)
+		for (int i=0; i < R; i++) {
+			if ( fabs( a(i,j) - ref(i,j) ) > d )	d = fabs( a(i,j) - ref(i,j) );
+			if ( fabs( ref(i,j) ) > m )				m = fabs( ref(i,j) );
+		}
+	return ( m > 0 ) ? d/m : d;
+}
+
+/** X and P of two filters, relative difference of each */
+template <class F>
+static void	compare( F &a, F &b, FT &dX, FT &dP )
+{
+	Matrix<FT,7,1>	Xa, Xb;
+	Matrix<FT,7,7>	Pa, Pb;
+	a.getStateVector( Xa );		b.getStateVector( Xb );
+	a.getCovarianceMatrix( Pa );	b.getCovarianceMatrix( Pb );
+	dX	= relDiff( Xa, Xb );
+	dP	= relDiff( Pa, Pb );
+}
+
+/**
+ * Results of the axisMask checks, largest relative difference over all
+ * the points tried. All but infR must be exactly 0: the same arithmetic
+ * on the same numbers.
+ */
+struct	MaskResult
+{
+	FT		none;		/* no axis selected, against the filter before */
+	FT		ignored;	/* masked-out component changed */
+	FT		all;		/* all axes, against the plain sequential update */
+	FT		infR;		/* against the joint update with an infinite variance */
+
+	MaskResult() { none = ignored = all = infR = 0; }
+
+	void	add( FT &r, FT dX, FT dP ) { r = std::max( r, std::max( dX, dP ) ); }
+};
+
+/**
+ * Mask checks for kalman7 on the filter f, before the update of step i.
+ * The update renormalizes the quaternion of X before and after the
+ * scalar updates, so with no axis selected X must be the one before with
+ * its quaternion normalized twice.
+ */
+static void	checkMask( const kalman7 &f, int i, MaskResult &res )
+{
+	Matrix<FT,3,1>	z	= input.angles[i];
+	Matrix<FT,3,1>	zb	= z;
+	zb(2)	+= 1;
+	FT	dX, dP;
+
+	kalman7	a = f, b = f;
+	a.KalmanUpdate( i, z, dt, 0 );
+	{
+		Matrix<FT,7,1>	Xa, Xb;
+		Matrix<FT,7,7>	Pa, Pb;
+		a.getStateVector( Xa );		b.getStateVector( Xb );
+		a.getCovarianceMatrix( Pa );	b.getCovarianceMatrix( Pb );
+
+		Matrix<FT,4,1>	q	= Xb.start<4>();
+		quat::quatNormalize( q.data() );
+		quat::quatNormalize( q.data() );
+		Xb.start<4>()	= q;
+		res.add( res.none, relDiff( Xa, Xb ), relDiff( Pa, Pb ) );
+	}
+
+	a = f;	b = f;
+	a.KalmanUpdate( i, z, dt, 0x3 );
+	b.KalmanUpdate( i, zb, dt, 0x3 );
+	compare( a, b, dX, dP );
+	res.add( res.ignored, dX, dP );
+
+	a = f;	b = f;
+	a.setSequentialUpdate( true );
+	a.KalmanUpdate( i, z, dt );
+	b.KalmanUpdate( i, z, dt, 0x7 );
+	compare( a, b, dX, dP );
+	res.add( res.all, dX, dP );
+}
+
+/** same for the UKF, with R = diag(measVar) in f */
+template <class F>
+static void	checkMask( const F &f, int i, const Matrix<FT,3,1> &measVar, MaskResult &res )
+{
+	Matrix<FT,3,1>	z	= input.angles[i];
+	Matrix<FT,3,1>	zb	= z;
+	zb(2)	+= 1;
+	FT	dX, dP;
+
+	F	a = f, b = f;
+	a.KalmanUpdate( i, z, dt, 0 );
+	compare( a, b, dX, dP );
+	res.add( res.none, dX, dP );
+
+	a = f;	b = f;
+	a.KalmanUpdate( i, z, dt, 0x3 );
+	b.KalmanUpdate( i, zb, dt, 0x3 );
+	compare( a, b, dX, dP );
+	res.add( res.ignored, dX, dP );
+
+	a = f;	b = f;
+	a.setSequentialUpdate( true );
+	a.KalmanUpdate( i, z, dt );
+	b.KalmanUpdate( i, z, dt, 0x7 );
+	compare( a, b, dX, dP );
+	res.add( res.all, dX, dP );
+
+	/* joint update, yaw all but ignored through R */
+	Matrix<FT,3,3>	R;
+	R.setZero();
+	R(0,0)	= measVar(0);
+	R(1,1)	= measVar(1);
+	R(2,2)	= HUGE_VARIANCE*measVar(2);
+
+	a = f;	b = f;
+	a.setSequentialUpdate( false );
+	a.setMeasurementCovariance( R );
+	a.KalmanUpdate( i, z, dt );
+	b.KalmanUpdate( i, z, dt, 0x3 );
+	compare( a, b, dX, dP );
+	res.add( res.infR, dX, dP );
+}
+
+static bool	report( const char *name, FT dX, FT dP, FT tol )
+{
+	bool	ok	= ( dX <= tol ) && ( dP <= tol );
+	printf("%-28s X %-12g P %-12g (tolerance %g) %s\n", name,
+			(double)dX, (double)dP, (double)tol, ok ? "ok" : "WRONG" );
+	return ok;
+}
+
+static bool	report( const char *name, const MaskResult &r, FT tol, bool haveInfR )
+{
+	bool	ok	= ( r.none == 0 ) && ( r.ignored == 0 ) && ( r.all == 0 ) &&
+				  ( !haveInfR || r.infR <= tol + TOLERANCE_INF_R );
+
+	printf("%-28s none %-10g ignored %-6g all %-6g", name,
+			(double)r.none, (double)r.ignored, (double)r.all );
+	if ( haveInfR )
+		printf(" infinite R %-10g", (double)r.infR );
+	printf(" %s\n", ok ? "ok" : "WRONG" );
+	return ok;
+}
+
+/** joint against sequential on one UKF form, and its mask checks */
+template <class F>
+static bool	runUKF( const char *name, FT tol )
+{
+	Matrix<FT,3,1>	angle		= input.angles[0];
+	Matrix<FT,3,1>	startBias	= input.gyros[0];
+	Matrix<FT,3,1>	measVar;
+	measVar.setConstant( meas_variance );
+
+	F	*joint	= new F;
+	F	*seq	= new F;
+	initUKF( *joint, angle, startBias, measVar );
+
+	FT	maxX = 0, maxP = 0, dX, dP;
+	MaskResult	mask;
+
+	for (int i=0; i < N; i++)
+	{
+		if ( i % MASK_EVERY == MASK_EVERY - 1 )
+			checkMask( *joint, i, measVar, mask );
+
+		*seq	= *joint;
+		seq->setSequentialUpdate( true );
+
+		joint->KalmanUpdate( i, input.angles[i], dt );
+		seq->KalmanUpdate( i, input.angles[i], dt );
+
+		compare( *seq, *joint, dX, dP );
+		maxX	= std::max( maxX, dX );
+		maxP	= std::max( maxP, dP );
+
+		joint->KalmanPredict( i, input.gyros[i], dt );
+	}
+
+	delete joint;
+	delete seq;
+
+	char	s[64];
+	snprintf( s, sizeof(s), "%s sequential", name );
+	bool	ok	= report( s, maxX, maxP, tol );
+	snprintf( s, sizeof(s), "%s axisMask", name );
+	ok	= report( s, mask, tol, true ) && ok;
+	return ok;
+}
+
+int main()
+{
+	makeTempData();
+
+	FT	eps	= std::numeric_limits<FT>::epsilon();
+	bool	ok	= true;
+
+	/** kalman7 **/
+	{
+		Matrix<FT,3,1>	angle		= input.angles[0];
+		Matrix<FT,3,1>	startBias	= input.gyros[0];
+
+		kalman7	joint, seq;
+		joint.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+
+		FT	maxX = 0, maxP = 0, dX, dP;
+		MaskResult	mask;
+
+		for (int i=0; i < N; i++)
+		{
+			if ( i % MASK_EVERY == MASK_EVERY - 1 )
+				checkMask( joint, i, mask );
+
+			/* the sequential update starts from the joint filter at every
+			 * step, so that rounding differences don't pile up */
+			seq	= joint;
+			seq.setSequentialUpdate( true );
+
+			joint.KalmanUpdate( i, input.angles[i], dt );
+			seq.KalmanUpdate( i, input.angles[i], dt );
+
+			compare( seq, joint, dX, dP );
+			maxX	= std::max( maxX, dX );
+			maxP	= std::max( maxP, dP );
+
+			joint.KalmanPredict( i, input.gyros[i], dt );
+		}
+
+		ok	= report( "kalman7 sequential", maxX, maxP, TOLERANCE_KAL7_EPS*eps ) && ok;
+		ok	= report( "kalman7 axisMask", mask, 0, false ) && ok;
+	}
+
+	/** UKF, both forms **/
+	ok	= runUKF<UKFDense>( "UKF dense", TOLERANCE_UKF_EPS*eps ) && ok;
+	ok	= runUKF<UKFSqrt>( "UKF square-root", TOLERANCE_UKF_EPS*eps ) && ok;
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ *	Test for the steady-state gain mode of kalman7: a stationary segment
+ *	followed by the test-kal7 trajectory, run by a filter with the mode on
+ *	next to one without it, with joint updates and with the sequential
+ *	accel/magnetometer updates of AHRSs/avr32. Checks that the gain gets
+ *	frozen while at rest, that the gates give it up as soon as the motion
+ *	starts, and that the attitude error stays close to the full filter's.
+ *	Also reports the time per step of both.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* stationary points, then the test-kal7 trajectory */
+#define	NREST	3000
+#define	N		( NREST + 2000 )
+
+static const FT meas_variance = 0.01;
+
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+	Matrix<FT,3,1>	realAngles[N];
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance, 0.1, -0.2, 0.5 );
+
+	for ( int i=0; i < N; i++ )
+	{
+		if ( i < NREST )
+			traj.hold();
+		else
+			traj.step( i - NREST );
+		input.realAngles[i]	= traj.getAngles();
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+struct	Result
+{
+	int		steadyRest;		/* steps in steady state while at rest */
+	int		steadyMotion;	/* and while moving */
+	int		firstMotionExit;	/* steps into the motion until it was left, -1 if it was not */
+	FT		rmsRest;		/* attitude error at rest, last half only */
+	FT		rmsMotion;
+	double	ns;				/* per step, update and predict */
+};
+
+static FT	angleErr2( kalman7 &K, int i )
+{
+	Matrix<FT,7,1>	X;
+	K.getStateVector( X );
+	Matrix<FT,4,1>	q	= X.start<4>();
+	Matrix<FT,3,1>	a	= util::quatToEuler( q );
+
+	FT	e2 = 0;
+	for (int j=0; j < 3; j++) {
+		FT	e	= util::calcAngleError( input.realAngles[i](j), a(j) );
+		e2	+= e*e;
+	}
+	return e2;
+}
+
+/**
+ * Runs the whole data set. Joint updates when sequential is false, otherwise
+ * pitch/roll and yaw are updated on alternating steps, as the avr32 board does
+ */
+static Result	run( bool steadyGain, bool sequential )
+{
+	Result	res;
+	res.steadyRest = res.steadyMotion = 0;
+	res.firstMotionExit	= -1;
+
+	kalman7	K;
+	Matrix<FT,3,1>	startBias;
+	startBias	<< 3,5,7;
+	startBias	+= util::randomVector3( 0, 0.1 );
+
+	K.KalmanInit( input.angles[0], startBias, meas_variance, 1e-6, 1e-6 );
+	K.setSteadyStateGain( steadyGain );
+	/* the gyro noise here is 0.1 rad/s on each axis, far more than a real sensor */
+	K.setSteadyStateLimits( 1e-3, 20, 4, 0.35 );
+
+	double	e2Rest = 0, e2Motion = 0;
+	double	t	= 0;
+
+	for (int i=0; i < N; i++)
+	{
+		double	t1	= nowNs();
+		if ( !sequential )
+			K.KalmanUpdate( i, input.angles[i], dt );
+		else
+			K.KalmanUpdate( i, input.angles[i], dt, ( i & 1 ) ? 0x4 : 0x3 );
+		K.KalmanPredict( i, input.gyros[i], dt );
+		t	+= nowNs() - t1;
+
+		if ( i < NREST ) {
+			res.steadyRest	+= K.isSteadyState();
+			if ( i >= NREST/2 )
+				e2Rest	+= angleErr2( K, i + 1 < N ? i + 1 : i );
+		}
+		else {
+			res.steadyMotion	+= K.isSteadyState();
+			e2Motion	+= angleErr2( K, i + 1 < N ? i + 1 : i );
+			if ( ( res.firstMotionExit < 0 ) && !K.isSteadyState() )
+				res.firstMotionExit	= i - NREST;
+		}
+	}
+
+	res.rmsRest		= sqrt( e2Rest/( NREST - NREST/2 ) );
+	res.rmsMotion	= sqrt( e2Motion/( N - NREST ) );
+	res.ns			= t/N;
+	return res;
+}
+
+static bool	report( const char *name, const Result &full, const Result &ss )
+{
+	printf("%s updates\n", name );
+	printf("  full         %8.1f ns/step  rms error rest %.5f motion %.5f rad\n",
+			full.ns, full.rmsRest, full.rmsMotion );
+	printf("  steady gain  %8.1f ns/step  rms error rest %.5f motion %.5f rad\n",
+			ss.ns, ss.rmsRest, ss.rmsMotion );
+	printf("  steady at rest %.1f%%, while moving %.1f%%, left it %d steps into the motion\n",
+			100.0*ss.steadyRest/NREST, 100.0*ss.steadyMotion/( N - NREST ), ss.firstMotionExit );
+
+	bool	ok	= true;
+	ok	= ok && ( full.steadyRest == 0 ) && ( full.steadyMotion == 0 );
+	ok	= ok && ( ss.steadyRest > NREST/2 );					/* froze while at rest */
+	ok	= ok && ( ss.firstMotionExit >= 0 ) && ( ss.firstMotionExit < 5 );	/* and let go */
+	ok	= ok && ( ss.rmsRest < 1.5*full.rmsRest + 1e-3 );
+	ok	= ok && ( ss.rmsMotion < 1.5*full.rmsMotion + 1e-3 );
+
+	return ok;
+}
+
+int main()
+{
+	makeTempData();
+
+	printf("FT is %s\n", ( sizeof(FT) == sizeof(float) ) ? "float" : "double" );
+
+	bool	ok	= report( "joint", run( false, false ), run( true, false ) );
+	ok	= report( "sequential", run( false, true ), run( true, true ) ) && ok;
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
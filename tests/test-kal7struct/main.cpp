@@ -0,0 +1,255 @@
+/*
+ *	Regression test for the structured kalman7 kernels
+ *	Runs kalman7 next to a plain dense implementation of the same filter
+ *	(the full 7x7 A*P*A' and Joseph form update it used before) on the
+ *	test-kal7 trajectory, and checks that state and covariance agree within
+ *	a few tens of ulps after every predict and update. Also reports the
+ *	time per step of both.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <limits>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points for test, same trajectory as test-kal7 */
+#define	N	2000
+
+/* allowed difference, relative to the largest element, in units of epsilon */
+#define	TOLERANCE_EPS	64
+
+static const FT meas_variance = 0.01;
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+/**
+ * Reference: kalman7 with full 7x7 products, as in the original implementation
+ */
+class kalman7Dense
+{
+public:
+	Matrix<FT,7,1>	X;
+	Matrix<FT,7,7>	A, P, W, I;
+	Matrix<FT,3,7>	H;
+	Matrix<FT,7,3>	K;
+	Matrix<FT,3,3>	R;
+	Matrix<FT,4,1>	q;
+
+	void	KalmanInit( Matrix<FT,3,1> &startAngle, Matrix<FT,3,1> &startBias, FT meas_var,
+						FT process_bias_var, FT process_quat_var )
+	{
+		I.setIdentity();
+		P.setIdentity();
+		A.setIdentity();
+		R.setIdentity();
+		R	*= meas_var;
+
+		W.setIdentity();
+		W		*= process_quat_var;
+		W(4,4)	 = process_bias_var;
+		W(5,5)	 = process_bias_var;
+		W(6,6)	 = process_bias_var;
+
+		H.setZero();
+
+		X.block<4,1>(0,0)	= util::eulerToQuat( startAngle );
+		X.block<3,1>(4,0)	= startBias;
+	}
+
+	void	KalmanUpdate( const Matrix<FT,3,1> &angles )
+	{
+		q	= X.start<4>();
+		q.normalize();
+		X.start<4>()	= q;
+
+		H.block<3,4>(0,0)	= util::calcQMeas( q );
+
+		Matrix<FT,7,3>	Ht	= H.transpose();
+		Matrix<FT,3,3> inv;
+		( H*P*Ht + R ).computeInverse( &inv );
+
+		K	= P*Ht * inv;
+
+		Matrix<FT,3,1>	predAngles	= util::quatToEuler( q );
+		Matrix<FT,3,1>	angleErr;
+		angleErr(0)	= util::calcAngleError( angles(0), predAngles(0) );
+		angleErr(1)	= util::calcAngleError( angles(1), predAngles(1) );
+		angleErr(2)	= util::calcAngleError( angles(2), predAngles(2) );
+
+		X	= X + K*angleErr;
+
+		q	= X.start<4>();
+		q.normalize();
+		X.start<4>()	= q;
+
+		P	= ( I - K*H ) * P * (( I - K*H ).transpose()) + K*R*(K.transpose());
+	}
+
+	void	KalmanPredict( const Matrix<FT,3,1> &gyros, FT dt )
+	{
+		A.setIdentity();
+		A.block<4,4>(0,0)	= Matrix<FT,4,4>::Identity() +
+				dt * util::calcQOmega( gyros[0] - X(4), gyros[1] - X(5), gyros[2] - X(6) )/2;
+
+		A.block<1,3>(0,4)	<<	 dt*q[1]/2,  dt*q[2]/2,  dt*q[3]/2;
+		A.block<1,3>(1,4)	<<	-dt*q[0]/2,  dt*q[3]/2, -dt*q[2]/2;
+		A.block<1,3>(2,4)	<<	-dt*q[3]/2, -dt*q[0]/2,  dt*q[1]/2;
+		A.block<1,3>(3,4)	<<	 dt*q[2]/2, -dt*q[1]/2, -dt*q[0]/2;
+
+		Matrix<FT,4,1>	quat = X.start<4>();
+		X.start<4>()	= quat + util::calcQOmega( gyros(0) - X(4), gyros(1) - X(5), gyros(2) - X(6) )*quat*dt/2;
+
+		P	= A*P*(A.transpose()) + W;
+	}
+
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/** largest absolute difference over the largest absolute element of ref */
+template <int R, int C>
+static FT	relDiff( const Matrix<FT,R,C> &a, const Matrix<FT,R,C> &ref )
+{
+	FT	d = 0, m = 0;
+	for (int j=0; j < C; j++)
+		for (int i=0; i < R; i++) {
+			if ( fabs( a(i,j) - ref(i,j) ) > d )	d = fabs( a(i,j) - ref(i,j) );
+			if ( fabs( ref(i,j) ) > m )				m = fabs( ref(i,j) );
+		}
+	return ( m > 0 ) ? d/m : d;
+}
+
+int main()
+{
+	makeTempData();
+
+	Matrix<FT,3,1>	angle		= input.angles[0];
+	Matrix<FT,3,1>	startBias	= input.gyros[0];
+
+	kalman7			K7;
+	kalman7Dense	*ref = new kalman7Dense;
+
+	K7.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+	ref->KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+
+	Matrix<FT,7,1>	X;
+	Matrix<FT,7,7>	P;
+	FT	maxX = 0, maxP = 0, maxAsym = 0;
+
+	for (int i=0; i < N; i++)
+	{
+		/* the reference restarts from kalman7's state at every step, so that
+		 * rounding differences don't pile up over the run */
+		K7.getStateVector( ref->X );
+		K7.getCovarianceMatrix( ref->P );
+
+		K7.KalmanUpdate( i, input.angles[i], dt );
+		ref->KalmanUpdate( input.angles[i] );
+
+		K7.getStateVector( X );
+		K7.getCovarianceMatrix( P );
+		maxX	= std::max( maxX, relDiff( X, ref->X ) );
+		maxP	= std::max( maxP, relDiff( P, ref->P ) );
+		maxAsym	= std::max( maxAsym, relDiff( Matrix<FT,7,7>(P.transpose()), P ) );
+
+		/* predict linearizes at the normalized quaternion from the update */
+		ref->X	= X;
+		ref->P	= P;
+		ref->q	= X.start<4>();
+
+		K7.KalmanPredict( i, input.gyros[i], dt );
+		ref->KalmanPredict( input.gyros[i], dt );
+
+		K7.getStateVector( X );
+		K7.getCovarianceMatrix( P );
+		maxX	= std::max( maxX, relDiff( X, ref->X ) );
+		maxP	= std::max( maxP, relDiff( P, ref->P ) );
+		maxAsym	= std::max( maxAsym, relDiff( Matrix<FT,7,7>(P.transpose()), P ) );
+	}
+
+	/* timing, separate runs so the comparison doesn't get in the way */
+	K7.KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++) {
+		K7.KalmanUpdate( i, input.angles[i], dt );
+		K7.KalmanPredict( i, input.gyros[i], dt );
+	}
+	double	t2 = nowNs();
+
+	ref->KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+	double	t3 = nowNs();
+	for (int i=0; i < N; i++) {
+		ref->KalmanUpdate( input.angles[i] );
+		ref->KalmanPredict( input.gyros[i], dt );
+	}
+	double	t4 = nowNs();
+
+	delete ref;
+
+	FT	tol = TOLERANCE_EPS*std::numeric_limits<FT>::epsilon();
+
+	printf("structured  %8.1f ns/step\n", (t2-t1)/N );
+	printf("dense       %8.1f ns/step\n", (t4-t3)/N );
+	printf("max relative difference: X %g  P %g  asymmetry %g  (tolerance %g)\n",
+			(double)maxX, (double)maxP, (double)maxAsym, (double)tol );
+
+	if ( !(maxX <= tol) || !(maxP <= tol) || !(maxAsym == 0) ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
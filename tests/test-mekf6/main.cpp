@@ -0,0 +1,152 @@
+/*
+ *	Test for the multiplicative 6-state kalman filter
+ *	Runs mekf6 and kalman7 on the test-kal7 trajectory, with the same
+ *	tuning, and reports time per step and attitude RMS error of both.
+ *	mekf6 must do about as well as kalman7, in attitude and in bias.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/kalman/mekf6.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points for test, same trajectory as test-kal7 */
+#define	N	2000
+
+/* largest attitude RMS error and bias error of mekf6, relative to kalman7 */
+#define	TOLERANCE_RMS	0.05
+#define	TOLERANCE_BIAS	0.05
+
+static const FT meas_variance = 0.01;
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+	Matrix<FT,3,1>	realAngles[N];
+	Matrix<FT,3,1>	gyroBias;
+
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+	input.gyroBias	= traj.getGyroBias();
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+		input.realAngles[i]	= traj.getAngles();
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+/** attitude RMS error over the second half, and bias error at the end */
+struct	Result
+{
+	double	rms;
+	double	bias;
+};
+
+/** run the whole trajectory, update then predict as in test-kal7 */
+template <class Filter>
+Result	runFilter( const char *name )
+{
+	Matrix<FT,3,1>	angle		= input.angles[0];
+	Matrix<FT,3,1>	startBias	= input.gyros[0];
+	Matrix<FT,7,1>	X;
+
+	Filter	*K = new Filter;
+	K->KalmanInit( angle, startBias, meas_variance, 1e-2, 1e-5 );
+
+	double	err = 0;
+	int		nerr = 0;
+
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++)
+	{
+		K->KalmanUpdate( i, input.angles[i], dt );
+
+		/* error once converged, second half of the run */
+		if ( i >= N/2 ) {
+			K->getStateVector( X );
+			Matrix<FT,3,1>	ang = util::quatToEulerNorm( X.start<4>() );
+			for (int k=0; k < 3; k++) {
+				FT	d = limitPI( ang(k) - input.realAngles[i](k) );
+				err += d*d;
+				nerr++;
+			}
+		}
+
+		K->KalmanPredict( i, input.gyros[i], dt );
+	}
+	double	t2 = nowNs();
+
+	K->getStateVector( X );
+	delete K;
+
+	Result	r;
+	r.rms	= sqrt( err/nerr );
+	r.bias	= ( X.end<3>() - input.gyroBias ).norm();
+
+	printf("%-8s %8.1f ns/step   RMS %.7f rad   bias %f %f %f (error %f)\n",
+			name, (t2-t1)/N, r.rms, X(4), X(5), X(6), r.bias );
+	return r;
+}
+
+int main()
+{
+	makeTempData();
+
+	Result	k7	= runFilter<kalman7>( "kalman7" );
+	Result	m6	= runFilter<mekf6>( "mekf6" );
+
+	bool	ok	= ( m6.rms <= ( 1 + TOLERANCE_RMS )*k7.rms ) &&
+				  ( m6.bias <= ( 1 + TOLERANCE_BIAS )*k7.bias );
+	printf("mekf6 against kalman7: RMS %+.2f%%, bias error %+.2f%%  (tolerance +%g%%, +%g%%)\n",
+			100*( m6.rms/k7.rms - 1 ), 100*( m6.bias/k7.bias - 1 ),
+			100*TOLERANCE_RMS, 100*TOLERANCE_BIAS );
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
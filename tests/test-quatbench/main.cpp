@@ -0,0 +1,287 @@
+/*
+ *	Microbenchmark for the quaternion kernels (util/quatkernel.h)
+ *	Reports ns per call of the code the filters used before, the portable
+ *	kernels and the SIMD ones, and checks that they agree.
+ *	Build with FLOAT_TYPE=float for single precision figures, add
+ *	-DQUATKERNEL_SIMD=2 (and -mavx2) to CXXFLAGS for the double SIMD versions.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/util/quatkernel.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+/* number of calls per measurement */
+#define	NITER	1000000
+
+/* results go here, so that the compiler can't drop the loops */
+static volatile FT	sink;
+
+static FT	frand()
+{
+	return FT(rand())/FT(RAND_MAX) - FT(0.5);
+}
+
+static void	report( const char *op, const char *how, double t1, double t2 )
+{
+	printf( "%-10s %-10s %8.2f ns/call\n", op, how, (t2 - t1)/NITER );
+}
+
+static FT	maxDiff( const FT *a, const FT *b, int n )
+{
+	FT	m = 0;
+	for (int i=0; i < n; i++)
+		if ( fabs( a[i] - b[i] ) > m )
+			m = fabs( a[i] - b[i] );
+	return m;
+}
+
+/** omega integration and renormalization, kalman7::predictState() and UKFst7 */
+static void	benchIntegrate()
+{
+	Matrix<FT,4,1>	q0, q;
+	Matrix<FT,3,1>	w;
+	const FT	dt = FT(0.01);
+
+	q0	<< 1, frand()/10, frand()/10, frand()/10;
+	q0.normalize();
+	w	<< frand(), frand(), frand();
+
+	/* old code, through the 4x4 omega matrix */
+	q	= q0;
+	double	t1 = nowNs();
+	for (int n=0; n < NITER; n++) {
+		q	= q + util::calcQOmega( w(0), w(1), w(2) )*q*dt/2;
+		q.normalize();
+	}
+	double	t2 = nowNs();
+	report( "integrate", "eigen", t1, t2 );
+	sink	= q(1);
+
+	q	= q0;
+	t1	= nowNs();
+	for (int n=0; n < NITER; n++) {
+		quat::scalar::integrate( q.data(), w.data(), dt );
+		quat::scalar::normalize( q.data() );
+	}
+	t2	= nowNs();
+	report( "integrate", "portable", t1, t2 );
+	sink	= q(1);
+
+	q	= q0;
+	t1	= nowNs();
+	for (int n=0; n < NITER; n++) {
+		quat::quatIntegrate( q.data(), w.data(), dt );
+		quat::quatNormalize( q.data() );
+	}
+	t2	= nowNs();
+	report( "integrate", "kernel", t1, t2 );
+	sink	= q(1);
+}
+
+/** quaternion product and renormalization, mekf6::applyError() */
+static void	benchMultiply()
+{
+	FT	a0[4], a[4], b[4], r[4];
+	for (int i=0; i < 4; i++) {
+		a0[i] = frand();	b[i] = frand()/100;
+	}
+	b[0] = 1;
+
+	/* old code, written out */
+	for (int i=0; i < 4; i++)
+		a[i] = a0[i];
+	double	t1 = nowNs();
+	for (int n=0; n < NITER; n++) {
+		r[0]	= a[0] - b[1]*a[1] - b[2]*a[2] - b[3]*a[3];
+		r[1]	= a[1] + b[1]*a[0] + b[3]*a[2] - b[2]*a[3];
+		r[2]	= a[2] + b[2]*a[0] - b[3]*a[1] + b[1]*a[3];
+		r[3]	= a[3] + b[3]*a[0] + b[2]*a[1] - b[1]*a[2];
+
+		FT	norm	= sqrt( r[0]*r[0] + r[1]*r[1] + r[2]*r[2] + r[3]*r[3] );
+		a[0] = r[0]/norm;	a[1] = r[1]/norm;	a[2] = r[2]/norm;	a[3] = r[3]/norm;
+	}
+	double	t2 = nowNs();
+	report( "multiply", "old", t1, t2 );
+	sink	= a[1];
+
+	for (int i=0; i < 4; i++)
+		a[i] = a0[i];
+	t1	= nowNs();
+	for (int n=0; n < NITER; n++) {
+		quat::scalar::multiply( a, b, r );
+		a[0] = r[0];	a[1] = r[1];	a[2] = r[2];	a[3] = r[3];
+		quat::scalar::normalize( a );
+	}
+	t2	= nowNs();
+	report( "multiply", "portable", t1, t2 );
+	sink	= a[1];
+
+	for (int i=0; i < 4; i++)
+		a[i] = a0[i];
+	t1	= nowNs();
+	for (int n=0; n < NITER; n++) {
+		quat::quatMultiply( a, b, a );
+		quat::quatNormalize( a );
+	}
+	t2	= nowNs();
+	report( "multiply", "kernel", t1, t2 );
+	sink	= a[1];
+}
+
+/** body to earth-fixed rotation, util::magnReference() */
+static void	benchRotate()
+{
+	Matrix<FT,4,1>	q, qc;
+	Matrix<FT,3,1>	v, r;
+	Matrix<FT,3,4>	H;
+
+	q	<< 1, frand(), frand(), frand();
+	q.normalize();
+	v	<< frand(), frand(), frand();
+
+	/* old code, C(q*)' and its jacobian */
+	double	t1 = nowNs();
+	for (int n=0; n < NITER; n++) {
+		qc	<< q(0), -q(1), -q(2), -q(3);
+		util::calcVectorMeas( qc, v, r, H );
+		v(0)	= r(1);		/* chain the calls */
+	}
+	double	t2 = nowNs();
+	report( "rotate", "old", t1, t2 );
+	sink	= v(0);
+
+	t1	= nowNs();
+	for (int n=0; n < NITER; n++) {
+		quat::quatRotate( q.data(), v.data(), r.data() );
+		v(0)	= r(1);
+	}
+	t2	= nowNs();
+	report( "rotate", "kernel", t1, t2 );
+	sink	= v(0);
+}
+
+/**
+ * One call of each kernel against the code it replaces, on independent
+ * random quaternions. Returns the largest difference of each in err[].
+ */
+static void	checkKernels( FT err[5] )
+{
+	for (int k=0; k < 5; k++)
+		err[k] = 0;
+
+	for (int n=0; n < 10000; n++)
+	{
+		Matrix<FT,4,1>	q, b, qe, qn;
+		Matrix<FT,3,1>	w, v, ve, ref;
+		Matrix<FT,3,4>	H;
+		FT	r[4], rs[4], C[9], qr[4];
+		const FT	dt	= FT(0.01);
+
+		q	<< frand(), frand(), frand(), frand();
+		b	<< frand(), frand(), frand(), frand();
+		w	<< frand(), frand(), frand();
+
+		/* product */
+		quat::quatMultiply( q.data(), b.data(), r );
+		quat::scalar::multiply( q.data(), b.data(), rs );
+		err[0]	= std::max( err[0], maxDiff( r, rs, 4 ) );
+
+		/* normalize */
+		qe	= q;
+		qe.normalize();
+		qn	= q;
+		quat::quatNormalize( qn.data() );
+		err[1]	= std::max( err[1], maxDiff( qn.data(), qe.data(), 4 ) );
+		q	= qe;
+
+		/* omega integration */
+		qe	= q + util::calcQOmega( w(0), w(1), w(2) )*q*dt/2;
+		qn	= q;
+		quat::quatIntegrate( qn.data(), w.data(), dt );
+		err[2]	= std::max( err[2], maxDiff( qn.data(), qe.data(), 4 ) );
+
+		/* DCM, column by column against calcVectorMeas(), and back */
+		quat::quatToDCM( q.data(), C );
+		for (int j=0; j < 3; j++) {
+			ref.setZero();
+			ref(j)	= 1;
+			util::calcVectorMeas( q, ref, ve, H );
+			for (int i=0; i < 3; i++)
+				err[3]	= std::max( err[3], FT( fabs( C[3*i+j] - ve(i) ) ) );
+		}
+
+		quat::quatRotateInv( q.data(), w.data(), v.data() );
+		util::calcVectorMeas( q, w, ve, H );
+		err[3]	= std::max( err[3], maxDiff( v.data(), ve.data(), 3 ) );
+
+		quat::dcmToQuat( C, qr );
+		FT	sgn	= ( q(0) < 0 ) ? -1 : 1;
+		for (int i=0; i < 4; i++)
+			err[4]	= std::max( err[4], FT( fabs( qr[i] - sgn*q(i) ) ) );
+	}
+}
+
+int main()
+{
+	const bool	isFloat	= ( sizeof(FT) == sizeof(float) );
+	const FT	tol		= isFloat ? FT(1e-5) : FT(1e-12);
+	const char	*simd;
+
+	if ( isFloat )
+		simd	= QUATKERNEL_SSE ? "SSE" : "portable";
+	else
+		simd	= QUATKERNEL_AVX2 ? "AVX2" : ( QUATKERNEL_SSE2 ? "SSE2" : "portable" );
+
+	printf( "FT is %s, kernels: %s\n", isFloat ? "float" : "double", simd );
+
+	benchIntegrate();
+	benchMultiply();
+	benchRotate();
+
+	FT	err[5];
+	checkKernels( err );
+
+	printf( "max difference: multiply %g  normalize %g  integrate %g  DCM %g  DCM round trip %g\n",
+		double(err[0]), double(err[1]), double(err[2]), double(err[3]), double(err[4]) );
+
+	for (int k=0; k < 5; k++)
+		if ( err[k] > tol ) {
+			printf( "FAILED\n" );
+			return 1;
+		}
+
+	printf( "OK\n" );
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ *	calib::SensorTransform: a chain of axis remap, scale, ellipsoid correction
+ *	and rotation folded into one transform, against the same steps done one
+ *	after the other. Largest difference and ns per sample, one sample at a
+ *	time and in blocks.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/calib/SensorTransform.h>
+#include <openAHRS/calib/StreamEllipsoid.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+/* samples per run */
+#define	N	100000
+
+/* block size for the array form, a few hundred ms of samples */
+#define	BLOCK	64
+
+static FT	raw[3*N], steps[3*N], one[3*N], block[3*N];
+
+static FT	frand()
+{
+	return FT(rand())/FT(RAND_MAX) - FT(0.5);
+}
+
+int main()
+{
+	const FT	tol		= ( sizeof(FT) == sizeof(float) ) ? FT(1e-5) : FT(1e-12);
+	bool		ok		= true;
+
+	/* a magnetometer: Y negated by the wiring, volts, offset and skewed */
+	Matrix<FT,9,1>	X;
+	X	<< 0.11e-3, 1.05, 0.93, 0.04, -0.03, 0.02, 3e-5, -2e-5, 1e-5;
+
+	calib::StreamEllipsoid	SP;
+	SP.setStateVector( X );
+
+	/* mounting, 30 degrees about Z then 10 about X */
+	Matrix<FT,3,3>	Rz, Rx, R;
+	FT	cz = cos( 30*M_PI/180 ), sz = sin( 30*M_PI/180 );
+	FT	cx = cos( 10*M_PI/180 ), sx = sin( 10*M_PI/180 );
+	Rz	<< cz, -sz, 0,   sz, cz, 0,   0, 0, 1;
+	Rx	<< 1, 0, 0,   0, cx, -sx,   0, sx, cx;
+	R	= Rx*Rz;
+
+	calib::SensorTransform	t	= calib::SensorTransform::axes( 0,1, 1,-1, 2,1 )
+									.then( calib::SensorTransform::ellipsoid( X ) )
+									.then( calib::SensorTransform::rotation( R ) );
+
+	for (int i=0; i < N; i++) {
+		Matrix<FT,3,1>	d;
+		d	<< frand(), frand(), frand();
+		d.normalize();
+		raw[i]			= X(6) + 0.11e-3*d(0) + 1e-6*frand();
+		raw[N + i]		= -X(7) - 0.11e-3*d(1) + 1e-6*frand();
+		raw[2*N + i]	= X(8) + 0.11e-3*d(2) + 1e-6*frand();
+	}
+
+	/** one step after the other, as Sensing, MagCalib and the output used to **/
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++) {
+		Matrix<FT,3,1>	m, c, o;
+		m	<< raw[i], -raw[N + i], raw[2*N + i];
+		SP.processInput( m, c );
+		o	= R*c;
+		steps[i] = o(0);	steps[N + i] = o(1);	steps[2*N + i] = o(2);
+	}
+
+	/** fused, one sample at a time **/
+	double	t2 = nowNs();
+	for (int i=0; i < N; i++) {
+		Matrix<FT,3,1>	o;
+		t.apply( raw[i], raw[N + i], raw[2*N + i], o );
+		one[i] = o(0);	one[N + i] = o(1);	one[2*N + i] = o(2);
+	}
+
+	/** fused, blocks of BLOCK samples **/
+	double	t3 = nowNs();
+	for (int i=0; i < N; i += BLOCK)
+	{
+		static FT	in[3*BLOCK], out[3*BLOCK];
+		int	n	= ( N - i < BLOCK ) ? N - i : BLOCK;
+		for (int k=0; k < 3; k++)
+			for (int j=0; j < n; j++)
+				in[k*n + j]	= raw[k*N + i + j];
+		t.apply( in, out, n );
+		for (int k=0; k < 3; k++)
+			for (int j=0; j < n; j++)
+				block[k*N + i + j]	= out[k*n + j];
+	}
+
+	/** fused, the whole log **/
+	double	t4 = nowNs();
+	static FT	whole[3*N];
+	t.apply( raw, whole, N );
+	double	t5 = nowNs();
+
+	FT	errOne = 0, errBlock = 0, errWhole = 0;
+	for (int i=0; i < 3*N; i++) {
+		errOne		= std::max( errOne, FT( fabs( one[i] - steps[i] ) ) );
+		errBlock	= std::max( errBlock, FT( fabs( block[i] - one[i] ) ) );
+		errWhole	= std::max( errWhole, FT( fabs( whole[i] - one[i] ) ) );
+	}
+
+	printf( "separate steps     %7.2f ns\n", (t2 - t1)/N );
+	printf( "fused, one         %7.2f ns   max difference %g\n", (t3 - t2)/N, double(errOne) );
+	printf( "fused, blocks of %d %5.2f ns   max difference %g (with copies in and out)\n",
+			BLOCK, (t4 - t3)/N, double(errBlock) );
+	printf( "fused, whole log   %7.2f ns   max difference %g\n", (t5 - t4)/N, double(errWhole) );
+
+	ok	= ( errOne <= tol ) && ( errBlock <= tol ) && ( errWhole <= tol );
+
+	/** then() is associative, and the identity changes nothing **/
+	{
+		calib::SensorTransform	a	= calib::SensorTransform::scale( 2, -1, 0.5 );
+		calib::SensorTransform	b	= calib::SensorTransform::ellipsoid( X );
+		calib::SensorTransform	c	= calib::SensorTransform::rotation( R );
+
+		calib::SensorTransform	l	= a.then( b ).then( c );
+		calib::SensorTransform	r	= a.then( b.then( c ) ).then( calib::SensorTransform() );
+
+		FT	err	= 0;
+		for (int i=0; i < 3; i++) {
+			for (int j=0; j < 3; j++)
+				err	= std::max( err, FT( fabs( l.getMatrix()(i,j) - r.getMatrix()(i,j) ) ) );
+			err	= std::max( err, FT( fabs( l.getOffset()(i) - r.getOffset()(i) ) ) );
+		}
+		printf( "associativity      max difference %g\n", double(err) );
+		ok	= ok && ( err <= tol );
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ *	util::SeqLock: a writer thread publishes parameter sets as fast as it
+ *	can while a reader polls them with readIfNewer(). Every copy the reader
+ *	gets must be whole (all coefficients from the same write) and versions
+ *	must only go up. Also time per poll against a mutex.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/seqlock.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+/* values published */
+#define	N		200000
+
+/* as published by the calibration thread of the AVR32 AHRS */
+struct	Params
+{
+	Matrix<FT,9,1>	p;		/* every coefficient is n */
+	int				n;
+};
+
+static	util::SeqLock<Params>	published;
+
+static void	*writer( void * )
+{
+	Params	v;
+	for (int n=1; n <= N; n++) {
+		v.n	= n;
+		for (int i=0; i < 9; i++)
+			v.p(i)	= n;
+		published.write(v);
+		if ( n % 16 == 0 )
+			sched_yield();		/* let the reader in on a single CPU */
+	}
+	return NULL;
+}
+
+int main()
+{
+	bool	ok	= true;
+
+	pthread_t	w;
+	pthread_create( &w, NULL, writer, NULL );
+
+	Params		v;
+	unsigned	version	= 0;
+	int			last	= 0, reads = 0, polls = 0, torn = 0;
+
+	while ( last < N )
+	{
+		polls++;
+		if ( !published.readIfNewer( v, version ) ) {
+			sched_yield();
+			continue;
+		}
+		reads++;
+
+		for (int i=0; i < 9; i++)
+			if ( v.p(i) != v.n )
+				torn++;
+		if ( v.n <= last || (int)version != v.n )
+			ok	= false;
+		last	= v.n;
+	}
+	pthread_join( w, NULL );
+
+	printf( "%d polls, %d new values read, %d torn\n", polls, reads, torn );
+	ok	= ok && ( torn == 0 ) && ( published.getVersion() == N );
+
+	/** cost of a poll with nothing new, what the filter loop pays most of the time **/
+	{
+		const int	M	= 1000000;
+		int			got	= 0;
+
+		double	t1 = nowNs();
+		for (int i=0; i < M; i++)
+			got	+= published.readIfNewer( v, version );
+		double	t2 = nowNs();
+		for (int i=0; i < M; i++)
+			got	+= published.tryRead( v );
+		double	t3 = nowNs();
+
+		pthread_mutex_t	mutex;
+		pthread_mutex_init( &mutex, NULL );
+		Params	shared	= v;
+		double	t4 = nowNs();
+		for (int i=0; i < M; i++) {
+			pthread_mutex_lock( &mutex );
+			v	= shared;
+			pthread_mutex_unlock( &mutex );
+		}
+		double	t5 = nowNs();
+		pthread_mutex_destroy( &mutex );
+
+		printf( "readIfNewer, nothing new %6.2f ns\n", (t2 - t1)/M );
+		printf( "tryRead                  %6.2f ns\n", (t3 - t2)/M );
+		printf( "mutex and copy           %6.2f ns\n", (t5 - t4)/M );
+
+		ok	= ok && ( got == M );
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ *	Microbenchmark for the UKF template
+ *	Reports ns per covariance reconstruction and per predict+update step,
+ *	for L=7 and L=9. Build both test-ukfbench and test-ukfbench-float
+ *	to get double and single precision figures. D*W*D' must give the
+ *	same P, Pxz and Pzz as the outer-product loop, within a few ulps.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/kalman/UKF.h>
+#include <openAHRS/util/covariance.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS::testdata;
+
+/* number of iterations per measurement */
+#define	NITER	20000
+
+/* allowed difference of D*W*D' against the loop, relative to the largest
+ * element, in units of epsilon */
+#define	TOLERANCE_EPS	8
+
+static FT	frand()
+{
+	return FT(rand())/FT(RAND_MAX) - FT(0.5);
+}
+
+/**
+ * L-state model: first 4 states are a quaternion driven by the first
+ * 3 inputs minus the bias in states 4..6, remaining states are constant.
+ * Measurement is the down and north vectors in body frame, so that all
+ * the attitude is observable.
+ */
+template <int L>
+struct	BenchFuncs
+{
+	inline Matrix<FT,6,1>	measure( const Matrix<FT,L,1> &st, FT dt )
+	{
+		Matrix<FT,6,1>	ret;
+		ret <<	2*(st(1)*st(3) - st(0)*st(2)),
+				2*(st(2)*st(3) + st(0)*st(1)),
+				1 - 2*(st(1)*st(1) + st(2)*st(2)),
+				1 - 2*(st(2)*st(2) + st(3)*st(3)),
+				2*(st(1)*st(2) - st(0)*st(3)),
+				2*(st(1)*st(3) + st(0)*st(2));
+		return ret;
+	}
+
+	inline Matrix<FT,L,1>	predictState( const Matrix<FT,L,1> &st, const Matrix<FT,3,1> &g, FT dt )
+	{
+		Matrix<FT,L,1>	ret = st;
+		FT	p = (g(0) - st(4))*dt/2;
+		FT	q = (g(1) - st(5))*dt/2;
+		FT	r = (g(2) - st(6))*dt/2;
+
+		ret(0) += -p*st(1) - q*st(2) - r*st(3);
+		ret(1) +=  p*st(0) + r*st(2) - q*st(3);
+		ret(2) +=  q*st(0) - r*st(1) + p*st(3);
+		ret(3) +=  r*st(0) + q*st(1) - p*st(2);
+
+		FT	n = sqrt( ret(0)*ret(0) + ret(1)*ret(1) + ret(2)*ret(2) + ret(3)*ret(3) );
+		ret.template block<4,1>(0,0) /= n;
+
+		return ret;
+	}
+};
+
+/** largest absolute difference over the largest absolute element of ref */
+template <int R, int C>
+static FT	relDiff( const Matrix<FT,R,C> &a, const Matrix<FT,R,C> &ref )
+{
+	FT	d = 0, m = 0;
+	for (int j=0; j < C; j++)
+		for (int i=0; i < R; i++) {
+			if ( fabs( a(i,j) - ref(i,j) ) > d )	d = fabs( a(i,j) - ref(i,j) );
+			if ( fabs( ref(i,j) ) > m )				m = fabs( ref(i,j) );
+		}
+	return ( m > 0 ) ? d/m : d;
+}
+
+/**
+ * covariance reconstruction: per-column outer products (old code) vs D*W*D'
+ *
+ * @return	false if the two disagree
+ */
+template <int L>
+bool	benchCovariance()
+{
+	enum { M = 3, K = 2*L + 1 };
+
+	Matrix<FT,L,K>	dX;
+	Matrix<FT,M,K>	dY;
+	Matrix<FT,L,L>	P;
+	Matrix<FT,L,M>	Pxz;
+	Matrix<FT,M,M>	Pzz;
+
+	for (int i=0; i < L; i++)
+		for (int j=0; j < K; j++)
+			dX(i,j) = frand();
+	for (int i=0; i < M; i++)
+		for (int j=0; j < K; j++)
+			dY(i,j) = frand();
+
+	FT	w0 = -2.5, wi = 0.25;
+	FT	sink = 0;
+
+	double	t1 = nowNs();
+	for (int n=0; n < NITER; n++)
+	{
+		dX(0,0) += FT(1e-6);	/* keep the compiler from hoisting */
+
+		P.setZero();
+		Pxz.setZero();
+		Pzz.setZero();
+		for (int i=1; i < K; i++) {
+			P	+= wi*dX.col(i)*dX.col(i).transpose();
+			Pxz	+= wi*dX.col(i)*dY.col(i).transpose();
+			Pzz	+= wi*dY.col(i)*dY.col(i).transpose();
+		}
+		P	+= w0*dX.col(0)*dX.col(0).transpose();
+		Pxz	+= w0*dX.col(0)*dY.col(0).transpose();
+		Pzz	+= w0*dY.col(0)*dY.col(0).transpose();
+
+		sink += P(L-1,0) + Pxz(0,0) + Pzz(1,1);
+	}
+	double	t2 = nowNs();
+
+	for (int n=0; n < NITER; n++)
+	{
+		dX(0,0) += FT(1e-6);
+
+		openAHRS::util::weightedCovariance( dX, w0, wi, P );
+		openAHRS::util::weightedCrossCovariance( dX, dY, w0, wi, Pxz );
+		openAHRS::util::weightedCovariance( dY, w0, wi, Pzz );
+
+		sink += P(L-1,0) + Pxz(0,0) + Pzz(1,1);
+	}
+	double	t3 = nowNs();
+
+	printf("L=%d  covariance  outer-product loop: %8.1f ns   D*W*D': %8.1f ns   (%g)\n",
+			L, (t2-t1)/NITER, (t3-t2)/NITER, (double)sink );
+
+	/** both on the same deviations, the loop as reference **/
+	Matrix<FT,L,L>	Pref;
+	Matrix<FT,L,M>	Pxzref;
+	Matrix<FT,M,M>	Pzzref;
+
+	Pref.setZero();
+	Pxzref.setZero();
+	Pzzref.setZero();
+	for (int i=1; i < K; i++) {
+		Pref	+= wi*dX.col(i)*dX.col(i).transpose();
+		Pxzref	+= wi*dX.col(i)*dY.col(i).transpose();
+		Pzzref	+= wi*dY.col(i)*dY.col(i).transpose();
+	}
+	Pref	+= w0*dX.col(0)*dX.col(0).transpose();
+	Pxzref	+= w0*dX.col(0)*dY.col(0).transpose();
+	Pzzref	+= w0*dY.col(0)*dY.col(0).transpose();
+
+	openAHRS::util::weightedCovariance( dX, w0, wi, P );
+	openAHRS::util::weightedCrossCovariance( dX, dY, w0, wi, Pxz );
+	openAHRS::util::weightedCovariance( dY, w0, wi, Pzz );
+
+	FT	tol		= TOLERANCE_EPS*std::numeric_limits<FT>::epsilon();
+	FT	dP		= relDiff( P, Pref );
+	FT	dPxz	= relDiff( Pxz, Pxzref );
+	FT	dPzz	= relDiff( Pzz, Pzzref );
+	bool	ok	= ( dP <= tol ) && ( dPxz <= tol ) && ( dPzz <= tol );
+
+	printf("L=%d  D*W*D' against the loop: P %g  Pxz %g  Pzz %g  (tolerance %g) %s\n",
+			L, (double)dP, (double)dPxz, (double)dPzz, (double)tol, ok ? "ok" : "WRONG" );
+	return ok;
+}
+
+/**
+ * full filter step, dense and square-root forms
+ * reuse: KalmanStep(), sigma points drawn once per step
+ */
+template <int L, bool sqrtForm, bool reuse>
+void	benchStep()
+{
+	UKF< BenchFuncs<L>, L, 6, 3, false, sqrtForm >	ukf;
+
+	Matrix<FT,L,1>	X, truth;
+	Matrix<FT,L,L>	P;
+	Matrix<FT,L,L>	Q;
+	Matrix<FT,6,6>	R;
+	Matrix<FT,3,1>	g;
+	Matrix<FT,6,1>	z;
+
+	X.setZero();
+	X(0) = 1;
+
+	truth = X;
+
+	P.setIdentity();
+	P *= FT(1e-2);
+	Q.setIdentity();
+	Q *= FT(1e-6);
+	R.setIdentity();
+	R *= FT(1e-2);
+
+	ukf.KalmanInit();
+	ukf.setStateVector( X );
+	ukf.setCovarianceMatrix( P );
+	ukf.setProcessCovariance( Q );
+	ukf.setMeasurementCovariance( R );
+
+	/* single precision needs a wider sigma point spread */
+	if ( sizeof(FT) == sizeof(float) )
+		ukf.setScaling( 1, 2, 0 );
+
+	BenchFuncs<L>	f;
+	FT	dt = FT(0.02);
+
+	double	t1 = nowNs();
+	for (int n=0; n < NITER; n++)
+	{
+		g << FT(0.3)*sin(n*dt), FT(0.2)*cos(n*dt), FT(0.1);
+		truth = f.predictState( truth, g, dt );
+		z = f.measure( truth, dt );
+
+		if ( reuse )
+			ukf.KalmanStep( n, g, z, dt );
+		else {
+			ukf.KalmanUpdate( n, z, dt );
+			ukf.KalmanPredict( n, g, dt );
+		}
+	}
+	double	t2 = nowNs();
+
+	ukf.getStateVector( X );
+	printf("L=%d  %s %s step: %8.1f ns   (q0 error %g)\n",
+			L, sqrtForm ? "square-root" : "dense      ", reuse ? "fused         " : "update+predict",
+			(t2-t1)/NITER, (double)(X(0) - truth(0)) );
+}
+
+int main()
+{
+	printf("---- UKF microbenchmark, FT is %s\n\n", sizeof(FT) == sizeof(float) ? "float" : "double" );
+
+	bool	ok	= benchCovariance<7>();
+	ok	= benchCovariance<9>() && ok;
+	printf("\n");
+
+	benchStep<7,false,false>();
+	benchStep<7,false,true>();
+	benchStep<7,true,false>();
+	benchStep<7,true,true>();
+	benchStep<9,false,false>();
+	benchStep<9,false,true>();
+	benchStep<9,true,false>();
+	benchStep<9,true,true>();
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ *	Sigma point set comparison for the 7-state UKF
+ *	Runs the test-ukfkal7 synthetic trajectory through UKF<UKFst7_Funcs>
+ *	with the symmetric, spherical simplex and cubature sets, dense and
+ *	square-root, and reports time per step and attitude RMS error. The
+ *	smaller sets must come within a bound of the RMS error of the
+ *	symmetric set in the same form.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/UKFst7.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points for test, same trajectory as test-ukfkal7 */
+#define	N	10000
+
+static const FT meas_variance = 1e-1;
+
+/* largest attitude RMS error of the simplex and cubature sets, relative
+ * to the symmetric set: the smaller sets may lose a little accuracy */
+#define	TOLERANCE_RMS	0.05
+static struct
+{
+	Matrix<FT,3,1>	accels[N];
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+	Matrix<FT,3,1>	realAngles[N];
+
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+		input.realAngles[i]	= traj.getAngles();
+
+		input.accels[i]	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( input.accels[i] );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+/**
+ * Run the whole trajectory, update then predict as in test-ukfkal7.
+ * Returns the attitude RMS error over the second half
+ */
+template <template <int> class Set, bool sqrtForm>
+double	runSet( const char *name )
+{
+	enum { L = 7, M = 3 };
+
+	UKF< UKFst7_Funcs, L, M, 3, false, sqrtForm, Set >	ukf;
+
+	Matrix<FT,L,L>	Q;
+	Matrix<FT,M,M>	R;
+	Matrix<FT,L,1>	X;
+
+	/* same setup as UKFst7::KalmanInit() */
+	ukf.KalmanInit();
+	/* float needs the wider spread, see UKF::setScaling() */
+	if ( sizeof(FT) == sizeof(float) )
+		ukf.setScaling( 0.5, 2, 0 );
+
+	R.setIdentity();
+	R	*= meas_variance;
+	Q.setIdentity();
+	Q	*= 1e-6;
+	Q(4,4) = Q(5,5) = Q(6,6) = 1e-9;
+
+	X.template block<4,1>(0,0)	= util::eulerToQuat( input.angles[0] );
+	X.template block<3,1>(4,0)	= input.gyros[0];
+
+	ukf.setStateVector( X );
+	ukf.setProcessCovariance( Q );
+	ukf.setMeasurementCovariance( R );
+
+	double	err = 0;
+	int		nerr = 0;
+
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++)
+	{
+		ukf.KalmanUpdate( i, input.angles[i], dt );
+
+		/* error once converged, second half of the run */
+		if ( i >= N/2 ) {
+			ukf.getStateVector( X );
+			Matrix<FT,3,1>	ang = util::quatToEulerNorm( X.template start<4>() );
+			for (int k=0; k < 3; k++) {
+				FT	d = limitPI( ang(k) - input.realAngles[i](k) );
+				err += d*d;
+				nerr++;
+			}
+		}
+
+		ukf.KalmanPredict( i, input.gyros[i], dt );
+	}
+	double	t2 = nowNs();
+
+	printf("%-10s %-11s  %2d points   %8.1f ns/step   RMS %.7f rad\n",
+			name, sqrtForm ? "square-root" : "dense", (int)Set<L>::K,
+			(t2-t1)/N, sqrt( err/nerr ) );
+
+	return sqrt( err/nerr );
+}
+
+/** a smaller set against the symmetric one */
+static bool	check( const char *name, double rms, double ref )
+{
+	bool	ok	= ( fabs( rms - ref ) <= TOLERANCE_RMS*ref );
+	printf("%-22s RMS %+.2f%% of the symmetric set  %s\n", name,
+			100*( rms - ref )/ref, ok ? "ok" : "WRONG" );
+	return ok;
+}
+
+int main()
+{
+	makeTempData();
+
+	double	symD	= runSet< UKFSymmetricSet, false >( "symmetric" );
+	double	simD	= runSet< UKFSimplexSet, false >( "simplex" );
+	double	cubD	= runSet< UKFCubatureSet, false >( "cubature" );
+
+	double	symS	= runSet< UKFSymmetricSet, true >( "symmetric" );
+	double	simS	= runSet< UKFSimplexSet, true >( "simplex" );
+	double	cubS	= runSet< UKFCubatureSet, true >( "cubature" );
+
+	bool	ok	= true;
+	ok	= check( "simplex dense", simD, symD ) && ok;
+	ok	= check( "cubature dense", cubD, symD ) && ok;
+	ok	= check( "simplex square-root", simS, symS ) && ok;
+	ok	= check( "cubature square-root", cubS, symS ) && ok;
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
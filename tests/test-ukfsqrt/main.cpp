@@ -0,0 +1,257 @@
+/*
+ *	Regression test for the square-root UKF.
+ *	The dense and the square-root form of UKF<> run the UKFst7 model on
+ *	the test-kal7 trajectory. At every step the square-root filter is
+ *	restarted from the state and covariance of the dense one, then
+ *	both do the same update and predict: X and S*S' against P must agree
+ *	within a tolerance after each. A free run of both over the whole
+ *	trajectory must end at nearly the same state. A step from a singular
+ *	P, where adding Q to S has to fall back to triangularize(), must match
+ *	too. Also reports the time per step of each form.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/kalman/UKF.h>
+#include <openAHRS/kalman/UKFst7.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points for test, same trajectory as test-kal7 */
+#define	N	2000
+
+/* allowed difference after one step from the same start, relative to
+ * the largest element. With the default alpha of 1e-3 (double) the
+ * central weight is about -1e6, which scales up rounding errors in both
+ * forms; float runs with alpha 0.5 */
+#define	TOLERANCE_STEP_DOUBLE	1e-11
+#define	TOLERANCE_STEP_FLOAT	5e-5
+
+/* allowed difference of the state at the end of the free run, absolute */
+#define	TOLERANCE_RUN_DOUBLE	1e-8
+#define	TOLERANCE_RUN_FLOAT		1e-4
+
+static const FT meas_variance = 0.01;
+
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+
+} input;
+
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+typedef UKF< UKFst7_Funcs, 7, 3, 3, false, false >	UKFDense;
+typedef UKF< UKFst7_Funcs, 7, 3, 3, false, true >	UKFSqrt;
+
+/** as UKFst7::KalmanInit() */
+template <class F>
+static void	initUKF( F &f )
+{
+	Matrix<FT,7,7>	Q;
+	Matrix<FT,3,3>	R;
+	Matrix<FT,7,1>	X;
+
+	f.KalmanInit();
+	/* float needs the wider spread, see UKF::setScaling() */
+	if ( sizeof(FT) == sizeof(float) )
+		f.setScaling( 0.5, 2, 0 );
+
+	R.setIdentity();
+	R	*= meas_variance;
+
+	Q.setIdentity();
+	Q		*= 1e-5;
+	Q(4,4)	 = 1e-2;
+	Q(5,5)	 = 1e-2;
+	Q(6,6)	 = 1e-2;
+
+	X.block<4,1>(0,0)	= util::eulerToQuat( input.angles[0] );
+	X.block<3,1>(4,0)	= input.gyros[0];
+
+	f.setStateVector( X );
+	f.setProcessCovariance( Q );
+	f.setMeasurementCovariance( R );
+}
+
+/** largest absolute difference over the largest absolute element of ref */
+template <int R, int C>
+static FT	relDiff( const Matrix<FT,R,C> &a, const Matrix<FT,R,C> &ref )
+{
+	FT	d = 0, m = 0;
+	for (int j=0; j < C; j++)
+		for (int i=0; i < R; i++) {
+			if ( fabs( a(i,j) - ref(i,j) ) > d )	d = fabs( a(i,j) - ref(i,j) );
+			if ( fabs( ref(i,j) ) > m )				m = fabs( ref(i,j) );
+		}
+	return ( m > 0 ) ? d/m : d;
+}
+
+/** X and S*S' of sq against X and P of dense, largest so far in maxX and maxP */
+static void	compare( UKFDense &dense, UKFSqrt &sq, FT &maxX, FT &maxP )
+{
+	Matrix<FT,7,1>	Xd, Xs;
+	Matrix<FT,7,7>	Pd, Ps;
+	dense.getStateVector( Xd );		sq.getStateVector( Xs );
+	dense.getCovarianceMatrix( Pd );	sq.getCovarianceMatrix( Ps );
+	maxX	= std::max( maxX, relDiff( Xs, Xd ) );
+	maxP	= std::max( maxP, relDiff( Ps, Pd ) );
+}
+
+int main()
+{
+	makeTempData();
+
+	UKFDense	*dense	= new UKFDense;
+	UKFSqrt		*sq		= new UKFSqrt;
+	bool		ok		= true;
+
+	/** one step at a time, from the same start **/
+	initUKF( *dense );
+	initUKF( *sq );
+
+	Matrix<FT,7,1>	X;
+	Matrix<FT,7,7>	P;
+	FT	maxX = 0, maxP = 0;
+
+	for (int i=0; i < N; i++)
+	{
+		dense->getStateVector( X );
+		dense->getCovarianceMatrix( P );
+		sq->setStateVector( X );
+		sq->setCovarianceMatrix( P );
+
+		dense->KalmanUpdate( i, input.angles[i], dt );
+		sq->KalmanUpdate( i, input.angles[i], dt );
+		compare( *dense, *sq, maxX, maxP );
+
+		dense->getStateVector( X );
+		dense->getCovarianceMatrix( P );
+		sq->setStateVector( X );
+		sq->setCovarianceMatrix( P );
+
+		dense->KalmanPredict( i, input.gyros[i], dt );
+		sq->KalmanPredict( i, input.gyros[i], dt );
+		compare( *dense, *sq, maxX, maxP );
+	}
+
+	FT	tol	= ( sizeof(FT) == sizeof(float) ) ? TOLERANCE_STEP_FLOAT : TOLERANCE_STEP_DOUBLE;
+	bool	stepOk	= ( maxX <= tol ) && ( maxP <= tol );
+	printf("one step:  max relative difference X %g  S*S'-P %g  (tolerance %g) %s\n",
+			(double)maxX, (double)maxP, (double)tol, stepOk ? "ok" : "WRONG" );
+	ok	= ok && stepOk;
+
+	/** free run, timed **/
+	initUKF( *dense );
+	double	t1 = nowNs();
+	for (int i=0; i < N; i++) {
+		dense->KalmanUpdate( i, input.angles[i], dt );
+		dense->KalmanPredict( i, input.gyros[i], dt );
+	}
+	double	t2 = nowNs();
+
+	initUKF( *sq );
+	double	t3 = nowNs();
+	for (int i=0; i < N; i++) {
+		sq->KalmanUpdate( i, input.angles[i], dt );
+		sq->KalmanPredict( i, input.gyros[i], dt );
+	}
+	double	t4 = nowNs();
+
+	Matrix<FT,7,1>	Xd, Xs;
+	dense->getStateVector( Xd );
+	sq->getStateVector( Xs );
+
+	/* q and -q are the same attitude, the two runs may end on either */
+	if ( Xs.start<4>().dot( Xd.start<4>() ) < 0 )
+		Xs.start<4>()	= -Xs.start<4>();
+
+	FT	runDiff	= 0;
+	for (int i=0; i < 7; i++)
+		runDiff	= std::max( runDiff, FT( fabs( Xs(i) - Xd(i) ) ) );
+	FT	runTol	= ( sizeof(FT) == sizeof(float) ) ? TOLERANCE_RUN_FLOAT : TOLERANCE_RUN_DOUBLE;
+	bool	runOk	= ( runDiff <= runTol );
+	printf("free run:  state difference at the end %g  (tolerance %g) %s\n",
+			(double)runDiff, (double)runTol, runOk ? "ok" : "WRONG" );
+	ok	= ok && runOk;
+
+	/** singular P: zero pivot in S, Q added the long way **/
+	initUKF( *dense );
+	initUKF( *sq );
+	dense->setSigmaPointReuse( true );
+	sq->setSigmaPointReuse( true );
+
+	P.setIdentity();
+	P	*= 1e-4;
+	for (int i=0; i < 7; i++)
+		P(0,i)	= P(i,0)	= 0;
+	dense->setCovarianceMatrix( P );
+	sq->setCovarianceMatrix( P );
+
+	maxX = maxP = 0;
+	dense->KalmanStep( 0, input.gyros[0], input.angles[1], dt );
+	sq->KalmanStep( 0, input.gyros[0], input.angles[1], dt );
+	compare( *dense, *sq, maxX, maxP );
+
+	bool	singOk	= ( maxX <= tol ) && ( maxP <= tol );
+	printf("singular P: max relative difference X %g  S*S'-P %g  (tolerance %g) %s\n",
+			(double)maxX, (double)maxP, (double)tol, singOk ? "ok" : "WRONG" );
+	ok	= ok && singOk;
+
+	printf("dense        %8.1f ns/step\n", (t2-t1)/N );
+	printf("square-root  %8.1f ns/step\n", (t4-t3)/N );
+
+	delete dense;
+	delete sq;
+
+	if ( !ok ) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -12,7 +12,7 @@ struct	TestFuncs
 {
 	inline Matrix<FT,NUMINPUTS,1> measure( Matrix<FT,NUMSTATES,1> state, FT dt )
 	{
-		return	state.block<3,3>(0,0);
+		return	state.block<NUMINPUTS,1>(0,0);
 	}
 
 	inline Matrix<FT,NUMSTATES,1> predictState( Matrix<FT,NUMSTATES,1> state, Matrix<FT,NUMPREDINPUTS,1> data, FT dt )
@@ -22,6 +22,7 @@ struct	TestFuncs
 };
 
 UKF< TestFuncs<int>, NUMSTATES, NUMINPUTS, NUMPREDINPUTS, false >	ukfTest;
+UKF< TestFuncs<int>, NUMSTATES, NUMINPUTS, NUMPREDINPUTS, false, true >	ukfTestSqrt;	/* square-root form */
 
 int main()
 {
@@ -33,6 +34,10 @@ int main()
 	ukfTest.KalmanUpdate( 1, in, 20e-3 );
 	ukfTest.KalmanPredict( 1, inPred, 20e-3 );
 
+	ukfTestSqrt.KalmanInit();
+	ukfTestSqrt.KalmanUpdate( 1, in, 20e-3 );
+	ukfTestSqrt.KalmanPredict( 1, inPred, 20e-3 );
+
 	return 0;
 }
 
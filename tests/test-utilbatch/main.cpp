@@ -0,0 +1,170 @@
+/*
+ *	Batch attitude conversions (util::quatToEulerBatch() and friends)
+ *	against the one-sample versions: largest difference and ns per sample.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+#include <openAHRS/util/util.h>
+
+#include "../common/testdata.h"
+
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+/* samples per run */
+#define	N	100000
+
+static FT	q[4*N], angles[3*N], q2[4*N], accels[3*N], magn[3*N], heading[N];
+
+static FT	frand()
+{
+	return FT(rand())/FT(RAND_MAX) - FT(0.5);
+}
+
+static void	report( const char *op, double tOne, double tBatch, FT err )
+{
+	printf( "%-12s one %7.2f ns   batch %7.2f ns   max difference %g\n",
+		op, tOne/N, tBatch/N, double(err) );
+}
+
+int main()
+{
+	const FT	tol		= ( sizeof(FT) == sizeof(float) ) ? FT(2e-5) : FT(1e-6);
+	bool		ok		= true;
+
+	for (int i=0; i < N; i++)
+	{
+		Matrix<FT,4,1>	qi;
+		qi	<< frand(), frand(), frand(), frand();
+		qi.normalize();
+		for (int k=0; k < 4; k++)
+			q[k*N + i]	= qi(k);
+
+		for (int k=0; k < 3; k++) {
+			accels[k*N + i]	= frand();
+			magn[k*N + i]	= frand();
+		}
+		accels[2*N + i]	+= 1;		/* mostly level */
+	}
+
+	/** quatToEuler **/
+	{
+		Matrix<FT,4,1>	qi;
+		Matrix<FT,3,1>	e;
+		FT	err	= 0;
+
+		double	t1 = nowNs();
+		for (int i=0; i < N; i++) {
+			qi	<< q[i], q[N + i], q[2*N + i], q[3*N + i];
+			e	= util::quatToEuler( qi );
+			angles[i] = e(0);	angles[N + i] = e(1);	angles[2*N + i] = e(2);
+		}
+		double	t2 = nowNs();
+		static FT	ab[3*N];
+		util::quatToEulerBatch( q, ab, N );
+		double	t3 = nowNs();
+
+		for (int i=0; i < 3*N; i++)
+			err	= std::max( err, FT( fabs( util::calcAngleError( ab[i], angles[i] ) ) ) );
+		report( "quatToEuler", t2 - t1, t3 - t2, err );
+		ok		= ok && ( err <= tol );
+	}
+
+	/** eulerToQuat, from the angles above, so back to q up to the sign **/
+	{
+		Matrix<FT,3,1>	e;
+		Matrix<FT,4,1>	qi;
+		FT	err	= 0;
+
+		double	t1 = nowNs();
+		for (int i=0; i < N; i++) {
+			e	<< angles[i], angles[N + i], angles[2*N + i];
+			qi	= util::eulerToQuat( e );
+			q2[i] = qi(0);	q2[N + i] = qi(1);	q2[2*N + i] = qi(2);	q2[3*N + i] = qi(3);
+		}
+		double	t2 = nowNs();
+		static FT	qb[4*N];
+		util::eulerToQuatBatch( angles, qb, N );
+		double	t3 = nowNs();
+
+		for (int i=0; i < 4*N; i++)
+			err	= std::max( err, FT( fabs( qb[i] - q2[i] ) ) );
+		report( "eulerToQuat", t2 - t1, t3 - t2, err );
+		ok		= ok && ( err <= tol );
+	}
+
+	/** accelToPR, then calcHeading with its roll and pitch **/
+	{
+		Matrix<FT,3,1>	a, m, e;
+		static FT	ab[3*N];
+		FT	err	= 0;
+
+		double	t1 = nowNs();
+		for (int i=0; i < N; i++) {
+			a	<< accels[i], accels[N + i], accels[2*N + i];
+			util::accelToPR( a, e );
+			angles[i] = e(0);	angles[N + i] = e(1);
+		}
+		double	t2 = nowNs();
+		util::accelToPRBatch( accels, ab, N );
+		double	t3 = nowNs();
+
+		for (int i=0; i < 2*N; i++)
+			err	= std::max( err, FT( fabs( ab[i] - angles[i] ) ) );
+		report( "accelToPR", t2 - t1, t3 - t2, err );
+		ok		= ok && ( err <= tol );
+
+		err	= 0;
+		t1	= nowNs();
+		for (int i=0; i < N; i++) {
+			m	<< magn[i], magn[N + i], magn[2*N + i];
+			e	<< angles[i], angles[N + i], 0;
+			heading[i]	= util::calcHeading( m, e );
+		}
+		t2	= nowNs();
+		util::calcHeadingBatch( magn, angles, ab + 2*N, N );
+		t3	= nowNs();
+
+		for (int i=0; i < N; i++)
+			err	= std::max( err, FT( fabs( util::calcAngleError( ab[2*N + i], heading[i] ) ) ) );
+		report( "calcHeading", t2 - t1, t3 - t2, err );
+
+		/* calcHeading() works in float, whatever FT is */
+		ok		= ok && ( err <= FT(2e-5) );
+	}
+
+	if ( !ok ) {
+		printf( "FAILED\n" );
+		return 1;
+	}
+
+	printf( "OK\n" );
+	return 0;
+}
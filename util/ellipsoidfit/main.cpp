@@ -0,0 +1,147 @@
+/*
+ *	Batch ellipsoid calibration of a magnetometer or accelerometer log
+ *	Fits all the samples of an octave vector variable at once with
+ *	calib::EllipsoidFit, optionally refines the result with one pass of
+ *	UKFEllipsoid started from it, and prints the parameters in the
+ *	UKFEllipsoid state layout.
+ *
+ *	Usage: ellipsoidfit <octave file> <variable> [refine] [threads]
+ *
+ *	For example 'ellipsoidfit octave/mag rawmag' on the log test-calib-ukfellipsoid reads.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+/* no exit() when P stops being positive definite, see UKFEllipsoid.h */
+#define	UKFELLIPSOID_SQUARE_ROOT	1
+
+#include <openAHRS/calib/EllipsoidFit.h>
+#include <openAHRS/calib/UKFEllipsoid.h>
+#include <openAHRS/util/octave.h>
+
+using namespace std;
+using namespace openAHRS;
+
+static double	nowMs()
+{
+	struct timespec	ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return 1e3*ts.tv_sec + 1e-6*ts.tv_nsec;
+}
+
+static void	usage()
+{
+	printf("Usage: ellipsoidfit <octave file> <variable> [refine] [threads]\n");
+	printf("\trefine\tone UKFEllipsoid pass over the log, started from the batch fit\n");
+	printf("\tthreads\tdefault is one per processor\n");
+}
+
+static void	printState( const char *name, const Matrix<FT,9,1> &X, FT residual )
+{
+	printf("%-10s", name );
+	for (int i=0; i < 9; i++)
+		printf(" %.6g", (double)X(i) );
+	printf("   residual %.3g\n", (double)residual );
+}
+
+/** rms of |out| - 1 */
+static FT	residual( calib::UKFEllipsoid &EL, const vector< Matrix<FT,3,1> > &meas )
+{
+	double	r = 0;
+	for (unsigned int i=0; i < meas.size(); i++) {
+		Matrix<FT,3,1>	out;
+		EL.processInput( meas[i], out );
+		double	e	= out.norm() - 1;
+		r	+= e*e;
+	}
+	return sqrt( r/meas.size() );
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc < 3 ) {
+		usage();
+		return 1;
+	}
+
+	bool	refine	= false;
+	int		threads	= 0;
+	for (int i=3; i < argc; i++) {
+		if ( strcmp( argv[i], "refine" ) == 0 )
+			refine	= true;
+		else
+			threads	= atoi( argv[i] );
+	}
+
+	ifstream	file( argv[1] );
+	int			nread = 0;
+	MatrixXd	*m	= octave::readVectors( file, argv[2], &nread );
+	if ( ( m == NULL ) || ( nread <= 0 ) ) {
+		printf("Could not read '%s' from %s\n", argv[2], argv[1] );
+		return 1;
+	}
+
+	vector< Matrix<FT,3,1> >	meas( nread );
+	for (int i=0; i < nread; i++)
+		meas[i]	<< m[i](0), m[i](1), m[i](2);
+	delete [] m;
+
+	util::ThreadPool	pool( threads );
+	calib::EllipsoidFit	fit;
+
+	double	t1	= nowMs();
+	if ( !fit.fit( &meas[0], nread, &pool ) ) {
+		printf("%d samples do not determine an ellipsoid\n", nread );
+		return 1;
+	}
+	double	t2	= nowMs();
+
+	Matrix<FT,9,1>	X;
+	fit.getStateVector( X );
+
+	printf("%d samples, batch fit in %.2f ms on %d threads\n", nread, t2 - t1, pool.size() );
+	printState( "batch", X, fit.getResidual() );
+
+	if ( refine )
+	{
+		calib::UKFEllipsoid	EL;
+		EL.init( 1e-6, X, 1e-6, 1e-9, 1e-6 );
+		for (int i=0; i < nread; i++)
+			EL.estimateParams( meas[i] );
+		double	t3	= nowMs();
+
+		EL.getStateVector( X );
+		printf("UKF pass in %.2f ms\n", t3 - t2 );
+		printState( "refined", X, residual( EL, meas ) );
+	}
+
+	return 0;
+}
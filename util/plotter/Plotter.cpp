@@ -25,7 +25,7 @@
 
 //not quite tidy but quicker
 #include "../../openAHRS/src/util/util.cpp"
-#include <Eigen/Geometry>
+#include <openAHRS/util/quatkernel.h>
 
 #define	TO_DEG(x)	((x)*180.0/3.14)
 
@@ -70,15 +70,19 @@ Plotter::Plotter(QWidget *parent) : QMainWindow(parent)
 //takes quaternion, returns quaternion
 static	Matrix<FT,4,1>	correct45Deg( Matrix<FT,4,1>	quat )
 {
-	static Eigen::Quaternion<FT>	qRot;	//quaternion used to rotate the measurements 45 degrees
-	static bool	firstTime = true;
-	if	(firstTime) {
-		qRot.coeffs()	= openAHRS::util::eulerToQuat(  Matrix<FT,3,1>(0,0,-45*M_PI/180) );
-		firstTime = false;
-	}
-
-
-	return (qRot * Eigen::Quaternion<FT>( quat ) ).coeffs();
+	/* This used to be Eigen::Quaternion( eulerToQuat(0,0,-45deg) ) * Eigen::Quaternion( quat ),
+	 * but Eigen keeps the coefficients as [x y z w], so both our [e0 ex ey ez] quaternions
+	 * went in, and the result came out, shifted by one place. Same transform as before,
+	 * spelled out with the shift so the output doesn't change. */
+	static const FT	qRot[4]	= { -0.38268343236508977, 0.92387953251128674, 0, 0 };	/* -sin, cos 22.5deg */
+	FT	q[4]	= { quat(3), quat(0), quat(1), quat(2) };
+	FT	r[4];
+
+	openAHRS::quat::quatMultiply( qRot, q, r );
+
+	Matrix<FT,4,1>	ret;
+	ret	<< r[1], r[2], r[3], r[0];
+	return ret;
 }
 
 void	Plotter::processDatagram( QByteArray &data )
@@ -0,0 +1,389 @@
+/*
+ *	Filter tuning sweep
+ *	Runs kalman7, UKFst7 or the UKF ellipsoid calibrator on the synthetic
+ *	data of test-kal7 / test-calib-ukfellipsoid for a grid or a random set
+ *	of noise parameters, one configuration per job on a pool of threads,
+ *	and prints the errors and run time of each, best first.
+ *
+ *	Usage: tune <kalman7|ukfst7|ellipsoid> [grid <points per parameter> | random <configurations>] [threads] [store]
+ *
+ *	Parameters are swept on a log scale, between the bounds in targets[] below.
+ *	Default is a grid of 6 points per parameter on one thread per processor.
+ *	With a store file, the best configuration is written to it as record
+ *	"tune.<target>", for the AVR32 AHRS to start with; the other records
+ *	of the file are kept.
+ *
+ *  Copyright (c) by Carlos Becker	http://github.com/cbecker
+ *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <Eigen/Core>
+
+USING_PART_OF_NAMESPACE_EIGEN
+
+/* the plain UKFEllipsoid exits the process when P stops being positive
+ * definite, which a bad configuration can cause and which would end the
+ * whole sweep. The square-root form is the same filter without that exit */
+#define	UKFELLIPSOID_SQUARE_ROOT	1
+
+#include <openAHRS/util/util.h>
+#include <openAHRS/util/threadpool.h>
+#include <openAHRS/util/calibstore.h>
+#include <openAHRS/kalman/kalman7.h>
+#include <openAHRS/kalman/UKFst7.h>
+#include <openAHRS/calib/UKFEllipsoid.h>
+
+#include "../../tests/common/testdata.h"
+
+using namespace std;
+using namespace openAHRS;
+using namespace openAHRS::testdata;
+
+FT	dt	= 1.0/50;
+
+/* number of points of the attitude trajectory, as test-kal7 */
+#define	N		2000
+
+/* number of magnetometer samples, as test-calib-ukfellipsoid */
+#define	NCAL	10000
+
+static const FT meas_variance = 0.01;
+
+static struct
+{
+	Matrix<FT,3,1>	angles[N];
+	Matrix<FT,3,1>	gyros[N];
+	Matrix<FT,3,1>	realAngles[N];
+	Matrix<FT,3,1>	gyroBias;
+
+	Matrix<FT,3,1>	magn[NCAL];
+} input;
+
+/** sphere used for the ellipsoid data, and its distortion */
+#define	SPHERE_RADIUS	11
+#define	SPHERE_X		7
+#define	SPHERE_Y		3
+#define	SPHERE_Z		5
+static const FT	dist[3]	= { 1.5, 1.15, 0.95 };
+static const FT	calNoiseStdDev	= 0.01;
+
+/** test-kal7 trajectory, with noise */
+static void	makeTempData()
+{
+	Trajectory	traj( dt, meas_variance );
+	input.gyroBias	= traj.getGyroBias();
+
+	for ( int i=0; i < N; i++ )
+	{
+		traj.step( i );
+		input.realAngles[i]	= traj.getAngles();
+
+		Matrix<FT,3,1>	accels	= traj.measureAccels();
+		input.angles[i]	= traj.measureAngles( accels );
+		input.gyros[i]	= traj.measureGyros();
+	}
+}
+
+/** test-calib-ukfellipsoid data, distorted sphere with noise */
+static void	makeCalibData()
+{
+	for (int i=0; i < NCAL; i++)
+	{
+		FT	theta	= -C_PI + 2*C_PI*util::randomNormal();
+		FT	phi		= -C_PI + 2*C_PI*util::randomNormal();
+
+		input.magn[i](0)	= SPHERE_X + dist[0]*SPHERE_RADIUS*cos(theta)*sin(phi);
+		input.magn[i](1)	= SPHERE_Y + dist[1]*SPHERE_RADIUS*sin(theta)*sin(phi);
+		input.magn[i](2)	= SPHERE_Z + dist[2]*SPHERE_RADIUS*cos(phi);
+
+		input.magn[i]	+= util::randomVector3( 0, calNoiseStdDev );
+	}
+}
+
+/**
+ * Result of one configuration: err1 and err2 as named by the target,
+ * nan if the filter diverged.
+ */
+struct	Config
+{
+	double	param[4];
+	double	err1, err2;
+	double	seconds;
+};
+
+/** RMS of the angle errors over the run, and final bias error */
+template <class Filter>
+static void	runAttitude( Filter &F, Config &c )
+{
+	Matrix<FT,3,1>	angle		= input.angles[0];
+	Matrix<FT,3,1>	startBias	= input.gyros[0];
+	Matrix<FT,7,1>	X;
+
+	F.KalmanInit( angle, startBias, c.param[0], c.param[1], c.param[2] );
+
+	/* the iteration number is only for debug output, UKFst7 prints its
+	 * matrices when it is a multiple of 100 */
+	const int	iter	= 1;
+
+	double	sum	= 0;
+	for (int i=0; i < N; i++)
+	{
+		F.KalmanUpdate( iter, input.angles[i], dt );
+		F.getStateVector( X );
+
+		Matrix<FT,3,1>	e	= util::quatToEulerNorm( X.start<4>() );
+		for (int k=0; k < 3; k++) {
+			FT	d	= util::calcAngleError( e(k), input.realAngles[i](k) );
+			sum		+= d*d;
+		}
+
+		F.KalmanPredict( iter, input.gyros[i], dt );
+	}
+
+	c.err1	= sqrt( sum/(3*N) );
+	c.err2	= ( X.end<3>() - input.gyroBias ).norm();
+}
+
+static void	runKalman7( Config &c )
+{
+	kalman7	K7;
+	runAttitude( K7, c );
+}
+
+static void	runUKFst7( Config &c )
+{
+	UKFst7	*U	= new UKFst7;
+	runAttitude( *U, c );
+	delete U;
+}
+
+/** offset error, and relative error of the largest axis */
+static void	runEllipsoid( Config &c )
+{
+	calib::UKFEllipsoid	*EL	= new calib::UKFEllipsoid;
+	Matrix<FT,3,1>	offset;
+	Matrix<FT,9,1>	X;
+
+	offset	<< 2.5, 2.5, 2.5;
+	EL->init( c.param[0], offset, SPHERE_RADIUS, c.param[1], c.param[2], c.param[3] );
+
+	for (int i=0; i < NCAL; i++)
+		EL->estimateParams( input.magn[i] );
+	EL->getStateVector( X );
+	delete EL;
+
+	Matrix<FT,3,1>	trueOffset;
+	trueOffset	<< SPHERE_X, SPHERE_Y, SPHERE_Z;
+
+	c.err1	= ( X.end<3>() - trueOffset ).norm();
+	c.err2	= fabs( X(0) - dist[0]*SPHERE_RADIUS )/( dist[0]*SPHERE_RADIUS );
+}
+
+/**
+ * What can be tuned, parameter bounds are log10
+ */
+struct	Target
+{
+	const char	*name;
+	int			nParams;
+	const char	*paramName[4];
+	double		lo[4], hi[4];
+	const char	*err1Name, *err2Name;
+	void		(*run)( Config &c );
+};
+
+static const Target	targets[]	=
+{
+	{ "kalman7", 3, { "meas_var", "bias_var", "quat_var" },
+		{ -4, -10, -10 }, { 0, -1, -1 },
+		"RMS angle [rad]", "bias error", runKalman7 },
+
+	{ "ukfst7", 3, { "meas_var", "bias_var", "quat_var" },
+		{ -4, -10, -10 }, { 0, -1, -1 },
+		"RMS angle [rad]", "bias error", runUKFst7 },
+
+	{ "ellipsoid", 4, { "meas_noise", "variance1", "variance2", "P0_var" },
+		{ -9, -12, -12, -5 }, { -3, -4, -4, -1 },
+		"offset error", "axis error", runEllipsoid },
+};
+
+static const Target	*target;
+
+static double	nowSec()
+{
+	struct timespec	ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return 1.0*ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/** one job of the pool */
+static void	runConfig( int i, void *arg )
+{
+	Config	&c	= ( *(vector<Config> *)arg )[i];
+
+	double	t1	= nowSec();
+	target->run( c );
+	c.seconds	= nowSec() - t1;
+}
+
+/** smaller first, nan last */
+static bool	better( const Config &a, const Config &b )
+{
+	if ( isnan( a.err1 ) )
+		return false;
+	if ( isnan( b.err1 ) )
+		return true;
+	return a.err1 < b.err1;
+}
+
+static void	usage()
+{
+	printf( "usage: tune <kalman7|ukfst7|ellipsoid> [grid <points per parameter> | random <configurations>] [threads] [store]\n" );
+	exit( 1 );
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc < 2 )
+		usage();
+
+	for (unsigned int t=0; t < sizeof(targets)/sizeof(targets[0]); t++)
+		if ( strcmp( argv[1], targets[t].name ) == 0 )
+			target	= &targets[t];
+	if ( target == NULL )
+		usage();
+
+	bool	random	= false;
+	int		count	= 6;
+	int		threads	= 0;
+
+	if ( argc >= 4 ) {
+		if ( strcmp( argv[2], "random" ) == 0 )
+			random	= true;
+		else if ( strcmp( argv[2], "grid" ) != 0 )
+			usage();
+		count	= atoi( argv[3] );
+	}
+	if ( argc >= 5 )
+		threads	= atoi( argv[4] );
+	const char	*storeFile	= ( argc >= 6 ) ? argv[5] : NULL;
+	if ( count < 1 )
+		usage();
+
+	/** data first, the filters only read it **/
+	makeTempData();
+	makeCalibData();
+
+	/** configurations, log spaced or log uniform **/
+	vector<Config>	configs;
+	const int	np	= target->nParams;
+
+	if ( random )
+	{
+		srand( 1 );
+		for (int i=0; i < count; i++) {
+			Config	c;
+			for (int k=0; k < np; k++) {
+				double	u	= rand()/(double)RAND_MAX;
+				c.param[k]	= pow( 10.0, target->lo[k] + u*( target->hi[k] - target->lo[k] ) );
+			}
+			configs.push_back( c );
+		}
+	}
+	else
+	{
+		int	total	= 1;
+		for (int k=0; k < np; k++)
+			total	*= count;
+
+		for (int i=0; i < total; i++) {
+			Config	c;
+			int		idx	= i;
+			for (int k=0; k < np; k++) {
+				double	u	= ( count > 1 ) ? ( idx % count )/double( count - 1 ) : 0.5;
+				c.param[k]	= pow( 10.0, target->lo[k] + u*( target->hi[k] - target->lo[k] ) );
+				idx	/= count;
+			}
+			configs.push_back( c );
+		}
+	}
+
+	/** run **/
+	util::ThreadPool	pool( threads );
+
+	printf( "%s: %d configurations on %d threads\n", target->name, (int)configs.size(), pool.size() );
+	fflush( stdout );
+
+	double	t1	= nowSec();
+	pool.parallelFor( configs.size(), runConfig, &configs );
+	double	wall	= nowSec() - t1;
+
+	/** report **/
+	sort( configs.begin(), configs.end(), better );
+
+	for (int k=0; k < np; k++)
+		printf( "%12s ", target->paramName[k] );
+	printf( "%16s %12s %9s\n", target->err1Name, target->err2Name, "time [s]" );
+
+	double	serial	= 0;
+	for (unsigned int i=0; i < configs.size(); i++)
+	{
+		const Config	&c	= configs[i];
+		for (int k=0; k < np; k++)
+			printf( "%12.3g ", c.param[k] );
+		printf( "%16.6g %12.6g %9.3f\n", c.err1, c.err2, c.seconds );
+		serial	+= c.seconds;
+	}
+
+	printf( "wall time %.2f s, %.2f s of filter time, %.1fx\n", wall, serial, serial/wall );
+
+	/** best one to the store **/
+	if ( storeFile != NULL && !isnan( configs[0].err1 ) )
+	{
+		util::CalibStore		old;
+		util::CalibStoreWriter	w;
+		FT		best[4];
+		char	name[24];
+
+		for (int k=0; k < np; k++)
+			best[k]	= configs[0].param[k];
+		snprintf( name, sizeof(name), "tune.%s", target->name );
+
+		w.add( name, best, 1, np );
+		if ( old.open( storeFile ) )
+			w.keep( old );
+		old.close();
+
+		if ( !w.save( storeFile ) ) {
+			printf( "error writing %s\n", storeFile );
+			return 1;
+		}
+		printf( "best configuration saved to %s as %s\n", storeFile, name );
+	}
+
+	return 0;
+}